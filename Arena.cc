@@ -0,0 +1,61 @@
+/** \file   Arena.cc
+ *  \brief  Implementation of the Arena class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Arena.h"
+#include <algorithm>
+
+
+const size_t Arena::DEFAULT_BLOCK_SIZE;
+
+
+Arena::~Arena() {
+    for (const auto &block : blocks_)
+	delete [] block.data_;
+}
+
+
+void *Arena::allocateFromNextBlock(const size_t size, const size_t alignment) {
+    // Blocks that have been kept across a reset() are reused if they are large enough.
+    const size_t required_size(size + alignment - 1);
+    size_t next_block_index(next_ == NULL ? 0 : current_block_index_ + 1);
+    while (next_block_index < blocks_.size() and blocks_[next_block_index].size_ < required_size)
+	++next_block_index;
+
+    if (next_block_index == blocks_.size()) {
+	const Block new_block = { new char[std::max(block_size_, required_size)],
+				  std::max(block_size_, required_size) };
+	blocks_.push_back(new_block);
+    }
+
+    // N.B. Skipped blocks, if any, stay unused until the next reset().
+    current_block_index_ = next_block_index;
+    next_ = blocks_[current_block_index_].data_;
+    end_  = next_ + blocks_[current_block_index_].size_;
+
+    return allocate(size, alignment);
+}
+
+
+size_t Arena::getCapacity() const {
+    size_t capacity(0);
+    for (const auto &block : blocks_)
+	capacity += block.size_;
+
+    return capacity;
+}
@@ -0,0 +1,146 @@
+/** \file   Arena.h
+ *  \brief  Interface for the Arena class and the ArenaVector class template.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <type_traits>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "Slice.h"
+
+
+/** \class Arena
+ *  \brief A bump allocator for short-lived objects, e.g. the parts of a record while it is being edited.
+ *
+ *  Memory is handed out from large blocks and is never freed individually.  reset() makes all blocks available
+ *  again in O(1) w/o returning them to the heap, so that after a warm-up phase processing further records does not
+ *  call malloc() at all.  Only trivially destructible objects may be placed in an Arena as no destructors are run.
+ */
+class Arena {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+private:
+    struct Block {
+	char *data_;
+	size_t size_;
+    };
+
+    size_t block_size_;
+    std::vector<Block> blocks_;
+    size_t current_block_index_;
+    char *next_; // The next free byte in the current block.
+    char *end_;  // The end of the current block.
+public:
+    explicit Arena(const size_t block_size = DEFAULT_BLOCK_SIZE)
+	: block_size_(block_size), current_block_index_(0), next_(NULL), end_(NULL) {}
+    ~Arena();
+
+    /** \return "size" bytes of uninitialised memory aligned to "alignment", which must be a power of 2. */
+    void *allocate(const size_t size, const size_t alignment = 1) {
+	char * const start(reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(next_) + alignment - 1)
+						    & ~static_cast<uintptr_t>(alignment - 1)));
+	if (next_ == NULL or start + size > end_)
+	    return allocateFromNextBlock(size, alignment);
+	next_ = start + size;
+	return start;
+    }
+
+    /** \return Uninitialised storage for "count" objects of type "Type". */
+    template<typename Type> Type *allocateArray(const size_t count) {
+	static_assert(std::is_trivially_destructible<Type>::value, "Arena objects are never destroyed!");
+	return static_cast<Type *>(allocate(count * sizeof(Type), alignof(Type)));
+    }
+
+    /** \return A copy of "data" that lives in the arena. */
+    Slice copy(const Slice &data) {
+	char * const copy_start(static_cast<char *>(allocate(data.size())));
+	if (not data.empty())
+	    std::memcpy(copy_start, data.data(), data.size());
+	return Slice(copy_start, data.size());
+    }
+
+    /** Invalidates all memory handed out so far and makes it available for reuse. */
+    void reset() {
+	current_block_index_ = 0;
+	next_ = blocks_.empty() ? NULL : blocks_[0].data_;
+	end_  = blocks_.empty() ? NULL : blocks_[0].data_ + blocks_[0].size_;
+    }
+
+    /** \return The total size of the blocks owned by the arena. */
+    size_t getCapacity() const;
+private:
+    Arena(const Arena &rhs) = delete;
+    const Arena &operator=(const Arena &rhs) = delete;
+
+    void *allocateFromNextBlock(const size_t size, const size_t alignment);
+};
+
+
+/** \class ArenaVector
+ *  \brief A minimal growable array whose storage lives in an Arena.
+ *  \note  Growing leaves the old storage behind in the arena until the arena gets reset.
+ */
+template<typename ElementType> class ArenaVector {
+    Arena *arena_;
+    ElementType *data_;
+    size_t size_, capacity_;
+public:
+    explicit ArenaVector(Arena * const arena): arena_(arena), data_(NULL), size_(0), capacity_(0) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    ElementType &operator[](const size_t index) { return data_[index]; }
+    const ElementType &operator[](const size_t index) const { return data_[index]; }
+    const ElementType *begin() const { return data_; }
+    const ElementType *end() const { return data_ + size_; }
+
+    void push_back(const ElementType &element) { insert(size_, element); }
+
+    /** Inserts "element" before the element at "index" and moves the following elements up by one. */
+    void insert(const size_t index, const ElementType &element) {
+	if (size_ == capacity_)
+	    grow();
+	std::memmove(data_ + index + 1, data_ + index, (size_ - index) * sizeof(ElementType));
+	data_[index] = element;
+	++size_;
+    }
+
+    void erase(const size_t index) {
+	std::memmove(data_ + index, data_ + index + 1, (size_ - index - 1) * sizeof(ElementType));
+	--size_;
+    }
+
+    /** Forgets all elements.  Must be called after the arena has been reset. */
+    void clear() { data_ = NULL; size_ = capacity_ = 0; }
+private:
+    void grow() {
+	const size_t new_capacity(capacity_ == 0 ? 16 : 2 * capacity_);
+	ElementType * const new_data(arena_->allocateArray<ElementType>(new_capacity));
+	if (size_ > 0)
+	    std::memcpy(new_data, data_, size_ * sizeof(ElementType));
+	data_ = new_data;
+	capacity_ = new_capacity;
+    }
+};
+
+
+#endif // ifndef ARENA_H
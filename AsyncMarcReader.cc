@@ -0,0 +1,462 @@
+/** \file   AsyncMarcReader.cc
+ *  \brief  Implementation of the AsyncMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "AsyncMarcReader.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#   include <liburing.h>
+#endif
+#include "Stats.h"
+
+
+const size_t AsyncMarcReader::DEFAULT_BUFFER_COUNT;
+const size_t AsyncMarcReader::DEFAULT_BUFFER_SIZE;
+
+
+/** \class AsyncReadBackend
+ *  \brief Performs reads of a file asynchronously.  Each outstanding read is identified by a "slot".
+ */
+class AsyncReadBackend {
+protected:
+    const std::string input_filename_;
+    const int fd_;
+public:
+    AsyncReadBackend(const std::string &input_filename, const int fd): input_filename_(input_filename), fd_(fd) {}
+
+    /** Waits for all reads that are in flight. */
+    virtual ~AsyncReadBackend() {}
+
+    virtual const char *getName() const = 0;
+
+    /** \brief Starts reading exactly "count" bytes at "offset" into "buffer".
+     *  \note  There may only be one outstanding read per slot.
+     */
+    virtual bool submit(const unsigned slot, char * const buffer, const size_t count, const off_t offset,
+			std::string * const err_msg) = 0;
+
+    /** \brief Waits for the read in "slot" to complete.
+     *  \return False if the read failed and then "err_msg" will be set, else true.
+     */
+    virtual bool waitFor(const unsigned slot, std::string * const err_msg) = 0;
+protected:
+    std::string getUnexpectedEofMessage() const {
+	return "unexpected end of \"" + input_filename_ + "\"!  (Has it been truncated while we were reading it?)";
+    }
+};
+
+
+/** Performs the reads w/ pread(2) on a pool of threads. */
+class PreadBackend: public AsyncReadBackend {
+    struct Request {
+	unsigned slot_;
+	char *buffer_;
+	size_t count_;
+	off_t offset_;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable request_submitted_, read_completed_;
+    std::deque<Request> requests_;
+    std::vector<bool> completed_;
+    std::vector<std::string> err_msgs_;
+    bool stop_;
+    std::vector<std::thread> threads_;
+public:
+    PreadBackend(const std::string &input_filename, const int fd, const unsigned slot_count);
+    ~PreadBackend();
+
+    const char *getName() const override { return "pread"; }
+    bool submit(const unsigned slot, char * const buffer, const size_t count, const off_t offset,
+		std::string * const err_msg) override;
+    bool waitFor(const unsigned slot, std::string * const err_msg) override;
+private:
+    /** The body of the worker threads. */
+    void work();
+
+    bool readFully(const Request &request, std::string * const err_msg) const;
+};
+
+
+PreadBackend::PreadBackend(const std::string &input_filename, const int fd, const unsigned slot_count)
+    : AsyncReadBackend(input_filename, fd), completed_(slot_count), err_msgs_(slot_count), stop_(false)
+{
+    for (unsigned thread_no(0); thread_no < slot_count; ++thread_no)
+	threads_.emplace_back(&PreadBackend::work, this);
+}
+
+
+PreadBackend::~PreadBackend() {
+    {
+	std::lock_guard<std::mutex> lock(mutex_);
+	stop_ = true;
+    }
+    request_submitted_.notify_all();
+    for (auto &thread : threads_)
+	thread.join();
+}
+
+
+bool PreadBackend::submit(const unsigned slot, char * const buffer, const size_t count, const off_t offset,
+			  std::string * const /* err_msg */)
+{
+    const Request request = { slot, buffer, count, offset };
+    {
+	std::lock_guard<std::mutex> lock(mutex_);
+	requests_.push_back(request);
+    }
+    request_submitted_.notify_one();
+    return true;
+}
+
+
+bool PreadBackend::waitFor(const unsigned slot, std::string * const err_msg) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    read_completed_.wait(lock, [this, slot]{ return completed_[slot]; });
+    completed_[slot] = false;
+    if (not err_msgs_[slot].empty()) {
+	*err_msg = err_msgs_[slot];
+	return false;
+    }
+
+    return true;
+}
+
+
+void PreadBackend::work() {
+    for (;;) {
+	Request request;
+	{
+	    std::unique_lock<std::mutex> lock(mutex_);
+	    request_submitted_.wait(lock, [this]{ return stop_ or not requests_.empty(); });
+	    if (stop_) // Requests that have not been started yet are of no interest anymore.
+		return;
+	    request = requests_.front();
+	    requests_.pop_front();
+	}
+
+	std::string err_msg;
+	readFully(request, &err_msg);
+
+	{
+	    std::lock_guard<std::mutex> lock(mutex_);
+	    completed_[request.slot_] = true;
+	    err_msgs_[request.slot_]  = err_msg;
+	}
+	read_completed_.notify_all();
+    }
+}
+
+
+bool PreadBackend::readFully(const Request &request, std::string * const err_msg) const {
+    size_t done(0);
+    while (done < request.count_) {
+	const ssize_t retval(::pread(fd_, request.buffer_ + done, request.count_ - done, request.offset_ + done));
+	if (retval == -1) {
+	    if (errno == EINTR)
+		continue;
+	    *err_msg = "read from \"" + input_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	    return false;
+	}
+	if (retval == 0) {
+	    *err_msg = getUnexpectedEofMessage();
+	    return false;
+	}
+	done += retval;
+    }
+
+    return true;
+}
+
+
+#ifdef HAVE_LIBURING
+
+
+/** Submits the reads via io_uring(7).  No additional threads are needed. */
+class UringBackend: public AsyncReadBackend {
+    struct Read {
+	char *buffer_;
+	size_t count_, done_;
+	off_t offset_;
+	bool completed_;
+	std::string err_msg_;
+    };
+
+    struct io_uring ring_;
+    bool initialised_;
+    std::vector<Read> reads_;
+    unsigned in_flight_count_;
+public:
+    UringBackend(const std::string &input_filename, const int fd, const unsigned slot_count)
+	: AsyncReadBackend(input_filename, fd), initialised_(false), reads_(slot_count), in_flight_count_(0) {}
+    ~UringBackend();
+
+    /** \return False if the kernel does not support io_uring(7) and then "err_msg" will be set, else true. */
+    bool init(std::string * const err_msg);
+
+    const char *getName() const override { return "io_uring"; }
+    bool submit(const unsigned slot, char * const buffer, const size_t count, const off_t offset,
+		std::string * const err_msg) override;
+    bool waitFor(const unsigned slot, std::string * const err_msg) override;
+private:
+    /** Submits the part of the read in "slot" that has not been completed yet. */
+    bool submitRemainder(const unsigned slot, std::string * const err_msg);
+
+    /** Waits for a single completion of any slot and processes it. */
+    bool reapCompletion(std::string * const err_msg);
+};
+
+
+UringBackend::~UringBackend() {
+    if (not initialised_)
+	return;
+
+    // The kernel may still be writing into our buffers.
+    std::string err_msg;
+    while (in_flight_count_ > 0 and reapCompletion(&err_msg))
+	/* Intentionally empty! */;
+    ::io_uring_queue_exit(&ring_);
+}
+
+
+bool UringBackend::init(std::string * const err_msg) {
+    const int retval(::io_uring_queue_init(static_cast<unsigned>(reads_.size()), &ring_, 0));
+    if (retval < 0) {
+	*err_msg = "io_uring_queue_init(3) failed! (" + std::string(std::strerror(-retval)) + ")";
+	return false;
+    }
+
+    initialised_ = true;
+    return true;
+}
+
+
+bool UringBackend::submit(const unsigned slot, char * const buffer, const size_t count, const off_t offset,
+			  std::string * const err_msg)
+{
+    Read &read(reads_[slot]);
+    read.buffer_    = buffer;
+    read.count_     = count;
+    read.done_      = 0;
+    read.offset_    = offset;
+    read.completed_ = false;
+    read.err_msg_.clear();
+
+    return submitRemainder(slot, err_msg);
+}
+
+
+bool UringBackend::submitRemainder(const unsigned slot, std::string * const err_msg) {
+    struct io_uring_sqe * const sqe(::io_uring_get_sqe(&ring_));
+    if (sqe == NULL) {
+	*err_msg = "the io_uring submission queue is full!";
+	return false;
+    }
+
+    const Read &read(reads_[slot]);
+    ::io_uring_prep_read(sqe, fd_, read.buffer_ + read.done_, static_cast<unsigned>(read.count_ - read.done_),
+			 read.offset_ + read.done_);
+    ::io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(static_cast<uintptr_t>(slot)));
+
+    const int retval(::io_uring_submit(&ring_));
+    if (retval < 0) {
+	*err_msg = "io_uring_submit(3) failed! (" + std::string(std::strerror(-retval)) + ")";
+	return false;
+    }
+
+    ++in_flight_count_;
+    return true;
+}
+
+
+bool UringBackend::reapCompletion(std::string * const err_msg) {
+    struct io_uring_cqe *cqe;
+    int retval;
+    do
+	retval = ::io_uring_wait_cqe(&ring_, &cqe);
+    while (retval == -EINTR);
+    if (retval < 0) {
+	*err_msg = "io_uring_wait_cqe(3) failed! (" + std::string(std::strerror(-retval)) + ")";
+	return false;
+    }
+
+    const unsigned slot(static_cast<unsigned>(reinterpret_cast<uintptr_t>(::io_uring_cqe_get_data(cqe))));
+    const int result(cqe->res);
+    ::io_uring_cqe_seen(&ring_, cqe);
+    --in_flight_count_;
+
+    Read &read(reads_[slot]);
+    if (result == -EINTR or result == -EAGAIN)
+	return submitRemainder(slot, err_msg);
+    if (result < 0)
+	read.err_msg_ = "read from \"" + input_filename_ + "\" failed! (" + std::strerror(-result) + ")";
+    else if (result == 0)
+	read.err_msg_ = getUnexpectedEofMessage();
+    else {
+	read.done_ += result;
+	if (read.done_ < read.count_) // A short read.
+	    return submitRemainder(slot, err_msg);
+    }
+
+    read.completed_ = true;
+    return true;
+}
+
+
+bool UringBackend::waitFor(const unsigned slot, std::string * const err_msg) {
+    Read &read(reads_[slot]);
+    while (not read.completed_) {
+	if (not reapCompletion(err_msg))
+	    return false;
+    }
+
+    read.completed_ = false;
+    if (not read.err_msg_.empty()) {
+	*err_msg = read.err_msg_;
+	return false;
+    }
+
+    return true;
+}
+
+
+#endif // ifdef HAVE_LIBURING
+
+
+AsyncMarcReader *AsyncMarcReader::AsyncMarcReaderFactory(const std::string &input_filename,
+							 std::string * const err_msg, const size_t buffer_count,
+							 const size_t buffer_size)
+{
+    const int fd(::open(input_filename.c_str(), O_RDONLY));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + input_filename + "\" for reading! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    struct stat stat_buf;
+    if (::fstat(fd, &stat_buf) == -1) {
+	*err_msg = "can't stat \"" + input_filename + "\"! (" + std::strerror(errno) + ")";
+	::close(fd);
+	return NULL;
+    }
+    if (not S_ISREG(stat_buf.st_mode)) {
+	*err_msg = "\"" + input_filename + "\" is not a regular file!";
+	::close(fd);
+	return NULL;
+    }
+
+    // Only a hint, so we ignore errors.
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<AsyncMarcReader> reader(new AsyncMarcReader(input_filename, fd, stat_buf.st_size,
+								std::max<size_t>(buffer_count, 2), buffer_size));
+    while (reader->next_block_to_submit_ < std::min(reader->block_count_, reader->buffers_.size())) {
+	if (not reader->submitNextBlock(err_msg))
+	    return NULL;
+    }
+
+    return reader.release();
+}
+
+
+AsyncMarcReader::AsyncMarcReader(const std::string &input_filename, const int fd, const size_t file_size,
+				 const size_t buffer_count, const size_t buffer_size)
+    : BufferedMarcReader(input_filename), fd_(fd), file_size_(file_size), buffer_size_(buffer_size),
+      block_count_((file_size + buffer_size - 1) / buffer_size), next_block_to_submit_(0),
+      next_block_to_consume_(0), holding_buffer_(false)
+{
+    for (size_t buffer_no(0); buffer_no < buffer_count; ++buffer_no)
+	buffers_.emplace_back(new char[buffer_size]);
+
+#ifdef HAVE_LIBURING
+    std::unique_ptr<UringBackend> uring_backend(new UringBackend(input_filename, fd, buffer_count));
+    std::string err_msg;
+    if (uring_backend->init(&err_msg))
+	backend_.reset(uring_backend.release());
+#endif
+    if (backend_ == NULL)
+	backend_.reset(new PreadBackend(input_filename, fd, buffer_count));
+}
+
+
+AsyncMarcReader::~AsyncMarcReader() {
+    backend_.reset(); // Waits for the reads in flight which need "fd_".
+    ::close(fd_);
+}
+
+
+const char *AsyncMarcReader::getBackendName() const {
+    return backend_->getName();
+}
+
+
+bool AsyncMarcReader::submitNextBlock(std::string * const err_msg) {
+    const unsigned slot(next_block_to_submit_ % buffers_.size());
+    const size_t offset(next_block_to_submit_ * buffer_size_);
+    if (not backend_->submit(slot, buffers_[slot].get(), std::min(buffer_size_, file_size_ - offset), offset,
+			     err_msg))
+	return false;
+
+    ++next_block_to_submit_;
+    return true;
+}
+
+
+bool AsyncMarcReader::getNextBuffer(const char ** const buffer, size_t * const buffer_size,
+				    std::string * const err_msg)
+{
+    const Stats::StageTimer timer(Stats::READING);
+    if (not read_err_msg_.empty()) {
+	*err_msg = read_err_msg_;
+	return false;
+    }
+
+    if (holding_buffer_) {
+	// The buffer that we just released receives the block "buffer_count" blocks ahead.
+	holding_buffer_ = false;
+	++next_block_to_consume_;
+	if (next_block_to_submit_ < block_count_ and not submitNextBlock(&read_err_msg_)) {
+	    *err_msg = read_err_msg_;
+	    return false;
+	}
+    }
+
+    if (next_block_to_consume_ == block_count_)
+	return false;
+
+    const unsigned slot(next_block_to_consume_ % buffers_.size());
+    if (not backend_->waitFor(slot, &read_err_msg_)) {
+	*err_msg = read_err_msg_;
+	return false;
+    }
+
+    holding_buffer_ = true;
+    *buffer         = buffers_[slot].get();
+    *buffer_size    = std::min(buffer_size_, file_size_ - next_block_to_consume_ * buffer_size_);
+    return true;
+}
@@ -0,0 +1,83 @@
+/** \file   AsyncMarcReader.h
+ *  \brief  Interface for the AsyncMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ASYNC_MARC_READER_H
+#define ASYNC_MARC_READER_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "BufferedMarcReader.h"
+
+
+class AsyncReadBackend;
+
+
+/** \class AsyncMarcReader
+ *  \brief Reads a file of binary MARC-21 records w/ several large reads in flight.
+ *
+ *  The input file is read in blocks of "buffer_size" bytes.  As soon as the consumer is done w/ a block, the read of
+ *  the block "buffer_count" blocks ahead gets submitted into the freed buffer, so that the storage device always has
+ *  "buffer_count" - 1 or more large requests queued.  If compiled w/ HAVE_LIBURING, the reads are submitted via
+ *  io_uring(7), otherwise, or if the kernel does not support io_uring, they are performed by a small pool of threads
+ *  w/ pread(2).
+ */
+class AsyncMarcReader: public BufferedMarcReader {
+public:
+    static const size_t DEFAULT_BUFFER_COUNT = 4;
+    static const size_t DEFAULT_BUFFER_SIZE = 8 * 1024 * 1024;
+private:
+    const int fd_;
+    const size_t file_size_;
+    const size_t buffer_size_;
+    std::vector<std::unique_ptr<char[]>> buffers_;
+    std::unique_ptr<AsyncReadBackend> backend_; // Must be destroyed before "buffers_" because of reads in flight.
+    size_t block_count_;
+    size_t next_block_to_submit_;
+    size_t next_block_to_consume_;
+    bool holding_buffer_;
+    std::string read_err_msg_; // The first error, which will be reported by all later calls to getNextBuffer().
+public:
+    /** \brief Opens "input_filename", which must be a regular file, and submits the first reads.
+     *  \return NULL if "input_filename" could not be opened or the reads could not be submitted and then also sets
+     *          "err_msg".
+     */
+    static AsyncMarcReader *AsyncMarcReaderFactory(const std::string &input_filename, std::string * const err_msg,
+						   const size_t buffer_count = DEFAULT_BUFFER_COUNT,
+						   const size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    ~AsyncMarcReader();
+
+    /** \return "io_uring" or "pread", depending on how the reads are performed. */
+    const char *getBackendName() const;
+protected:
+    bool getNextBuffer(const char ** const buffer, size_t * const buffer_size, std::string * const err_msg) override;
+private:
+    AsyncMarcReader(const std::string &input_filename, const int fd, const size_t file_size,
+		    const size_t buffer_count, const size_t buffer_size);
+    AsyncMarcReader(const AsyncMarcReader &rhs) = delete;
+    const AsyncMarcReader &operator=(const AsyncMarcReader &rhs) = delete;
+
+    /** Submits the read of the next block into the buffer that it maps to. */
+    bool submitNextBlock(std::string * const err_msg);
+};
+
+
+#endif // ifndef ASYNC_MARC_READER_H
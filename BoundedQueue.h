@@ -0,0 +1,193 @@
+/** \file   BoundedQueue.h
+ *  \brief  A bounded lock-free queue for passing work between threads.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+
+
+/** \class BoundedQueue
+ *  \brief A fixed-capacity FIFO queue that any number of threads may push to and pop from.
+ *
+ *  tryPush() and tryPop() are lock-free: each slot carries a sequence number that tells producers and consumers
+ *  whether it is free or filled for the current lap around the ring (D. Vyukov's bounded MPMC queue), so a single
+ *  compare-and-swap claims a slot.  push() and pop() spin briefly and then block on a condition variable until the
+ *  queue is no longer full or empty.  The mutex is only ever touched if some thread is actually blocked.
+ *
+ *  \note  "ElementType" should be a cheap-to-copy, default-constructible type, e.g. a pointer.
+ */
+template<typename ElementType> class BoundedQueue {
+    static const size_t CACHE_LINE_SIZE = 64;
+    static const unsigned SPIN_COUNT = 16;
+
+    struct Slot {
+	std::atomic<size_t> sequence_no_;
+	ElementType element_;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    // The producer and consumer positions are kept on separate cache lines so that they don't ping-pong.
+    char padding1_[CACHE_LINE_SIZE];
+    std::atomic<size_t> push_pos_;
+    char padding2_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> pop_pos_;
+    char padding3_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    std::atomic<unsigned> blocked_count_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+public:
+    /** \param min_capacity  Gets rounded up to the next power of two, but to at least 2. */
+    explicit BoundedQueue(const size_t min_capacity);
+
+    size_t capacity() const { return mask_ + 1; }
+
+    /** \return False if the queue is full, else true. */
+    bool tryPush(const ElementType &element) {
+	if (not tryPushNoWake(element))
+	    return false;
+	wakeBlocked();
+	return true;
+    }
+
+    /** \return False if the queue is empty, else true. */
+    bool tryPop(ElementType * const element) {
+	if (not tryPopNoWake(element))
+	    return false;
+	wakeBlocked();
+	return true;
+    }
+
+    /** Waits while the queue is full. */
+    void push(const ElementType &element)
+	{ waitFor([this, &element]() { return tryPushNoWake(element); }); }
+
+    /** Waits while the queue is empty. */
+    void pop(ElementType * const element)
+	{ waitFor([this, element]() { return tryPopNoWake(element); }); }
+private:
+    BoundedQueue(const BoundedQueue &rhs) = delete;
+    const BoundedQueue &operator=(const BoundedQueue &rhs) = delete;
+
+    bool tryPushNoWake(const ElementType &element);
+    bool tryPopNoWake(ElementType * const element);
+
+    /** Notifies blocked threads, if there are any, that a slot has been filled or freed. */
+    void wakeBlocked() {
+	// Pairs w/ the fence in waitFor(): either we see the blocked thread or it sees our update of the queue.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (blocked_count_.load(std::memory_order_relaxed) > 0) {
+	    std::lock_guard<std::mutex> lock(mutex_);
+	    changed_.notify_all();
+	}
+    }
+
+    template<typename Operation> void waitFor(const Operation &operation);
+};
+
+
+template<typename ElementType> BoundedQueue<ElementType>::BoundedQueue(const size_t min_capacity)
+    : mask_((min_capacity <= 2 ? 2 : size_t(1) << (64 - __builtin_clzll(min_capacity - 1))) - 1),
+      slots_(new Slot[mask_ + 1]), push_pos_(0), pop_pos_(0), blocked_count_(0)
+{
+    for (size_t slot_no(0); slot_no <= mask_; ++slot_no)
+	slots_[slot_no].sequence_no_.store(slot_no, std::memory_order_relaxed);
+}
+
+
+template<typename ElementType> bool BoundedQueue<ElementType>::tryPushNoWake(const ElementType &element) {
+    size_t pos(push_pos_.load(std::memory_order_relaxed));
+    Slot *slot;
+    for (;;) {
+	slot = &slots_[pos & mask_];
+	const intptr_t lag(static_cast<intptr_t>(slot->sequence_no_.load(std::memory_order_acquire))
+			   - static_cast<intptr_t>(pos));
+	if (lag == 0) { // The slot is free.
+	    if (push_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+		break;
+	} else if (lag < 0) // The slot still holds the element from the previous lap.
+	    return false;
+	else // Another producer has claimed the slot.
+	    pos = push_pos_.load(std::memory_order_relaxed);
+    }
+
+    slot->element_ = element;
+    slot->sequence_no_.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+
+template<typename ElementType> bool BoundedQueue<ElementType>::tryPopNoWake(ElementType * const element) {
+    size_t pos(pop_pos_.load(std::memory_order_relaxed));
+    Slot *slot;
+    for (;;) {
+	slot = &slots_[pos & mask_];
+	const intptr_t lag(static_cast<intptr_t>(slot->sequence_no_.load(std::memory_order_acquire))
+			   - static_cast<intptr_t>(pos + 1));
+	if (lag == 0) { // The slot has been filled.
+	    if (pop_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+		break;
+	} else if (lag < 0) // The slot has not been filled yet.
+	    return false;
+	else // Another consumer has claimed the slot.
+	    pos = pop_pos_.load(std::memory_order_relaxed);
+    }
+
+    *element = slot->element_;
+    slot->sequence_no_.store(pos + mask_ + 1, std::memory_order_release); // Free for the next lap.
+    return true;
+}
+
+
+template<typename ElementType> template<typename Operation>
+    void BoundedQueue<ElementType>::waitFor(const Operation &operation)
+{
+    for (unsigned attempt(0); attempt < SPIN_COUNT; ++attempt) {
+	if (operation()) {
+	    wakeBlocked();
+	    return;
+	}
+	std::this_thread::yield();
+    }
+
+    {
+	// Updates of the queue that happen after we have registered ourselves notify us under the mutex and therefore
+	// can't slip in between the failed attempt and the wait.
+	std::unique_lock<std::mutex> lock(mutex_);
+	blocked_count_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (not operation())
+	    changed_.wait(lock);
+	blocked_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    wakeBlocked();
+}
+
+
+#endif // ifndef BOUNDED_QUEUE_H
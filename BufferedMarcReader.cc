@@ -0,0 +1,85 @@
+/** \file   BufferedMarcReader.cc
+ *  \brief  Implementation of the BufferedMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "BufferedMarcReader.h"
+#include <algorithm>
+
+
+BufferedMarcReader::BufferedMarcReader(const std::string &input_filename)
+    : input_filename_(input_filename), buffer_(NULL), buffer_size_(0), position_(0), offset_(0), spill_position_(0)
+{
+    spill_.reserve(99999); // The maximum length of a MARC-21 record.
+}
+
+
+bool BufferedMarcReader::advanceBuffer(std::string * const err_msg) {
+    position_ = 0;
+    if (getNextBuffer(&buffer_, &buffer_size_, err_msg))
+	return true;
+
+    buffer_size_ = 0;
+    return false;
+}
+
+
+const char *BufferedMarcReader::peek(const size_t min_size, size_t * const available, std::string * const err_msg) {
+    if (spill_position_ == spill_.size()) {
+	if (position_ == buffer_size_ and not advanceBuffer(err_msg)) {
+	    *available = 0;
+	    return NULL;
+	}
+
+	// The common case: the requested bytes lie within the current buffer.
+	if (buffer_size_ - position_ >= min_size) {
+	    *available = buffer_size_ - position_;
+	    return buffer_ + position_;
+	}
+
+	spill_.clear();
+	spill_position_ = 0;
+    } else if (spill_.size() - spill_position_ >= min_size) {
+	*available = spill_.size() - spill_position_;
+	return spill_.data() + spill_position_;
+    } else if (spill_position_ > 0) {
+	spill_.erase(0, spill_position_);
+	spill_position_ = 0;
+    }
+
+    // Only copy the requested bytes into the spill buffer.
+    while (spill_.size() < min_size) {
+	if (position_ == buffer_size_ and not advanceBuffer(err_msg))
+	    break;
+
+	const size_t count(std::min(min_size - spill_.size(), buffer_size_ - position_));
+	spill_.append(buffer_ + position_, count);
+	position_ += count;
+    }
+
+    *available = spill_.size();
+    return spill_.data();
+}
+
+
+void BufferedMarcReader::skip(const size_t count) {
+    if (spill_position_ < spill_.size())
+	spill_position_ += count;
+    else
+	position_ += count;
+    offset_ += count;
+}
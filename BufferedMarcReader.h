@@ -0,0 +1,68 @@
+/** \file   BufferedMarcReader.h
+ *  \brief  Interface for the BufferedMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BUFFERED_MARC_READER_H
+#define BUFFERED_MARC_READER_H
+
+
+#include <string>
+#include "MarcReader.h"
+
+
+/** \class BufferedMarcReader
+ *  \brief Base class for readers that receive their input as a sequence of large buffers.
+ *
+ *  Records that lie entirely within a buffer are handed out w/o copying.  Only a record that straddles a buffer
+ *  boundary gets assembled in a small spill buffer.  The returned records are only valid until the next call.
+ */
+class BufferedMarcReader: public MarcReader {
+    const std::string input_filename_;
+    const char *buffer_;
+    size_t buffer_size_;     // Zero if we are not holding a buffer.
+    size_t position_;        // Within "buffer_".
+    size_t offset_;          // The offset, in the uncompressed input, of the current position.
+
+    // Bytes that straddled a buffer boundary.  If spill_position_ < spill_.size(), the current position is
+    // spill_position_ and the bytes in "buffer_" starting at "position_" follow the ones in "spill_".
+    std::string spill_;
+    size_t spill_position_;
+public:
+    const std::string &getFilename() const override { return input_filename_; }
+    size_t tell() const override { return offset_; }
+protected:
+    explicit BufferedMarcReader(const std::string &input_filename);
+
+    /** \brief Releases the buffer returned by the previous call, if any, and returns the next non-empty buffer.
+     *  \return False if there is no more input and then "err_msg" will be set if an error occurred.  Subsequent calls
+     *          must return false, too.
+     */
+    virtual bool getNextBuffer(const char ** const buffer, size_t * const buffer_size, std::string * const err_msg)
+	= 0;
+
+    const char *peek(const size_t min_size, size_t * const available, std::string * const err_msg) override;
+    void skip(const size_t count) override;
+private:
+    BufferedMarcReader(const BufferedMarcReader &rhs) = delete;
+    const BufferedMarcReader &operator=(const BufferedMarcReader &rhs) = delete;
+
+    bool advanceBuffer(std::string * const err_msg);
+};
+
+
+#endif // ifndef BUFFERED_MARC_READER_H
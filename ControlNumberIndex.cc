@@ -0,0 +1,206 @@
+/** \file   ControlNumberIndex.cc
+ *  \brief  Implementation of the ControlNumberIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ControlNumberIndex.h"
+#include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "MarcFileReader.h"
+#include "MarcTag.h"
+#include "util.h"
+
+
+static const char INDEX_MAGIC[8] = { 'M', 'A', 'R', 'C', 'I', 'D', 'X', '1' };
+
+
+ControlNumberIndex::ControlNumberIndex(MemoryMappedFile * const index_file)
+    : index_file_(index_file), header_(reinterpret_cast<const Header *>(index_file->getData())),
+      entries_(reinterpret_cast<const Entry *>(index_file->getData() + sizeof(Header))),
+      key_pool_(index_file->getData() + header_->key_pool_offset_)
+{
+}
+
+
+/** \return True if the keys of all entries lie within the key pool and all records within the MARC file, else false.
+ *  \note   "header" must be followed by its entries and the key pool, which must end at "index_size".
+ */
+static bool EntriesAreInBounds(const ControlNumberIndex::Header &header, const uint64_t index_size) {
+    const uint64_t key_pool_size(index_size - header.key_pool_offset_);
+    const ControlNumberIndex::Entry * const entries(reinterpret_cast<const ControlNumberIndex::Entry *>(&header + 1));
+    for (const ControlNumberIndex::Entry *entry(entries); entry != entries + header.entry_count_; ++entry) {
+	if (static_cast<uint64_t>(entry->key_offset_) + entry->key_length_ > key_pool_size
+	    or entry->record_offset_ > header.source_size_
+	    or entry->record_length_ > header.source_size_ - entry->record_offset_)
+	    return false;
+    }
+
+    return true;
+}
+
+
+ControlNumberIndex *ControlNumberIndex::ControlNumberIndexFactory(const std::string &index_filename,
+								  const std::string &marc_filename,
+								  std::string * const err_msg)
+{
+    MemoryMappedFile * const raw_index_file(
+	MemoryMappedFile::MemoryMappedFileFactory(index_filename, err_msg, MemoryMappedFile::RANDOM));
+    if (raw_index_file == NULL)
+	return NULL;
+    std::unique_ptr<MemoryMappedFile> index_file(raw_index_file);
+
+    const Header * const header(reinterpret_cast<const Header *>(index_file->getData()));
+    if (index_file->getSize() < sizeof(Header)
+	or std::memcmp(header->magic_, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0)
+    {
+	*err_msg = "\"" + index_filename + "\" is not a control number index!";
+	return NULL;
+    }
+
+    // N.B. Checking the entry count first keeps the multiplication from overflowing.
+    if (header->entry_count_ > (index_file->getSize() - sizeof(Header)) / sizeof(Entry)
+	or header->key_pool_offset_ != sizeof(Header) + header->entry_count_ * sizeof(Entry)
+	or not EntriesAreInBounds(*header, index_file->getSize()))
+    {
+	*err_msg = "control number index \"" + index_filename + "\" is corrupt!";
+	return NULL;
+    }
+
+    struct stat stat_buf;
+    if (not GetFileStatus(marc_filename, &stat_buf, err_msg))
+	return NULL;
+    if (header->source_size_ != static_cast<uint64_t>(stat_buf.st_size)
+	or header->source_mtime_seconds_ != stat_buf.st_mtim.tv_sec
+	or header->source_mtime_nanoseconds_ != stat_buf.st_mtim.tv_nsec)
+    {
+	*err_msg = "control number index \"" + index_filename + "\" is stale w.r.t. \"" + marc_filename + "\"!";
+	return NULL;
+    }
+
+    return new ControlNumberIndex(index_file.release());
+}
+
+
+namespace {
+
+
+struct ControlNumberAndLocation {
+    Slice control_number_;
+    uint64_t record_offset_;
+    uint32_t record_length_;
+};
+
+
+} // unnamed namespace
+
+
+bool ControlNumberIndex::Build(const std::string &marc_filename, const std::string &index_filename,
+			       std::string * const err_msg)
+{
+    struct stat stat_buf;
+    if (not GetFileStatus(marc_filename, &stat_buf, err_msg))
+	return false;
+
+    MarcFileReader * const raw_reader(MarcFileReader::MarcFileReaderFactory(marc_filename, err_msg));
+    if (raw_reader == NULL)
+	return false;
+    const std::unique_ptr<MarcFileReader> reader(raw_reader);
+
+    // The control numbers point directly into the mapped MARC file.
+    std::vector<ControlNumberAndLocation> locations;
+    uint64_t record_offset(reader->tell());
+    RecordView record;
+    while (reader->getNextRecord(&record, err_msg)) {
+	const size_t field_index(record.findTag("001"_tag));
+	if (field_index == record.getNumberOfFields())
+	    Warning("record at offset " + std::to_string(record_offset) + " has no control number!");
+	else {
+	    const ControlNumberAndLocation location = { record.getField(field_index), record_offset,
+							record.getRecordLength() };
+	    locations.push_back(location);
+	}
+	record_offset = reader->tell();
+    }
+    if (not err_msg->empty())
+	return false;
+
+    std::stable_sort(locations.begin(), locations.end(),
+		     [](const ControlNumberAndLocation &lhs, const ControlNumberAndLocation &rhs)
+		     { return lhs.control_number_ < rhs.control_number_; });
+
+    Header header;
+    std::memcpy(header.magic_, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    header.source_size_              = stat_buf.st_size;
+    header.source_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.source_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.entry_count_              = locations.size();
+    header.key_pool_offset_          = sizeof(Header) + locations.size() * sizeof(Entry);
+
+    std::vector<Entry> entries;
+    entries.reserve(locations.size());
+    uint32_t key_offset(0);
+    for (const auto &location : locations) {
+	const Entry entry = { location.record_offset_, location.record_length_, key_offset,
+			      static_cast<uint32_t>(location.control_number_.size()), 0 };
+	entries.push_back(entry);
+	key_offset += location.control_number_.size();
+    }
+
+    // Write to a temporary file first so that readers never see a partially written index.
+    const std::string temp_filename(index_filename + ".tmp");
+    FILE * const output(std::fopen(temp_filename.c_str(), "wb"));
+    if (output == NULL) {
+	*err_msg = "can't open \"" + temp_filename + "\" for writing! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    bool write_ok(std::fwrite(&header, sizeof header, 1, output) == 1);
+    if (write_ok and not entries.empty())
+	write_ok = std::fwrite(entries.data(), sizeof(Entry), entries.size(), output) == entries.size();
+    for (auto location(locations.cbegin()); write_ok and location != locations.cend(); ++location)
+	write_ok = std::fwrite(location->control_number_.data(), 1, location->control_number_.size(), output)
+		   == location->control_number_.size();
+    if (std::fclose(output) != 0)
+	write_ok = false;
+
+    if (not write_ok or std::rename(temp_filename.c_str(), index_filename.c_str()) != 0) {
+	*err_msg = "failed to write \"" + index_filename + "\"! (" + std::strerror(errno) + ")";
+	std::remove(temp_filename.c_str());
+	return false;
+    }
+
+    return true;
+}
+
+
+bool ControlNumberIndex::lookup(const Slice &control_number, uint64_t * const record_offset,
+				unsigned * const record_length) const
+{
+    const Entry * const end(entries_ + header_->entry_count_);
+    const Entry * const entry(std::lower_bound(entries_, end, control_number,
+					       [this](const Entry &lhs, const Slice &rhs)
+					       { return getKey(lhs) < rhs; }));
+    if (entry == end or getKey(*entry) != control_number)
+	return false;
+
+    *record_offset = entry->record_offset_;
+    *record_length = entry->record_length_;
+    return true;
+}
@@ -0,0 +1,92 @@
+/** \file   ControlNumberIndex.h
+ *  \brief  Interface for the ControlNumberIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONTROL_NUMBER_INDEX_H
+#define CONTROL_NUMBER_INDEX_H
+
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "MemoryMappedFile.h"
+#include "Slice.h"
+
+
+/** \class ControlNumberIndex
+ *  \brief An on-disk index that maps control numbers (field 001) to the locations of records in a MARC-21 file.
+ *
+ *  The index file consists of a header, an array of fixed-size entries sorted by control number and a pool of the
+ *  concatenated control numbers.  All integers are stored in host byte order.  The header records the size and the
+ *  modification time of the indexed MARC file so that a stale index can be detected.
+ */
+class ControlNumberIndex {
+public:
+    struct Header {
+	char magic_[8];
+	uint64_t source_size_;
+	int64_t source_mtime_seconds_;
+	int64_t source_mtime_nanoseconds_;
+	uint64_t entry_count_;
+	uint64_t key_pool_offset_; // Relative to the start of the index file.
+    };
+
+    struct Entry {
+	uint64_t record_offset_;
+	uint32_t record_length_;
+	uint32_t key_offset_;      // Relative to the start of the key pool.
+	uint32_t key_length_;
+	uint32_t reserved_;
+    };
+private:
+    std::unique_ptr<MemoryMappedFile> index_file_;
+    const Header *header_;
+    const Entry *entries_;
+    const char *key_pool_;
+public:
+    /** \brief Opens the index "index_filename" for the MARC file "marc_filename".
+     *  \return NULL if the index could not be opened, is corrupt or is stale w.r.t. "marc_filename".  In that case
+     *          "err_msg" will be set.
+     */
+    static ControlNumberIndex *ControlNumberIndexFactory(const std::string &index_filename,
+							 const std::string &marc_filename, std::string * const err_msg);
+
+    /** \brief Scans "marc_filename" once and writes an index to "index_filename".
+     *  \note  Records w/o a control number field are skipped with a warning.
+     *  \return True on success, else false and then "err_msg" will be set.
+     */
+    static bool Build(const std::string &marc_filename, const std::string &index_filename,
+		      std::string * const err_msg);
+
+    /** \return The name that tools use for the index of "marc_filename" unless told otherwise. */
+    static std::string DefaultIndexFilename(const std::string &marc_filename) { return marc_filename + ".idx"; }
+
+    size_t size() const { return header_->entry_count_; }
+
+    /** \brief Binary search for "control_number".
+     *  \return True if "control_number" was found, else false.  If the control number is not unique, the location
+     *          of the first record that was found in the MARC file will be returned.
+     */
+    bool lookup(const Slice &control_number, uint64_t * const record_offset, unsigned * const record_length) const;
+private:
+    explicit ControlNumberIndex(MemoryMappedFile * const index_file);
+    Slice getKey(const Entry &entry) const { return Slice(key_pool_ + entry.key_offset_, entry.key_length_); }
+};
+
+
+#endif // ifndef CONTROL_NUMBER_INDEX_H
@@ -0,0 +1,405 @@
+/** \file   DecompressingMarcReader.cc
+ *  \brief  Implementation of the DecompressingMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DecompressingMarcReader.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#   include <zstd.h>
+#endif
+#include "Stats.h"
+
+
+const size_t DecompressingMarcReader::DEFAULT_BUFFER_COUNT;
+const size_t DecompressingMarcReader::DEFAULT_BUFFER_SIZE;
+
+
+/** \class Decompressor
+ *  \brief Decompresses an input file into caller-supplied buffers.
+ *
+ *  The compressed data is either read from a file descriptor or, for input that can't be reopened, e.g. a pipe
+ *  whose first bytes have already been looked at, from another reader.
+ */
+class Decompressor {
+protected:
+    static const size_t INPUT_BUFFER_SIZE = 256 * 1024;
+    const std::string input_filename_;
+    const int fd_;                     // -1 if we read from "input_".
+    std::unique_ptr<MarcReader> input_; // NULL if we read from "fd_".
+    std::unique_ptr<char[]> input_buffer_;
+public:
+    Decompressor(const std::string &input_filename, const int fd, MarcReader * const input)
+	: input_filename_(input_filename), fd_(fd), input_(input), input_buffer_(new char[INPUT_BUFFER_SIZE]) {}
+    virtual ~Decompressor() {
+	if (fd_ != -1)
+	    ::close(fd_);
+    }
+
+    virtual bool init(std::string * const err_msg) = 0;
+
+    /** \brief Decompresses until "buffer" holds "capacity" bytes or the end of the compressed data has been reached.
+     *  \param fill_level  The number of bytes that have been stored in "buffer".
+     *  \param eof         Will be set to true if the compressed data has been exhausted.
+     *  \return False if reading or decompression failed and then "err_msg" will be set, else true.
+     */
+    virtual bool fill(char * const buffer, const size_t capacity, size_t * const fill_level, bool * const eof,
+		      std::string * const err_msg) = 0;
+protected:
+    /** Reads up to INPUT_BUFFER_SIZE bytes into "input_buffer_".  "*count" will be 0 at EOF. */
+    bool readInput(size_t * const count, std::string * const err_msg);
+};
+
+
+const size_t Decompressor::INPUT_BUFFER_SIZE;
+
+
+bool Decompressor::readInput(size_t * const count, std::string * const err_msg) {
+    if (input_ != NULL) {
+	const char * const input(input_->peek(INPUT_BUFFER_SIZE, count, err_msg));
+	if (not err_msg->empty())
+	    return false;
+	std::memcpy(input_buffer_.get(), input, *count);
+	input_->skip(*count);
+	return true;
+    }
+
+    ssize_t retval;
+    do
+	retval = ::read(fd_, input_buffer_.get(), INPUT_BUFFER_SIZE);
+    while (retval == -1 and errno == EINTR);
+
+    if (retval == -1) {
+	*err_msg = "read from \"" + input_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    *count = static_cast<size_t>(retval);
+    return true;
+}
+
+
+/** Handles single- and multi-member gzip files, e.g. the output of "cat a.gz b.gz". */
+class GzipDecompressor: public Decompressor {
+    z_stream stream_;
+    bool initialised_;
+    bool in_member_; // True if we have seen the start but not the end of a gzip member.
+public:
+    GzipDecompressor(const std::string &input_filename, const int fd, MarcReader * const input)
+	: Decompressor(input_filename, fd, input), stream_(), initialised_(false), in_member_(false) {}
+    ~GzipDecompressor() {
+	if (initialised_)
+	    ::inflateEnd(&stream_);
+    }
+
+    bool init(std::string * const err_msg) override;
+    bool fill(char * const buffer, const size_t capacity, size_t * const fill_level, bool * const eof,
+	      std::string * const err_msg) override;
+private:
+    std::string getErrorMessage(const int retval) const {
+	return "gzip decompression of \"" + input_filename_ + "\" failed! ("
+	       + (stream_.msg != NULL ? stream_.msg : ::zError(retval)) + ")";
+    }
+};
+
+
+bool GzipDecompressor::init(std::string * const err_msg) {
+    // 16 + MAX_WBITS makes zlib expect a gzip rather than a zlib header.
+    const int retval(::inflateInit2(&stream_, 16 + MAX_WBITS));
+    if (retval != Z_OK) {
+	*err_msg = getErrorMessage(retval);
+	return false;
+    }
+
+    initialised_ = true;
+    return true;
+}
+
+
+bool GzipDecompressor::fill(char * const buffer, const size_t capacity, size_t * const fill_level, bool * const eof,
+			    std::string * const err_msg)
+{
+    *eof = false;
+    stream_.next_out  = reinterpret_cast<Bytef *>(buffer);
+    stream_.avail_out = static_cast<uInt>(capacity);
+    while (stream_.avail_out > 0) {
+	if (stream_.avail_in == 0) {
+	    size_t count;
+	    if (not readInput(&count, err_msg))
+		return false;
+	    if (count == 0 and not in_member_) {
+		*eof = true;
+		break;
+	    }
+	    stream_.next_in  = reinterpret_cast<Bytef *>(input_buffer_.get());
+	    stream_.avail_in = static_cast<uInt>(count);
+	}
+
+	if (stream_.avail_in > 0)
+	    in_member_ = true;
+	const int retval(::inflate(&stream_, Z_NO_FLUSH));
+	if (retval == Z_STREAM_END) {
+	    in_member_ = false;
+	    ::inflateReset(&stream_); // Leaves any remaining input, i.e. the next member, alone.
+	} else if (retval == Z_BUF_ERROR) { // No progress w/o more input but we are at EOF.
+	    *err_msg = "unexpected end of the gzip data in \"" + input_filename_ + "\"!";
+	    return false;
+	} else if (retval != Z_OK) {
+	    *err_msg = getErrorMessage(retval);
+	    return false;
+	}
+    }
+
+    *fill_level = capacity - stream_.avail_out;
+    return true;
+}
+
+
+#ifdef HAVE_ZSTD
+
+
+/** Handles single- and multi-frame zstd files. */
+class ZstdDecompressor: public Decompressor {
+    ZSTD_DStream *stream_;
+    ZSTD_inBuffer input_;
+    bool frame_complete_;
+public:
+    ZstdDecompressor(const std::string &input_filename, const int fd, MarcReader * const input)
+	: Decompressor(input_filename, fd, input), stream_(::ZSTD_createDStream()), input_(), frame_complete_(true) {}
+    ~ZstdDecompressor() { ::ZSTD_freeDStream(stream_); }
+
+    bool init(std::string * const err_msg) override;
+    bool fill(char * const buffer, const size_t capacity, size_t * const fill_level, bool * const eof,
+	      std::string * const err_msg) override;
+};
+
+
+bool ZstdDecompressor::init(std::string * const err_msg) {
+    if (stream_ == NULL) {
+	*err_msg = "can't create a zstd decompression stream for \"" + input_filename_ + "\"!";
+	return false;
+    }
+
+    const size_t retval(::ZSTD_initDStream(stream_));
+    if (::ZSTD_isError(retval)) {
+	*err_msg = "can't initialise zstd decompression of \"" + input_filename_ + "\"! ("
+		   + ::ZSTD_getErrorName(retval) + ")";
+	return false;
+    }
+
+    return true;
+}
+
+
+bool ZstdDecompressor::fill(char * const buffer, const size_t capacity, size_t * const fill_level, bool * const eof,
+			    std::string * const err_msg)
+{
+    *eof = false;
+    ZSTD_outBuffer output = { buffer, capacity, 0 };
+    while (output.pos < output.size) {
+	if (input_.pos == input_.size) {
+	    size_t count;
+	    if (not readInput(&count, err_msg))
+		return false;
+	    if (count == 0 and frame_complete_) {
+		*eof = true;
+		break;
+	    }
+	    input_.src  = input_buffer_.get();
+	    input_.size = count;
+	    input_.pos  = 0;
+	}
+
+	const size_t previous_output_pos(output.pos);
+	const size_t retval(::ZSTD_decompressStream(stream_, &output, &input_));
+	if (::ZSTD_isError(retval)) {
+	    *err_msg = "zstd decompression of \"" + input_filename_ + "\" failed! (" + ::ZSTD_getErrorName(retval)
+		       + ")";
+	    return false;
+	}
+	frame_complete_ = retval == 0;
+
+	// At EOF we only get here to flush buffered output.  No progress means that the last frame is incomplete.
+	if (input_.size == 0 and not frame_complete_ and output.pos == previous_output_pos) {
+	    *err_msg = "unexpected end of the zstd data in \"" + input_filename_ + "\"!";
+	    return false;
+	}
+    }
+
+    *fill_level = output.pos;
+    return true;
+}
+
+
+#endif // ifdef HAVE_ZSTD
+
+
+/** \brief Creates and initialises a Decompressor for "compression" that takes ownership of "fd" and "input".
+ *  \return NULL if "compression" is not supported or the initialisation failed and then also sets "err_msg".
+ */
+static Decompressor *NewDecompressor(const std::string &input_filename, const MarcReader::Compression compression,
+				     const int fd, MarcReader * const input, std::string * const err_msg)
+{
+    std::unique_ptr<Decompressor> decompressor;
+    switch (compression) {
+    case MarcReader::GZIP:
+	decompressor.reset(new GzipDecompressor(input_filename, fd, input));
+	break;
+    case MarcReader::ZSTD:
+#ifdef HAVE_ZSTD
+	decompressor.reset(new ZstdDecompressor(input_filename, fd, input));
+	break;
+#else
+	*err_msg = "can't read \"" + input_filename + "\" because zstd support has not been compiled in!";
+	break;
+#endif
+    default:
+	*err_msg = "\"" + input_filename + "\" is not compressed!";
+    }
+
+    if (decompressor == NULL) {
+	if (fd != -1)
+	    ::close(fd);
+	delete input;
+	return NULL;
+    }
+
+    return decompressor->init(err_msg) ? decompressor.release() : NULL;
+}
+
+
+DecompressingMarcReader *DecompressingMarcReader::DecompressingMarcReaderFactory(const std::string &input_filename,
+										 const Compression compression,
+										 std::string * const err_msg,
+										 const size_t buffer_count,
+										 const size_t buffer_size)
+{
+    const int fd(::open(input_filename.c_str(), O_RDONLY));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + input_filename + "\" for reading! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    Decompressor * const decompressor(NewDecompressor(input_filename, compression, fd, NULL, err_msg));
+    if (decompressor == NULL)
+	return NULL;
+
+    return new DecompressingMarcReader(input_filename, decompressor, std::max<size_t>(buffer_count, 2), buffer_size);
+}
+
+
+DecompressingMarcReader *DecompressingMarcReader::DecompressingMarcReaderFactory(MarcReader * const input,
+										 const Compression compression,
+										 std::string * const err_msg,
+										 const size_t buffer_count,
+										 const size_t buffer_size)
+{
+    const std::string input_filename(input->getFilename());
+    Decompressor * const decompressor(NewDecompressor(input_filename, compression, -1, input, err_msg));
+    if (decompressor == NULL)
+	return NULL;
+
+    return new DecompressingMarcReader(input_filename, decompressor, std::max<size_t>(buffer_count, 2), buffer_size);
+}
+
+
+DecompressingMarcReader::DecompressingMarcReader(const std::string &input_filename, Decompressor * const decompressor,
+						 const size_t buffer_count, const size_t buffer_size)
+    : BufferedMarcReader(input_filename), decompressor_(decompressor), buffer_size_(buffer_size),
+      buffer_fill_levels_(buffer_count), full_count_(0), producer_done_(false), stop_(false), read_index_(0),
+      holding_buffer_(false)
+{
+    for (size_t buffer_no(0); buffer_no < buffer_count; ++buffer_no)
+	buffers_.emplace_back(new char[buffer_size]);
+
+    producer_ = std::thread(&DecompressingMarcReader::produce, this);
+}
+
+
+DecompressingMarcReader::~DecompressingMarcReader() {
+    {
+	std::lock_guard<std::mutex> lock(mutex_);
+	stop_ = true;
+    }
+    buffer_released_.notify_one();
+    producer_.join();
+}
+
+
+void DecompressingMarcReader::produce() {
+    std::string err_msg;
+    size_t write_index(0);
+    bool eof(false);
+    while (not eof) {
+	{
+	    std::unique_lock<std::mutex> lock(mutex_);
+	    buffer_released_.wait(lock, [this]{ return full_count_ < buffers_.size() or stop_; });
+	    if (stop_)
+		break;
+	}
+
+	// The consumer does not touch buffers that are not full, so we can fill this one w/o holding the lock.
+	size_t fill_level;
+	{
+	    const Stats::StageTimer timer(Stats::READING);
+	    if (not decompressor_->fill(buffers_[write_index].get(), buffer_size_, &fill_level, &eof, &err_msg))
+		break;
+	}
+
+	if (fill_level > 0) {
+	    std::lock_guard<std::mutex> lock(mutex_);
+	    buffer_fill_levels_[write_index] = fill_level;
+	    ++full_count_;
+	    write_index = (write_index + 1) % buffers_.size();
+	    buffer_filled_.notify_one();
+	}
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    producer_done_    = true;
+    producer_err_msg_ = err_msg;
+    buffer_filled_.notify_one();
+}
+
+
+bool DecompressingMarcReader::getNextBuffer(const char ** const buffer, size_t * const buffer_size,
+					    std::string * const err_msg)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (holding_buffer_) {
+	holding_buffer_ = false;
+	--full_count_;
+	read_index_ = (read_index_ + 1) % buffers_.size();
+	buffer_released_.notify_one();
+    }
+
+    buffer_filled_.wait(lock, [this]{ return full_count_ > 0 or producer_done_; });
+    if (full_count_ == 0) {
+	*err_msg = producer_err_msg_;
+	return false;
+    }
+
+    holding_buffer_ = true;
+    *buffer         = buffers_[read_index_].get();
+    *buffer_size    = buffer_fill_levels_[read_index_];
+    return true;
+}
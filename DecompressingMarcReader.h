@@ -0,0 +1,99 @@
+/** \file   DecompressingMarcReader.h
+ *  \brief  Interface for the DecompressingMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DECOMPRESSING_MARC_READER_H
+#define DECOMPRESSING_MARC_READER_H
+
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BufferedMarcReader.h"
+
+
+class Decompressor;
+
+
+/** \class DecompressingMarcReader
+ *  \brief Reads gzip or zstd compressed files of binary MARC-21 records.
+ *
+ *  Decompression happens on a dedicated thread that fills a ring of large buffers ahead of the consumer, so that
+ *  decompressing and processing records overlap.
+ */
+class DecompressingMarcReader: public BufferedMarcReader {
+public:
+    static const size_t DEFAULT_BUFFER_COUNT = 4;
+    static const size_t DEFAULT_BUFFER_SIZE = 16 * 1024 * 1024;
+private:
+    std::unique_ptr<Decompressor> decompressor_;
+
+    // The ring buffer.  Buffers are filled by the producer thread in order and released by the consumer in order.
+    const size_t buffer_size_;
+    std::vector<std::unique_ptr<char[]>> buffers_;
+    std::vector<size_t> buffer_fill_levels_;
+    std::mutex mutex_;
+    std::condition_variable buffer_filled_, buffer_released_;
+    size_t full_count_;   // Includes the buffer that the consumer is currently reading from.
+    bool producer_done_;
+    bool stop_;
+    std::string producer_err_msg_;
+    std::thread producer_;
+    size_t read_index_;
+    bool holding_buffer_;
+public:
+    /** \brief Opens "input_filename" and starts decompressing it on a separate thread.
+     *  \param compression   Typically determined w/ MarcReader::DetectCompression().
+     *  \param buffer_count  The number of buffers in the ring.  Must be at least 2.
+     *  \return NULL if "input_filename" could not be opened or "compression" is not supported and then also sets
+     *          "err_msg".
+     */
+    static DecompressingMarcReader *DecompressingMarcReaderFactory(const std::string &input_filename,
+								   const Compression compression,
+								   std::string * const err_msg,
+								   const size_t buffer_count = DEFAULT_BUFFER_COUNT,
+								   const size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    /** \brief Like the above but decompresses what "input" returns, e.g. a StdioMarcReader that reads from a pipe.
+     *  \param input  Will be owned by us, even if we fail.  Its tell() must still be 0.
+     */
+    static DecompressingMarcReader *DecompressingMarcReaderFactory(MarcReader * const input,
+								   const Compression compression,
+								   std::string * const err_msg,
+								   const size_t buffer_count = DEFAULT_BUFFER_COUNT,
+								   const size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    /** Stops and joins the decompression thread. */
+    ~DecompressingMarcReader();
+protected:
+    bool getNextBuffer(const char ** const buffer, size_t * const buffer_size, std::string * const err_msg) override;
+private:
+    DecompressingMarcReader(const std::string &input_filename, Decompressor * const decompressor,
+			    const size_t buffer_count, const size_t buffer_size);
+    DecompressingMarcReader(const DecompressingMarcReader &rhs) = delete;
+    const DecompressingMarcReader &operator=(const DecompressingMarcReader &rhs) = delete;
+
+    /** The body of the decompression thread. */
+    void produce();
+};
+
+
+#endif // ifndef DECOMPRESSING_MARC_READER_H
@@ -19,61 +19,72 @@
  */
 #include "DirectoryEntry.h"
 #include "StringUtil.h"
-#include "util.h"
 
 
 const size_t DirectoryEntry::DIRECTORY_ENTRY_LENGTH(12);
 const size_t DirectoryEntry::TAG_LENGTH(3);
 
 
-DirectoryEntry::DirectoryEntry(const std::string &raw_entry) {
-    if (raw_entry.size() != DIRECTORY_ENTRY_LENGTH)
-	Error("incorrect raw directory entry size (" + std::to_string(raw_entry.size()) + ").  Must be 12!");
-    tag_ = raw_entry.substr(0, TAG_LENGTH);
+bool DirectoryEntry::ParseDirEntry(const std::string &raw_entry, DirectoryEntry * const entry,
+				   std::string * const err_msg)
+{
+    if (raw_entry.size() != DIRECTORY_ENTRY_LENGTH) {
+	if (err_msg != NULL)
+	    *err_msg = "incorrect raw directory entry size (" + std::to_string(raw_entry.size()) + ").  Must be 12!";
+	return false;
+    }
 
-    if (std::sscanf(raw_entry.data() + TAG_LENGTH, "%4u", &field_length_) != 1)
-	Error("can't scan field length (" + raw_entry.substr(TAG_LENGTH, 4)
-	      + ") in directory entry! (Tag was " + tag_ + ")");
+    if (not DecodeRawEntry(raw_entry.data(), raw_entry.size(), &entry->field_length_, &entry->field_offset_)) {
+	if (err_msg != NULL)
+	    *err_msg = "can't scan field length or offset (" + raw_entry.substr(TAG_LENGTH)
+		       + ") in directory entry! (Tag was " + raw_entry.substr(0, TAG_LENGTH) + ")";
+	return false;
+    }
 
-    if (std::sscanf(raw_entry.data() + 7, "%5u", &field_offset_) != 1)
-	Error("can't scan field oddset in directory entry!");
+    entry->tag_ = MarcTag(raw_entry.data());
+    return true;
 }
 
 
 std::string DirectoryEntry::toString() const {
-    std::string field_as_string;
-    field_as_string.reserve(DirectoryEntry::DIRECTORY_ENTRY_LENGTH);
-
-    field_as_string += tag_;
-    field_as_string += StringUtil::PadLeading(std::to_string(field_length_), 4, '0');
-    field_as_string += StringUtil::PadLeading(std::to_string(field_offset_), 5, '0');
+    std::string field_as_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH, '\0');
+    toBuffer(&field_as_string[0]);
 
     return field_as_string;
 }
 
 
-bool DirectoryEntry::ParseDirEntries(const std::string &entries_string, std::vector<DirectoryEntry> * const entries,
-				     std::string * const err_msg) {
+bool DirectoryEntry::ParseDirEntries(const char * const entries_start, const size_t entries_size,
+				     std::vector<DirectoryEntry> * const entries, std::string * const err_msg)
+{
     entries->clear();
-    if ((entries_string.length() % DIRECTORY_ENTRY_LENGTH) != 1) {
+    if ((entries_size % DIRECTORY_ENTRY_LENGTH) != 1) {
 	if (err_msg != NULL)
 	    *err_msg = "Raw directory entries string must be a multiple of " + std::to_string(DIRECTORY_ENTRY_LENGTH)
 		+ " in length!";
 	return false;
     }
 
-    if (entries_string[entries_string.length() - 1] != '\x1E') {
+    if (entries_start[entries_size - 1] != '\x1E') {
 	if (err_msg != NULL)
 	    *err_msg = "Missing field terminator at end of directory!";
 	return false;
     }
 
-    const unsigned count(entries_string.length() / DIRECTORY_ENTRY_LENGTH);
+    const unsigned count(entries_size / DIRECTORY_ENTRY_LENGTH);
     entries->reserve(count);
-    size_t offset(0);
-    for (unsigned i(0); i < count; ++i) {
-	entries->push_back(DirectoryEntry(entries_string.substr(offset, DIRECTORY_ENTRY_LENGTH)));
-	offset += DIRECTORY_ENTRY_LENGTH;
+    const char *raw_entry(entries_start);
+    for (unsigned i(0); i < count; ++i, raw_entry += DIRECTORY_ENTRY_LENGTH) {
+	unsigned field_length, field_offset;
+	if (not DecodeRawEntry(raw_entry, entries_start + entries_size - raw_entry, &field_length, &field_offset)) {
+	    if (err_msg != NULL)
+		*err_msg = "Malformed directory entry #" + std::to_string(i) + " (\""
+			   + std::string(raw_entry, DIRECTORY_ENTRY_LENGTH) + "\")!";
+	    entries->clear();
+	    return false;
+	}
+
+	entries->push_back(DirectoryEntry(MarcTag(raw_entry), field_length, field_offset));
     }
 
     return true;
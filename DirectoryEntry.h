@@ -23,34 +23,39 @@
 
 #include <string>
 #include <vector>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "MarcTag.h"
 #include "StringUtil.h"
 
 
 /** \class DirectoryEntry
  *  \brief Encapsulates a MARC-21 directory entry.
+ *  \note  The tag is stored as a packed MarcTag, so a DirectoryEntry is a small value type w/o any heap allocations
+ *         and a std::vector<DirectoryEntry> is a dense array.
  */
 class DirectoryEntry {
 public:
     static const size_t DIRECTORY_ENTRY_LENGTH; //< The fixed length of a directory entry according to the standard.
     static const size_t TAG_LENGTH;             //< The fixed length of a field tag according to the standard.
 private:
-    std::string tag_;
+    MarcTag tag_;
     unsigned field_length_;
     unsigned field_offset_;
 public:
-    /** Constructs a DirectoryEntry from the binary representation of a MARC-21 directory entry. */
-    explicit DirectoryEntry(const std::string &raw_entry);
+    DirectoryEntry(): field_length_(0), field_offset_(0) {}
 
     /** \brief Constructs a DirectoryEntry from its component parts.
      *
-     *  \param tag           A field tag.  Must have a length of 3.
+     *  \param tag           A field tag, e.g. "245"_tag.
      *  \param field_length  Must be less than 10,000.
      *  \param field_offset  Must be less than 10,000.
      */
-    DirectoryEntry(const std::string &tag, const unsigned field_length, const unsigned field_offset)
+    DirectoryEntry(const MarcTag &tag, const unsigned field_length, const unsigned field_offset)
 	: tag_(tag), field_length_(field_length), field_offset_(field_offset) {}
 
-    const std::string &getTag() const { return tag_; }
+    MarcTag getTag() const { return tag_; }
     unsigned getFieldLength() const { return field_length_; }
 
     /** \param new_field_length  Must be less than 10,000. */
@@ -62,11 +67,36 @@ public:
     void setFieldOffset(const unsigned new_field_offset) { field_offset_ = new_field_offset; }
 
     /** \return True if this DirectoryEntry corresponds to a control field, else false. */
-    bool isControlFieldEntry() const { return StringUtil::StartsWith(tag_, "00"); }
+    bool isControlFieldEntry() const { return tag_.isControlFieldTag(); }
 
     // Returns the string representation of a DirectoryEntry but w/o the trailing field terminator.
     std::string toString() const;
 
+    /** Writes the DIRECTORY_ENTRY_LENGTH bytes of the binary representation to "buffer" w/o any allocations. */
+    void toBuffer(char * const buffer) const {
+	tag_.toBuffer(buffer);
+	StringUtil::UnsignedToDecimalDigits(field_length_, 4, buffer + TAG_LENGTH);
+	StringUtil::UnsignedToDecimalDigits(field_offset_, 5, buffer + TAG_LENGTH + 4);
+    }
+
+    /** \brief Validates and converts the field length and field offset digits of a raw directory entry.
+     *  \param raw_entry     The start of a binary MARC-21 directory entry.
+     *  \param available     How many bytes, starting at "raw_entry", may be read.  If there are more than the 12
+     *                       bytes of the entry itself, SIMD instructions will be used if available.
+     *  \param field_length  The decoded field length will be returned here.
+     *  \param field_offset  The decoded field offset will be returned here.
+     *  \return False if any of the 9 length and offset characters is not a decimal digit, else true.
+     */
+    static inline bool DecodeRawEntry(const char * const raw_entry, const size_t available,
+				      unsigned * const field_length, unsigned * const field_offset);
+
+    /** \brief Converts the binary representation of a single MARC-21 directory entry.
+     *  \param raw_entry  Must be exactly DIRECTORY_ENTRY_LENGTH bytes long.
+     *  \return False if "raw_entry" is malformed and then "err_msg" will be set if it is not NULL, else true.
+     */
+    static bool ParseDirEntry(const std::string &raw_entry, DirectoryEntry * const entry,
+			      std::string * const err_msg = NULL);
+
     /** \brief Parses a binary MARC-21 directory blob.
      *
      *  \param entries_string A binary blob that represents the directory of a MARC-21 record.
@@ -76,8 +106,53 @@ public:
      *  \return True if no parse errors occurred, else false.
      */
     static bool ParseDirEntries(const std::string &entries_string, std::vector<DirectoryEntry> * const entries,
-				std::string * const err_msg = NULL);
+				std::string * const err_msg = NULL)
+	{ return ParseDirEntries(entries_string.data(), entries_string.size(), entries, err_msg); }
+
+    /** \brief Parses a binary MARC-21 directory blob in a single pass w/o copying any of its entries.
+     *
+     *  \param entries_start  The start of a binary blob that represents the directory of a MARC-21 record.
+     *  \param entries_size   The length of the blob including the trailing field terminator.
+     *  \param entries        Return value containing the parsed DirectoryEntry's.
+     *  \param err_msg        If not NULL, error messages will be returned here.
+     *
+     *  \return True if no parse errors occurred, else false.
+     */
+    static bool ParseDirEntries(const char * const entries_start, const size_t entries_size,
+				std::vector<DirectoryEntry> * const entries, std::string * const err_msg = NULL);
 };
 
 
+bool DirectoryEntry::DecodeRawEntry(const char * const raw_entry, const size_t available,
+				    unsigned * const field_length, unsigned * const field_offset)
+{
+#ifdef __SSE2__
+    // The 9 digits start at offset 3 and we load 16 bytes from there.
+    if (available >= TAG_LENGTH + sizeof(__m128i)) {
+	const __m128i digits(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw_entry + TAG_LENGTH)),
+					  _mm_set1_epi8('0')));
+	const __m128i nine(_mm_set1_epi8(9));
+	if ((_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine)) & 0x1FF) != 0x1FF)
+	    return false;
+
+	// Widen to 16 bits and multiply-add adjacent pairs:
+	// 32-bit lanes: [1000*d0 + 100*d1, 10*d2 + d3, 10000*d4 + 1000*d5, 100*d6 + 10*d7] and [d8, 0, 0, 0].
+	const __m128i zero(_mm_setzero_si128());
+	const __m128i low_products(_mm_madd_epi16(_mm_unpacklo_epi8(digits, zero),
+						  _mm_setr_epi16(1000, 100, 10, 1, 10000, 1000, 100, 10)));
+	const __m128i high_products(_mm_madd_epi16(_mm_unpackhi_epi8(digits, zero),
+						   _mm_setr_epi16(1, 0, 0, 0, 0, 0, 0, 0)));
+	const __m128i sums(_mm_add_epi32(low_products, _mm_srli_si128(low_products, 4)));
+	*field_length = _mm_cvtsi128_si32(sums);
+	*field_offset = _mm_cvtsi128_si32(_mm_srli_si128(sums, 8)) + _mm_cvtsi128_si32(high_products);
+	return true;
+    }
+#else
+    (void)available;
+#endif
+    return StringUtil::DecimalDigitsToUnsigned(raw_entry + TAG_LENGTH, 4, field_length)
+	   and StringUtil::DecimalDigitsToUnsigned(raw_entry + TAG_LENGTH + 4, 5, field_offset);
+}
+
+
 #endif // ifndef DIRECTORY_ENTRY_H
@@ -0,0 +1,219 @@
+/** \file   Extractor.h
+ *  \brief  Field and subfield extractors that are specialised at compile time.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EXTRACTOR_H
+#define EXTRACTOR_H
+
+
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include "MarcTag.h"
+#include "RecordView.h"
+#include "Slice.h"
+#include "SubfieldView.h"
+
+
+/** \struct Tag
+ *  \brief A field tag as a type, e.g. Tag<'2','4','5'>.  VALUE is the same integer as MarcTag::toInt() returns.
+ */
+template<char FIRST, char SECOND, char THIRD> struct Tag {
+    static constexpr uint32_t VALUE = (static_cast<uint32_t>(static_cast<unsigned char>(FIRST)) << 16u)
+				      | (static_cast<uint32_t>(static_cast<unsigned char>(SECOND)) << 8u)
+				      | static_cast<uint32_t>(static_cast<unsigned char>(THIRD));
+    static constexpr bool IS_CONTROL_FIELD_TAG = FIRST == '0' and SECOND == '0';
+
+    static bool Matches(const MarcTag &tag) { return tag.toInt() == VALUE; }
+};
+
+
+template<char FIRST, char SECOND, char THIRD> constexpr uint32_t Tag<FIRST, SECOND, THIRD>::VALUE;
+template<char FIRST, char SECOND, char THIRD> constexpr bool Tag<FIRST, SECOND, THIRD>::IS_CONTROL_FIELD_TAG;
+
+
+/** \struct Codes
+ *  \brief A set of subfield codes as a type, e.g. Codes<'a','b'>.
+ *
+ *  The set is a 128-bit mask that gets computed at compile time, so that a membership test is a shift and an AND.
+ *  An empty set, i.e. Codes<>, selects the entire field.
+ */
+template<char... CODES> struct Codes;
+
+
+template<> struct Codes<> {
+    static constexpr uint64_t LOW_BITS = 0;  // Codes 0x00-0x3F.
+    static constexpr uint64_t HIGH_BITS = 0; // Codes 0x40-0x7F.
+    static constexpr bool EMPTY = true;
+};
+
+
+template<char CODE, char... MORE_CODES> struct Codes<CODE, MORE_CODES...> {
+    static_assert(static_cast<unsigned char>(CODE) < 0x80u, "subfield codes must be ASCII characters!");
+
+    static constexpr uint64_t LOW_BITS = (CODE < 64 ? uint64_t(1) << (CODE & 63) : 0) | Codes<MORE_CODES...>::LOW_BITS;
+    static constexpr uint64_t HIGH_BITS = (CODE >= 64 ? uint64_t(1) << (CODE & 63) : 0)
+					  | Codes<MORE_CODES...>::HIGH_BITS;
+    static constexpr bool EMPTY = false;
+
+    static bool Contains(const char subfield_code) {
+	const unsigned char code(static_cast<unsigned char>(subfield_code));
+	return (code < 64u) ? ((LOW_BITS >> code) & 1u) != 0
+			    : code < 128u and ((HIGH_BITS >> (code - 64u)) & 1u) != 0;
+    }
+};
+
+
+template<char CODE, char... MORE_CODES> constexpr uint64_t Codes<CODE, MORE_CODES...>::LOW_BITS;
+template<char CODE, char... MORE_CODES> constexpr uint64_t Codes<CODE, MORE_CODES...>::HIGH_BITS;
+template<char CODE, char... MORE_CODES> constexpr bool Codes<CODE, MORE_CODES...>::EMPTY;
+
+
+/** \class Extractor
+ *  \brief Extracts the subfields w/ one of the codes in "CodesType" from the fields w/ the tag "TagType".
+ *
+ *  This is the compile-time counterpart of a field reference like "245ab": the tag test becomes a comparison against
+ *  an integer constant and the subfield code test a lookup in a constant bitmask.  Unlike marc_grep, which reports
+ *  the subfields of one code after the other, the values are reported in field order, which only takes a single
+ *  scan of each field.  All occurrences of repeatable fields are processed.
+ *
+ *  The callbacks are invoked as callback(subfield_code, value).  If "CodesType" is empty, the entire field is
+ *  reported w/ a subfield code of '\0'.
+ */
+template<typename TagType, typename CodesType = Codes<>> class Extractor {
+    static_assert(not TagType::IS_CONTROL_FIELD_TAG or CodesType::EMPTY, "control fields have no subfields!");
+public:
+    typedef TagType ExtractorTag;
+    typedef CodesType ExtractorCodes;
+
+    static bool Matches(const MarcTag &tag) { return TagType::Matches(tag); }
+
+    /** \param field  The contents of a field w/ our tag.
+     *  \return The number of values that have been reported.
+     */
+    template<typename Callback> static unsigned ExtractFromField(const Slice &field, Callback &callback)
+	{ return ExtractFromField(field, callback, std::integral_constant<bool, CodesType::EMPTY>()); }
+
+    /** \return The number of values that have been reported. */
+    template<typename Callback> static unsigned Extract(const RecordView &record, Callback callback) {
+	unsigned value_count(0);
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    if (Matches(record.getTag(field_index)))
+		value_count += ExtractFromField(record.getField(field_index), callback);
+	}
+
+	return value_count;
+    }
+private:
+    template<typename Callback> static unsigned ExtractFromField(const Slice &field, Callback &callback,
+								 std::true_type /* entire field */)
+    {
+	callback('\0', field);
+	return 1;
+    }
+
+    template<typename Callback> static unsigned ExtractFromField(const Slice &field, Callback &callback,
+								 std::false_type /* entire field */)
+    {
+	unsigned value_count(0);
+	const SubfieldView subfields(field);
+	for (auto code_and_value(subfields.begin()); code_and_value != subfields.end(); ++code_and_value) {
+	    if (CodesType::Contains(code_and_value->first)) {
+		callback(code_and_value->first, code_and_value->second);
+		++value_count;
+	    }
+	}
+
+	return value_count;
+    }
+};
+
+
+namespace ExtractorSetHelpers {
+
+
+/** Hands a field to the extractors, starting w/ the one numbered "EXTRACTOR_NO", whose tags match. */
+template<unsigned EXTRACTOR_NO, typename... Extractors> struct Dispatcher;
+
+
+template<unsigned EXTRACTOR_NO> struct Dispatcher<EXTRACTOR_NO> {
+    static bool Matches(const MarcTag &/* tag */) { return false; }
+
+    template<typename Callback> static unsigned Dispatch(const MarcTag &/* tag */, const Slice &/* field */,
+							 Callback &/* callback */)
+	{ return 0; }
+};
+
+
+template<unsigned EXTRACTOR_NO, typename FirstExtractor, typename... MoreExtractors>
+    struct Dispatcher<EXTRACTOR_NO, FirstExtractor, MoreExtractors...>
+{
+    typedef Dispatcher<EXTRACTOR_NO + 1, MoreExtractors...> Next;
+
+    static bool Matches(const MarcTag &tag) { return FirstExtractor::Matches(tag) or Next::Matches(tag); }
+
+    template<typename Callback> static unsigned Dispatch(const MarcTag &tag, const Slice &field,
+							 Callback &callback)
+    {
+	unsigned value_count(0);
+	if (FirstExtractor::Matches(tag)) {
+	    auto numbered_callback([&callback](const char subfield_code, const Slice &value) {
+		callback(EXTRACTOR_NO, subfield_code, value);
+	    });
+	    value_count = FirstExtractor::ExtractFromField(field, numbered_callback);
+	}
+
+	return value_count + Next::Dispatch(tag, field, callback);
+    }
+};
+
+
+} // namespace ExtractorSetHelpers
+
+
+/** \class ExtractorSet
+ *  \brief Runs several Extractor's in a single pass over a record.
+ *
+ *  Each directory entry is read once and the tag is compared against all of the extractors' tags w/ an unrolled
+ *  chain of integer comparisons.  The callback is invoked as callback(extractor_no, subfield_code, value) where
+ *  "extractor_no" is the position of the extractor in "Extractors", starting at 0.  The values are reported in
+ *  field order and, for fields that are of interest to several extractors, in the order of the extractors.
+ */
+template<typename... Extractors> class ExtractorSet {
+    typedef ExtractorSetHelpers::Dispatcher<0, Extractors...> FirstDispatcher;
+public:
+    static const unsigned SIZE = sizeof...(Extractors);
+
+    /** \return The number of values that have been reported. */
+    template<typename Callback> static unsigned Extract(const RecordView &record, Callback callback) {
+	unsigned value_count(0);
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    const MarcTag tag(record.getTag(field_index));
+	    if (FirstDispatcher::Matches(tag))
+		value_count += FirstDispatcher::Dispatch(tag, record.getField(field_index), callback);
+	}
+
+	return value_count;
+    }
+};
+
+
+template<typename... Extractors> const unsigned ExtractorSet<Extractors...>::SIZE;
+
+
+#endif // ifndef EXTRACTOR_H
@@ -1,21 +1,21 @@
 #include "Leader.h"
-#include <cstdio>
+#include <cstring>
 #include "StringUtil.h"
 
 
-const size_t Leader::LEADER_LENGTH(24);
+const size_t Leader::LEADER_LENGTH;
 
 
-bool Leader::ParseLeader(const std::string &leader_string, Leader ** const leader, std::string * const err_msg) {
-    if (err_msg != NULL)
-	err_msg->clear();
+// Record length and base address of data get filled in when a record is composed.
+static const char DEFAULT_LEADER[] = "00000nam a2200000   4500";
 
-    if (leader == NULL) {
-	if (err_msg != NULL)
-	    *err_msg = "\"leader\" argument to Leader::ParseLeader must point to something!";
-	return false;
-    }
 
+Leader::Leader(): record_length_(0), base_address_of_data_(0) {
+    std::memcpy(raw_leader_, DEFAULT_LEADER, LEADER_LENGTH);
+}
+
+
+bool Leader::ParseLeader(const std::string &leader_string, Leader * const leader, std::string * const err_msg) {
     if (leader_string.size() != LEADER_LENGTH) {
 	if (err_msg != NULL)
 	    *err_msg = "Leader length must be " + std::to_string(LEADER_LENGTH) +
@@ -23,15 +23,29 @@ bool Leader::ParseLeader(const std::string &leader_string, Leader ** const leade
 	return false;
     }
 
+    return ParseLeader(leader_string.data(), leader, err_msg);
+}
+
+
+bool Leader::ParseLeader(const char * const leader_start, Leader * const leader, std::string * const err_msg) {
+    if (err_msg != NULL)
+	err_msg->clear();
+
+    if (leader == NULL) {
+	if (err_msg != NULL)
+	    *err_msg = "\"leader\" argument to Leader::ParseLeader must point to something!";
+	return false;
+    }
+
     unsigned record_length;
-    if (std::sscanf(leader_string.substr(0, 5).data(), "%5u", &record_length) != 1) {
+    if (not StringUtil::DecimalDigitsToUnsigned(leader_start, 5, &record_length)) {
 	if (err_msg != NULL)
 	    *err_msg = "Can't parse record length!";
 	return false;
     }
 
     unsigned base_address_of_data;
-    if (std::sscanf(leader_string.substr(12, 5).data(), "%5u", &base_address_of_data) != 1) {
+    if (not StringUtil::DecimalDigitsToUnsigned(leader_start + 12, 5, &base_address_of_data)) {
 	if (err_msg != NULL)
 	    *err_msg = "Can't parse base address of data!";
 	return false;
@@ -42,27 +56,29 @@ bool Leader::ParseLeader(const std::string &leader_string, Leader ** const leade
     //
 
     // Check indicator count:
-    if (leader_string[10] != '2') {
+    if (leader_start[10] != '2') {
 	if (err_msg != NULL)
 	    *err_msg = "Invalid indicator count!";
 	return false;
     }
   
     // Check subfield code length:
-    if (leader_string[11] != '2') {
+    if (leader_start[11] != '2') {
 	if (err_msg != NULL)
 	    *err_msg = "Invalid subfield code length!";
 	return false;
     }
 
     // Check entry map:
-    if (leader_string.substr(20, 4) != "4500") {
+    if (std::memcmp(leader_start + 20, "4500", 4) != 0) {
 	if (err_msg != NULL)
 	    *err_msg = "Invalid entry map!";
 	return false;
     }
 
-    *leader = new Leader(leader_string, record_length, base_address_of_data);
+    std::memcpy(leader->raw_leader_, leader_start, LEADER_LENGTH);
+    leader->record_length_        = record_length;
+    leader->base_address_of_data_ = base_address_of_data;
     return true;
 }
 
@@ -72,20 +88,20 @@ bool Leader::setRecordLength(const unsigned new_record_length, std::string * con
 	err_msg->clear();
 
     if (new_record_length > 99999) {
-	*err_msg = "new record length (" + std::to_string(new_record_length)
+	if (err_msg != NULL)
+	    *err_msg = "new record length (" + std::to_string(new_record_length)
                    + ") exceeds valid maximum (99999)!";
 	return false;
     }
 
     record_length_ = new_record_length;
-    raw_leader_ = StringUtil::PadLeading(std::to_string(record_length_), 5, '0') + raw_leader_.substr(5);
+    StringUtil::UnsignedToDecimalDigits(record_length_, 5, raw_leader_);
     return true;
 }
 
 
 void Leader::setBaseAddressOfData(const unsigned new_base_address_of_data) {
     base_address_of_data_ = new_base_address_of_data;
-    raw_leader_ = raw_leader_.substr(0, 12) + StringUtil::PadLeading(std::to_string(base_address_of_data_), 5, '0')
-                  + raw_leader_.substr(17);
+    StringUtil::UnsignedToDecimalDigits(base_address_of_data_, 5, raw_leader_ + 12);
 }
 
@@ -22,31 +22,37 @@
 
 
 #include <string>
+#include <cstring>
 
 
 /** \class Leader
  *  \brief Encapsulates a MARC-21 record leader.
+ *  \note  A Leader is a small value type w/o any heap allocations and can be copied and returned by value.
  */
 class Leader {
 public:
-    static const size_t LEADER_LENGTH;
+    static const size_t LEADER_LENGTH = 24;
 private:
-    std::string raw_leader_;
+    char raw_leader_[LEADER_LENGTH];
     unsigned record_length_;
     unsigned base_address_of_data_;
-
-    /** Constructs a leader from its constituent parts. */
-    Leader(const std::string &raw_leader, unsigned record_length, unsigned base_address_of_data)
-	: raw_leader_(raw_leader), record_length_(record_length), base_address_of_data_(base_address_of_data) {}
 public:
+    /** Constructs a leader for an empty bibliographic record w/ a record length and base address of data of 0. */
+    Leader();
+
     /** \brief Creates a "Leader" instance from a binary MARC-21 leader blob.
      *  \param leader_string  The binary blob that should be a leader from a MARC-21 record.
-     *  \param leader         Must be the address of a "Leader*" (pointer-to-Leader). ParseLeader will allocate a
-     *                        Leader instance and set "*leader" to point to this newly initialised object.
+     *  \param leader         Will be overwritten w/ the parsed leader if the parse succeeded.
      *  \param err_msg        If not NULL and a parse error occurred an informational text will be returned here.
      *  \return True if the parse succeeded, else false.
      */
-    static bool ParseLeader(const std::string &leader_string, Leader ** const leader,
+    static bool ParseLeader(const std::string &leader_string, Leader * const leader,
+			    std::string * const err_msg = NULL);
+
+    /** \brief Like the above but parses the LEADER_LENGTH bytes starting at "leader_start" w/o copying them first,
+     *         e.g. directly from a read buffer or a memory-mapped file.
+     */
+    static bool ParseLeader(const char * const leader_start, Leader * const leader,
 			    std::string * const err_msg = NULL);
 
     /** \brief Index operator returning the n'th byte of the leader.
@@ -59,14 +65,18 @@ public:
 
     char getRecordStatus() const { return raw_leader_[5]; }
     char getRecordType() const { return raw_leader_[6]; }
-    char getCharacterCodingScheme() const { return raw_leader_[9]; }
-    std::string getImplementationDefined1() const { return raw_leader_.substr(7, 2); }
-    std::string getImplementationDefined2() const { return raw_leader_.substr(17, 3); }
+    char getCharacterCodingScheme() const { return raw_leader_[9]; } // ' ' for MARC-8, 'a' for UTF-8.
+    void setCharacterCodingScheme(const char new_scheme) { raw_leader_[9] = new_scheme; }
+    std::string getImplementationDefined1() const { return std::string(raw_leader_ + 7, 2); }
+    std::string getImplementationDefined2() const { return std::string(raw_leader_ + 17, 3); }
     unsigned getBaseAddressOfData() const { return base_address_of_data_; }
     void setBaseAddressOfData(const unsigned new_base_address_of_data);
 
     /** \return A binary representation of the leader.  Can be used to construct a MARC-21 record. */ 
-    std::string toString() const { return raw_leader_; }
+    std::string toString() const { return std::string(raw_leader_, LEADER_LENGTH); }
+
+    /** Writes the LEADER_LENGTH bytes of the binary representation to "buffer" w/o any allocations. */
+    void toBuffer(char * const buffer) const { std::memcpy(buffer, raw_leader_, LEADER_LENGTH); }
 };
 
 
@@ -0,0 +1,541 @@
+/** \file   Marc8.cc
+ *  \brief  Implementation of the MARC-8 to UTF-8 conversion.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Marc8.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+
+namespace Marc8 {
+
+
+namespace {
+
+
+const unsigned char ESCAPE(0x1B);
+const uint32_t REPLACEMENT_CHARACTER(0xFFFD);
+
+
+// The tables below are indexed by the low 7 bits of a byte minus 0x20, so that the same table serves a set whether
+// it has been designated as G0 (0x21-0x7E) or as G1 (0xA1-0xFE).  0 marks undefined characters.
+
+
+/** Extended Latin (ANSEL). */
+const uint16_t ANSEL[96] = {
+    0x0000, 0x0141, 0x00D8, 0x0110, 0x00DE, 0x00C6, 0x0152, 0x02B9, // 0xA0
+    0x00B7, 0x266D, 0x00AE, 0x00B1, 0x01A0, 0x01AF, 0x02BC, 0x0000, // 0xA8
+    0x02BB, 0x0142, 0x00F8, 0x0111, 0x00FE, 0x00E6, 0x0153, 0x02BA, // 0xB0
+    0x0131, 0x00A3, 0x00F0, 0x0000, 0x01A1, 0x01B0, 0x0000, 0x0000, // 0xB8
+    0x00B0, 0x2113, 0x2117, 0x00A9, 0x266F, 0x00BF, 0x00A1, 0x00DF, // 0xC0
+    0x20AC, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xC8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xD0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xD8
+    0x0309, 0x0300, 0x0301, 0x0302, 0x0303, 0x0304, 0x0306, 0x0307, // 0xE0, combining from here on
+    0x0308, 0x030C, 0x030A, 0xFE20, 0xFE21, 0x0315, 0x030B, 0x0310, // 0xE8
+    0x0327, 0x0328, 0x0323, 0x0324, 0x0325, 0x0333, 0x0332, 0x0326, // 0xF0
+    0x031C, 0x032E, 0xFE22, 0xFE23, 0x0000, 0x0000, 0x0313, 0x0000, // 0xF8
+};
+
+
+/** Greek symbols, designated w/ ESC g. */
+const uint16_t GREEK_SYMBOLS[96] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0x03B1, 0x03B2, 0x03B3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+
+/** Subscripts, designated w/ ESC b. */
+const uint16_t SUBSCRIPTS[96] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0x208D, 0x208E, 0, 0x208A, 0, 0x208B, 0, 0,                         // 0x20
+    0x2080, 0x2081, 0x2082, 0x2083, 0x2084, 0x2085, 0x2086, 0x2087, 0x2088, 0x2089, 0, 0, 0, 0, 0, 0, // 0x30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+
+/** Superscripts, designated w/ ESC p. */
+const uint16_t SUPERSCRIPTS[96] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0x207D, 0x207E, 0, 0x207A, 0, 0x207B, 0, 0,                         // 0x20
+    0x2070, 0x00B9, 0x00B2, 0x00B3, 0x2074, 0x2075, 0x2076, 0x2077, 0x2078, 0x2079, 0, 0, 0, 0, 0, 0, // 0x30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+
+/** Basic Hebrew, designated w/ final character 2. */
+const uint16_t BASIC_HEBREW[96] = {
+    0x0000, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, // 0x20
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x05BE, 0x002E, 0x002F, // 0x28
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, // 0x30
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F, // 0x38
+    0x05B7, 0x05B8, 0x05B6, 0x05B5, 0x05B4, 0x05B9, 0x05BB, 0x05B0, // 0x40, the points up to 0x4E are combining
+    0x05B2, 0x05B3, 0x05B1, 0x05BC, 0x05BF, 0x05C1, 0xFB1E, 0x0000, // 0x48
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0x50
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0x58
+    0x05D0, 0x05D1, 0x05D2, 0x05D3, 0x05D4, 0x05D5, 0x05D6, 0x05D7, // 0x60
+    0x05D8, 0x05D9, 0x05DA, 0x05DB, 0x05DC, 0x05DD, 0x05DE, 0x05DF, // 0x68
+    0x05E0, 0x05E1, 0x05E2, 0x05E3, 0x05E4, 0x05E5, 0x05E6, 0x05E7, // 0x70
+    0x05E8, 0x05E9, 0x05EA, 0x05F0, 0x05F1, 0x05F2, 0x0000, 0x0000, // 0x78
+};
+
+
+/** Basic Arabic, designated w/ final character 3. */
+const uint16_t BASIC_ARABIC[96] = {
+    0x0000, 0x0021, 0x0022, 0x0023, 0x0024, 0x066A, 0x0026, 0x0027, // 0x20
+    0x0028, 0x0029, 0x066D, 0x002B, 0x060C, 0x002D, 0x002E, 0x002F, // 0x28
+    0x0660, 0x0661, 0x0662, 0x0663, 0x0664, 0x0665, 0x0666, 0x0667, // 0x30
+    0x0668, 0x0669, 0x003A, 0x061B, 0x003C, 0x003D, 0x003E, 0x061F, // 0x38
+    0x0000, 0x0621, 0x0622, 0x0623, 0x0624, 0x0625, 0x0626, 0x0627, // 0x40
+    0x0628, 0x0629, 0x062A, 0x062B, 0x062C, 0x062D, 0x062E, 0x062F, // 0x48
+    0x0630, 0x0631, 0x0632, 0x0633, 0x0634, 0x0635, 0x0636, 0x0637, // 0x50
+    0x0638, 0x0639, 0x063A, 0x005B, 0x0000, 0x005D, 0x0000, 0x0000, // 0x58
+    0x0640, 0x0641, 0x0642, 0x0643, 0x0644, 0x0645, 0x0646, 0x0647, // 0x60
+    0x0648, 0x0649, 0x064A, 0x064B, 0x064C, 0x064D, 0x064E, 0x064F, // 0x68, 0x6B-0x72 are combining
+    0x0650, 0x0651, 0x0652, 0x0671, 0x0670, 0x0000, 0x0000, 0x0000, // 0x70
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0x78
+};
+
+
+/** Extended Arabic, designated w/ final character 4. */
+const uint16_t EXTENDED_ARABIC[96] = {
+    0x0000, 0x06FD, 0x0672, 0x0673, 0x0679, 0x067A, 0x067B, 0x067C, // 0xA0
+    0x067D, 0x067E, 0x067F, 0x0680, 0x0681, 0x0682, 0x0683, 0x0684, // 0xA8
+    0x0685, 0x0686, 0x06BF, 0x0687, 0x0688, 0x0689, 0x068A, 0x068B, // 0xB0
+    0x068C, 0x068D, 0x068E, 0x068F, 0x0690, 0x0691, 0x0692, 0x0693, // 0xB8
+    0x0694, 0x0695, 0x0696, 0x0697, 0x0698, 0x0699, 0x069A, 0x069B, // 0xC0
+    0x069C, 0x069D, 0x069E, 0x069F, 0x06A0, 0x06A1, 0x06A2, 0x06A3, // 0xC8
+    0x06A4, 0x06A5, 0x06A6, 0x06A7, 0x06A8, 0x06A9, 0x06AA, 0x06AB, // 0xD0
+    0x06AC, 0x06AD, 0x06AE, 0x06AF, 0x06B0, 0x06B1, 0x06B2, 0x06B3, // 0xD8
+    0x06B4, 0x06B5, 0x06B6, 0x06B7, 0x06B8, 0x06B9, 0x06BA, 0x06BB, // 0xE0
+    0x06BC, 0x06BD, 0x06BE, 0x06C0, 0x06C1, 0x06C2, 0x06C3, 0x06C4, // 0xE8
+    0x06C5, 0x06C6, 0x06C7, 0x06C8, 0x06C9, 0x06CA, 0x06CB, 0x06CC, // 0xF0
+    0x06CD, 0x06CE, 0x06CF, 0x06D0, 0x06D1, 0x06D2, 0x06D3, 0x0000, // 0xF8
+};
+
+
+/** Basic Cyrillic, designated w/ final character N. */
+const uint16_t BASIC_CYRILLIC[96] = {
+    0x0000, 0x0021, 0x0022, 0x0023, 0x0024, 0x0025, 0x0026, 0x0027, // 0x20
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F, // 0x28
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, // 0x30
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F, // 0x38
+    0x044E, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433, // 0x40
+    0x0445, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, // 0x48
+    0x043F, 0x044F, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432, // 0x50
+    0x044C, 0x044B, 0x0437, 0x0448, 0x044D, 0x0449, 0x0447, 0x044A, // 0x58
+    0x042E, 0x0410, 0x0411, 0x0426, 0x0414, 0x0415, 0x0424, 0x0413, // 0x60
+    0x0425, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, // 0x68
+    0x041F, 0x042F, 0x0420, 0x0421, 0x0422, 0x0423, 0x0416, 0x0412, // 0x70
+    0x042C, 0x042B, 0x0417, 0x0428, 0x042D, 0x0429, 0x0427, 0x0000, // 0x78
+};
+
+
+/** Extended Cyrillic, designated w/ final character Q. */
+const uint16_t EXTENDED_CYRILLIC[96] = {
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xA0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xA8
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xB0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xB8
+    0x0491, 0x0452, 0x0453, 0x0454, 0x0451, 0x0455, 0x0456, 0x0457, // 0xC0
+    0x0458, 0x0459, 0x045A, 0x045B, 0x045C, 0x045E, 0x045F, 0x0000, // 0xC8
+    0x0463, 0x0473, 0x0475, 0x046B, 0x0000, 0x0000, 0x0000, 0x0000, // 0xD0
+    0x0000, 0x0000, 0x0000, 0x005B, 0x0000, 0x005D, 0x0000, 0x005F, // 0xD8
+    0x0490, 0x0402, 0x0403, 0x0404, 0x0401, 0x0405, 0x0406, 0x0407, // 0xE0
+    0x0408, 0x0409, 0x040A, 0x040B, 0x040C, 0x040E, 0x040F, 0x042A, // 0xE8
+    0x0462, 0x0472, 0x0474, 0x046A, 0x0000, 0x0000, 0x0000, 0x0000, // 0xF0
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0xF8
+};
+
+
+/** Basic Greek, designated w/ final character S. */
+const uint16_t BASIC_GREEK[96] = {
+    0x0000, 0x0300, 0x0301, 0x0308, 0x0342, 0x0313, 0x0314, 0x0345, // 0x20, 0x21-0x27 are combining
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, // 0x28
+    0x00AB, 0x00BB, 0x201C, 0x201D, 0x0374, 0x0375, 0x0000, 0x0000, // 0x30
+    0x0000, 0x0000, 0x0000, 0x0387, 0x0000, 0x0000, 0x0000, 0x037E, // 0x38
+    0x0000, 0x0391, 0x0392, 0x0000, 0x0393, 0x0394, 0x0395, 0x03DA, // 0x40
+    0x03DC, 0x0396, 0x0397, 0x0398, 0x0399, 0x039A, 0x039B, 0x039C, // 0x48
+    0x039D, 0x039E, 0x039F, 0x03A0, 0x03DE, 0x03A1, 0x03A3, 0x0000, // 0x50
+    0x03A4, 0x03A5, 0x03A6, 0x03A7, 0x03A8, 0x03A9, 0x03E0, 0x0000, // 0x58
+    0x0000, 0x03B1, 0x03B2, 0x03D0, 0x03B3, 0x03B4, 0x03B5, 0x03DB, // 0x60
+    0x03DD, 0x03B6, 0x03B7, 0x03B8, 0x03B9, 0x03BA, 0x03BB, 0x03BC, // 0x68
+    0x03BD, 0x03BE, 0x03BF, 0x03C0, 0x03DF, 0x03C1, 0x03C3, 0x03C2, // 0x70
+    0x03C4, 0x03C5, 0x03C6, 0x03C7, 0x03C8, 0x03C9, 0x03E1, 0x0000, // 0x78
+};
+
+
+/** Used for East Asian (EACC), which we recognise but can't convert. */
+const uint16_t UNSUPPORTED[96] = {};
+
+
+struct CharacterSet {
+    const uint16_t *code_points_; // NULL for ASCII, i.e. the low 7 bits are the code point.
+    unsigned bytes_per_character_;
+};
+
+
+const CharacterSet ASCII_SET             = { NULL,              1 };
+const CharacterSet ANSEL_SET             = { ANSEL,             1 };
+const CharacterSet GREEK_SYMBOLS_SET     = { GREEK_SYMBOLS,     1 };
+const CharacterSet SUBSCRIPTS_SET        = { SUBSCRIPTS,        1 };
+const CharacterSet SUPERSCRIPTS_SET      = { SUPERSCRIPTS,      1 };
+const CharacterSet BASIC_HEBREW_SET      = { BASIC_HEBREW,      1 };
+const CharacterSet BASIC_ARABIC_SET      = { BASIC_ARABIC,      1 };
+const CharacterSet EXTENDED_ARABIC_SET   = { EXTENDED_ARABIC,   1 };
+const CharacterSet BASIC_CYRILLIC_SET    = { BASIC_CYRILLIC,    1 };
+const CharacterSet EXTENDED_CYRILLIC_SET = { EXTENDED_CYRILLIC, 1 };
+const CharacterSet BASIC_GREEK_SET       = { BASIC_GREEK,       1 };
+const CharacterSet EACC_SET              = { UNSUPPORTED,       3 };
+
+
+/** \return The set w/ the final character "final_char" of a designating escape sequence or NULL if there is none. */
+const CharacterSet *FinalCharacterToSet(const char final_char, const bool multibyte) {
+    if (multibyte)
+	return final_char == '1' ? &EACC_SET : NULL;
+
+    switch (final_char) {
+    case 'B':
+	return &ASCII_SET;
+    case 'E':
+	return &ANSEL_SET;
+    case 'g':
+	return &GREEK_SYMBOLS_SET;
+    case 'b':
+	return &SUBSCRIPTS_SET;
+    case 'p':
+	return &SUPERSCRIPTS_SET;
+    case '2':
+	return &BASIC_HEBREW_SET;
+    case '3':
+	return &BASIC_ARABIC_SET;
+    case '4':
+	return &EXTENDED_ARABIC_SET;
+    case 'N':
+	return &BASIC_CYRILLIC_SET;
+    case 'Q':
+	return &EXTENDED_CYRILLIC_SET;
+    case 'S':
+	return &BASIC_GREEK_SET;
+    default:
+	return NULL;
+    }
+}
+
+
+/** \brief Interprets the escape sequence at "escape".
+ *  \return The length of the escape sequence or 0 if it is invalid or truncated.
+ */
+size_t ParseEscape(const unsigned char * const escape, const size_t available, const CharacterSet ** const g0,
+		   const CharacterSet ** const g1)
+{
+    if (available < 2)
+	return 0;
+
+    // The short form that only switches G0, e.g. for a few superscript digits.
+    switch (escape[1]) {
+    case 's':
+	*g0 = &ASCII_SET;
+	return 2;
+    case 'g':
+	*g0 = &GREEK_SYMBOLS_SET;
+	return 2;
+    case 'b':
+	*g0 = &SUBSCRIPTS_SET;
+	return 2;
+    case 'p':
+	*g0 = &SUPERSCRIPTS_SET;
+	return 2;
+    }
+
+    // The general form: ESC [$] intermediate [!] final, where "$" introduces a multibyte set and "(" and "," designate
+    // G0 and ")" and "-" designate G1.  "ESC $ final" designates a multibyte G0.
+    size_t pos(1);
+    const bool multibyte(escape[pos] == '$');
+    if (multibyte)
+	++pos;
+    bool designates_g1(false);
+    if (pos < available and (escape[pos] == '(' or escape[pos] == ','))
+	++pos;
+    else if (pos < available and (escape[pos] == ')' or escape[pos] == '-')) {
+	designates_g1 = true;
+	++pos;
+    } else if (not multibyte)
+	return 0;
+    if (pos < available and escape[pos] == '!')
+	++pos;
+    if (pos >= available)
+	return 0;
+
+    const CharacterSet * const set(FinalCharacterToSet(escape[pos], multibyte));
+    if (set == NULL)
+	return 0;
+    *(designates_g1 ? g1 : g0) = set;
+    return pos + 1;
+}
+
+
+/** \return The code point for a byte in the C1 range (0x80-0xA0) or 0 if it has no meaning in MARC-8. */
+uint32_t C1ToCodePoint(const unsigned char byte) {
+    switch (byte) {
+    case 0x88: // Non-sort begin
+	return 0x0098;
+    case 0x89: // Non-sort end
+	return 0x009C;
+    case 0x8D: // Joiner
+	return 0x200D;
+    case 0x8E: // Non-joiner
+	return 0x200C;
+    default:
+	return 0;
+    }
+}
+
+
+/** \return True for the code points of the combining characters in our tables, incl. the Hebrew and Arabic points. */
+inline bool IsCombining(const uint32_t code_point) {
+    if (code_point < 0x0300)
+	return false;
+    return code_point <= 0x036F or (code_point >= 0x05B0 and code_point <= 0x05C2 and code_point != 0x05BE)
+	   or (code_point >= 0x064B and code_point <= 0x0652) or code_point == 0x0670 or code_point == 0xFB1E
+	   or (code_point >= 0xFE20 and code_point <= 0xFE2F);
+}
+
+
+/** Writes the UTF-8 encoding of "code_point", which must be in the BMP, to "out".  \return The new end of "out". */
+inline char *AppendCodePoint(const uint32_t code_point, char *out) {
+    if (code_point < 0x80)
+	*out++ = static_cast<char>(code_point);
+    else if (code_point < 0x800) {
+	*out++ = static_cast<char>(0xC0 | (code_point >> 6));
+	*out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+	*out++ = static_cast<char>(0xE0 | (code_point >> 12));
+	*out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+	*out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+
+    return out;
+}
+
+
+#ifdef __SSE2__
+/** \return A mask w/ a bit set for each byte of "chunk" that is >= 0x80 or an escape. */
+inline unsigned StopMask(const __m128i chunk) {
+    return _mm_movemask_epi8(chunk) | _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(ESCAPE)));
+}
+#endif
+
+
+/** \brief Copies the leading run of bytes that are neither >= 0x80 nor escapes from "in" to "out".
+ *  \param out  May be overwritten beyond the end of the run but not beyond out + "size".
+ *  \return The length of the run.
+ */
+inline size_t CopyAsciiRun(const unsigned char * const in, const size_t size, char * const out) {
+    size_t length(0);
+#ifdef __SSE2__
+    if (size >= sizeof(__m128i)) {
+	for (;;) {
+	    // Rather than finishing byte by byte, the last chunk overlaps its predecessor.
+	    if (length + sizeof(__m128i) > size)
+		length = size - sizeof(__m128i);
+	    const __m128i chunk(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + length)));
+	    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + length), chunk);
+	    const unsigned stop_mask(StopMask(chunk));
+	    if (stop_mask != 0)
+		return length + __builtin_ctz(stop_mask);
+	    length += sizeof(__m128i);
+	    if (length == size)
+		return size;
+	}
+    }
+#endif
+    while (length < size and in[length] < 0x80 and in[length] != ESCAPE) {
+	out[length] = in[length];
+	++length;
+    }
+
+    return length;
+}
+
+
+/** Scans like CopyAsciiRun() but w/o copying anything. */
+inline size_t AsciiRunLength(const unsigned char * const in, const size_t size) {
+    size_t length(0);
+#ifdef __SSE2__
+    if (size >= sizeof(__m128i)) {
+	for (;;) {
+	    if (length + sizeof(__m128i) > size)
+		length = size - sizeof(__m128i);
+	    const unsigned stop_mask(StopMask(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + length))));
+	    if (stop_mask != 0)
+		return length + __builtin_ctz(stop_mask);
+	    length += sizeof(__m128i);
+	    if (length == size)
+		return size;
+	}
+    }
+#endif
+    while (length < size and in[length] < 0x80 and in[length] != ESCAPE)
+	++length;
+
+    return length;
+}
+
+
+} // unnamed namespace
+
+
+bool NeedsConversion(const char * const marc8, const size_t size) {
+    return AsciiRunLength(reinterpret_cast<const unsigned char *>(marc8), size) != size;
+}
+
+
+size_t ToUtf8(const char * const marc8, const size_t size, char * const utf8, size_t * const replacement_count) {
+    const CharacterSet *g0(&ASCII_SET), *g1(&ANSEL_SET);
+
+    // Combining diacritics precede their base character in MARC-8 and are held back until we have emitted it.
+    char pending_diacritics[8 * MAX_EXPANSION];
+    size_t pending_size(0);
+
+    size_t replacements(0);
+    const unsigned char *in(reinterpret_cast<const unsigned char *>(marc8));
+    const unsigned char * const end(in + size);
+    char *out(utf8);
+    while (in != end) {
+	// Since every byte may expand to MAX_EXPANSION bytes, "out" always has at least as much room as is left of
+	// the input.
+	if (g0 == &ASCII_SET and pending_size == 0) {
+	    const size_t run_length(CopyAsciiRun(in, end - in, out));
+	    in  += run_length;
+	    out += run_length;
+	    if (in == end)
+		break;
+	}
+
+	const unsigned char byte(*in);
+	if (byte == ESCAPE) {
+	    const size_t escape_length(ParseEscape(in, end - in, &g0, &g1));
+	    if (escape_length == 0) {
+		out = AppendCodePoint(REPLACEMENT_CHARACTER, out);
+		++replacements;
+		++in;
+	    } else
+		in += escape_length;
+	    continue;
+	}
+
+	uint32_t code_point;
+	if (byte <= 0x20 or byte == 0x7F) { // Controls, incl. the subfield delimiter, and the space are always ASCII.
+	    code_point = byte;
+	    ++in;
+	} else if (byte < 0x80 or (byte > 0xA0 and byte < 0xFF)) {
+	    const CharacterSet &set(byte < 0x80 ? *g0 : *g1);
+	    if (set.bytes_per_character_ > 1) {
+		// Never swallow a delimiter or an escape, even if the character is truncated.
+		size_t character_length(1);
+		while (character_length < set.bytes_per_character_ and in + character_length != end
+		       and in[character_length] > 0x20)
+		    ++character_length;
+		in += character_length;
+		code_point = 0;
+	    } else {
+		code_point = (set.code_points_ == NULL) ? (byte & 0x7Fu) : set.code_points_[(byte & 0x7Fu) - 0x20];
+		++in;
+	    }
+	} else {
+	    code_point = C1ToCodePoint(byte);
+	    ++in;
+	}
+
+	if (code_point == 0) {
+	    code_point = REPLACEMENT_CHARACTER;
+	    ++replacements;
+	}
+
+	if (IsCombining(code_point)) {
+	    if (pending_size + MAX_EXPANSION > sizeof pending_diacritics) { // Pathological, don't bother reordering.
+		out = std::copy(pending_diacritics, pending_diacritics + pending_size, out);
+		pending_size = 0;
+	    }
+	    pending_size = AppendCodePoint(code_point, pending_diacritics + pending_size) - pending_diacritics;
+	} else if (code_point < 0x20) {
+	    // Diacritics w/o a base character in their subfield end up in front of the delimiter.
+	    out = std::copy(pending_diacritics, pending_diacritics + pending_size, out);
+	    pending_size = 0;
+	    *out++ = static_cast<char>(code_point);
+	} else {
+	    out = AppendCodePoint(code_point, out);
+	    out = std::copy(pending_diacritics, pending_diacritics + pending_size, out);
+	    pending_size = 0;
+	}
+    }
+    out = std::copy(pending_diacritics, pending_diacritics + pending_size, out);
+
+    if (replacement_count != NULL)
+	*replacement_count += replacements;
+    return out - utf8;
+}
+
+
+size_t ToUtf8(const Slice &marc8, std::string * const utf8) {
+    utf8->resize(MAX_EXPANSION * marc8.size());
+    size_t replacement_count(0);
+    utf8->resize(ToUtf8(marc8.data(), marc8.size(), &(*utf8)[0], &replacement_count));
+    return replacement_count;
+}
+
+
+size_t ConvertRecord(const RecordView &record, MarcRecord * const converted) {
+    converted->load(record);
+    converted->setLeaderByte(9, 'a');
+
+    size_t replacement_count(0);
+    for (size_t field_index(0); field_index < converted->getNumberOfFields(); ++field_index) {
+	const Slice field(converted->getField(field_index));
+	const size_t ascii_prefix_length(AsciiRunLength(reinterpret_cast<const unsigned char *>(field.data()),
+							field.size()));
+	if (ascii_prefix_length == field.size())
+	    continue;
+
+	// The prefix leaves the conversion in its initial state, so there is no need to scan it again.
+	char * const utf8(converted->getArena()->allocateArray<char>(MAX_EXPANSION * field.size()));
+	std::memcpy(utf8, field.data(), ascii_prefix_length);
+	const size_t utf8_length(ascii_prefix_length
+				 + ToUtf8(field.data() + ascii_prefix_length, field.size() - ascii_prefix_length,
+					  utf8 + ascii_prefix_length, &replacement_count));
+	converted->setField(field_index, Slice(utf8, utf8_length));
+    }
+
+    return replacement_count;
+}
+
+
+} // namespace Marc8
@@ -0,0 +1,81 @@
+/** \file   Marc8.h
+ *  \brief  Conversion of MARC-8 encoded data and records to UTF-8.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC8_H
+#define MARC8_H
+
+
+#include <string>
+#include <cstddef>
+#include "MarcRecord.h"
+#include "RecordView.h"
+#include "Slice.h"
+
+
+/** \namespace Marc8
+ *  \brief Converts from MARC-8, the legacy character encoding of MARC-21 records w/ a blank in leader/09.
+ *
+ *  Supported are the default sets, i.e. Basic Latin (ASCII) and Extended Latin (ANSEL), the Greek symbol,
+ *  subscript and superscript sets and the basic and extended Hebrew, Arabic, Cyrillic and Greek sets.  Escape
+ *  sequences that designate any of these as G0 or G1 are honoured.  East Asian (EACC) is recognised so that the right
+ *  number of bytes gets consumed but each of its characters is replaced w/ U+FFFD, as are undefined characters.
+ *  MARC-8 places combining diacritics before the base character while Unicode places them after it, so they are
+ *  reordered.  The output is in decomposed form, i.e. no Unicode normalisation takes place.
+ */
+namespace Marc8 {
+
+
+/** A single MARC-8 byte never becomes more than this many UTF-8 bytes. */
+const size_t MAX_EXPANSION(3);
+
+
+/** \return True if "marc8" contains a byte >= 0x80 or an escape, i.e. if its MARC-8 and UTF-8 encodings differ. */
+bool NeedsConversion(const char * const marc8, const size_t size);
+
+
+/** \brief Converts one field from MARC-8 to UTF-8.
+ *  \param utf8  Must have room for MAX_EXPANSION * "size" bytes.
+ *  \param replacement_count  If not NULL, the number of characters that were replaced by U+FFFD will be added here.
+ *  \return The number of bytes written to "utf8".
+ *  \note  Each call starts out w/ ASCII as G0 and ANSEL as G1, as required at the start of each field.  Subfield
+ *         delimiters are copied, so a data field can be converted as a whole.
+ */
+size_t ToUtf8(const char * const marc8, const size_t size, char * const utf8, size_t * const replacement_count = NULL);
+
+
+/** Like the above but replaces the contents of "utf8". */
+size_t ToUtf8(const Slice &marc8, std::string * const utf8);
+
+
+/** \brief Loads "record" into "converted" w/ all of its fields converted to UTF-8 and leader/09 set to 'a'.
+ *
+ *  Fields that don't need any conversion are not copied.  The converted fields are allocated in the arena of
+ *  "converted".  The record length, base address of data and the directory are recomputed when "converted" is
+ *  written, e.g. w/ MarcWriter::write(), which also rejects fields or records that have become too long.
+ *
+ *  \note  Leader/09 is not checked, i.e. only pass records for which Leader::getCharacterCodingScheme() is ' '.
+ *  \return The number of characters that were replaced by U+FFFD.
+ */
+size_t ConvertRecord(const RecordView &record, MarcRecord * const converted);
+
+
+} // namespace Marc8
+
+
+#endif // ifndef MARC8_H
@@ -0,0 +1,142 @@
+/** \file   MarcFileReader.cc
+ *  \brief  Implementation of the MarcFileReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcFileReader.h"
+#include <algorithm>
+#include "Stats.h"
+
+
+MarcFileReader *MarcFileReader::MarcFileReaderFactory(const std::string &input_filename,
+						      std::string * const err_msg)
+{
+    MemoryMappedFile * const input(MemoryMappedFile::MemoryMappedFileFactory(input_filename, err_msg));
+    if (input == NULL)
+	return NULL;
+
+    return new MarcFileReader(input);
+}
+
+
+bool MarcFileReader::getNextRecord(RecordView * const record_view, std::string * const err_msg) {
+    if (reject_log_ != NULL or validate_utf8_)
+	return MarcReader::getNextRecord(record_view, err_msg);
+
+    err_msg->clear();
+    if (offset_ >= input_->getSize())
+	return false;
+
+    if (not RecordView::ParseRecord(input_->getData() + offset_, input_->getSize() - offset_, record_view,
+				    err_msg))
+    {
+	*err_msg += " (Record starting at file offset " + std::to_string(offset_) + ".)";
+	return false;
+    }
+
+    offset_ += record_view->getRecordLength();
+    Stats::CountRawRecord(record_view->getRecordLength());
+    return true;
+}
+
+
+const char *MarcFileReader::peek(const size_t /* min_size */, size_t * const available,
+				 std::string * const /* err_msg */)
+{
+    // The entire rest of the file is always available.
+    *available = offset_ < input_->getSize() ? input_->getSize() - offset_ : 0;
+    return input_->getData() + offset_;
+}
+
+
+bool MarcFileReader::getRecordAt(const size_t offset, RecordView * const record_view, std::string * const err_msg) const
+{
+    err_msg->clear();
+    if (offset >= input_->getSize()) {
+	*err_msg = "record offset " + std::to_string(offset) + " is beyond the end of \"" + input_->getFilename()
+		   + "\"!";
+	return false;
+    }
+
+    if (not RecordView::ParseRecord(input_->getData() + offset, input_->getSize() - offset, record_view, err_msg)) {
+	*err_msg += " (Record starting at file offset " + std::to_string(offset) + ".)";
+	return false;
+    }
+
+    return true;
+}
+
+
+bool MarcFileReader::openControlNumberIndex(const std::string &index_filename, std::string * const err_msg) {
+    ControlNumberIndex * const index(
+	ControlNumberIndex::ControlNumberIndexFactory(index_filename, input_->getFilename(), err_msg));
+    if (index == NULL)
+	return false;
+
+    control_number_index_.reset(index);
+    return true;
+}
+
+
+bool MarcFileReader::getRecordByControlNumber(const std::string &control_number, RecordView * const record_view,
+					      std::string * const err_msg) const
+{
+    err_msg->clear();
+    if (control_number_index_ == NULL) {
+	*err_msg = "no control number index has been opened!";
+	return false;
+    }
+
+    uint64_t record_offset;
+    unsigned record_length;
+    if (not control_number_index_->lookup(Slice(control_number), &record_offset, &record_length))
+	return false;
+
+    if (not getRecordAt(record_offset, record_view, err_msg))
+	return false;
+
+    if (record_view->getRecordLength() != record_length) {
+	*err_msg = "record length for control number \"" + control_number + "\" does not match the index!";
+	return false;
+    }
+
+    return true;
+}
+
+
+void MarcFileReader::splitIntoChunks(const unsigned chunk_count, std::vector<Slice> * const chunks) const {
+    chunks->clear();
+
+    const char * const data(input_->getData());
+    const size_t size(input_->getSize());
+    if (size == 0)
+	return;
+
+    size_t chunk_start(0);
+    for (unsigned chunk_no(1); chunk_no < chunk_count; ++chunk_no) {
+	size_t candidate(std::max(chunk_start, size / chunk_count * chunk_no));
+	candidate += RecordView::FindNextRecordStart(data + candidate, size - candidate);
+	if (candidate == size)
+	    break;
+	if (candidate > chunk_start) {
+	    chunks->push_back(Slice(data + chunk_start, candidate - chunk_start));
+	    chunk_start = candidate;
+	}
+    }
+
+    chunks->push_back(Slice(data + chunk_start, size - chunk_start));
+}
@@ -0,0 +1,100 @@
+/** \file   MarcFileReader.h
+ *  \brief  Interface for the MarcFileReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_FILE_READER_H
+#define MARC_FILE_READER_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "ControlNumberIndex.h"
+#include "MarcReader.h"
+#include "MemoryMappedFile.h"
+#include "RecordView.h"
+
+
+/** \class MarcFileReader
+ *  \brief Zero-copy reader for files of binary MARC-21 records.
+ *
+ *  The input file gets memory mapped and records are handed out as RecordView's that point directly into the
+ *  mapping.  Unlike MarcUtil::ReadNextRecord no per-record buffers get allocated or copied.  The RecordView's remain
+ *  valid for the lifetime of the MarcFileReader.
+ */
+class MarcFileReader: public MarcReader {
+    std::unique_ptr<MemoryMappedFile> input_;
+    size_t offset_;
+    std::unique_ptr<ControlNumberIndex> control_number_index_;
+public:
+    /** \brief Creates a MarcFileReader.
+     *  \return NULL if "input_filename" could not be mapped and then also sets "err_msg".
+     */
+    static MarcFileReader *MarcFileReaderFactory(const std::string &input_filename, std::string * const err_msg);
+
+    bool getNextRecord(RecordView * const record_view, std::string * const err_msg) override;
+    const std::string &getFilename() const override { return input_->getFilename(); }
+    bool recordsRemainValid() const override { return true; }
+
+    /** \return The start of the mapped input file. */
+    const char *getData() const { return input_->getData(); }
+
+    size_t getSize() const { return input_->getSize(); }
+
+    /** \brief Partitions the input file into (at most) "chunk_count" ranges of records of roughly equal size.
+     *
+     *  Chunk boundaries are placed immediately after record terminators and verified w/
+     *  RecordView::IsPlausibleRecordStart().  The chunks can be parsed independently, e.g. by multiple threads, via
+     *  RecordView::ParseRecord().
+     */
+    void splitIntoChunks(const unsigned chunk_count, std::vector<Slice> * const chunks) const;
+
+    /** \brief Random access to the record starting at file offset "offset".
+     *  \note   Does not affect the file offset used by getNextRecord().
+     */
+    bool getRecordAt(const size_t offset, RecordView * const record_view, std::string * const err_msg) const;
+
+    /** \brief Enables getRecordByControlNumber().
+     *  \param index_filename  An index built w/ ControlNumberIndex::Build() for our input file.
+     *  \return False if the index could not be opened or is stale, else true.
+     */
+    bool openControlNumberIndex(const std::string &index_filename, std::string * const err_msg);
+
+    /** \brief Random access to a record via the control number index.  Requires openControlNumberIndex().
+     *  \return False if "control_number" is not in the index and then "err_msg" will be empty, or if the record
+     *          could not be parsed and then "err_msg" will be set.
+     *  \note   Does not affect the file offset used by getNextRecord().
+     */
+    bool getRecordByControlNumber(const std::string &control_number, RecordView * const record_view,
+				  std::string * const err_msg) const;
+
+    /** \return The file offset of the record that will be returned by the next call to getNextRecord(). */
+    size_t tell() const override { return offset_; }
+
+    /** Sets the file offset of the record that will be returned by the next call to getNextRecord(). */
+    void seek(const size_t offset) { offset_ = offset; }
+protected:
+    const char *peek(const size_t min_size, size_t * const available, std::string * const err_msg) override;
+
+    void skip(const size_t count) override { offset_ += count; }
+private:
+    explicit MarcFileReader(MemoryMappedFile * const input): input_(input), offset_(0) {}
+};
+
+
+#endif // ifndef MARC_FILE_READER_H
@@ -0,0 +1,283 @@
+/** \file   MarcJson.cc
+ *  \brief  Implementation of the JSON serialisation of MARC-21 records.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcJson.h"
+#include <algorithm>
+#include <cstdint>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "Marc8.h"
+#include "MarcTag.h"
+#include "SmallVector.h"
+#include "SubfieldView.h"
+
+
+namespace MarcJson {
+
+
+namespace {
+
+
+inline bool NeedsEscaping(const char ch) {
+    return static_cast<unsigned char>(ch) < 0x20u or ch == '"' or ch == '\\';
+}
+
+
+/** \return The first character in ["ch", "end") that needs escaping or "end" if there is none. */
+const char *FindCharacterToEscape(const char *ch, const char * const end) {
+#ifdef __SSE2__
+    const __m128i quotes(_mm_set1_epi8('"')), backslashes(_mm_set1_epi8('\\')), max_controls(_mm_set1_epi8(0x1F));
+    while (end - ch >= static_cast<ptrdiff_t>(sizeof(__m128i))) {
+	const __m128i chunk(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ch)));
+	// A byte is a control character iff its unsigned minimum w/ 0x1F is the byte itself.
+	const __m128i to_escape(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quotes),
+							  _mm_cmpeq_epi8(chunk, backslashes)),
+					     _mm_cmpeq_epi8(_mm_min_epu8(chunk, max_controls), chunk)));
+	const unsigned to_escape_mask(_mm_movemask_epi8(to_escape));
+	if (to_escape_mask != 0)
+	    return ch + __builtin_ctz(to_escape_mask);
+	ch += sizeof(__m128i);
+    }
+#endif
+    while (ch != end and not NeedsEscaping(*ch))
+	++ch;
+    return ch;
+}
+
+
+void AppendEscape(const char ch, std::string * const json) {
+    switch (ch) {
+    case '"':
+	json->append("\\\"", 2);
+	break;
+    case '\\':
+	json->append("\\\\", 2);
+	break;
+    case '\b':
+	json->append("\\b", 2);
+	break;
+    case '\f':
+	json->append("\\f", 2);
+	break;
+    case '\n':
+	json->append("\\n", 2);
+	break;
+    case '\r':
+	json->append("\\r", 2);
+	break;
+    case '\t':
+	json->append("\\t", 2);
+	break;
+    default: {
+	static const char HEX_DIGITS[] = "0123456789abcdef";
+	const char escape[] = { '\\', 'u', '0', '0', HEX_DIGITS[(ch >> 4) & 0xF], HEX_DIGITS[ch & 0xF] };
+	json->append(escape, sizeof escape);
+    }
+    }
+}
+
+
+/** Appends "data" as a quoted JSON string. */
+inline void AppendString(const char * const data, const size_t size, std::string * const json) {
+    *json += '"';
+    AppendEscaped(data, size, json);
+    *json += '"';
+}
+
+
+inline void AppendString(const Slice &data, std::string * const json) { AppendString(data.data(), data.size(), json); }
+
+
+/** Supplies the leader and the field contents of a record in UTF-8. */
+class RecordDecoder {
+    const RecordView &record_;
+    const bool is_marc8_;
+    std::string utf8_; // Never reallocated, so that the returned Slice's remain valid during our lifetime.
+    size_t replacement_count_;
+public:
+    explicit RecordDecoder(const RecordView &record)
+	: record_(record), is_marc8_(record.getLeader()[9] == ' '), replacement_count_(0)
+    {
+	if (is_marc8_)
+	    utf8_.reserve(Leader::LEADER_LENGTH + Marc8::MAX_EXPANSION * record.getRecordLength());
+    }
+
+    /** \return The leader w/ an 'a' in leader/09 if the record has been converted. */
+    Slice getLeader() {
+	if (not is_marc8_)
+	    return record_.getLeader();
+
+	const size_t start(utf8_.size());
+	utf8_.append(record_.getLeader().data(), Leader::LEADER_LENGTH);
+	utf8_[start + 9] = 'a';
+	return Slice(utf8_.data() + start, Leader::LEADER_LENGTH);
+    }
+
+    Slice getField(const size_t field_index) {
+	const Slice field(record_.getField(field_index));
+	if (not is_marc8_ or not Marc8::NeedsConversion(field.data(), field.size()))
+	    return field;
+
+	const size_t start(utf8_.size());
+	utf8_.resize(start + Marc8::MAX_EXPANSION * field.size());
+	utf8_.resize(start + Marc8::ToUtf8(field.data(), field.size(), &utf8_[start], &replacement_count_));
+	return Slice(utf8_.data() + start, utf8_.size() - start);
+    }
+
+    /** \return The number of MARC-8 characters of the fields returned so far that were replaced by U+FFFD. */
+    size_t getReplacementCount() const { return replacement_count_; }
+};
+
+
+void AppendMarcInJson(const RecordView &record, std::string * const json, size_t * const replacement_count) {
+    RecordDecoder decoder(record);
+    json->append("{\"leader\":", 10);
+    AppendString(decoder.getLeader(), json);
+    json->append(",\"fields\":[", 11);
+    for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	char tag[DirectoryEntry::TAG_LENGTH];
+	record.getTag(field_index).toBuffer(tag);
+	json->append(field_index == 0 ? "{" : ",{", field_index == 0 ? 1 : 2);
+	AppendString(tag, sizeof tag, json);
+	*json += ':';
+
+	const Slice field(decoder.getField(field_index));
+	if (record.getTag(field_index).isControlFieldTag()) {
+	    AppendString(field, json);
+	    *json += '}';
+	    continue;
+	}
+
+	json->append("{\"ind1\":", 8);
+	AppendString(field.data(), field.empty() ? 0 : 1, json);
+	json->append(",\"ind2\":", 8);
+	AppendString(field.data() + 1, field.size() < 2 ? 0 : 1, json);
+	json->append(",\"subfields\":[", 14);
+	const SubfieldView subfields(field);
+	bool first_subfield(true);
+	for (const auto &code_and_value : subfields) {
+	    json->append(first_subfield ? "{" : ",{", first_subfield ? 1 : 2);
+	    first_subfield = false;
+	    AppendString(&code_and_value.first, 1, json);
+	    *json += ':';
+	    AppendString(code_and_value.second, json);
+	    *json += '}';
+	}
+	json->append("]}}", 3);
+    }
+    json->append("]}\n", 3);
+    if (replacement_count != NULL)
+	*replacement_count += decoder.getReplacementCount();
+}
+
+
+/** A value of the flat projection.  "key_" orders by tag and then by subfield code. */
+struct FlatValue {
+    uint32_t key_; // The tag shifted left by 8 bits, ORed w/ the subfield code or w/ 0 for control fields.
+    Slice value_;
+};
+
+
+void AppendFlat(const RecordView &record, std::string * const json, size_t * const replacement_count) {
+    RecordDecoder decoder(record);
+    SmallVector<FlatValue, 128> values;
+    for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	const MarcTag tag(record.getTag(field_index));
+	const Slice field(decoder.getField(field_index));
+	if (tag.isControlFieldTag()) {
+	    values.push_back(FlatValue{ tag.toInt() << 8u, field });
+	    continue;
+	}
+
+	const SubfieldView subfields(field);
+	for (const auto &code_and_value : subfields)
+	    values.push_back(FlatValue{ (tag.toInt() << 8u) | static_cast<unsigned char>(code_and_value.first),
+					code_and_value.second });
+    }
+    if (replacement_count != NULL)
+	*replacement_count += decoder.getReplacementCount();
+
+    // Records are mostly sorted by tag already and the stable sort keeps repeated values in field order.
+    std::stable_sort(values.begin(), values.end(),
+		     [](const FlatValue &lhs, const FlatValue &rhs) { return lhs.key_ < rhs.key_; });
+
+    json->append("{\"leader\":", 10);
+    AppendString(decoder.getLeader(), json);
+    for (size_t value_index(0); value_index < values.size(); ++value_index) {
+	const uint32_t key(values[value_index].key_);
+	if (value_index > 0 and key == values[value_index - 1].key_)
+	    *json += ',';
+	else {
+	    if (value_index > 0)
+		*json += ']';
+	    const char key_chars[] = { static_cast<char>(key >> 24u), static_cast<char>(key >> 16u),
+				       static_cast<char>(key >> 8u), static_cast<char>(key) };
+	    *json += ',';
+	    AppendString(key_chars, (key & 0xFFu) == 0 ? DirectoryEntry::TAG_LENGTH : sizeof key_chars, json);
+	    json->append(":[", 2);
+	}
+	AppendString(values[value_index].value_, json);
+    }
+    if (not values.empty())
+	*json += ']';
+    json->append("}\n", 2);
+}
+
+
+} // unnamed namespace
+
+
+bool ParseFormat(const std::string &format_name, Format * const format) {
+    if (format_name == "marc-in-json")
+	*format = MARC_IN_JSON;
+    else if (format_name == "flat")
+	*format = FLAT;
+    else
+	return false;
+
+    return true;
+}
+
+
+void AppendEscaped(const char * const data, const size_t size, std::string * const json) {
+    const char * const end(data + size);
+    const char *run_start(data);
+    for (;;) {
+	const char * const ch(FindCharacterToEscape(run_start, end));
+	json->append(run_start, ch - run_start);
+	if (ch == end)
+	    return;
+	AppendEscape(*ch, json);
+	run_start = ch + 1;
+    }
+}
+
+
+void AppendRecord(const RecordView &record, const Format format, std::string * const json,
+		  size_t * const replacement_count)
+{
+    if (format == MARC_IN_JSON)
+	AppendMarcInJson(record, json, replacement_count);
+    else
+	AppendFlat(record, json, replacement_count);
+}
+
+
+} // namespace MarcJson
@@ -0,0 +1,71 @@
+/** \file   MarcJson.h
+ *  \brief  Serialisation of MARC-21 records as JSON.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_JSON_H
+#define MARC_JSON_H
+
+
+#include <string>
+#include <cstddef>
+#include "RecordView.h"
+
+
+/** \namespace MarcJson
+ *  \brief Writes records as JSON straight from their raw field bytes, one record per line.
+ *
+ *  Two formats are supported:
+ *  - MARC_IN_JSON: the "MARC-in-JSON" layout, i.e. {"leader":"...","fields":[{"001":"..."},{"245":{"ind1":"1",
+ *    "ind2":"0","subfields":[{"a":"..."},...]}},...]}, which preserves the complete record.
+ *  - FLAT: a projection for search engines like Solr or Elasticsearch, i.e. {"leader":"...","001":["..."],
+ *    "245a":["..."],...}.  The keys are the tags of the control fields and the tags of the data fields followed by a
+ *    subfield code, in ascending order.  Each value is an array of all occurrences in field order.  Indicators are
+ *    dropped.
+ *
+ *  MARC-8 records, i.e. those w/ a blank in leader/09, are converted to UTF-8 and get an 'a' in leader/09.  The
+ *  fields of UTF-8 records are copied as is, so ill-formed UTF-8 should be rejected beforehand, e.g. w/
+ *  MarcReader::setValidateUtf8().  The characters that need escaping are located 16 bytes at a time w/ SSE2.
+ */
+namespace MarcJson {
+
+
+enum Format { MARC_IN_JSON, FLAT };
+
+
+/** \brief Maps "marc-in-json" and "flat" to the corresponding Format.
+ *  \return False if "format_name" is unknown, else true.
+ */
+bool ParseFormat(const std::string &format_name, Format * const format);
+
+
+/** Appends "data" to "json" w/ the escapes required inside of a JSON string, but w/o the enclosing quotes. */
+void AppendEscaped(const char * const data, const size_t size, std::string * const json);
+
+
+/** \brief Appends "record" in "format" and a terminating newline to "json".
+ *  \param replacement_count  If not NULL, the number of MARC-8 characters that could not be converted and were
+ *                            replaced by U+FFFD will be added here.
+ */
+void AppendRecord(const RecordView &record, const Format format, std::string * const json,
+		  size_t * const replacement_count = NULL);
+
+
+} // namespace MarcJson
+
+
+#endif // ifndef MARC_JSON_H
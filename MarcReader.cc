@@ -0,0 +1,303 @@
+/** \file   MarcReader.cc
+ *  \brief  Implementation of the MarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcReader.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "AsyncMarcReader.h"
+#include "DecompressingMarcReader.h"
+#include "MarcFileReader.h"
+#include "MarcXmlReader.h"
+#include "RejectLog.h"
+#include "StdioMarcReader.h"
+#include "StringUtil.h"
+#include "Utf8.h"
+
+
+// The number of bytes that GetCompression() needs to look at.
+static const size_t MAGIC_SIZE(4);
+
+
+/** Determines the compression from "magic", the first "magic_size" bytes of a file. */
+static MarcReader::Compression GetCompression(const unsigned char * const magic, const size_t magic_size) {
+    // N.B. MARC-21 records start w/ the decimal digits of their length and can never be mistaken for these.
+    if (magic_size >= 2 and magic[0] == 0x1F and magic[1] == 0x8B)
+	return MarcReader::GZIP;
+    if (magic_size >= 4 and magic[0] == 0x28 and magic[1] == 0xB5 and magic[2] == 0x2F and magic[3] == 0xFD)
+	return MarcReader::ZSTD;
+    return MarcReader::NO_COMPRESSION;
+}
+
+
+MarcReader *MarcReader::MarcReaderFactory(const std::string &input_filename, std::string * const err_msg,
+					  const Backend backend)
+{
+    Compression compression;
+    if (not DetectCompression(input_filename, &compression, err_msg))
+	return NULL;
+
+    bool is_regular_file;
+    if (not IsRegularFile(input_filename, &is_regular_file, err_msg))
+	return NULL;
+
+    MarcReader *reader;
+    if (compression != NO_COMPRESSION)
+	reader = DecompressingMarcReader::DecompressingMarcReaderFactory(input_filename, compression, err_msg);
+    else if (backend == STDIO or not is_regular_file) // Pipes etc. can neither be mapped nor read asynchronously.
+	reader = StdioMarcReader::StdioMarcReaderFactory(input_filename, err_msg);
+    else if (backend == ASYNC)
+	reader = AsyncMarcReader::AsyncMarcReaderFactory(input_filename, err_msg);
+    else
+	reader = MarcFileReader::MarcFileReaderFactory(input_filename, err_msg);
+    if (reader == NULL)
+	return NULL;
+
+    // The magic bytes of a pipe can only be looked at through the reader.
+    if (not is_regular_file) {
+	size_t available;
+	const char * const start(reader->peek(MAGIC_SIZE, &available, err_msg));
+	if (not err_msg->empty()) {
+	    delete reader;
+	    return NULL;
+	}
+	compression = GetCompression(reinterpret_cast<const unsigned char *>(start), available);
+	if (compression != NO_COMPRESSION) {
+	    reader = DecompressingMarcReader::DecompressingMarcReaderFactory(reader, compression, err_msg);
+	    if (reader == NULL)
+		return NULL;
+	}
+    }
+
+    // Looking at the decompressed data also recognises compressed MARCXML and MARCXML that gets piped to us.
+    size_t available;
+    const char * const start(reader->peek(Leader::LEADER_LENGTH, &available, err_msg));
+    if (not err_msg->empty()) {
+	delete reader;
+	return NULL;
+    }
+    return MarcXmlReader::IsMarcXml(start, available) ? new MarcXmlReader(reader) : reader;
+}
+
+
+bool MarcReader::ParseBackend(const std::string &backend_name, Backend * const backend) {
+    if (backend_name == "mmap")
+	*backend = MMAP;
+    else if (backend_name == "stdio")
+	*backend = STDIO;
+    else if (backend_name == "async")
+	*backend = ASYNC;
+    else
+	return false;
+
+    return true;
+}
+
+
+/** \brief Reads up to "size" bytes from the start of "input_filename" unless it is not a regular file.
+ *  \param count  Set to the number of bytes that have been read, which is 0 for pipes etc.
+ */
+static bool ReadFileStart(const std::string &input_filename, void * const buffer, const size_t size,
+			  size_t * const count, std::string * const err_msg)
+{
+    const int fd(::open(input_filename.c_str(), O_RDONLY));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + input_filename + "\" for reading! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    // Reading from a pipe would consume the bytes that we look at.
+    struct stat stat_buf;
+    if (::fstat(fd, &stat_buf) == 0 and not S_ISREG(stat_buf.st_mode)) {
+	::close(fd);
+	*count = 0;
+	return true;
+    }
+
+    ssize_t read_count;
+    do
+	read_count = ::read(fd, buffer, size);
+    while (read_count == -1 and errno == EINTR);
+    const int read_errno(errno);
+    ::close(fd);
+    if (read_count == -1) {
+	*err_msg = "can't read from \"" + input_filename + "\"! (" + std::strerror(read_errno) + ")";
+	return false;
+    }
+
+    *count = read_count;
+    return true;
+}
+
+
+bool MarcReader::IsRegularFile(const std::string &input_filename, bool * const is_regular_file,
+			       std::string * const err_msg)
+{
+    struct stat stat_buf;
+    if (::stat(input_filename.c_str(), &stat_buf) == -1) {
+	*err_msg = "can't stat \"" + input_filename + "\"! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    *is_regular_file = S_ISREG(stat_buf.st_mode);
+    return true;
+}
+
+
+bool MarcReader::DetectCompression(const std::string &input_filename, Compression * const compression,
+				   std::string * const err_msg)
+{
+    unsigned char magic[MAGIC_SIZE];
+    size_t magic_size;
+    if (not ReadFileStart(input_filename, magic, sizeof magic, &magic_size, err_msg))
+	return false;
+
+    *compression = GetCompression(magic, magic_size);
+    return true;
+}
+
+
+bool MarcReader::DetectMarcXml(const std::string &input_filename, bool * const is_marc_xml,
+			       std::string * const err_msg)
+{
+    char start[Leader::LEADER_LENGTH];
+    size_t start_size;
+    if (not ReadFileStart(input_filename, start, sizeof start, &start_size, err_msg))
+	return false;
+
+    *is_marc_xml = MarcXmlReader::IsMarcXml(start, start_size);
+    return true;
+}
+
+
+bool MarcReader::getNextRecord(RecordView * const record_view, std::string * const err_msg) {
+    Slice raw_record;
+    while (getNextRawRecord(&raw_record, err_msg)) {
+	if (RecordView::ParseRecord(raw_record.data(), raw_record.size(), record_view, err_msg))
+	    return true;
+
+	size_t input_size;
+	const size_t record_offset(locateRecord(raw_record, &input_size));
+	if (reject_log_ == NULL) {
+	    *err_msg += " (Record starting at file offset " + std::to_string(record_offset) + ".)";
+	    return false;
+	}
+	reject_log_->log(record_offset, input_size, *err_msg);
+    }
+
+    return false;
+}
+
+
+bool MarcReader::getNextRawRecord(Slice * const raw_record, std::string * const err_msg) {
+    err_msg->clear();
+    for (;;) {
+	size_t available;
+	const char * const record_start(peekRecord(&available, err_msg));
+	if (available == 0 or not err_msg->empty())
+	    return false;
+
+	// Short or garbled records are diagnosed here:
+	if (RecordView::GetRawRecord(record_start, available, raw_record, err_msg)) {
+	    skip(raw_record->size());
+	    if (not validate_utf8_ or ValidateUtf8(*raw_record, err_msg))
+		return true;
+
+	    // We know where the next record starts, so there is no need to resynchronise.
+	    const size_t record_offset(tell() - raw_record->size());
+	    if (reject_log_ == NULL) {
+		*err_msg += " (Record starting at file offset " + std::to_string(record_offset) + ".)";
+		return false;
+	    }
+	    reject_log_->log(record_offset, raw_record->size(), *err_msg);
+	    err_msg->clear();
+	    continue;
+	}
+
+	if (reject_log_ == NULL) {
+	    *err_msg += " (Record starting at file offset " + std::to_string(tell()) + ".)";
+	    return false;
+	}
+
+	const std::string reason(*err_msg);
+	err_msg->clear();
+	if (not resync(reason, err_msg))
+	    return false;
+    }
+}
+
+
+bool MarcReader::ValidateUtf8(const Slice &raw_record, std::string * const err_msg) {
+    if (raw_record[9] != 'a' or Utf8::IsValid(raw_record.data(), raw_record.size()))
+	return true;
+
+    RecordView record_view;
+    return RecordView::ParseRecord(raw_record.data(), raw_record.size(), &record_view, err_msg)
+	   and record_view.validateUtf8(err_msg);
+}
+
+
+const char *MarcReader::peekRecord(size_t * const available, std::string * const err_msg) {
+    const char * const leader(peek(Leader::LEADER_LENGTH, available, err_msg));
+    unsigned record_length;
+    if (*available >= Leader::LEADER_LENGTH and StringUtil::DecimalDigitsToUnsigned(leader, 5, &record_length)
+	and record_length > *available)
+	return peek(record_length, available, err_msg);
+    return leader;
+}
+
+
+// Large enough to make the scan for record terminators efficient and small enough to not cause a lot of copying in
+// readers that have to assemble the requested bytes.
+const size_t RESYNC_SCAN_SIZE(64 * 1024);
+
+
+bool MarcReader::resync(const std::string &reason, std::string * const err_msg) {
+    const size_t reject_offset(tell());
+    skip(1); // We know that the current position is not a valid record start.
+
+    bool found_record_start(false);
+    for (;;) {
+	size_t available;
+	const char * const scan_start(peek(RESYNC_SCAN_SIZE, &available, err_msg));
+	if (available == 0)
+	    break;
+
+	const char * const record_terminator(
+	    reinterpret_cast<const char *>(std::memchr(scan_start, '\x1D', available)));
+	if (record_terminator == NULL) {
+	    skip(available);
+	    continue;
+	}
+	skip(record_terminator - scan_start + 1);
+
+	const char * const candidate(peekRecord(&available, err_msg));
+	if (not err_msg->empty())
+	    break;
+	if (RecordView::IsPlausibleRecordStart(candidate, available)) {
+	    found_record_start = true;
+	    break;
+	}
+    }
+
+    reject_log_->log(reject_offset, tell() - reject_offset, reason);
+    return found_record_start;
+}
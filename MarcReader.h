@@ -0,0 +1,174 @@
+/** \file   MarcReader.h
+ *  \brief  Interface for the MarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_READER_H
+#define MARC_READER_H
+
+
+#include <string>
+#include <cstdint>
+#include "RecordView.h"
+#include "Slice.h"
+
+
+class RejectLog;
+
+
+/** \class MarcReader
+ *  \brief The interface of the sequential readers of binary MARC-21 records.
+ *
+ *  Unless an implementation guarantees more, the Slice's and RecordView's that are returned by a reader are only
+ *  valid until the next call to getNextRawRecord() or getNextRecord().
+ */
+class MarcReader {
+    friend class MarcXmlReader; // Reads its XML through the peek() and skip() of another reader.
+    friend class Decompressor;  // Reads compressed pipes through the peek() and skip() of a StdioMarcReader.
+public:
+    enum Compression { NO_COMPRESSION, GZIP, ZSTD };
+
+    /** How uncompressed files get read: MMAP uses a MarcFileReader, STDIO a StdioMarcReader and ASYNC an
+     *  AsyncMarcReader. */
+    enum Backend { MMAP, STDIO, ASYNC };
+protected:
+    RejectLog *reject_log_; // NULL unless the tolerant mode has been enabled.
+    bool validate_utf8_;
+public:
+    virtual ~MarcReader() {}
+
+    /** \brief Opens "input_filename" w/ a reader that is appropriate for it.
+     *
+     *  Compressed files are recognised by their magic bytes, not by their names, and are always read w/ a
+     *  DecompressingMarcReader, files that are not regular files, e.g. pipes, w/ a StdioMarcReader, which gets
+     *  wrapped in a DecompressingMarcReader if the data is compressed, and all other files w/ the reader selected by
+     *  "backend".  If the, possibly decompressed, input turns out to be MARCXML, that reader gets wrapped in a
+     *  MarcXmlReader.
+     *
+     *  \return NULL if "input_filename" could not be opened and then also sets "err_msg".
+     */
+    static MarcReader *MarcReaderFactory(const std::string &input_filename, std::string * const err_msg,
+					 const Backend backend = MMAP);
+
+    /** \brief Maps "mmap", "stdio" and "async" to the corresponding backend.
+     *  \return False if "backend_name" is none of these, else true.
+     */
+    static bool ParseBackend(const std::string &backend_name, Backend * const backend);
+
+    /** \brief Determines whether "input_filename" is a regular file, i.e. one that can be mapped, as opposed to a pipe.
+     *  \return False if "input_filename" could not be stat'ed and then also sets "err_msg", else true.
+     */
+    static bool IsRegularFile(const std::string &input_filename, bool * const is_regular_file,
+			      std::string * const err_msg);
+
+    /** \brief Determines the compression of "input_filename" from its first few bytes.
+     *  \note  Files that are not regular files, e.g. pipes, are never considered to be compressed.
+     *  \return False if "input_filename" could not be read and then also sets "err_msg", else true.
+     */
+    static bool DetectCompression(const std::string &input_filename, Compression * const compression,
+				  std::string * const err_msg);
+
+    /** \brief Determines whether "input_filename" holds MARCXML, see MarcXmlReader::IsMarcXml().
+     *  \note  Like DetectCompression() this does not look into compressed files or files that are not regular files,
+     *         e.g. pipes, which are never considered to hold MARCXML.
+     *  \return False if "input_filename" could not be read and then also sets "err_msg", else true.
+     */
+    static bool DetectMarcXml(const std::string &input_filename, bool * const is_marc_xml,
+			      std::string * const err_msg);
+
+    /** \brief Enables the tolerant mode.
+     *
+     *  Instead of failing, getNextRecord() and getNextRawRecord() then log corrupt records to "reject_log" and
+     *  continue.  If the extent of a corrupt record can be determined, only the record itself gets skipped.
+     *  Otherwise the input is resynchronised at the next plausible record start that follows a record terminator,
+     *  see RecordView::FindNextRecordStart().  I/O and decompression errors still end the input.
+     */
+    void setRejectLog(RejectLog * const reject_log) { reject_log_ = reject_log; }
+
+    RejectLog *getRejectLog() const { return reject_log_; }
+
+    /** \brief If "validate_utf8" is true, records that claim to be UTF-8 encoded, i.e. have an 'a' in leader/09, but
+     *         contain ill-formed UTF-8 are treated like corrupt records by getNextRecord() and getNextRawRecord().
+     *  \note  See ValidateUtf8() for the details.
+     */
+    void setValidateUtf8(const bool validate_utf8) { validate_utf8_ = validate_utf8; }
+
+    bool getValidateUtf8() const { return validate_utf8_; }
+
+    /** \brief Checks that the fields of "raw_record" are well-formed UTF-8 if leader/09 says that they should be.
+     *
+     *  The entire record is checked in a single pass and only if that fails, the record gets parsed in order to
+     *  report the tag, subfield code and offset of the first ill-formed sequence via "err_msg".
+     *
+     *  \param raw_record  A record whose extent has been determined, e.g. w/ RecordView::GetRawRecord().
+     *  \return True if "raw_record" does not claim to be UTF-8 encoded or all of its fields are well-formed, else
+     *          false.
+     */
+    static bool ValidateUtf8(const Slice &raw_record, std::string * const err_msg);
+
+    /** \brief Advances to the next record.
+     *  \return False on error and EOF.  To distinguish between the two: on EOF "err_msg" is empty but not when an
+     *          error has been detected.
+     */
+    virtual bool getNextRecord(RecordView * const record_view, std::string * const err_msg);
+
+    /** \brief Like getNextRecord() but only determines the extent of the next record.
+     *  \note  See RecordView::GetRawRecord() for what gets checked.
+     */
+    virtual bool getNextRawRecord(Slice * const raw_record, std::string * const err_msg);
+
+    virtual const std::string &getFilename() const = 0;
+
+    /** \return True if the Slice's and RecordView's that we return remain valid for our lifetime, e.g. because they
+     *          point into a memory mapped file, else false.
+     */
+    virtual bool recordsRemainValid() const { return false; }
+
+    /** \return The offset, in the uncompressed data, of the record that will be returned next. */
+    virtual size_t tell() const = 0;
+
+    /** \brief Locates the input of "raw_record", which must be the record that getNextRawRecord() returned last.
+     *  \param input_size  Set to the number of input bytes, which differs from the size of "raw_record" for readers
+     *                     that convert their input, e.g. MarcXmlReader.
+     *  \return The offset of the input in the same terms as tell(), e.g. for error messages and the reject log.
+     */
+    virtual size_t locateRecord(const Slice &raw_record, size_t * const input_size) const
+	{ *input_size = raw_record.size(); return tell() - raw_record.size(); }
+protected:
+    MarcReader(): reject_log_(NULL), validate_utf8_(false) {}
+
+    /** \brief Makes at least "min_size" bytes, starting at the current position, contiguously available.
+     *  \param available  The number of bytes available at the returned address.  This is less than "min_size" only
+     *                    at the end of the input and 0 at EOF or if an error occurred.
+     *  \return The current position.  The bytes remain valid until the next call to peek().
+     */
+    virtual const char *peek(const size_t min_size, size_t * const available, std::string * const err_msg) = 0;
+
+    /** Advances the current position, and thereby tell(), by "count" of the bytes that peek() made available. */
+    virtual void skip(const size_t count) = 0;
+private:
+    /** Peeks at the leader and, if the record length can be decoded, at the entire record. */
+    const char *peekRecord(size_t * const available, std::string * const err_msg);
+
+    /** \brief Skips everything up to the next plausible record start and logs the skipped range w/ "reason".
+     *  \return False if the input ended first, else true.
+     */
+    bool resync(const std::string &reason, std::string * const err_msg);
+};
+
+
+#endif // ifndef MARC_READER_H
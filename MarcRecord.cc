@@ -0,0 +1,167 @@
+/** \file   MarcRecord.cc
+ *  \brief  Implementation of the MarcRecord class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcRecord.h"
+#include <cstring>
+#include "DirectoryEntry.h"
+#include "StringUtil.h"
+#include "SubfieldView.h"
+
+
+void MarcRecord::load(const RecordView &record) {
+    clear();
+    std::memcpy(leader_, record.getLeader().data(), Leader::LEADER_LENGTH);
+
+    const size_t field_count(record.getNumberOfFields());
+    for (size_t field_index(0); field_index < field_count; ++field_index) {
+	Field field;
+	field.tag_ = record.getTag(field_index);
+	field.contents_ = record.getField(field_index);
+	fields_.push_back(field);
+    }
+}
+
+
+void MarcRecord::clear() {
+    leader_ = arena_->allocateArray<char>(Leader::LEADER_LENGTH);
+    Leader().toBuffer(leader_);
+    fields_.clear();
+}
+
+
+size_t MarcRecord::findTag(const MarcTag &tag, const size_t start_index) const {
+    for (size_t field_index(start_index); field_index < fields_.size(); ++field_index) {
+	if (fields_[field_index].tag_ == tag)
+	    return field_index;
+    }
+
+    return fields_.size();
+}
+
+
+size_t MarcRecord::insertField(const MarcTag &tag, const Slice &contents) {
+    size_t insertion_index(fields_.size());
+    while (insertion_index > 0 and fields_[insertion_index - 1].tag_ > tag)
+	--insertion_index;
+
+    Field field;
+    field.tag_ = tag;
+    field.contents_ = arena_->copy(contents);
+    fields_.insert(insertion_index, field);
+
+    return insertion_index;
+}
+
+
+void MarcRecord::addSubfield(const size_t field_index, const char subfield_code, const Slice &value) {
+    const Slice old_contents(fields_[field_index].contents_);
+    char * const new_contents(arena_->allocateArray<char>(old_contents.size() + 2 + value.size()));
+    std::memcpy(new_contents, old_contents.data(), old_contents.size());
+    new_contents[old_contents.size()]     = '\x1F';
+    new_contents[old_contents.size() + 1] = subfield_code;
+    std::memcpy(new_contents + old_contents.size() + 2, value.data(), value.size());
+    fields_[field_index].contents_ = Slice(new_contents, old_contents.size() + 2 + value.size());
+}
+
+
+size_t MarcRecord::replaceSubfields(const size_t field_index, const char subfield_code, const Slice &new_value) {
+    return rewriteSubfields(field_index, subfield_code, new_value, /* delete_subfields = */false);
+}
+
+
+size_t MarcRecord::deleteSubfields(const size_t field_index, const char subfield_code) {
+    return rewriteSubfields(field_index, subfield_code, Slice(), /* delete_subfields = */true);
+}
+
+
+size_t MarcRecord::rewriteSubfields(const size_t field_index, const char subfield_code, const Slice &new_value,
+				    const bool delete_subfields)
+{
+    const Slice old_contents(fields_[field_index].contents_);
+    const SubfieldView subfields(old_contents);
+    const auto begin_end(subfields.getIterators(subfield_code));
+
+    // Pass 1: compute the new size.
+    size_t match_count(0), new_size(old_contents.size());
+    for (auto code_and_value(begin_end.first); code_and_value != begin_end.second; ++code_and_value) {
+	++match_count;
+	new_size -= code_and_value->second.size();
+	if (delete_subfields)
+	    new_size -= 2; // subfield delimiter and code
+	else
+	    new_size += new_value.size();
+    }
+    if (match_count == 0)
+	return 0;
+
+    // Pass 2: copy the unaffected parts and the replacements.
+    char * const new_contents(arena_->allocateArray<char>(new_size));
+    char *dest(new_contents);
+    const char *copy_start(old_contents.begin());
+    for (auto code_and_value(begin_end.first); code_and_value != begin_end.second; ++code_and_value) {
+	const Slice &value(code_and_value->second);
+	const char * const copy_end(delete_subfields ? value.begin() - 2 : value.begin());
+	std::memcpy(dest, copy_start, copy_end - copy_start);
+	dest += copy_end - copy_start;
+	if (not delete_subfields) {
+	    std::memcpy(dest, new_value.data(), new_value.size());
+	    dest += new_value.size();
+	}
+	copy_start = value.end();
+    }
+    std::memcpy(dest, copy_start, old_contents.end() - copy_start);
+
+    fields_[field_index].contents_ = Slice(new_contents, new_size);
+    return match_count;
+}
+
+
+size_t MarcRecord::getRecordLength() const {
+    size_t record_length(Leader::LEADER_LENGTH + fields_.size() * DirectoryEntry::DIRECTORY_ENTRY_LENGTH + 1);
+    for (const auto &field : fields_)
+	record_length += field.contents_.size() + 1;
+
+    return record_length + 1;
+}
+
+
+void MarcRecord::toBuffer(char * const buffer) const {
+    const size_t base_address_of_data(Leader::LEADER_LENGTH
+				      + fields_.size() * DirectoryEntry::DIRECTORY_ENTRY_LENGTH + 1);
+    std::memcpy(buffer, leader_, Leader::LEADER_LENGTH);
+    StringUtil::UnsignedToDecimalDigits(getRecordLength(), 5, buffer);
+    StringUtil::UnsignedToDecimalDigits(base_address_of_data, 5, buffer + 12);
+
+    char *entry(buffer + Leader::LEADER_LENGTH);
+    char *field_data(buffer + base_address_of_data);
+    unsigned field_offset(0);
+    for (const auto &field : fields_) {
+	field.tag_.toBuffer(entry);
+	StringUtil::UnsignedToDecimalDigits(field.contents_.size() + 1, 4, entry + DirectoryEntry::TAG_LENGTH);
+	StringUtil::UnsignedToDecimalDigits(field_offset, 5, entry + DirectoryEntry::TAG_LENGTH + 4);
+	entry += DirectoryEntry::DIRECTORY_ENTRY_LENGTH;
+
+	std::memcpy(field_data, field.contents_.data(), field.contents_.size());
+	field_data += field.contents_.size();
+	*field_data++ = '\x1E';
+	field_offset += field.contents_.size() + 1;
+    }
+    *entry = '\x1E';
+    *field_data = '\x1D';
+}
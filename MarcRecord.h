@@ -0,0 +1,134 @@
+/** \file   MarcRecord.h
+ *  \brief  Interface for the MarcRecord class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_RECORD_H
+#define MARC_RECORD_H
+
+
+#include <string>
+#include "Arena.h"
+#include "MarcTag.h"
+#include "RecordView.h"
+#include "Slice.h"
+
+
+/** \class MarcRecord
+ *  \brief An editable MARC-21 record whose leader, fields and subfields live in an Arena.
+ *
+ *  Unmodified fields refer directly to the bytes of the record they were loaded from, modified fields are rebuilt in
+ *  the arena.  There is no separate directory, it gets computed from the fields when the record is written, e.g. w/
+ *  MarcWriter::write().  Therefore the directory is always consistent w/ the field data.
+ *
+ *  Several records may share an arena, e.g. all records of a batch.  After resetting the arena, clear() or load()
+ *  must be called before a record can be used again.
+ */
+class MarcRecord {
+    struct Field {
+	MarcTag tag_;
+	Slice contents_; // W/o the field terminator.
+    };
+
+    Arena *arena_;
+    char *leader_;
+    ArenaVector<Field> fields_;
+public:
+    /** Creates an empty record w/ a default leader. */
+    explicit MarcRecord(Arena * const arena): arena_(arena), leader_(NULL), fields_(arena) { clear(); }
+
+    /** \brief Replaces the contents of this record w/ the leader and fields of "record".
+     *  \note  The memory that "record" refers to must stay valid as long as this record is used.
+     */
+    void load(const RecordView &record);
+
+    /** Removes all fields and restores the default leader. */
+    void clear();
+
+    Arena *getArena() const { return arena_; }
+    Slice getLeader() const { return Slice(leader_, Leader::LEADER_LENGTH); }
+
+    /** \param pos  The offset of the byte to change.  The record length and the base address of data are computed
+     *              when the record is written and should not be set w/ this function.
+     */
+    void setLeaderByte(const size_t pos, const char new_value) { leader_[pos] = new_value; }
+
+    size_t getNumberOfFields() const { return fields_.size(); }
+    MarcTag getTag(const size_t field_index) const { return fields_[field_index].tag_; }
+
+    /** \return The contents of the field w/ index "field_index" w/o its field terminator. */
+    Slice getField(const size_t field_index) const { return fields_[field_index].contents_; }
+
+    /** \return The index of the first field at or after "start_index" w/ tag "tag" or getNumberOfFields() if
+     *          no such field exists.
+     */
+    size_t findTag(const MarcTag &tag, const size_t start_index = 0) const;
+
+    /** \brief Inserts a new field after all fields whose tags are less than or equal to "tag".
+     *  \param contents  The field contents w/o a field terminator.  Will be copied into the arena.
+     *  \return The index of the new field.
+     */
+    size_t insertField(const MarcTag &tag, const Slice &contents);
+
+    /** Replaces the contents of the field w/ index "field_index" w/ a copy of "new_contents". */
+    void replaceField(const size_t field_index, const Slice &new_contents)
+	{ fields_[field_index].contents_ = arena_->copy(new_contents); }
+
+    /** \brief Like replaceField() but w/o copying "new_contents".
+     *  \note  "new_contents" must stay valid as long as this record is used, e.g. by living in getArena().
+     */
+    void setField(const size_t field_index, const Slice &new_contents)
+	{ fields_[field_index].contents_ = new_contents; }
+
+    /** Removes the field w/ index "field_index".  The indices of all following fields decrease by one. */
+    void deleteField(const size_t field_index) { fields_.erase(field_index); }
+
+    /** Appends a subfield to the data field w/ index "field_index". */
+    void addSubfield(const size_t field_index, const char subfield_code, const Slice &value);
+
+    /** \brief Replaces the values of all subfields w/ code "subfield_code" of the data field w/ index "field_index".
+     *  \return The number of subfields that were replaced.
+     */
+    size_t replaceSubfields(const size_t field_index, const char subfield_code, const Slice &new_value);
+
+    /** \brief Removes all subfields w/ code "subfield_code" from the data field w/ index "field_index".
+     *  \return The number of subfields that were removed.
+     */
+    size_t deleteSubfields(const size_t field_index, const char subfield_code);
+
+    /** \return The length of the binary representation of this record. */
+    size_t getRecordLength() const;
+
+    /** \brief Writes the binary representation of this record to "buffer".
+     *  \param buffer  Must have room for getRecordLength() bytes.
+     *  \note  The caller is responsible for checking that the field lengths and the record length do not exceed the
+     *         limits of the MARC-21 format.
+     */
+    void toBuffer(char * const buffer) const;
+private:
+    MarcRecord(const MarcRecord &rhs) = delete;
+    const MarcRecord &operator=(const MarcRecord &rhs) = delete;
+
+    /** Rebuilds the contents of the field w/ index "field_index" w/ "new_value" instead of each subfield w/ code
+     *  "subfield_code", or w/o those subfields if "delete_subfields" is true.
+     */
+    size_t rewriteSubfields(const size_t field_index, const char subfield_code, const Slice &new_value,
+			    const bool delete_subfields);
+};
+
+
+#endif // ifndef MARC_RECORD_H
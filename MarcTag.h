@@ -0,0 +1,86 @@
+/** \file   MarcTag.h
+ *  \brief  Interface for the MarcTag class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_TAG_H
+#define MARC_TAG_H
+
+
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+
+
+/** \class MarcTag
+ *  \brief A 3-character MARC-21 field tag packed into a single integer.
+ *
+ *  The characters are stored in big-endian order so that comparing two tags is a single integer comparison and tags
+ *  sort in the same order as their string representations.  Tag literals can be written as "245"_tag and are
+ *  constant expressions.
+ */
+class MarcTag {
+    uint32_t tag_;
+public:
+    /** Constructs an empty tag that does not equal any tag read from a record. */
+    constexpr MarcTag(): tag_(0) {}
+
+    constexpr MarcTag(const char first, const char second, const char third)
+	: tag_((static_cast<uint32_t>(static_cast<unsigned char>(first)) << 16u)
+	       | (static_cast<uint32_t>(static_cast<unsigned char>(second)) << 8u)
+	       | static_cast<uint32_t>(static_cast<unsigned char>(third))) {}
+
+    /** Constructs a tag from the 3 bytes starting at "raw_tag", e.g. the start of a raw directory entry. */
+    constexpr explicit MarcTag(const char * const raw_tag): MarcTag(raw_tag[0], raw_tag[1], raw_tag[2]) {}
+
+    bool empty() const { return tag_ == 0; }
+    uint32_t toInt() const { return tag_; }
+
+    /** \return True if this is the tag of a control field, i.e. 001 through 009. */
+    bool isControlFieldTag() const { return (tag_ >> 8u) == (('0' << 8u) | '0'); }
+
+    /** Writes the 3 characters of this tag to "buffer". */
+    void toBuffer(char * const buffer) const {
+	buffer[0] = static_cast<char>(tag_ >> 16u);
+	buffer[1] = static_cast<char>(tag_ >> 8u);
+	buffer[2] = static_cast<char>(tag_);
+    }
+
+    std::string toString() const {
+	char buffer[3];
+	toBuffer(buffer);
+	return std::string(buffer, sizeof buffer);
+    }
+
+    bool operator==(const MarcTag &rhs) const { return tag_ == rhs.tag_; }
+    bool operator!=(const MarcTag &rhs) const { return tag_ != rhs.tag_; }
+    bool operator<(const MarcTag &rhs) const { return tag_ < rhs.tag_; }
+    bool operator>(const MarcTag &rhs) const { return tag_ > rhs.tag_; }
+};
+
+
+/** \brief Creates a MarcTag from a literal, e.g. "001"_tag.
+ *  \note  Literals that do not have exactly 3 characters are rejected at compile time when used in a constant
+ *         expression.
+ */
+constexpr MarcTag operator"" _tag(const char * const tag, const size_t length) {
+    return (length == 3) ? MarcTag(tag[0], tag[1], tag[2])
+			 : throw std::invalid_argument("MARC-21 tags must have exactly 3 characters!");
+}
+
+
+#endif // ifndef MARC_TAG_H
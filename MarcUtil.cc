@@ -1,5 +1,6 @@
 #include "MarcUtil.h"
-#include <memory>
+#include <algorithm>
+#include "Stats.h"
     
 namespace MarcUtil {
 
@@ -42,13 +43,10 @@ bool ReadFields(const std::string &raw_fields, const std::vector<DirectoryEntry>
 }
 
 
-// Returns false on error and EOF.  To distinguish between the two: on EOF "err_msg" is empty but not when an
-// error has been detected.  For each entry in "dir_entries" there will be a corresponding entry in "field_data".
-bool ReadNextRecord(FILE * const input, Leader ** const leader, std::vector<DirectoryEntry> * const dir_entries,
-		    std::vector<std::string> * const field_data, std::string * const err_msg)
+bool ReadRecordHeader(FILE * const input, Leader * const leader, std::vector<DirectoryEntry> * const dir_entries,
+		      std::string * const err_msg)
 {
     dir_entries->clear();
-    field_data->clear();
     err_msg->clear();
 
     //
@@ -65,8 +63,22 @@ bool ReadNextRecord(FILE * const input, Leader ** const leader, std::vector<Dire
 	return false;
     }
 
-    if (not Leader::ParseLeader(std::string(leader_buf, Leader::LEADER_LENGTH), leader, err_msg)) {
-	delete *leader;
+    {
+	const Stats::StageTimer timer(Stats::PARSING);
+	if (not Leader::ParseLeader(leader_buf, leader, err_msg))
+	    return false;
+    }
+
+    // Both the directory, which includes its terminator, and the field data, which includes the record terminator,
+    // have to be non-empty or the sizes below would wrap around.
+    if (leader->getBaseAddressOfData() <= Leader::LEADER_LENGTH) {
+	*err_msg = "base address of data " + std::to_string(leader->getBaseAddressOfData())
+		   + " does not leave room for a directory!";
+	return false;
+    }
+    if (leader->getRecordLength() <= leader->getBaseAddressOfData()) {
+	*err_msg = "record length " + std::to_string(leader->getRecordLength()) + " does not exceed the base address of"
+		   " data " + std::to_string(leader->getBaseAddressOfData()) + "!";
 	return false;
     }
 
@@ -74,22 +86,106 @@ bool ReadNextRecord(FILE * const input, Leader ** const leader, std::vector<Dire
     // Parse directory entries.
     //
 
-    const ssize_t directory_length((*leader)->getBaseAddressOfData() - Leader::LEADER_LENGTH);
+    const ssize_t directory_length(leader->getBaseAddressOfData() - Leader::LEADER_LENGTH);
     char directory_buf[directory_length];
     if ((read_count = std::fread(directory_buf, 1, directory_length, input)) != directory_length) {
 	*err_msg = "Short read for a directory or premature EOF!";
 	return false;
     }
 
-    if (not DirectoryEntry::ParseDirEntries(std::string(directory_buf, directory_length), dir_entries, err_msg))
+    const Stats::StageTimer timer(Stats::PARSING);
+    return DirectoryEntry::ParseDirEntries(directory_buf, directory_length, dir_entries, err_msg);
+}
+
+
+// Advances "input" by "count" bytes.  Falls back to reading if "input" is not seekable, e.g. a pipe.
+static bool SkipBytes(FILE * const input, const long count, std::string * const err_msg) {
+    if (count == 0 or std::fseek(input, count, SEEK_CUR) == 0)
+	return true;
+
+    if (count < 0) {
+	*err_msg = "can't seek backwards in non-seekable input!";
+	return false;
+    }
+
+    char discard_buf[BUFSIZ];
+    for (long remainder(count); remainder > 0; /* Intentionally empty! */) {
+	const size_t chunk_size(std::min(static_cast<size_t>(remainder), sizeof discard_buf));
+	if (std::fread(discard_buf, 1, chunk_size, input) != chunk_size) {
+	    *err_msg = "Short read for field data or premature EOF!";
+	    return false;
+	}
+	remainder -= chunk_size;
+    }
+
+    return true;
+}
+
+
+bool SkipRecordBody(FILE * const input, const Leader &leader, std::string * const err_msg) {
+    err_msg->clear();
+    return SkipBytes(input, leader.getRecordLength() - leader.getBaseAddressOfData(), err_msg);
+}
+
+
+bool ReadSelectedFields(FILE * const input, const Leader &leader, const std::vector<DirectoryEntry> &dir_entries,
+			const std::vector<size_t> &field_indices, std::vector<std::string> * const field_data,
+			std::string * const err_msg)
+{
+    field_data->clear();
+    field_data->reserve(field_indices.size());
+    err_msg->clear();
+
+    const long field_data_size(leader.getRecordLength() - leader.getBaseAddressOfData());
+    long position(0); // Relative to the base address of data.
+    for (const size_t field_index : field_indices) {
+	const DirectoryEntry &dir_entry(dir_entries[field_index]);
+	const long field_offset(dir_entry.getFieldOffset()), field_length(dir_entry.getFieldLength());
+	if (field_length == 0 or field_offset + field_length >= field_data_size) {
+	    *err_msg = "misaligned field, extending past the record!";
+	    return false;
+	}
+
+	if (not SkipBytes(input, field_offset - position, err_msg))
+	    return false;
+
+	std::string field(field_length, '\0');
+	if (std::fread(&field[0], 1, field_length, input) != static_cast<size_t>(field_length)) {
+	    *err_msg = "Short read for field data or premature EOF!";
+	    return false;
+	}
+
+	if (field[field_length - 1] != '\x1E') {
+	    *err_msg = "missing field terminator at end of field!";
+	    return false;
+	}
+
+	field.resize(field_length - 1);
+	field_data->push_back(field);
+	position = field_offset + field_length;
+    }
+
+    return SkipBytes(input, field_data_size - position, err_msg);
+}
+
+
+// Returns false on error and EOF.  To distinguish between the two: on EOF "err_msg" is empty but not when an
+// error has been detected.  For each entry in "dir_entries" there will be a corresponding entry in "field_data".
+bool ReadNextRecord(FILE * const input, Leader * const leader, std::vector<DirectoryEntry> * const dir_entries,
+		    std::vector<std::string> * const field_data, std::string * const err_msg)
+{
+    const Stats::StageTimer timer(Stats::READING);
+    field_data->clear();
+    if (not ReadRecordHeader(input, leader, dir_entries, err_msg))
 	return false;
 
     //
     // Parse variable fields.
     //
 
-    const size_t field_data_size((*leader)->getRecordLength() - Leader::LEADER_LENGTH - directory_length);
+    const size_t field_data_size(leader->getRecordLength() - leader->getBaseAddressOfData());
     char raw_field_data[field_data_size];
+    ssize_t read_count;
     if ((read_count = std::fread(raw_field_data, 1, field_data_size, input))
 	!= static_cast<ssize_t>(field_data_size))
 	{
@@ -101,6 +197,8 @@ bool ReadNextRecord(FILE * const input, Leader ** const leader, std::vector<Dire
     if (not ReadFields(std::string(raw_field_data, field_data_size), *dir_entries, field_data, err_msg))
 	return false;
 
+    Stats::CountRawRecord(leader->getRecordLength());
+    Stats::CountParsedRecord(leader->getRecordLength(), dir_entries->size());
     return true;
 }
 
@@ -122,9 +220,13 @@ std::string ComposeRecord(const std::vector<DirectoryEntry> &dir_entries, const
 
     std::string record;
     record.reserve(record_size);
-    record += leader->toString();
-    for (const auto &dir_entry : dir_entries)
-        record +=  dir_entry.toString();
+    record.resize(Leader::LEADER_LENGTH + directory_size);
+    leader->toBuffer(&record[0]);
+    char *entry(&record[Leader::LEADER_LENGTH]);
+    for (const auto &dir_entry : dir_entries) {
+	dir_entry.toBuffer(entry);
+	entry += DirectoryEntry::DIRECTORY_ENTRY_LENGTH;
+    }
     record += '\x1E';
     for (const auto &field : fields) {
 	record += field;
@@ -143,43 +245,42 @@ bool RecordSeemsCorrect(const std::string &record, std::string * const err_msg)
 	return false;
     }
 
-    Leader *raw_leader;
-    if (not Leader::ParseLeader(record.substr(0, Leader::LEADER_LENGTH), &raw_leader, err_msg))
+    Leader leader;
+    if (not Leader::ParseLeader(record.data(), &leader, err_msg))
 	return false;
-    const std::unique_ptr<Leader> leader(raw_leader);
 
-    if (leader->getRecordLength() != record.length()) {
-	*err_msg = "leader's record length (" + std::to_string(leader->getRecordLength())
-	           + ") does not equal actual record length (" + std::to_string(record.length()) + ")!";
+    if (leader.getRecordLength() != record.length()) {
+	*err_msg = "leader's record length (" + std::to_string(leader.getRecordLength())
+		   + ") does not equal actual record length (" + std::to_string(record.length()) + ")!";
 	return false;
     }
 
     if (record.length() > 99999) {
 	*err_msg = "record length (" + std::to_string(record.length())
-                   + ") exceeds maxium legal record length (99999)!";
+		   + ") exceeds maxium legal record length (99999)!";
 	return false;
     } 
 
-    if (leader->getBaseAddressOfData() <= Leader::LEADER_LENGTH) {
+    if (leader.getBaseAddressOfData() <= Leader::LEADER_LENGTH) {
 	*err_msg = "impossible base address of data!";
 	return false;
     }
 
-    const size_t directory_length(leader->getBaseAddressOfData() - Leader::LEADER_LENGTH - 1);
+    const size_t directory_length(leader.getBaseAddressOfData() - Leader::LEADER_LENGTH - 1);
     if ((directory_length % DirectoryEntry::DIRECTORY_ENTRY_LENGTH) != 0) {
 	*err_msg = "directory length is not a multiple of "
-	           + std::to_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH) + "!";
+		   + std::to_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH) + "!";
 	return false;
     }
 
-    if (record[leader->getBaseAddressOfData() - 1] != '\x1E') {
+    if (record[leader.getBaseAddressOfData() - 1] != '\x1E') {
 	*err_msg = "directory is not terminated with a field terminator!";
 	return false;
     }
 
     if (record[record.size() - 1] != '\x1D') {
 	*err_msg = "record is not terminated with a record terminator!";
-        return false;
+	return false;
     }
     
     return true;
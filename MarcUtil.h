@@ -38,11 +38,34 @@ bool ReadFields(const std::string &raw_fields, const std::vector<DirectoryEntry>
 
 // Returns false on error and EOF.  To distinguish between the two: on EOF "err_msg" is empty but not when an
 // error has been detected.  For each entry in "dir_entries" there will be a corresponding entry in "field_data".
-bool ReadNextRecord(FILE * const input, Leader ** const leader, std::vector<DirectoryEntry> * const dir_entries,
+bool ReadNextRecord(FILE * const input, Leader * const leader, std::vector<DirectoryEntry> * const dir_entries,
 		    std::vector<std::string> * const field_data, std::string * const err_msg);
 
 
-// Creates a binary, a.k.a. "raw" representation of a MARC21 record.
+// Reads the leader and the directory of the next record and leaves "input" positioned at the start of the record's
+// field data.  This allows callers to inspect the tags in "dir_entries" before deciding whether to call
+// SkipRecordBody() or ReadSelectedFields(), one of which must be called next.  Returns false on error and EOF like
+// ReadNextRecord().  Leaders whose base address of data or record length leave no room for a directory or field data
+// are reported as errors.
+bool ReadRecordHeader(FILE * const input, Leader * const leader, std::vector<DirectoryEntry> * const dir_entries,
+		      std::string * const err_msg);
+
+
+// Positions "input" at the start of the next record w/o reading the field data of the current record.  Seeks if
+// possible.
+bool SkipRecordBody(FILE * const input, const Leader &leader, std::string * const err_msg);
+
+
+// Reads only the fields w/ the indices "field_indices" into "field_data", seeking past all other fields if
+// possible.  "field_indices" should be sorted by field offset, i.e. in directory order for regular records.
+// Afterwards "input" is positioned at the start of the next record.
+bool ReadSelectedFields(FILE * const input, const Leader &leader, const std::vector<DirectoryEntry> &dir_entries,
+			const std::vector<size_t> &field_indices, std::vector<std::string> * const field_data,
+			std::string * const err_msg);
+
+
+// Creates a binary, a.k.a. "raw" representation of a MARC21 record.  When writing many records MarcWriter::write()
+// should be used instead as it avoids the per-record allocations.
 std::string ComposeRecord(const std::vector<DirectoryEntry> &dir_entries, const std::vector<std::string> &fields,
 			  Leader * const leader);
 
@@ -0,0 +1,209 @@
+/** \file   MarcWriter.cc
+ *  \brief  Implementation of the MarcWriter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "StringUtil.h"
+#include "util.h"
+
+
+const size_t MarcWriter::DEFAULT_BUFFER_SIZE;
+const size_t MarcWriter::MAX_RECORD_LENGTH;
+const size_t MarcWriter::MAX_FIELD_LENGTH;
+
+
+MarcWriter *MarcWriter::MarcWriterFactory(const std::string &output_filename, std::string * const err_msg,
+					  const SyncMode sync_mode, const size_t buffer_size)
+{
+    const int fd(::open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + output_filename + "\" for writing! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    return new MarcWriter(output_filename, fd, sync_mode, std::max(buffer_size, MAX_RECORD_LENGTH));
+}
+
+
+MarcWriter::~MarcWriter() {
+    if (fd_ != -1) {
+	std::string err_msg;
+	if (not close(&err_msg))
+	    Warning(err_msg);
+    }
+}
+
+
+bool MarcWriter::write(const Leader &leader, const std::vector<DirectoryEntry> &dir_entries,
+		       const std::vector<std::string> &fields, std::string * const err_msg)
+{
+    if (dir_entries.size() != fields.size()) {
+	*err_msg = "number of directory entries (" + std::to_string(dir_entries.size())
+		   + ") does not equal the number of fields (" + std::to_string(fields.size()) + ")!";
+	return false;
+    }
+
+    const size_t base_address_of_data(Leader::LEADER_LENGTH
+				      + dir_entries.size() * DirectoryEntry::DIRECTORY_ENTRY_LENGTH + 1);
+    size_t record_length(base_address_of_data);
+    for (const auto &field : fields) {
+	if (field.size() + 1 > MAX_FIELD_LENGTH) {
+	    *err_msg = "field too long (" + std::to_string(field.size() + 1) + " bytes) for a MARC-21 record!";
+	    return false;
+	}
+	record_length += field.size() + 1;
+    }
+    ++record_length; // record terminator
+
+    if (record_length > MAX_RECORD_LENGTH) {
+	*err_msg = "record length (" + std::to_string(record_length) + ") exceeds valid maximum ("
+		   + std::to_string(MAX_RECORD_LENGTH) + ")!";
+	return false;
+    }
+
+    if (buffer_used_ + record_length > buffer_.size() and not flush(err_msg))
+	return false;
+
+    char * const record_start(buffer_.data() + buffer_used_);
+
+    // The leader and its computed lengths:
+    leader.toBuffer(record_start);
+    StringUtil::UnsignedToDecimalDigits(record_length, 5, record_start);
+    StringUtil::UnsignedToDecimalDigits(base_address_of_data, 5, record_start + 12);
+
+    // The directory and the field data:
+    char *entry(record_start + Leader::LEADER_LENGTH);
+    char *field_data(record_start + base_address_of_data);
+    unsigned field_offset(0);
+    for (size_t field_index(0); field_index < fields.size(); ++field_index) {
+	const std::string &field(fields[field_index]);
+	dir_entries[field_index].getTag().toBuffer(entry);
+	StringUtil::UnsignedToDecimalDigits(field.size() + 1, 4, entry + DirectoryEntry::TAG_LENGTH);
+	StringUtil::UnsignedToDecimalDigits(field_offset, 5, entry + DirectoryEntry::TAG_LENGTH + 4);
+	entry += DirectoryEntry::DIRECTORY_ENTRY_LENGTH;
+
+	std::memcpy(field_data, field.data(), field.size());
+	field_data += field.size();
+	*field_data++ = '\x1E';
+	field_offset += field.size() + 1;
+    }
+    *entry = '\x1E';
+    *field_data = '\x1D';
+
+    buffer_used_ += record_length;
+    return true;
+}
+
+
+bool MarcWriter::write(const MarcRecord &record, std::string * const err_msg) {
+    for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	if (record.getField(field_index).size() + 1 > MAX_FIELD_LENGTH) {
+	    *err_msg = "field " + record.getTag(field_index).toString() + " too long ("
+		       + std::to_string(record.getField(field_index).size() + 1) + " bytes) for a MARC-21 record!";
+	    return false;
+	}
+    }
+
+    const size_t record_length(record.getRecordLength());
+    if (record_length > MAX_RECORD_LENGTH) {
+	*err_msg = "record length (" + std::to_string(record_length) + ") exceeds valid maximum ("
+		   + std::to_string(MAX_RECORD_LENGTH) + ")!";
+	return false;
+    }
+
+    if (buffer_used_ + record_length > buffer_.size() and not flush(err_msg))
+	return false;
+
+    record.toBuffer(buffer_.data() + buffer_used_);
+    buffer_used_ += record_length;
+    return true;
+}
+
+
+bool MarcWriter::writeRaw(const Slice &raw_record, std::string * const err_msg) {
+    if (buffer_used_ + raw_record.size() <= buffer_.size()) {
+	std::memcpy(buffer_.data() + buffer_used_, raw_record.data(), raw_record.size());
+	buffer_used_ += raw_record.size();
+	return true;
+    }
+
+    return writeBufferAnd(raw_record.data(), raw_record.size(), err_msg);
+}
+
+
+bool MarcWriter::flush(std::string * const err_msg) {
+    return writeBufferAnd(NULL, 0, err_msg);
+}
+
+
+bool MarcWriter::writeBufferAnd(const char * const extra, const size_t extra_size, std::string * const err_msg) {
+    struct iovec iov[2];
+    iov[0].iov_base = buffer_.data();
+    iov[0].iov_len  = buffer_used_;
+    iov[1].iov_base = const_cast<char *>(extra);
+    iov[1].iov_len  = extra_size;
+
+    // Handle short writes by advancing through the I/O vector.
+    struct iovec *next_iov(iov[0].iov_len > 0 ? iov : iov + 1);
+    const struct iovec * const iov_end(extra_size > 0 ? iov + 2 : iov + 1);
+    while (next_iov < iov_end) {
+	const ssize_t written(::writev(fd_, next_iov, iov_end - next_iov));
+	if (written == -1) {
+	    if (errno == EINTR)
+		continue;
+	    *err_msg = "write to \"" + output_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	    return false;
+	}
+
+	size_t remaining(written);
+	while (next_iov < iov_end and remaining >= next_iov->iov_len) {
+	    remaining -= next_iov->iov_len;
+	    ++next_iov;
+	}
+	if (next_iov < iov_end) {
+	    next_iov->iov_base = static_cast<char *>(next_iov->iov_base) + remaining;
+	    next_iov->iov_len -= remaining;
+	}
+    }
+
+    buffer_used_ = 0;
+    return true;
+}
+
+
+bool MarcWriter::close(std::string * const err_msg) {
+    bool success(flush(err_msg));
+    if (success and sync_mode_ == SYNC_ON_CLOSE and ::fsync(fd_) == -1) {
+	*err_msg = "fsync of \"" + output_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	success = false;
+    }
+
+    if (::close(fd_) == -1 and success) {
+	*err_msg = "close of \"" + output_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	success = false;
+    }
+    fd_ = -1;
+
+    return success;
+}
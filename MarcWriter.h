@@ -0,0 +1,105 @@
+/** \file   MarcWriter.h
+ *  \brief  Interface for the MarcWriter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_WRITER_H
+#define MARC_WRITER_H
+
+
+#include <string>
+#include <vector>
+#include "DirectoryEntry.h"
+#include "Leader.h"
+#include "MarcRecord.h"
+#include "Slice.h"
+
+
+/** \class MarcWriter
+ *  \brief Writes binary MARC-21 records to a file through a large, reusable output buffer.
+ *
+ *  Records are composed directly in the output buffer, including the digits of the leader and the directory, so that
+ *  writing a record does not allocate any memory.  The buffer is flushed w/ few, large write(2) or writev(2) calls.
+ */
+class MarcWriter {
+public:
+    enum SyncMode { NO_SYNC, SYNC_ON_CLOSE };
+    static const size_t DEFAULT_BUFFER_SIZE = 8 * 1024 * 1024;
+    static const size_t MAX_RECORD_LENGTH = 99999; // The leader has 5 digits for the record length.
+    static const size_t MAX_FIELD_LENGTH = 9999;   // A directory entry has 4 digits for the field length.
+private:
+    std::string output_filename_;
+    int fd_;
+    SyncMode sync_mode_;
+    std::vector<char> buffer_;
+    size_t buffer_used_;
+public:
+    /** \brief Creates or truncates "output_filename" and opens it for writing.
+     *  \param sync_mode    If SYNC_ON_CLOSE, close() will fsync(2) the file.  This is much cheaper than syncing
+     *                      periodically and still guarantees that the data is on stable storage once close() returns.
+     *  \param buffer_size  The size of the output buffer.  Values below MAX_RECORD_LENGTH are rounded up.
+     *  \return NULL if "output_filename" could not be opened and then also sets "err_msg".
+     */
+    static MarcWriter *MarcWriterFactory(const std::string &output_filename, std::string * const err_msg,
+					 const SyncMode sync_mode = NO_SYNC,
+					 const size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    /** Calls close() if that has not happened yet.  Errors are reported as warnings. */
+    ~MarcWriter();
+
+    const std::string &getFilename() const { return output_filename_; }
+
+    /** \brief Composes a record from "leader", the tags of "dir_entries" and "fields" in the output buffer.
+     *
+     *  The record length and the base address of data in the leader as well as the field lengths and offsets in the
+     *  directory are computed from "fields", i.e. the corresponding values in "leader" and "dir_entries" are ignored.
+     *
+     *  \param fields  The field contents w/o field terminators.  There must be one for each entry in "dir_entries".
+     *  \return False if the record could not be composed or written and then "err_msg" will be set, else true.
+     */
+    bool write(const Leader &leader, const std::vector<DirectoryEntry> &dir_entries,
+	       const std::vector<std::string> &fields, std::string * const err_msg);
+
+    /** \brief Composes "record" in the output buffer.
+     *  \return False if "record" exceeds the limits of the MARC-21 format or could not be written and then
+     *          "err_msg" will be set, else true.
+     */
+    bool write(const MarcRecord &record, std::string * const err_msg);
+
+    /** \brief Appends an already composed record, e.g. RecordView::getRawRecord(), w/o inspecting it.
+     *  \note  If "raw_record" does not fit into the remaining buffer space, the buffer and "raw_record" are written
+     *         w/ a single writev(2) call instead of copying "raw_record".
+     */
+    bool writeRaw(const Slice &raw_record, std::string * const err_msg);
+
+    /** Writes the contents of the output buffer to the output file. */
+    bool flush(std::string * const err_msg);
+
+    /** Flushes, optionally syncs and closes the output file.  No other member functions may be called afterwards. */
+    bool close(std::string * const err_msg);
+private:
+    MarcWriter(const std::string &output_filename, const int fd, const SyncMode sync_mode, const size_t buffer_size)
+	: output_filename_(output_filename), fd_(fd), sync_mode_(sync_mode), buffer_(buffer_size), buffer_used_(0) {}
+    MarcWriter(const MarcWriter &rhs) = delete;
+    const MarcWriter &operator=(const MarcWriter &rhs) = delete;
+
+    /** Writes the buffer contents followed by the "extra_size" bytes starting at "extra", which may be NULL. */
+    bool writeBufferAnd(const char * const extra, const size_t extra_size, std::string * const err_msg);
+};
+
+
+#endif // ifndef MARC_WRITER_H
@@ -0,0 +1,855 @@
+/** \file   MarcXmlReader.cc
+ *  \brief  Implementation of the MarcXmlReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcXmlReader.h"
+#include <algorithm>
+#include <cstring>
+#include "MarcWriter.h"
+#include "RejectLog.h"
+#include "SmallVector.h"
+#include "Stats.h"
+#include "StringUtil.h"
+
+
+const size_t MarcXmlReader::MAX_RECORD_XML_SIZE;
+
+
+namespace {
+
+
+// The initial number of bytes that we look at.  Large enough for typical records.
+const size_t INITIAL_WINDOW_SIZE(64 * 1024);
+
+// Enough for "&#x10FFFF;".
+const size_t MAX_REFERENCE_LENGTH(10);
+
+// Large enough to make the scan for record start tags efficient.
+const size_t RESYNC_SCAN_SIZE(64 * 1024);
+
+// Element names that are longer than this can't be "record" w/ a reasonable namespace prefix.
+const size_t MAX_NAME_LENGTH(64);
+
+
+inline bool IsXmlSpace(const char ch) {
+    return ch == ' ' or ch == '\t' or ch == '\n' or ch == '\r';
+}
+
+
+/** \return True for the C0 controls other than tab, newline and carriage return, which XML 1.0 forbids. */
+inline bool IsForbiddenControl(const uint32_t code_point) {
+    return code_point < 0x20u and code_point != '\t' and code_point != '\n' and code_point != '\r';
+}
+
+
+inline bool IsNameDelimiter(const char ch) {
+    return IsXmlSpace(ch) or ch == '>' or ch == '/' or ch == '=' or ch == '<' or ch == '"' or ch == '\'';
+}
+
+
+inline const char *Find(const char * const start, const char * const end, const char ch) {
+    return reinterpret_cast<const char *>(std::memchr(start, ch, end - start));
+}
+
+
+inline const char *Find(const char * const start, const char * const end, const char * const s) {
+    return reinterpret_cast<const char *>(::memmem(start, end - start, s, std::strlen(s)));
+}
+
+
+/** \return The part of the qualified name "name" after the namespace prefix, if any. */
+Slice GetLocalName(const Slice &name) {
+    const char * const colon(reinterpret_cast<const char *>(std::memchr(name.data(), ':', name.size())));
+    return colon == NULL ? name : Slice(colon + 1, name.end() - colon - 1);
+}
+
+
+void AppendUtf8(const uint32_t code_point, std::string * const utf8) {
+    if (code_point < 0x80u)
+	*utf8 += static_cast<char>(code_point);
+    else if (code_point < 0x800u) {
+	*utf8 += static_cast<char>(0xC0u | (code_point >> 6u));
+	*utf8 += static_cast<char>(0x80u | (code_point & 0x3Fu));
+    } else if (code_point < 0x10000u) {
+	*utf8 += static_cast<char>(0xE0u | (code_point >> 12u));
+	*utf8 += static_cast<char>(0x80u | ((code_point >> 6u) & 0x3Fu));
+	*utf8 += static_cast<char>(0x80u | (code_point & 0x3Fu));
+    } else {
+	*utf8 += static_cast<char>(0xF0u | (code_point >> 18u));
+	*utf8 += static_cast<char>(0x80u | ((code_point >> 12u) & 0x3Fu));
+	*utf8 += static_cast<char>(0x80u | ((code_point >> 6u) & 0x3Fu));
+	*utf8 += static_cast<char>(0x80u | (code_point & 0x3Fu));
+    }
+}
+
+
+/** \return False if the characters from "start" to "end" contain a forbidden control character, e.g. a subfield
+ *          delimiter, and then sets "err_msg", else true.
+ */
+bool CheckForControls(const char * const start, const char * const end, std::string * const err_msg) {
+    for (const char *ch(start); ch != end; ++ch) {
+	if (IsForbiddenControl(static_cast<unsigned char>(*ch))) {
+	    *err_msg = "forbidden control character (code " + std::to_string(static_cast<unsigned char>(*ch))
+		       + ") in character data or an attribute value!";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+
+/** Appends the characters from "start" to "end" as they are, unless CheckForControls() fails. */
+inline bool AppendLiteral(const char * const start, const char * const end, std::string * const decoded,
+			  std::string * const err_msg)
+{
+    if (not CheckForControls(start, end, err_msg))
+	return false;
+    decoded->append(start, end - start);
+    return true;
+}
+
+
+/** \brief Decodes the reference "name", i.e. what comes between a '&' and a ';', and appends the result. */
+bool AppendReference(const Slice &name, std::string * const decoded, std::string * const err_msg) {
+    if (name == "lt")
+	*decoded += '<';
+    else if (name == "gt")
+	*decoded += '>';
+    else if (name == "amp")
+	*decoded += '&';
+    else if (name == "quot")
+	*decoded += '"';
+    else if (name == "apos")
+	*decoded += '\'';
+    else if (name.size() >= 2 and name[0] == '#') {
+	const bool is_hex(name[1] == 'x');
+	const Slice digits(name.substr(is_hex ? 2 : 1));
+	uint32_t code_point(0);
+	for (const char digit : digits) {
+	    if (digit >= '0' and digit <= '9')
+		code_point = code_point * (is_hex ? 16 : 10) + (digit - '0');
+	    else if (is_hex and digit >= 'a' and digit <= 'f')
+		code_point = code_point * 16 + (digit - 'a' + 10);
+	    else if (is_hex and digit >= 'A' and digit <= 'F')
+		code_point = code_point * 16 + (digit - 'A' + 10);
+	    else {
+		code_point = 0;
+		break;
+	    }
+	}
+	if (digits.empty() or code_point == 0 or code_point > 0x10FFFFu or IsForbiddenControl(code_point)
+	    or (code_point >= 0xD800u and code_point <= 0xDFFFu))
+	{
+	    *err_msg = "invalid character reference \"&" + name.toString() + ";\"!";
+	    return false;
+	}
+	AppendUtf8(code_point, decoded);
+    } else {
+	*err_msg = "unknown entity \"&" + name.toString() + ";\"!";
+	return false;
+    }
+
+    return true;
+}
+
+
+/** Appends "raw", character data or an attribute value, w/ all references replaced by the characters they stand for. */
+bool AppendDecoded(const Slice &raw, std::string * const decoded, std::string * const err_msg) {
+    const char *run_start(raw.data());
+    for (;;) {
+	const char * const ampersand(Find(run_start, raw.end(), '&'));
+	if (ampersand == NULL)
+	    return AppendLiteral(run_start, raw.end(), decoded, err_msg);
+	if (not AppendLiteral(run_start, ampersand, decoded, err_msg))
+	    return false;
+
+	const char * const semicolon(Find(ampersand + 1,
+					  std::min(raw.end(), ampersand + 1 + MAX_REFERENCE_LENGTH), ';'));
+	if (semicolon == NULL) {
+	    *err_msg = "unterminated entity or character reference!";
+	    return false;
+	}
+	if (not AppendReference(Slice(ampersand + 1, semicolon - ampersand - 1), decoded, err_msg))
+	    return false;
+	run_start = semicolon + 1;
+    }
+}
+
+
+/** \return True if "candidate", which points to a '<', is a record start tag, false if it isn't or if that can't be
+ *          decided because "end" comes too early.  In the latter case "decidable" is set to false.
+ */
+bool IsRecordStartTag(const char * const candidate, const char * const end, bool * const decidable) {
+    const char * const name_start(candidate + 1);
+    const char *name_end(name_start);
+    while (name_end != end and not IsNameDelimiter(*name_end)) {
+	if (name_end - name_start == static_cast<ptrdiff_t>(MAX_NAME_LENGTH)) {
+	    *decidable = true;
+	    return false;
+	}
+	++name_end;
+    }
+
+    *decidable = name_end != end;
+    return *decidable and (IsXmlSpace(*name_end) or *name_end == '>' or *name_end == '/')
+	   and GetLocalName(Slice(name_start, name_end - name_start)) == "record";
+}
+
+
+} // unnamed namespace
+
+
+/** \class MarcXmlReader::XmlScanner
+ *  \brief A pull scanner for the subset of XML that is needed for MARCXML.
+ *
+ *  Each call to next() advances to the next start tag, end tag or run of character data in ["start", "end").
+ *  Comments, processing instructions and document type declarations are skipped.  Element names are returned w/o
+ *  their namespace prefixes and character data and attribute values are returned undecoded, i.e. as Slice's into the
+ *  input.
+ */
+class MarcXmlReader::XmlScanner {
+public:
+    enum TokenType { TEXT, CDATA, START_TAG, END_TAG };
+private:
+    struct Attribute {
+	Slice name_, value_;
+    };
+
+    const char *position_;
+    const char * const end_;
+    const char *token_start_;
+    TokenType type_;
+    Slice text_; // The contents of TEXT and CDATA tokens.
+    Slice name_; // The local name of START_TAG and END_TAG tokens.
+    bool is_empty_element_;
+    SmallVector<Attribute, 8> attributes_;
+public:
+    XmlScanner(const char * const start, const char * const end)
+	: position_(start), end_(end), token_start_(start), type_(TEXT), is_empty_element_(false) {}
+
+    /** \return The first byte after the current token. */
+    const char *getPosition() const { return position_; }
+
+    /** \return The first byte of the current token or, after NEED_MORE_INPUT, of the incomplete token. */
+    const char *getTokenStart() const { return token_start_; }
+
+    TokenType getType() const { return type_; }
+    const Slice &getText() const { return text_; }
+    const Slice &getName() const { return name_; }
+    bool isEmptyElement() const { return is_empty_element_; }
+
+    /** \return True if the current token is character data that consists of whitespace only. */
+    bool isSpace() const {
+	return type_ == TEXT and std::find_if(text_.begin(), text_.end(),
+					      [](const char ch) { return not IsXmlSpace(ch); }) == text_.end();
+    }
+
+    /** \brief Looks up the attribute "name" of the current start tag.
+     *  \param value    The decoded value or an empty Slice if the attribute does not exist.  Only points into
+     *                  "scratch" if the value contains references.
+     *  \return False if the value contains a bad reference or a forbidden control character and then also sets
+     *          "err_msg", else true.
+     */
+    bool getAttribute(const char * const name, Slice * const value, std::string * const scratch,
+		      std::string * const err_msg) const;
+
+    /** Advances to the next token. */
+    ParseStatus next(std::string * const err_msg);
+
+    /** \brief Appends the decoded character data of the element whose start tag is the current token and skips its
+     *         end tag.  Elements nested in the element are not allowed.
+     */
+    ParseStatus appendContents(std::string * const contents, std::string * const err_msg);
+private:
+    ParseStatus parseTag(std::string * const err_msg);
+};
+
+
+bool MarcXmlReader::XmlScanner::getAttribute(const char * const name, Slice * const value,
+					     std::string * const scratch, std::string * const err_msg) const
+{
+    for (const auto &attribute : attributes_) {
+	if (attribute.name_ == name) {
+	    if (Find(attribute.value_.begin(), attribute.value_.end(), '&') == NULL) {
+		*value = attribute.value_;
+		return CheckForControls(attribute.value_.begin(), attribute.value_.end(), err_msg);
+	    }
+
+	    scratch->clear();
+	    if (not AppendDecoded(attribute.value_, scratch, err_msg))
+		return false;
+	    *value = Slice(*scratch);
+	    return true;
+	}
+    }
+
+    *value = Slice();
+    return true;
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::XmlScanner::next(std::string * const err_msg) {
+    for (;;) {
+	token_start_ = position_;
+	if (position_ == end_)
+	    return NEED_MORE_INPUT;
+
+	if (*position_ != '<') {
+	    const char * const text_end(Find(position_, end_, '<'));
+	    if (text_end == NULL)
+		return NEED_MORE_INPUT;
+	    type_ = TEXT;
+	    text_ = Slice(position_, text_end - position_);
+	    position_ = text_end;
+	    return PARSED;
+	}
+
+	if (end_ - position_ < 2)
+	    return NEED_MORE_INPUT;
+	if (position_[1] == '?') { // A processing instruction or the XML declaration.
+	    const char * const pi_end(Find(position_ + 2, end_, "?>"));
+	    if (pi_end == NULL)
+		return NEED_MORE_INPUT;
+	    position_ = pi_end + 2;
+	} else if (position_[1] == '!') {
+	    if (end_ - position_ >= 4 and std::memcmp(position_, "<!--", 4) == 0) {
+		const char * const comment_end(Find(position_ + 4, end_, "-->"));
+		if (comment_end == NULL)
+		    return NEED_MORE_INPUT;
+		position_ = comment_end + 3;
+		continue;
+	    }
+
+	    static const size_t CDATA_START_LENGTH(9);
+	    if (end_ - position_ < static_cast<ptrdiff_t>(CDATA_START_LENGTH))
+		return NEED_MORE_INPUT;
+	    if (std::memcmp(position_, "<![CDATA[", CDATA_START_LENGTH) == 0) {
+		const char * const cdata_end(Find(position_ + CDATA_START_LENGTH, end_, "]]>"));
+		if (cdata_end == NULL)
+		    return NEED_MORE_INPUT;
+		type_ = CDATA;
+		text_ = Slice(position_ + CDATA_START_LENGTH, cdata_end - position_ - CDATA_START_LENGTH);
+		position_ = cdata_end + 3;
+		return PARSED;
+	    }
+
+	    // A document type declaration, whose internal subset, if any, is enclosed in square brackets.
+	    const char *declaration_end(position_ + 2);
+	    unsigned bracket_depth(0);
+	    for (; declaration_end != end_; ++declaration_end) {
+		if (*declaration_end == '[')
+		    ++bracket_depth;
+		else if (*declaration_end == ']' and bracket_depth > 0)
+		    --bracket_depth;
+		else if (*declaration_end == '>' and bracket_depth == 0)
+		    break;
+	    }
+	    if (declaration_end == end_)
+		return NEED_MORE_INPUT;
+	    position_ = declaration_end + 1;
+	} else
+	    return parseTag(err_msg);
+    }
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::XmlScanner::parseTag(std::string * const err_msg) {
+    const char *ch(position_ + 1);
+    const bool is_end_tag(*ch == '/');
+    if (is_end_tag)
+	++ch;
+
+    const char * const name_start(ch);
+    while (ch != end_ and not IsNameDelimiter(*ch))
+	++ch;
+    if (ch == end_)
+	return NEED_MORE_INPUT;
+    if (ch == name_start) {
+	*err_msg = "missing element name!";
+	return MALFORMED;
+    }
+    name_ = GetLocalName(Slice(name_start, ch - name_start));
+
+    attributes_.clear();
+    is_empty_element_ = false;
+    for (;;) {
+	while (ch != end_ and IsXmlSpace(*ch))
+	    ++ch;
+	if (ch == end_)
+	    return NEED_MORE_INPUT;
+
+	if (*ch == '>') {
+	    ++ch;
+	    break;
+	}
+	if (*ch == '/' and not is_end_tag) {
+	    if (ch + 1 == end_)
+		return NEED_MORE_INPUT;
+	    if (ch[1] != '>')
+		break;
+	    is_empty_element_ = true;
+	    ch += 2;
+	    break;
+	}
+	if (is_end_tag)
+	    break;
+
+	const char * const attribute_name_start(ch);
+	while (ch != end_ and not IsNameDelimiter(*ch))
+	    ++ch;
+	const Slice attribute_name(attribute_name_start, ch - attribute_name_start);
+	while (ch != end_ and IsXmlSpace(*ch))
+	    ++ch;
+	if (ch == end_)
+	    return NEED_MORE_INPUT;
+	if (attribute_name.empty() or *ch != '=') {
+	    *err_msg = "malformed attribute in the tag of <" + name_.toString() + ">!";
+	    return MALFORMED;
+	}
+	++ch;
+	while (ch != end_ and IsXmlSpace(*ch))
+	    ++ch;
+	if (ch == end_)
+	    return NEED_MORE_INPUT;
+	if (*ch != '"' and *ch != '\'') {
+	    *err_msg = "unquoted attribute value in the tag of <" + name_.toString() + ">!";
+	    return MALFORMED;
+	}
+	const char * const value_end(Find(ch + 1, end_, *ch));
+	if (value_end == NULL)
+	    return NEED_MORE_INPUT;
+	attributes_.push_back(Attribute{ attribute_name, Slice(ch + 1, value_end - ch - 1) });
+	ch = value_end + 1;
+    }
+
+    if (ch[-1] != '>') {
+	*err_msg = "malformed tag of <" + name_.toString() + ">!";
+	return MALFORMED;
+    }
+
+    type_ = is_end_tag ? END_TAG : START_TAG;
+    position_ = ch;
+    return PARSED;
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::XmlScanner::appendContents(std::string * const contents,
+								     std::string * const err_msg)
+{
+    if (is_empty_element_)
+	return PARSED;
+
+    const Slice element_name(name_);
+    for (;;) {
+	const ParseStatus status(next(err_msg));
+	if (status != PARSED)
+	    return status;
+
+	switch (type_) {
+	case TEXT:
+	    if (not AppendDecoded(text_, contents, err_msg))
+		return MALFORMED;
+	    break;
+	case CDATA:
+	    if (not AppendLiteral(text_.begin(), text_.end(), contents, err_msg))
+		return MALFORMED;
+	    break;
+	case START_TAG:
+	    *err_msg = "unexpected element <" + name_.toString() + "> in <" + element_name.toString() + ">!";
+	    return MALFORMED;
+	case END_TAG:
+	    if (name_ != element_name) {
+		*err_msg = "unexpected end tag </" + name_.toString() + "> in <" + element_name.toString() + ">!";
+		return MALFORMED;
+	    }
+	    return PARSED;
+	}
+    }
+}
+
+
+MarcXmlReader::MarcXmlReader(MarcReader * const input)
+    : input_(input), window_size_(INITIAL_WINDOW_SIZE), record_offset_(0), record_xml_size_(0)
+{
+    leader_.reserve(Leader::LEADER_LENGTH);
+    field_data_.reserve(MarcWriter::MAX_RECORD_LENGTH);
+    record_.reserve(MarcWriter::MAX_RECORD_LENGTH);
+}
+
+
+bool MarcXmlReader::IsMarcXml(const char * const data, const size_t size) {
+    const char *ch(data);
+    const char * const end(data + size);
+    if (size >= 3 and std::memcmp(ch, "\xEF\xBB\xBF", 3) == 0)
+	ch += 3;
+    while (ch != end and IsXmlSpace(*ch))
+	++ch;
+    return ch != end and *ch == '<';
+}
+
+
+bool MarcXmlReader::getNextRawRecord(Slice * const raw_record, std::string * const err_msg) {
+    const Stats::StageTimer timer(Stats::PARSING);
+    err_msg->clear();
+    for (;;) {
+	size_t record_offset;
+	const ParseStatus status(readRecord(&record_offset, err_msg));
+	if (status == NEED_MORE_INPUT)
+	    return false;
+
+	if (status == PARSED) {
+	    *raw_record = Slice(record_);
+	    record_offset_ = record_offset;
+	    record_xml_size_ = tell() - record_offset;
+	    if (not validate_utf8_ or ValidateUtf8(*raw_record, err_msg))
+		return true;
+
+	    if (reject_log_ == NULL) {
+		*err_msg += " (Record starting at file offset " + std::to_string(record_offset) + ".)";
+		return false;
+	    }
+	    reject_log_->log(record_offset_, record_xml_size_, *err_msg);
+	    err_msg->clear();
+	    continue;
+	}
+
+	if (reject_log_ == NULL) {
+	    *err_msg += " (At file offset " + std::to_string(tell()) + ".)";
+	    return false;
+	}
+	const std::string reason(*err_msg);
+	err_msg->clear();
+	if (not resync(reason, err_msg))
+	    return false;
+    }
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::readRecord(size_t * const record_offset, std::string * const err_msg) {
+    for (;;) {
+	size_t available;
+	const char * const window(peek(window_size_, &available, err_msg));
+	if (not err_msg->empty())
+	    return NEED_MORE_INPUT;
+	const char * const window_end(window + available);
+	const bool input_ended(available < window_size_);
+
+	if (tell() == 0 and available >= 3 and std::memcmp(window, "\xEF\xBB\xBF", 3) == 0) { // A byte order mark.
+	    skip(3);
+	    continue;
+	}
+
+	// Skip everything up to the next record start tag:
+	XmlScanner scanner(window, window_end);
+	ParseStatus status;
+	while ((status = scanner.next(err_msg)) == PARSED) {
+	    const XmlScanner::TokenType type(scanner.getType());
+	    if (type == XmlScanner::START_TAG and scanner.getName() == "record")
+		break;
+	    if (type == XmlScanner::TEXT and scanner.isSpace())
+		continue;
+	    if ((type == XmlScanner::START_TAG or type == XmlScanner::END_TAG) and scanner.getName() == "collection")
+		continue;
+
+	    if (type == XmlScanner::START_TAG)
+		*err_msg = "unexpected element <" + scanner.getName().toString() + "> outside of <record>!";
+	    else if (type == XmlScanner::END_TAG)
+		*err_msg = "unexpected end tag </" + scanner.getName().toString() + ">!";
+	    else
+		*err_msg = "unexpected character data outside of <record>!";
+	    status = MALFORMED;
+	    break;
+	}
+
+	const char * const token_start(scanner.getTokenStart());
+	skip(token_start - window);
+	if (status == MALFORMED)
+	    return MALFORMED;
+	if (status == NEED_MORE_INPUT) {
+	    if (input_ended) {
+		if (std::all_of(token_start, window_end, IsXmlSpace)) {
+		    skip(window_end - token_start);
+		    return NEED_MORE_INPUT;
+		}
+		*err_msg = *token_start == '<' ? "premature end of input!"
+					       : "unexpected character data at the end of the input!";
+		return MALFORMED;
+	    }
+	    if (token_start == window and not growWindow(err_msg))
+		return MALFORMED;
+	    continue;
+	}
+
+	// Parse the record:
+	*record_offset = tell();
+	if (scanner.isEmptyElement()) {
+	    *err_msg = "<record> w/o contents!";
+	    return MALFORMED;
+	}
+	XmlScanner record_scanner(scanner.getPosition(), std::min(window_end, token_start + MAX_RECORD_XML_SIZE));
+	status = parseRecord(&record_scanner, err_msg);
+	if (status == PARSED) {
+	    composeRecord();
+	    skip(record_scanner.getPosition() - token_start);
+	    return PARSED;
+	}
+	if (status == MALFORMED)
+	    return MALFORMED;
+
+	if (window_end - token_start >= static_cast<ptrdiff_t>(MAX_RECORD_XML_SIZE)) {
+	    *err_msg = "<record> exceeds the maximum of " + std::to_string(MAX_RECORD_XML_SIZE) + " bytes!";
+	    return MALFORMED;
+	}
+	if (input_ended) {
+	    *err_msg = "premature end of input in <record>!";
+	    return MALFORMED;
+	}
+	if (token_start == window and not growWindow(err_msg))
+	    return MALFORMED;
+    }
+}
+
+
+bool MarcXmlReader::growWindow(std::string * const err_msg) {
+    if (window_size_ >= MAX_RECORD_XML_SIZE) {
+	*err_msg = "markup exceeds the maximum of " + std::to_string(MAX_RECORD_XML_SIZE) + " bytes!";
+	return false;
+    }
+
+    window_size_ = std::min(2 * window_size_, MAX_RECORD_XML_SIZE);
+    return true;
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::parseRecord(XmlScanner * const scanner, std::string * const err_msg) {
+    leader_.clear();
+    fields_.clear();
+    field_data_.clear();
+    bool has_leader(false);
+    for (;;) {
+	ParseStatus status(scanner->next(err_msg));
+	if (status != PARSED)
+	    return status;
+
+	if (scanner->getType() == XmlScanner::END_TAG) {
+	    if (scanner->getName() != "record") {
+		*err_msg = "unexpected end tag </" + scanner->getName().toString() + "> in <record>!";
+		return MALFORMED;
+	    }
+	    break;
+	}
+	if (scanner->getType() != XmlScanner::START_TAG) {
+	    if (scanner->isSpace())
+		continue;
+	    *err_msg = "unexpected character data in <record>!";
+	    return MALFORMED;
+	}
+
+	if (scanner->getName() == "leader") {
+	    has_leader = true;
+	    status = scanner->appendContents(&leader_, err_msg);
+	} else if (scanner->getName() == "controlfield")
+	    status = parseControlField(scanner, err_msg);
+	else if (scanner->getName() == "datafield")
+	    status = parseDataField(scanner, err_msg);
+	else {
+	    *err_msg = "unexpected element <" + scanner->getName().toString() + "> in <record>!";
+	    return MALFORMED;
+	}
+	if (status != PARSED)
+	    return status;
+    }
+
+    if (not has_leader) {
+	*err_msg = "<record> w/o <leader>!";
+	return MALFORMED;
+    }
+    if (leader_.size() != Leader::LEADER_LENGTH) {
+	*err_msg = "<leader> has " + std::to_string(leader_.size()) + " instead of "
+		   + std::to_string(Leader::LEADER_LENGTH) + " bytes!";
+	return MALFORMED;
+    }
+
+    const size_t record_length(Leader::LEADER_LENGTH + fields_.size() * DirectoryEntry::DIRECTORY_ENTRY_LENGTH + 1
+			       + field_data_.size() + 1);
+    if (record_length > MarcWriter::MAX_RECORD_LENGTH) {
+	*err_msg = "record length (" + std::to_string(record_length) + ") exceeds valid maximum ("
+		   + std::to_string(MarcWriter::MAX_RECORD_LENGTH) + ")!";
+	return MALFORMED;
+    }
+
+    return PARSED;
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::parseControlField(XmlScanner * const scanner, std::string * const err_msg)
+{
+    Slice tag;
+    if (not scanner->getAttribute("tag", &tag, &attribute_, err_msg))
+	return MALFORMED;
+    if (tag.size() != DirectoryEntry::TAG_LENGTH) {
+	*err_msg = "<controlfield> w/o a valid tag!";
+	return MALFORMED;
+    }
+    const MarcTag marc_tag(tag.data());
+
+    const size_t field_start(field_data_.size());
+    const ParseStatus status(scanner->appendContents(&field_data_, err_msg));
+    if (status != PARSED)
+	return status;
+
+    return finishField(marc_tag, field_start, err_msg) ? PARSED : MALFORMED;
+}
+
+
+MarcXmlReader::ParseStatus MarcXmlReader::parseDataField(XmlScanner * const scanner, std::string * const err_msg) {
+    Slice value;
+    if (not scanner->getAttribute("tag", &value, &attribute_, err_msg))
+	return MALFORMED;
+    if (value.size() != DirectoryEntry::TAG_LENGTH) {
+	*err_msg = "<datafield> w/o a valid tag!";
+	return MALFORMED;
+    }
+    const MarcTag tag(value.data());
+
+    const size_t field_start(field_data_.size());
+    for (const char * const indicator : { "ind1", "ind2" }) {
+	if (not scanner->getAttribute(indicator, &value, &attribute_, err_msg))
+	    return MALFORMED;
+	if (value.size() > 1) {
+	    *err_msg = "<datafield> w/ tag " + tag.toString() + " has a bad " + indicator + "!";
+	    return MALFORMED;
+	}
+	field_data_ += value.empty() ? ' ' : value[0]; // A missing indicator is taken to be blank.
+    }
+
+    if (not scanner->isEmptyElement()) {
+	for (;;) {
+	    ParseStatus status(scanner->next(err_msg));
+	    if (status != PARSED)
+		return status;
+
+	    if (scanner->getType() == XmlScanner::END_TAG and scanner->getName() == "datafield")
+		break;
+	    if (scanner->isSpace())
+		continue;
+	    if (scanner->getType() != XmlScanner::START_TAG or scanner->getName() != "subfield") {
+		*err_msg = "unexpected markup or character data in <datafield> w/ tag " + tag.toString() + "!";
+		return MALFORMED;
+	    }
+
+	    if (not scanner->getAttribute("code", &value, &attribute_, err_msg))
+		return MALFORMED;
+	    if (value.size() != 1) {
+		*err_msg = "<subfield> w/o a valid code in <datafield> w/ tag " + tag.toString() + "!";
+		return MALFORMED;
+	    }
+	    field_data_ += '\x1F';
+	    field_data_ += value[0];
+	    if ((status = scanner->appendContents(&field_data_, err_msg)) != PARSED)
+		return status;
+	}
+    }
+
+    return finishField(tag, field_start, err_msg) ? PARSED : MALFORMED;
+}
+
+
+bool MarcXmlReader::finishField(const MarcTag &tag, const size_t field_start, std::string * const err_msg) {
+    field_data_ += '\x1E';
+    const size_t field_length(field_data_.size() - field_start);
+    if (field_length > MarcWriter::MAX_FIELD_LENGTH) {
+	*err_msg = "field " + tag.toString() + " too long (" + std::to_string(field_length)
+		   + " bytes) for a MARC-21 record!";
+	return false;
+    }
+
+    fields_.push_back(Field{ tag, field_length });
+    return true;
+}
+
+
+void MarcXmlReader::composeRecord() {
+    const size_t base_address_of_data(Leader::LEADER_LENGTH
+				      + fields_.size() * DirectoryEntry::DIRECTORY_ENTRY_LENGTH + 1);
+    const size_t record_length(base_address_of_data + field_data_.size() + 1);
+    record_.resize(record_length);
+
+    char * const record_start(&record_[0]);
+    std::memcpy(record_start, leader_.data(), Leader::LEADER_LENGTH);
+    StringUtil::UnsignedToDecimalDigits(record_length, 5, record_start);
+    StringUtil::UnsignedToDecimalDigits(base_address_of_data, 5, record_start + 12);
+    // The indicator and subfield code counts and the entry map are implied by the binary format that we compose, so
+    // sloppy values in the XML must not make the record unparsable.
+    record_start[10] = record_start[11] = '2';
+    std::memcpy(record_start + 20, "4500", 4);
+
+    char *entry(record_start + Leader::LEADER_LENGTH);
+    size_t field_offset(0);
+    for (const auto &field : fields_) {
+	field.tag_.toBuffer(entry);
+	StringUtil::UnsignedToDecimalDigits(field.length_, 4, entry + DirectoryEntry::TAG_LENGTH);
+	StringUtil::UnsignedToDecimalDigits(field_offset, 5, entry + DirectoryEntry::TAG_LENGTH + 4);
+	entry += DirectoryEntry::DIRECTORY_ENTRY_LENGTH;
+	field_offset += field.length_;
+    }
+    *entry = '\x1E';
+
+    std::memcpy(record_start + base_address_of_data, field_data_.data(), field_data_.size());
+    record_[record_length - 1] = '\x1D';
+}
+
+
+bool MarcXmlReader::resync(const std::string &reason, std::string * const err_msg) {
+    const size_t reject_offset(tell());
+    skip(1); // We know that the current position is not the start of a valid record.
+
+    bool found_record_start(false);
+    while (not found_record_start) {
+	size_t available;
+	const char * const scan_start(peek(RESYNC_SCAN_SIZE, &available, err_msg));
+	if (available == 0)
+	    break;
+
+	const char * const scan_end(scan_start + available);
+	const char *candidate(scan_start);
+	for (;;) {
+	    candidate = Find(candidate, scan_end, '<');
+	    if (candidate == NULL) {
+		skip(available);
+		break;
+	    }
+
+	    bool decidable;
+	    if (IsRecordStartTag(candidate, scan_end, &decidable)) {
+		skip(candidate - scan_start);
+		found_record_start = true;
+		break;
+	    }
+	    if (not decidable and available >= RESYNC_SCAN_SIZE) { // Look at the candidate again w/ more input.
+		skip(candidate - scan_start);
+		break;
+	    }
+	    ++candidate;
+	}
+    }
+
+    reject_log_->log(reject_offset, tell() - reject_offset, reason);
+    return found_record_start;
+}
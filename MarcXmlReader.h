@@ -0,0 +1,123 @@
+/** \file   MarcXmlReader.h
+ *  \brief  Interface for the MarcXmlReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_XML_READER_H
+#define MARC_XML_READER_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "MarcReader.h"
+#include "MarcTag.h"
+
+
+/** \class MarcXmlReader
+ *  \brief Reads MARCXML, i.e. records in the "MARC 21 XML slim" schema, and hands them out as binary MARC-21 records.
+ *
+ *  The XML is pulled through the peek()/skip() interface of another reader, so that all of their backends and
+ *  decompressors can be used, and only the current record has to be contiguously available.  No XML tree gets built:
+ *  a pull scanner returns the tags and character data as Slice's into the input and only character data that
+ *  contains entity or character references, or CDATA sections, gets decoded.  The field contents are appended to a
+ *  reusable buffer that becomes the data of the binary record once the directory has been computed, so that
+ *  RecordView, Subfields and all other code that works on binary records can be used unchanged.
+ *
+ *  The memory use does not depend on the size of the input.  Records whose XML exceeds MAX_RECORD_XML_SIZE or that
+ *  don't fit into the limits of the binary format are treated like corrupt records, i.e. they end the input unless
+ *  the tolerant mode has been enabled.  Namespace prefixes are accepted but not checked, as are DTD's, which are
+ *  skipped.  tell() and the offsets in error messages and in the reject log refer to the XML.
+ */
+class MarcXmlReader: public MarcReader {
+public:
+    static const size_t MAX_RECORD_XML_SIZE = 16 * 1024 * 1024;
+private:
+    enum ParseStatus { PARSED, NEED_MORE_INPUT, MALFORMED };
+    class XmlScanner;
+
+    struct Field {
+	MarcTag tag_;
+	size_t length_; // Including the field terminator.
+    };
+
+    const std::unique_ptr<MarcReader> input_;
+    size_t window_size_;      // The number of bytes that we ask "input_" for.
+    std::string leader_;
+    std::vector<Field> fields_;
+    std::string field_data_;  // The contents of "fields_", each w/ a field terminator.
+    std::string attribute_;   // Decoded attribute values that contain references.
+    std::string record_;
+    size_t record_offset_, record_xml_size_; // Where the XML of "record_" was found.
+public:
+    /** \param input  Will be owned by us and must neither be in the tolerant mode nor validate UTF-8. */
+    explicit MarcXmlReader(MarcReader * const input);
+
+    /** \return True if "data", the start of a file, looks like XML, i.e. if its first character that is neither a
+     *          byte order mark nor whitespace is a '<'.  Binary MARC-21 records start w/ a digit.
+     */
+    static bool IsMarcXml(const char * const data, const size_t size);
+
+    /** Returns the next record, composed in a buffer that is reused by the next call. */
+    bool getNextRawRecord(Slice * const raw_record, std::string * const err_msg) override;
+
+    const std::string &getFilename() const override { return input_->getFilename(); }
+    size_t tell() const override { return input_->tell(); }
+
+    /** Returns the offset and the size of the XML of the last record. */
+    size_t locateRecord(const Slice &/* raw_record */, size_t * const input_size) const override
+	{ *input_size = record_xml_size_; return record_offset_; }
+protected:
+    const char *peek(const size_t min_size, size_t * const available, std::string * const err_msg) override
+	{ return input_->peek(min_size, available, err_msg); }
+
+    void skip(const size_t count) override { input_->skip(count); }
+private:
+    MarcXmlReader(const MarcXmlReader &rhs) = delete;
+    const MarcXmlReader &operator=(const MarcXmlReader &rhs) = delete;
+
+    /** \brief Skips the input up to the next record, parses it and composes it in "record_".
+     *  \param record_offset  Set to the offset of the record start tag if a record has been parsed.
+     *  \return NEED_MORE_INPUT if the input has ended, w/ "err_msg" set if it could not be read.  After MALFORMED the
+     *          current position is the start of the offending markup.
+     */
+    ParseStatus readRecord(size_t * const record_offset, std::string * const err_msg);
+
+    /** Doubles "window_size_" unless that would exceed MAX_RECORD_XML_SIZE. */
+    bool growWindow(std::string * const err_msg);
+
+    /** Parses the contents and the end tag of a record element into "leader_", "fields_" and "field_data_".
+     *  "scanner" has to start right after the start tag. */
+    ParseStatus parseRecord(XmlScanner * const scanner, std::string * const err_msg);
+
+    ParseStatus parseControlField(XmlScanner * const scanner, std::string * const err_msg);
+    ParseStatus parseDataField(XmlScanner * const scanner, std::string * const err_msg);
+
+    /** Terminates the field that starts at "field_start" in "field_data_" and adds it to "fields_". */
+    bool finishField(const MarcTag &tag, const size_t field_start, std::string * const err_msg);
+
+    /** Composes the binary record from "leader_", "fields_" and "field_data_" in "record_". */
+    void composeRecord();
+
+    /** \brief Skips the input up to the start of the next record element and logs the skipped bytes w/ "reason".
+     *  \return False if the input ended first, else true.
+     */
+    bool resync(const std::string &reason, std::string * const err_msg);
+};
+
+
+#endif // ifndef MARC_XML_READER_H
@@ -0,0 +1,258 @@
+/** \file   MarcXmlWriter.cc
+ *  \brief  Implementation of the MarcXmlWriter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MarcXmlWriter.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "Marc8.h"
+#include "MarcTag.h"
+#include "SubfieldView.h"
+#include "util.h"
+
+
+const size_t MarcXmlWriter::DEFAULT_BUFFER_SIZE;
+
+
+namespace {
+
+
+const char COLLECTION_START[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				"<collection xmlns=\"http://www.loc.gov/MARC21/slim\">\n";
+const char COLLECTION_END[] = "</collection>\n";
+
+
+inline bool NeedsEscaping(const char ch) {
+    return static_cast<unsigned char>(ch) < 0x20u or ch == '<' or ch == '>' or ch == '&' or ch == '"';
+}
+
+
+/** \return The first character in ["ch", "end") that needs escaping or "end" if there is none. */
+const char *FindCharacterToEscape(const char *ch, const char * const end) {
+#ifdef __SSE2__
+    const __m128i less_thans(_mm_set1_epi8('<')), greater_thans(_mm_set1_epi8('>')),
+	ampersands(_mm_set1_epi8('&')), quotes(_mm_set1_epi8('"')), max_controls(_mm_set1_epi8(0x1F));
+    while (end - ch >= static_cast<ptrdiff_t>(sizeof(__m128i))) {
+	const __m128i chunk(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ch)));
+	const __m128i markup(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, less_thans),
+						       _mm_cmpeq_epi8(chunk, greater_thans)),
+					  _mm_or_si128(_mm_cmpeq_epi8(chunk, ampersands),
+						       _mm_cmpeq_epi8(chunk, quotes))));
+	const __m128i controls(_mm_cmpeq_epi8(_mm_min_epu8(chunk, max_controls), chunk));
+	const unsigned to_escape_mask(_mm_movemask_epi8(_mm_or_si128(markup, controls)));
+	if (to_escape_mask != 0)
+	    return ch + __builtin_ctz(to_escape_mask);
+	ch += sizeof(__m128i);
+    }
+#endif
+    while (ch != end and not NeedsEscaping(*ch))
+	++ch;
+    return ch;
+}
+
+
+/** \brief Appends "data" w/ the escapes required in character data and in quoted attribute values.
+ *  \return False if "data" contains a control character that XML 1.0 does not allow, else true.
+ */
+bool AppendEscaped(const Slice &data, std::string * const xml) {
+    const char * const end(data.data() + data.size());
+    const char *run_start(data.data());
+    for (;;) {
+	const char * const ch(FindCharacterToEscape(run_start, end));
+	xml->append(run_start, ch - run_start);
+	if (ch == end)
+	    return true;
+
+	switch (*ch) {
+	case '<':
+	    xml->append("&lt;", 4);
+	    break;
+	case '>':
+	    xml->append("&gt;", 4);
+	    break;
+	case '&':
+	    xml->append("&amp;", 5);
+	    break;
+	case '"':
+	    xml->append("&quot;", 6);
+	    break;
+	case '\t':
+	case '\n':
+	    *xml += *ch;
+	    break;
+	case '\r': // Would otherwise be lost to the line-end normalisation of XML parsers.
+	    xml->append("&#13;", 5);
+	    break;
+	default:
+	    return false;
+	}
+	run_start = ch + 1;
+    }
+}
+
+
+/** \brief Appends "record" as a <record> element on a line of its own.
+ *  \return False if "record" can't be represented in XML and then sets "err_msg" and leaves "xml" unchanged.
+ */
+template<typename RecordType> bool AppendRecord(const RecordType &record, std::string * const xml,
+						std::string * const err_msg)
+{
+    const size_t record_start(xml->size());
+    xml->append("<record><leader>", 16);
+    if (not AppendEscaped(record.getLeader(), xml)) {
+	xml->resize(record_start);
+	*err_msg = "the leader contains a control character!";
+	return false;
+    }
+    xml->append("</leader>", 9);
+
+    for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	char tag_chars[DirectoryEntry::TAG_LENGTH];
+	const MarcTag tag(record.getTag(field_index));
+	tag.toBuffer(tag_chars);
+	const Slice field(record.getField(field_index));
+	bool valid;
+	if (tag.isControlFieldTag()) {
+	    xml->append("<controlfield tag=\"", 19);
+	    valid = AppendEscaped(Slice(tag_chars, sizeof tag_chars), xml);
+	    xml->append("\">", 2);
+	    valid = AppendEscaped(field, xml) and valid;
+	    xml->append("</controlfield>", 15);
+	} else {
+	    xml->append("<datafield tag=\"", 16);
+	    valid = AppendEscaped(Slice(tag_chars, sizeof tag_chars), xml);
+	    xml->append("\" ind1=\"", 8);
+	    valid = AppendEscaped(field.size() < 1 ? Slice(" ", 1) : Slice(field.data(), 1), xml) and valid;
+	    xml->append("\" ind2=\"", 8);
+	    valid = AppendEscaped(field.size() < 2 ? Slice(" ", 1) : Slice(field.data() + 1, 1), xml) and valid;
+	    xml->append("\">", 2);
+	    const SubfieldView subfields(field);
+	    for (const auto &code_and_value : subfields) {
+		xml->append("<subfield code=\"", 16);
+		valid = AppendEscaped(Slice(&code_and_value.first, 1), xml) and valid;
+		xml->append("\">", 2);
+		valid = AppendEscaped(code_and_value.second, xml) and valid;
+		xml->append("</subfield>", 11);
+	    }
+	    xml->append("</datafield>", 12);
+	}
+
+	if (not valid) {
+	    xml->resize(record_start);
+	    *err_msg = "field " + tag.toString() + " contains a control character that can't be represented in XML!";
+	    return false;
+	}
+    }
+
+    xml->append("</record>\n", 10);
+    return true;
+}
+
+
+} // unnamed namespace
+
+
+MarcXmlWriter *MarcXmlWriter::MarcXmlWriterFactory(const std::string &output_filename, std::string * const err_msg,
+						   const size_t buffer_size)
+{
+    const int fd(::open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + output_filename + "\" for writing! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    return new MarcXmlWriter(output_filename, fd, buffer_size);
+}
+
+
+MarcXmlWriter::MarcXmlWriter(const std::string &output_filename, const int fd, const size_t buffer_size)
+    : output_filename_(output_filename), fd_(fd), buffer_size_(buffer_size), converted_(&arena_)
+{
+    // Records are only flushed after they have been appended, so leave some room for the one that fills the buffer.
+    buffer_.reserve(buffer_size_ + buffer_size_ / 4);
+    buffer_.append(COLLECTION_START, sizeof(COLLECTION_START) - 1);
+}
+
+
+MarcXmlWriter::~MarcXmlWriter() {
+    if (fd_ != -1) {
+	std::string err_msg;
+	if (not close(&err_msg))
+	    Warning(err_msg);
+    }
+}
+
+
+MarcXmlWriter::WriteStatus MarcXmlWriter::write(const RecordView &record, std::string * const err_msg,
+						size_t * const replacement_count)
+{
+    if (record.getLeader()[9] == ' ') {
+	arena_.reset();
+	const size_t record_replacement_count(Marc8::ConvertRecord(record, &converted_));
+	if (replacement_count != NULL)
+	    *replacement_count += record_replacement_count;
+	return write(converted_, err_msg);
+    }
+
+    if (not AppendRecord(record, &buffer_, err_msg))
+	return REJECTED;
+    return flushIfFull(err_msg) ? WRITTEN : FAILED;
+}
+
+
+MarcXmlWriter::WriteStatus MarcXmlWriter::write(const MarcRecord &record, std::string * const err_msg) {
+    if (not AppendRecord(record, &buffer_, err_msg))
+	return REJECTED;
+    return flushIfFull(err_msg) ? WRITTEN : FAILED;
+}
+
+
+bool MarcXmlWriter::flush(std::string * const err_msg) {
+    size_t written(0);
+    while (written < buffer_.size()) {
+	const ssize_t count(::write(fd_, buffer_.data() + written, buffer_.size() - written));
+	if (count == -1) {
+	    if (errno == EINTR)
+		continue;
+	    *err_msg = "write to \"" + output_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	    return false;
+	}
+	written += count;
+    }
+
+    buffer_.clear();
+    return true;
+}
+
+
+bool MarcXmlWriter::close(std::string * const err_msg) {
+    buffer_.append(COLLECTION_END, sizeof(COLLECTION_END) - 1);
+    bool success(flush(err_msg));
+    if (::close(fd_) == -1 and success) {
+	*err_msg = "close of \"" + output_filename_ + "\" failed! (" + std::strerror(errno) + ")";
+	success = false;
+    }
+    fd_ = -1;
+
+    return success;
+}
@@ -0,0 +1,96 @@
+/** \file   MarcXmlWriter.h
+ *  \brief  Interface for the MarcXmlWriter class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MARC_XML_WRITER_H
+#define MARC_XML_WRITER_H
+
+
+#include <string>
+#include "Arena.h"
+#include "MarcRecord.h"
+#include "RecordView.h"
+
+
+/** \class MarcXmlWriter
+ *  \brief Writes records as a MARCXML collection, i.e. in the "MARC 21 XML slim" schema, to a file.
+ *
+ *  The XML is composed straight from the field bytes in a large, reusable output buffer, one record per line, and
+ *  written w/ few, large write(2) calls, so that arbitrarily many records can be written w/ constant memory use.
+ *  The characters that need escaping are located 16 bytes at a time w/ SSE2.  MARC-8 records, i.e. those w/ a
+ *  blank in leader/09, are converted to UTF-8 and get an 'a' in leader/09.  The fields of UTF-8 records are copied
+ *  as is, so ill-formed UTF-8 should be rejected beforehand, e.g. w/ MarcReader::setValidateUtf8().
+ */
+class MarcXmlWriter {
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 8 * 1024 * 1024;
+
+    enum WriteStatus {
+	WRITTEN,   // The record has been appended.
+	REJECTED,  // The record can't be represented in XML, nothing has been appended.
+	FAILED     // The output file could not be written.
+    };
+private:
+    std::string output_filename_;
+    int fd_;
+    const size_t buffer_size_;
+    std::string buffer_;
+    Arena arena_;          // Holds "converted_".
+    MarcRecord converted_; // The UTF-8 version of the last MARC-8 record.
+public:
+    /** \brief Creates or truncates "output_filename", opens it for writing and starts the collection.
+     *  \param buffer_size  The buffer gets written once it holds at least this many bytes.
+     *  \return NULL if "output_filename" could not be opened and then also sets "err_msg".
+     */
+    static MarcXmlWriter *MarcXmlWriterFactory(const std::string &output_filename, std::string * const err_msg,
+					       const size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+    /** Calls close() if that has not happened yet.  Errors are reported as warnings. */
+    ~MarcXmlWriter();
+
+    const std::string &getFilename() const { return output_filename_; }
+
+    /** \brief Appends "record" to the collection.
+     *  \param replacement_count  If not NULL, the number of MARC-8 characters that could not be converted and were
+     *                            replaced by U+FFFD will be added here.
+     *  \return REJECTED if "record" can't be represented in XML, i.e. contains control characters other than tabs,
+     *          newlines and carriage returns, and FAILED if the output could not be written.  In both cases
+     *          "err_msg" will be set.
+     */
+    WriteStatus write(const RecordView &record, std::string * const err_msg, size_t * const replacement_count = NULL);
+
+    /** Like the above but "record" is always written as is, i.e. its fields should already be UTF-8 encoded. */
+    WriteStatus write(const MarcRecord &record, std::string * const err_msg);
+
+    /** Writes the contents of the output buffer to the output file. */
+    bool flush(std::string * const err_msg);
+
+    /** Ends the collection, flushes and closes the output file.  No other member functions may be called afterwards. */
+    bool close(std::string * const err_msg);
+private:
+    MarcXmlWriter(const std::string &output_filename, const int fd, const size_t buffer_size);
+    MarcXmlWriter(const MarcXmlWriter &rhs) = delete;
+    const MarcXmlWriter &operator=(const MarcXmlWriter &rhs) = delete;
+
+    /** Flushes the buffer if it holds at least "buffer_size_" bytes. */
+    bool flushIfFull(std::string * const err_msg)
+	{ return buffer_.size() < buffer_size_ or flush(err_msg); }
+};
+
+
+#endif // ifndef MARC_XML_WRITER_H
@@ -0,0 +1,76 @@
+/** \file   MemoryMappedFile.cc
+ *  \brief  Implementation of the MemoryMappedFile class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MemoryMappedFile.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+MemoryMappedFile::~MemoryMappedFile() {
+    if (data_ != NULL)
+	::munmap(const_cast<char *>(data_), size_);
+}
+
+
+MemoryMappedFile *MemoryMappedFile::MemoryMappedFileFactory(const std::string &filename, std::string * const err_msg,
+							    const AccessPattern access_pattern)
+{
+    err_msg->clear();
+
+    const int fd(::open(filename.c_str(), O_RDONLY));
+    if (fd == -1) {
+	*err_msg = "can't open \"" + filename + "\" for reading! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    struct stat stat_buf;
+    if (::fstat(fd, &stat_buf) == -1) {
+	*err_msg = "can't stat \"" + filename + "\"! (" + std::strerror(errno) + ")";
+	::close(fd);
+	return NULL;
+    }
+    if (not S_ISREG(stat_buf.st_mode)) { // E.g. a pipe, which would look like an empty file.
+	*err_msg = "\"" + filename + "\" is not a regular file!";
+	::close(fd);
+	return NULL;
+    }
+
+    // mmap(2) refuses to map zero bytes so we represent empty files w/o a mapping.
+    const size_t size(stat_buf.st_size);
+    if (size == 0) {
+	::close(fd);
+	return new MemoryMappedFile(filename, NULL, 0);
+    }
+
+    void * const data(::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0));
+    const int mmap_errno(errno);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+	*err_msg = "can't mmap \"" + filename + "\"! (" + std::strerror(mmap_errno) + ")";
+	return NULL;
+    }
+
+    ::madvise(data, size, access_pattern == SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    return new MemoryMappedFile(filename, reinterpret_cast<const char *>(data), size);
+}
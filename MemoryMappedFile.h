@@ -0,0 +1,61 @@
+/** \file   MemoryMappedFile.h
+ *  \brief  Interface for the MemoryMappedFile class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEMORY_MAPPED_FILE_H
+#define MEMORY_MAPPED_FILE_H
+
+
+#include <string>
+
+
+/** \class MemoryMappedFile
+ *  \brief Read-only memory mapping of an entire file.
+ */
+class MemoryMappedFile {
+    std::string filename_;
+    const char *data_;
+    size_t size_;
+public:
+    enum AccessPattern { SEQUENTIAL, RANDOM };
+public:
+    /** Unmaps the file. */
+    ~MemoryMappedFile();
+
+    /** \brief Maps "filename" into memory.
+     *  \param access_pattern  A hint that will be passed on to the kernel's paging logic.
+     *  \return NULL if "filename" is not a regular file or could not be mapped and then also sets "err_msg".
+     */
+    static MemoryMappedFile *MemoryMappedFileFactory(const std::string &filename, std::string * const err_msg,
+						     const AccessPattern access_pattern = SEQUENTIAL);
+
+    const std::string &getFilename() const { return filename_; }
+
+    /** \return The start of the mapping or NULL for an empty file. */
+    const char *getData() const { return data_; }
+
+    size_t getSize() const { return size_; }
+private:
+    MemoryMappedFile(const std::string &filename, const char * const data, const size_t size)
+	: filename_(filename), data_(data), size_(size) {}
+    MemoryMappedFile(const MemoryMappedFile &rhs) = delete;
+    const MemoryMappedFile &operator=(const MemoryMappedFile &rhs) = delete;
+};
+
+
+#endif // ifndef MEMORY_MAPPED_FILE_H
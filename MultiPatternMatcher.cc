@@ -0,0 +1,145 @@
+/** \file   MultiPatternMatcher.cc
+ *  \brief  Implementation of the MultiPatternMatcher class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MultiPatternMatcher.h"
+#include <fstream>
+#include <queue>
+#include "StringUtil.h"
+
+
+static const uint32_t NO_PATTERN(UINT32_MAX);
+
+
+MultiPatternMatcher::MultiPatternMatcher(const std::vector<std::string> &patterns): class_count_(1) {
+    for (const auto &pattern : patterns) {
+	if (not pattern.empty())
+	    patterns_.push_back(pattern);
+    }
+
+    // Class 0 is shared by all bytes that do not occur in any pattern.
+    for (auto &byte_class : byte_to_class_)
+	byte_class = 0;
+    for (const auto &pattern : patterns_) {
+	for (const char ch : pattern) {
+	    if (byte_to_class_[static_cast<unsigned char>(ch)] == 0)
+		byte_to_class_[static_cast<unsigned char>(ch)] = class_count_++;
+	}
+    }
+
+    //
+    // Build the trie.  State 0 is the root and, as no trie edge leads back to the root, 0 also means "no edge".
+    //
+
+    transitions_.resize(class_count_, 0);
+    state_to_pattern_index_.push_back(NO_PATTERN);
+    for (uint32_t pattern_index(0); pattern_index < patterns_.size(); ++pattern_index) {
+	uint32_t state(0);
+	for (const char ch : patterns_[pattern_index]) {
+	    uint32_t &edge(transitions_[state * class_count_ + byte_to_class_[static_cast<unsigned char>(ch)]]);
+	    if (edge == 0) {
+		edge = state_to_pattern_index_.size();
+		state_to_pattern_index_.push_back(NO_PATTERN);
+		transitions_.resize(transitions_.size() + class_count_, 0); // N.B. invalidates "edge"!
+	    }
+	    state = transitions_[state * class_count_ + byte_to_class_[static_cast<unsigned char>(ch)]];
+	}
+	if (state_to_pattern_index_[state] == NO_PATTERN)
+	    state_to_pattern_index_[state] = pattern_index;
+    }
+
+    //
+    // Compute the failure links in breadth-first order and replace the missing edges w/ the transitions of the
+    // failure states.  A state also reports the pattern of its failure state, if it does not have its own.
+    //
+
+    std::vector<uint32_t> failure_links(state_to_pattern_index_.size(), 0);
+    std::queue<uint32_t> queue;
+    for (unsigned byte_class(0); byte_class < class_count_; ++byte_class) {
+	if (transitions_[byte_class] != 0)
+	    queue.push(transitions_[byte_class]);
+    }
+
+    while (not queue.empty()) {
+	const uint32_t state(queue.front());
+	queue.pop();
+
+	const uint32_t failure_state(failure_links[state]);
+	for (unsigned byte_class(0); byte_class < class_count_; ++byte_class) {
+	    uint32_t &edge(transitions_[state * class_count_ + byte_class]);
+	    const uint32_t failure_target(transitions_[failure_state * class_count_ + byte_class]);
+	    if (edge == 0)
+		edge = failure_target;
+	    else {
+		failure_links[edge] = failure_target;
+		if (state_to_pattern_index_[edge] == NO_PATTERN)
+		    state_to_pattern_index_[edge] = state_to_pattern_index_[failure_target];
+		queue.push(edge);
+	    }
+	}
+    }
+
+    // Finally convert the targets to transition offsets and flag the transitions into states w/ a pattern.
+    for (auto &edge : transitions_) {
+	const uint32_t target_state(edge);
+	edge = target_state * class_count_;
+	if (state_to_pattern_index_[target_state] != NO_PATTERN)
+	    edge |= OUTPUT_FLAG;
+    }
+}
+
+
+MultiPatternMatcher *MultiPatternMatcher::MultiPatternMatcherFactory(const std::string &patterns_filename,
+								     std::string * const err_msg)
+{
+    std::ifstream input(patterns_filename);
+    if (not input) {
+	*err_msg = "can't open \"" + patterns_filename + "\" for reading!";
+	return NULL;
+    }
+
+    std::vector<std::string> patterns;
+    std::string line;
+    while (std::getline(input, line)) {
+	StringUtil::RightTrim(&line, " \t\r");
+	if (not line.empty())
+	    patterns.push_back(line);
+    }
+    if (input.bad()) {
+	*err_msg = "failed to read \"" + patterns_filename + "\"!";
+	return NULL;
+    }
+
+    return new MultiPatternMatcher(patterns);
+}
+
+
+bool MultiPatternMatcher::matched(const char * const s, const size_t length, size_t * const pattern_index) const {
+    const uint32_t * const transitions(transitions_.data());
+    uint32_t state_offset(0);
+    for (const char *ch(s); ch != s + length; ++ch) {
+	state_offset = transitions[state_offset + byte_to_class_[static_cast<unsigned char>(*ch)]];
+	if (state_offset & OUTPUT_FLAG) {
+	    if (pattern_index != NULL)
+		*pattern_index = state_to_pattern_index_[(state_offset & ~OUTPUT_FLAG) / class_count_];
+	    return true;
+	}
+    }
+
+    return false;
+}
@@ -0,0 +1,69 @@
+/** \file   MultiPatternMatcher.h
+ *  \brief  Interface for the MultiPatternMatcher class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MULTI_PATTERN_MATCHER_H
+#define MULTI_PATTERN_MATCHER_H
+
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+/** \class MultiPatternMatcher
+ *  \brief Finds occurrences of any of a set of literal byte strings in a single pass over the subject.
+ *
+ *  The patterns are compiled into an Aho-Corasick automaton whose failure links have been folded into a complete
+ *  transition table, i.e. matching costs one table lookup per subject byte regardless of the number of patterns.
+ *  In order to keep the table small, bytes that do not occur in any pattern share a single input class.
+ */
+class MultiPatternMatcher {
+    static const uint32_t OUTPUT_FLAG = 0x80000000u; // Set on transitions into states where a pattern ends.
+
+    std::vector<std::string> patterns_;
+    uint16_t byte_to_class_[256];
+    unsigned class_count_;
+
+    // The transitions of state s start at s * class_count_.  Targets are stored as the start of the target state's
+    // transitions, possibly or'ed w/ OUTPUT_FLAG, which saves a multiplication per subject byte.
+    std::vector<uint32_t> transitions_;
+
+    std::vector<uint32_t> state_to_pattern_index_;
+public:
+    /** \param patterns  The literals to search for.  Empty patterns are ignored. */
+    explicit MultiPatternMatcher(const std::vector<std::string> &patterns);
+
+    /** \brief Loads the patterns from "patterns_filename", one per line.
+     *  \note  Trailing whitespace is removed and empty lines are ignored.
+     *  \return NULL if the file could not be read and then also sets "err_msg".
+     */
+    static MultiPatternMatcher *MultiPatternMatcherFactory(const std::string &patterns_filename,
+							   std::string * const err_msg);
+
+    /** \return True if any pattern occurs in the "length" bytes starting at "s".  If "pattern_index" is not NULL
+     *          it will be set to the index of the pattern that ends first in "s".
+     */
+    bool matched(const char * const s, const size_t length, size_t * const pattern_index = NULL) const;
+
+    size_t size() const { return patterns_.size(); }
+    const std::string &getPattern(const size_t pattern_index) const { return patterns_[pattern_index]; }
+};
+
+
+#endif // ifndef MULTI_PATTERN_MATCHER_H
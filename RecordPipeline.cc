@@ -0,0 +1,276 @@
+/** \file   RecordPipeline.cc
+ *  \brief  Implementation of the RecordPipeline class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RecordPipeline.h"
+#include <thread>
+#include "RejectLog.h"
+
+
+const size_t RecordPipeline::DEFAULT_BATCH_SIZE;
+const size_t RecordPipeline::MAX_BATCH_BYTES;
+
+
+namespace {
+
+
+// Enough batches to keep every worker busy while the reader fills the next ones and the writer drains the previous
+// ones.
+const size_t BATCHES_PER_WORKER(4);
+
+
+thread_local unsigned worker_no_of_thread(0);
+
+
+} // unnamed namespace
+
+
+struct RecordPipeline::Batch {
+    struct Record {
+	size_t batch_offset_; // Relative to "base_".
+	size_t length_;
+	size_t file_offset_, file_length_; // The extent of the record's input, see MarcReader::locateRecord().
+    };
+
+    struct Reject {
+	size_t file_offset_, length_;
+	std::string reason_;
+    };
+
+    size_t sequence_no_;
+    const char *base_;
+    std::string copies_; // Holds the records if the reader does not guarantee that they remain valid.
+    std::vector<Record> records_;
+    std::vector<std::string> outputs_;
+    size_t matched_count_;
+    std::vector<Reject> rejects_;
+    std::string err_msg_; // Set if processing had to stop early because we're not in the tolerant mode.
+
+    /** Makes the batch reusable while keeping the allocated memory. */
+    void clear() {
+	copies_.clear();
+	records_.clear();
+	for (auto &output : outputs_)
+	    output.clear();
+	matched_count_ = 0;
+	rejects_.clear();
+	err_msg_.clear();
+    }
+};
+
+
+RecordPipeline::RecordPipeline(MarcReader * const reader, const unsigned worker_count, const Order order,
+			       const size_t batch_size)
+    : reader_(reader), worker_count_(worker_count), order_(order), batch_size_(batch_size), output_count_(1),
+      parser_([](const Slice &raw_record, RecordView * const record, std::string * const err_msg) {
+	      return RecordView::ParseRecord(raw_record.data(), raw_record.size(), record, err_msg);
+	  }),
+      free_batches_(BATCHES_PER_WORKER * worker_count + 2),
+      unprocessed_batches_(free_batches_.capacity() + worker_count),
+      processed_batches_(free_batches_.capacity() + worker_count),
+      abort_(false), reject_log_(NULL), record_count_(0), matched_count_(0)
+{
+    // All queues have room for all batches and the end-of-input markers, so only the pops ever have to wait.
+    for (size_t batch_no(0); batch_no < free_batches_.capacity(); ++batch_no) {
+	batches_.emplace_back(new Batch);
+	free_batches_.push(batches_.back().get());
+    }
+}
+
+
+RecordPipeline::~RecordPipeline() {
+}
+
+
+unsigned RecordPipeline::GetWorkerNo() {
+    return worker_no_of_thread;
+}
+
+
+bool RecordPipeline::run(std::string * const err_msg) {
+    err_msg->clear();
+    reader_err_msg_.clear();
+    abort_ = false;
+    reject_log_ = reader_->getRejectLog();
+    record_count_ = matched_count_ = 0;
+    for (auto &batch : batches_)
+	batch->outputs_.resize(output_count_);
+
+    std::thread reader_thread(&RecordPipeline::read, this);
+    std::vector<std::thread> worker_threads;
+    for (unsigned worker_no(0); worker_no < worker_count_; ++worker_no)
+	worker_threads.emplace_back(&RecordPipeline::work, this, worker_no);
+
+    // Fewer than batches_.size() consecutive sequence numbers can be in flight, so the slots of "pending", which
+    // holds batches that have arrived ahead of their turn, never collide.
+    std::vector<Batch *> pending(batches_.size(), NULL);
+    size_t next_sequence_no(0);
+    unsigned finished_worker_count(0);
+    while (finished_worker_count < worker_count_) {
+	Batch *batch;
+	processed_batches_.pop(&batch);
+	if (batch == NULL)
+	    ++finished_worker_count;
+	else if (order_ == UNORDERED)
+	    drainBatch(batch, err_msg);
+	else {
+	    pending[batch->sequence_no_ % pending.size()] = batch;
+	    while ((batch = pending[next_sequence_no % pending.size()]) != NULL) {
+		pending[next_sequence_no % pending.size()] = NULL;
+		++next_sequence_no;
+		drainBatch(batch, err_msg);
+	    }
+	}
+    }
+
+    reader_thread.join();
+    for (auto &worker_thread : worker_threads)
+	worker_thread.join();
+
+    // Errors of the reader occur after all records that it has handed out.
+    if (err_msg->empty())
+	*err_msg = reader_err_msg_;
+    return err_msg->empty();
+}
+
+
+void RecordPipeline::read() {
+    const bool copy_records(not reader_->recordsRemainValid());
+    size_t sequence_no(0);
+    bool more_records(true);
+    while (more_records) {
+	Batch *batch;
+	free_batches_.pop(&batch);
+	if (abort_) {
+	    free_batches_.push(batch);
+	    break;
+	}
+
+	batch->clear();
+	Slice raw_record;
+	const char *first_record(NULL);
+	size_t batch_bytes(0);
+	while (batch->records_.size() < batch_size_ and batch_bytes < MAX_BATCH_BYTES) {
+	    if (not reader_->getNextRawRecord(&raw_record, &reader_err_msg_)) {
+		more_records = false;
+		break;
+	    }
+
+	    size_t file_length;
+	    const size_t file_offset(reader_->locateRecord(raw_record, &file_length));
+	    if (copy_records) {
+		batch->records_.push_back(Batch::Record{ batch->copies_.size(), raw_record.size(), file_offset,
+							 file_length });
+		batch->copies_.append(raw_record.data(), raw_record.size());
+	    } else {
+		if (first_record == NULL)
+		    first_record = raw_record.data();
+		batch->records_.push_back(Batch::Record{ static_cast<size_t>(raw_record.data() - first_record),
+							 raw_record.size(), file_offset, file_length });
+	    }
+	    batch_bytes += raw_record.size();
+	}
+
+	if (batch->records_.empty()) {
+	    free_batches_.push(batch);
+	    break;
+	}
+	batch->base_ = copy_records ? batch->copies_.data() : first_record;
+	batch->sequence_no_ = sequence_no++;
+	unprocessed_batches_.push(batch);
+    }
+
+    for (unsigned worker_no(0); worker_no < worker_count_; ++worker_no)
+	unprocessed_batches_.push(NULL);
+}
+
+
+void RecordPipeline::work(const unsigned worker_no) {
+    worker_no_of_thread = worker_no;
+    for (;;) {
+	Batch *batch;
+	unprocessed_batches_.pop(&batch);
+	if (batch == NULL)
+	    break;
+	if (not abort_)
+	    processBatch(batch);
+	processed_batches_.push(batch);
+    }
+
+    processed_batches_.push(NULL);
+}
+
+
+void RecordPipeline::processBatch(Batch * const batch) {
+    RecordView record;
+    std::string err_msg;
+    std::vector<size_t> output_sizes(output_count_);
+    for (const auto &batch_record : batch->records_) {
+	const Slice raw_record(batch->base_ + batch_record.batch_offset_, batch_record.length_);
+	if (raw_filter_ and not raw_filter_(raw_record))
+	    continue;
+
+	for (unsigned output_no(0); output_no < output_count_; ++output_no)
+	    output_sizes[output_no] = batch->outputs_[output_no].size();
+	bool matched(false);
+	if (parser_(raw_record, &record, &err_msg)) {
+	    if (filter_ and not filter_(record))
+		continue;
+	    matched = not transform_ or transform_(record, &batch->outputs_[0], &err_msg);
+	}
+
+	if (matched)
+	    ++batch->matched_count_;
+	else if (not err_msg.empty()) {
+	    for (unsigned output_no(0); output_no < output_count_; ++output_no) // Drop any partial output.
+		batch->outputs_[output_no].resize(output_sizes[output_no]);
+	    if (reject_log_ == NULL) {
+		batch->err_msg_ = err_msg + " (Record starting at file offset "
+				  + std::to_string(batch_record.file_offset_) + ".)";
+		return;
+	    }
+
+	    batch->rejects_.push_back(Batch::Reject{ batch_record.file_offset_, batch_record.file_length_, err_msg });
+	    err_msg.clear();
+	}
+    }
+}
+
+
+void RecordPipeline::drainBatch(Batch * const batch, std::string * const err_msg) {
+    if (err_msg->empty()) {
+	for (unsigned output_no(0); output_no < output_count_ and not abort_; ++output_no) {
+	    if (not batch->outputs_[output_no].empty() and writer_
+		and not writer_(output_no, batch->outputs_[output_no], err_msg))
+		abort_ = true;
+	}
+
+	if (not abort_) {
+	    for (const auto &reject : batch->rejects_)
+		reject_log_->log(reject.file_offset_, reject.length_, reject.reason_);
+	    record_count_  += batch->records_.size();
+	    matched_count_ += batch->matched_count_;
+	    if (not batch->err_msg_.empty()) {
+		*err_msg = batch->err_msg_;
+		abort_ = true;
+	    }
+	}
+    }
+
+    free_batches_.push(batch);
+}
@@ -0,0 +1,161 @@
+/** \file   RecordPipeline.h
+ *  \brief  Interface for the RecordPipeline class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECORD_PIPELINE_H
+#define RECORD_PIPELINE_H
+
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BoundedQueue.h"
+#include "MarcReader.h"
+#include "RecordView.h"
+#include "Slice.h"
+
+
+/** \class RecordPipeline
+ *  \brief Processes the records of a MarcReader on several threads.
+ *
+ *  A reader thread collects the raw records into batches and hands them to a pool of worker threads via a
+ *  BoundedQueue.  The workers run the per-record stages, i.e. an optional raw filter, the parser, an optional filter
+ *  and the transform, and pass the batches on to the writer stage, which runs on the thread that called run().  The
+ *  writer either drains the batches in input order or in the order in which they have been finished.  All stages
+ *  for a given record run back-to-back on the same worker thread, so per-record state can be passed from one stage
+ *  to the next in per-worker storage, see GetWorkerNo().
+ *
+ *  A fixed number of batches circulates between the stages and the reader has to wait for the writer to recycle one
+ *  before it can read ahead any further, which bounds the memory use and throttles the reader if the workers or the
+ *  writer fall behind.  Only one queue operation per batch is needed, so that synchronisation costs are amortised.
+ *
+ *  If the reader is in the tolerant mode, i.e. has a RejectLog, records that fail in the parser or the transform are
+ *  logged and skipped as well.  Note that the reader logs the ranges that it skips itself, so that the entries of
+ *  the reject log are not necessarily in input order.
+ */
+class RecordPipeline {
+public:
+    static const size_t DEFAULT_BATCH_SIZE = 512;          // Records.
+    static const size_t MAX_BATCH_BYTES = 4 * 1024 * 1024; // Batches get handed on early once they hold this much.
+
+    enum Order { ORDERED, UNORDERED };
+
+    /** A cheap test of the raw bytes of a record, before it gets parsed.  Should return false to drop the record. */
+    typedef std::function<bool(const Slice &raw_record)> RawFilter;
+
+    /** Should return false and set "err_msg" if "raw_record" is corrupt.  The default is RecordView::ParseRecord(). */
+    typedef std::function<bool(const Slice &raw_record, RecordView * const record, std::string * const err_msg)>
+	Parser;
+
+    /** Should return false to drop the record. */
+    typedef std::function<bool(const RecordView &record)> Filter;
+
+    /** Should append the results for "record" to "outputs", which points to the first of getOutputCount() strings,
+     *  and return true if there were any.  If it fails, it should return false and set "err_msg". */
+    typedef std::function<bool(const RecordView &record, std::string * const outputs, std::string * const err_msg)>
+	Transform;
+
+    /** Receives the non-empty output w/ index "output_no" of the transform for a batch of records.  Should return
+     *  false and set "err_msg" if the output can't be written. */
+    typedef std::function<bool(const unsigned output_no, const std::string &output, std::string * const err_msg)>
+	Writer;
+private:
+    struct Batch;
+
+    MarcReader * const reader_;
+    const unsigned worker_count_;
+    const Order order_;
+    const size_t batch_size_;
+    unsigned output_count_;
+    RawFilter raw_filter_;
+    Parser parser_;
+    Filter filter_;
+    Transform transform_;
+    Writer writer_;
+    std::vector<std::unique_ptr<Batch>> batches_;
+    BoundedQueue<Batch *> free_batches_, unprocessed_batches_, processed_batches_;
+    std::atomic<bool> abort_;
+    RejectLog *reject_log_; // The one of the reader, NULL unless the reader is in the tolerant mode.
+    std::string reader_err_msg_;
+    size_t record_count_, matched_count_;
+public:
+    /** \param reader        Only the reader thread accesses "reader" while run() is executing.
+     *  \param worker_count  The number of threads that run the per-record stages.  Must be at least 1.
+     *  \param order         Whether the writer drains the batches in input order or as soon as they are available.
+     *  \param batch_size    The maximum number of records per batch.
+     */
+    RecordPipeline(MarcReader * const reader, const unsigned worker_count, const Order order = ORDERED,
+		   const size_t batch_size = DEFAULT_BATCH_SIZE);
+    ~RecordPipeline();
+
+    /** \note  The stages are called concurrently by all worker threads and therefore must be thread-safe. */
+    void setRawFilter(const RawFilter &raw_filter) { raw_filter_ = raw_filter; }
+    void setParser(const Parser &parser) { parser_ = parser; }
+    void setFilter(const Filter &filter) { filter_ = filter; }
+    void setTransform(const Transform &transform) { transform_ = transform; }
+
+    /** \note  Called on the thread that calls run() only. */
+    void setWriter(const Writer &writer) { writer_ = writer; }
+
+    /** Sets the number of separate outputs that the transform produces, e.g. one per output file.  The default is 1. */
+    void setOutputCount(const unsigned output_count) { output_count_ = output_count; }
+
+    unsigned getOutputCount() const { return output_count_; }
+    unsigned getWorkerCount() const { return worker_count_; }
+
+    /** \return The number, from 0 to getWorkerCount() - 1, of the worker thread that calls us.  Only meaningful when
+     *          called from a stage, e.g. to index per-worker scratch space.
+     */
+    static unsigned GetWorkerNo();
+
+    /** \brief Processes all records of the reader and returns once they have been written.
+     *
+     *  Outside of the tolerant mode the first record that fails to parse or transform ends the processing.  In the
+     *  ORDERED mode the output of all preceding records has been written at that point.
+     *
+     *  \return False if reading, processing or writing failed and then also sets "err_msg", else true.
+     */
+    bool run(std::string * const err_msg);
+
+    /** \return The number of records that have been read by the last call to run(). */
+    size_t getRecordCount() const { return record_count_; }
+
+    /** \return The number of records for which the transform, or the filter if there is no transform, returned true
+     *          during the last call to run(). */
+    size_t getMatchedCount() const { return matched_count_; }
+private:
+    RecordPipeline(const RecordPipeline &rhs) = delete;
+    const RecordPipeline &operator=(const RecordPipeline &rhs) = delete;
+
+    /** The body of the reader thread. */
+    void read();
+
+    /** The body of the worker threads. */
+    void work(const unsigned worker_no);
+
+    /** Runs the per-record stages on all records of "batch". */
+    void processBatch(Batch * const batch);
+
+    /** Writes the results of "batch" and recycles it.  Once an error has occurred, results are only discarded. */
+    void drainBatch(Batch * const batch, std::string * const err_msg);
+};
+
+
+#endif // ifndef RECORD_PIPELINE_H
@@ -0,0 +1,273 @@
+/** \file   RecordView.cc
+ *  \brief  Implementation of the RecordView class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RecordView.h"
+#include <cstring>
+#include "Stats.h"
+#include "Utf8.h"
+
+
+bool RecordView::ParseRecord(const char * const record_start, const size_t available, RecordView * const record_view,
+			     std::string * const err_msg)
+{
+    const Stats::StageTimer timer(Stats::PARSING);
+    if (err_msg != NULL)
+	err_msg->clear();
+
+    //
+    // Leader checks:
+    //
+
+    if (available < Leader::LEADER_LENGTH) {
+	if (err_msg != NULL)
+	    *err_msg = "Short read for a leader or premature EOF!";
+	return false;
+    }
+
+    unsigned record_length;
+    if (not StringUtil::DecimalDigitsToUnsigned(record_start, 5, &record_length)) {
+	if (err_msg != NULL)
+	    *err_msg = "Can't parse record length!";
+	return false;
+    }
+
+    unsigned base_address_of_data;
+    if (not StringUtil::DecimalDigitsToUnsigned(record_start + 12, 5, &base_address_of_data)) {
+	if (err_msg != NULL)
+	    *err_msg = "Can't parse base address of data!";
+	return false;
+    }
+
+    if (record_start[10] != '2') {
+	if (err_msg != NULL)
+	    *err_msg = "Invalid indicator count!";
+	return false;
+    }
+
+    if (record_start[11] != '2') {
+	if (err_msg != NULL)
+	    *err_msg = "Invalid subfield code length!";
+	return false;
+    }
+
+    if (std::memcmp(record_start + 20, "4500", 4) != 0) {
+	if (err_msg != NULL)
+	    *err_msg = "Invalid entry map!";
+	return false;
+    }
+
+    //
+    // Record and directory extent checks:
+    //
+
+    if (record_length > available) {
+	if (err_msg != NULL)
+	    *err_msg = "Short read for field data or premature EOF! (Expected " + std::to_string(record_length)
+		       + " bytes, got " + std::to_string(available) + " bytes.)";
+	return false;
+    }
+
+    if (base_address_of_data <= Leader::LEADER_LENGTH or base_address_of_data >= record_length) {
+	if (err_msg != NULL)
+	    *err_msg = "impossible base address of data!";
+	return false;
+    }
+
+    if (((base_address_of_data - Leader::LEADER_LENGTH - 1) % DirectoryEntry::DIRECTORY_ENTRY_LENGTH) != 0) {
+	if (err_msg != NULL)
+	    *err_msg = "Raw directory entries string must be a multiple of "
+		       + std::to_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH) + " in length!";
+	return false;
+    }
+
+    if (record_start[base_address_of_data - 1] != '\x1E') {
+	if (err_msg != NULL)
+	    *err_msg = "Missing field terminator at end of directory!";
+	return false;
+    }
+
+    if (record_start[record_length - 1] != '\x1D') {
+	if (err_msg != NULL)
+	    *err_msg = "missing trailing record terminator!";
+	return false;
+    }
+
+    //
+    // Directory entry checks:
+    //
+
+    const unsigned field_data_size(record_length - base_address_of_data - 1);
+    const char *entry(record_start + Leader::LEADER_LENGTH);
+    for (const char * const directory_end(record_start + base_address_of_data - 1); entry != directory_end;
+	 entry += DirectoryEntry::DIRECTORY_ENTRY_LENGTH)
+    {
+	unsigned field_length, field_offset;
+	if (not DirectoryEntry::DecodeRawEntry(entry, record_start + record_length - entry, &field_length,
+					       &field_offset))
+	{
+	    if (err_msg != NULL)
+		*err_msg = "can't scan field length or offset in directory entry! (Tag was "
+			   + std::string(entry, DirectoryEntry::TAG_LENGTH) + ")";
+	    return false;
+	}
+
+	if (field_length == 0 or field_offset + field_length > field_data_size) {
+	    if (err_msg != NULL)
+		*err_msg = "misaligned field, extending past the record!";
+	    return false;
+	}
+    }
+
+    record_view->record_               = record_start;
+    record_view->record_length_        = record_length;
+    record_view->base_address_of_data_ = base_address_of_data;
+
+    Stats::CountParsedRecord(record_length, record_view->getNumberOfFields());
+    return true;
+}
+
+
+bool RecordView::GetRawRecord(const char * const record_start, const size_t available, Slice * const raw_record,
+			      std::string * const err_msg)
+{
+    const Stats::StageTimer timer(Stats::READING);
+    if (err_msg != NULL)
+	err_msg->clear();
+
+    if (available < Leader::LEADER_LENGTH) {
+	if (err_msg != NULL)
+	    *err_msg = "Short read for a leader or premature EOF!";
+	return false;
+    }
+
+    unsigned record_length;
+    if (not StringUtil::DecimalDigitsToUnsigned(record_start, 5, &record_length)
+	or record_length <= Leader::LEADER_LENGTH)
+    {
+	if (err_msg != NULL)
+	    *err_msg = "Can't parse record length!";
+	return false;
+    }
+
+    if (record_length > available) {
+	if (err_msg != NULL)
+	    *err_msg = "Short read for field data or premature EOF! (Expected " + std::to_string(record_length)
+		       + " bytes, got " + std::to_string(available) + " bytes.)";
+	return false;
+    }
+
+    if (record_start[record_length - 1] != '\x1D') {
+	if (err_msg != NULL)
+	    *err_msg = "missing trailing record terminator!";
+	return false;
+    }
+
+    *raw_record = Slice(record_start, record_length);
+    Stats::CountRawRecord(record_length);
+    return true;
+}
+
+
+bool RecordView::IsPlausibleRecordStart(const char * const candidate, const size_t available) {
+    if (available < Leader::LEADER_LENGTH)
+	return false;
+
+    unsigned record_length, base_address_of_data;
+    if (not StringUtil::DecimalDigitsToUnsigned(candidate, 5, &record_length)
+	or record_length <= Leader::LEADER_LENGTH or record_length > available
+	or not StringUtil::DecimalDigitsToUnsigned(candidate + 12, 5, &base_address_of_data)
+	or base_address_of_data <= Leader::LEADER_LENGTH or base_address_of_data >= record_length)
+	return false;
+
+    return candidate[10] == '2' and candidate[11] == '2' and std::memcmp(candidate + 20, "4500", 4) == 0
+	   and ((base_address_of_data - Leader::LEADER_LENGTH - 1) % DirectoryEntry::DIRECTORY_ENTRY_LENGTH) == 0
+	   and candidate[base_address_of_data - 1] == '\x1E' and candidate[record_length - 1] == '\x1D';
+}
+
+
+size_t RecordView::FindNextRecordStart(const char * const data, const size_t size) {
+    const char *scan_start(data);
+    const char * const end(data + size);
+    while (scan_start < end) {
+	const char * const record_terminator(
+	    reinterpret_cast<const char *>(std::memchr(scan_start, '\x1D', end - scan_start)));
+	if (record_terminator == NULL)
+	    break;
+
+	scan_start = record_terminator + 1;
+	if (IsPlausibleRecordStart(scan_start, end - scan_start))
+	    return scan_start - data;
+    }
+
+    return size;
+}
+
+
+bool RecordView::validateFields(std::string * const err_msg) const {
+    const size_t field_count(getNumberOfFields());
+    for (size_t field_index(0); field_index < field_count; ++field_index) {
+	if (record_[base_address_of_data_ + getFieldOffset(field_index) + getFieldLength(field_index) - 1] != '\x1E') {
+	    if (err_msg != NULL)
+		*err_msg = "missing field terminator at end of field!";
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+
+bool RecordView::validateUtf8(std::string * const err_msg) const {
+    // Field and subfield delimiters are ASCII, so if the data area as a whole is valid, so is each field.
+    if (Utf8::IsValid(record_ + base_address_of_data_, record_length_ - base_address_of_data_))
+	return true;
+
+    const size_t field_count(getNumberOfFields());
+    for (size_t field_index(0); field_index < field_count; ++field_index) {
+	const Slice field(getField(field_index));
+	const size_t error_offset(Utf8::FindInvalidSequence(field.data(), field.size()));
+	if (error_offset == field.size())
+	    continue;
+
+	if (err_msg != NULL) {
+	    *err_msg = "ill-formed UTF-8 in field " + getTag(field_index).toString();
+	    const char *subfield_delimiter(field.data() + error_offset);
+	    while (subfield_delimiter != field.data() and *subfield_delimiter != '\x1F')
+		--subfield_delimiter;
+	    if (*subfield_delimiter == '\x1F' and subfield_delimiter + 1 < field.data() + error_offset)
+		*err_msg += ", subfield " + std::string(1, subfield_delimiter[1]);
+	    *err_msg += ", at byte offset " + std::to_string(error_offset) + " of the field!";
+	}
+	return false;
+    }
+
+    // The ill-formed bytes are not part of any field.
+    return true;
+}
+
+
+size_t RecordView::findTag(const MarcTag &tag, const size_t start_index) const {
+    const size_t field_count(getNumberOfFields());
+    for (size_t field_index(start_index); field_index < field_count; ++field_index) {
+	if (getTag(field_index) == tag)
+	    return field_index;
+    }
+
+    return field_count;
+}
@@ -0,0 +1,147 @@
+/** \file   RecordView.h
+ *  \brief  Interface for the RecordView class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECORD_VIEW_H
+#define RECORD_VIEW_H
+
+
+#include <string>
+#include "DirectoryEntry.h"
+#include "Leader.h"
+#include "MarcTag.h"
+#include "Slice.h"
+#include "StringUtil.h"
+
+
+/** \class RecordView
+ *  \brief A read-only, non-owning view of a binary MARC-21 record.
+ *
+ *  All accessors return Slice's that point directly into the underlying record bytes.  Nothing gets copied and
+ *  nothing gets allocated, which makes RecordView suitable for scanning large, memory-mapped MARC files.
+ */
+class RecordView {
+    const char *record_;
+    unsigned record_length_;
+    unsigned base_address_of_data_;
+public:
+    RecordView(): record_(NULL), record_length_(0), base_address_of_data_(0) {}
+
+    /** \brief Sets up a view of the record starting at "record_start" after performing sanity checks.
+     *
+     *  Only the leader, the directory and the record terminator are inspected.  In particular the field data is not
+     *  touched, so that the fields of records that get rejected based on their directory are never paged in.  The
+     *  directory checks guarantee that all fields lie within the record.
+     *
+     *  \param record_start  The first byte of the record, i.e. the first byte of its leader.
+     *  \param available     How many bytes, starting at "record_start", may be accessed.
+     *  \param record_view   Will refer to the parsed record after a successful return.
+     *  \param err_msg       If not NULL and a parse error occurred an informational text will be returned here.
+     *  \return True if the parse succeeded, else false.
+     */
+    static bool ParseRecord(const char * const record_start, const size_t available, RecordView * const record_view,
+			    std::string * const err_msg = NULL);
+
+    /** \brief Determines the extent of the record starting at "record_start" w/o looking at its directory.
+     *
+     *  Only the record length in the leader and the record terminator are checked.  This allows prefilters to
+     *  inspect the raw bytes of a record before paying for ParseRecord().
+     *
+     *  \param raw_record  Will refer to the entire record including the record terminator after a successful return.
+     *  \return True if the record length could be determined, else false.
+     */
+    static bool GetRawRecord(const char * const record_start, const size_t available, Slice * const raw_record,
+			     std::string * const err_msg = NULL);
+
+    /** \brief A cheap test whether "candidate" looks like the start of a record.
+     *  \return True if "candidate" starts w/ a valid leader, i.e. one that passes the leader checks of ParseRecord(),
+     *          whose record length fits into "available" bytes, and if the directory and the record are properly
+     *          terminated.
+     */
+    static bool IsPlausibleRecordStart(const char * const candidate, const size_t available);
+
+    /** \brief Finds the first plausible record start that immediately follows a record terminator.
+     *
+     *  Used to resynchronise after a corrupt record.  Record terminators are located w/ memchr(3), which is
+     *  vectorised in any reasonable C library, and only the bytes following them get checked w/
+     *  IsPlausibleRecordStart().
+     *
+     *  \return The offset of the plausible record start relative to "data" or "size" if there is none.
+     */
+    static size_t FindNextRecordStart(const char * const data, const size_t size);
+
+    /** \return The binary representation of the entire record including the record terminator. */
+    Slice getRawRecord() const { return Slice(record_, record_length_); }
+
+    unsigned getRecordLength() const { return record_length_; }
+    unsigned getBaseAddressOfData() const { return base_address_of_data_; }
+    Slice getLeader() const { return Slice(record_, Leader::LEADER_LENGTH); }
+
+    /** \return The directory w/o its trailing field terminator. */
+    Slice getDirectory() const
+	{ return Slice(record_ + Leader::LEADER_LENGTH, base_address_of_data_ - Leader::LEADER_LENGTH - 1); }
+
+    size_t getNumberOfFields() const
+	{ return (base_address_of_data_ - Leader::LEADER_LENGTH - 1) / DirectoryEntry::DIRECTORY_ENTRY_LENGTH; }
+
+    MarcTag getTag(const size_t field_index) const { return MarcTag(getRawDirectoryEntry(field_index)); }
+
+    /** \return The length of the field w/ index "field_index" including its field terminator. */
+    unsigned getFieldLength(const size_t field_index) const
+	{ return DecodeValidatedDigits(getRawDirectoryEntry(field_index) + DirectoryEntry::TAG_LENGTH, 4); }
+
+    /** \return The offset of the field w/ index "field_index" relative to the base address of data. */
+    unsigned getFieldOffset(const size_t field_index) const
+	{ return DecodeValidatedDigits(getRawDirectoryEntry(field_index) + DirectoryEntry::TAG_LENGTH + 4, 5); }
+
+    /** \return The contents of the field w/ index "field_index" w/o its field terminator. */
+    Slice getField(const size_t field_index) const
+	{ return Slice(record_ + base_address_of_data_ + getFieldOffset(field_index),
+		       getFieldLength(field_index) - 1); }
+
+    /** \brief Checks that each field ends in a field terminator.
+     *  \note  Unlike ParseRecord() this touches the data of all fields.
+     */
+    bool validateFields(std::string * const err_msg = NULL) const;
+
+    /** \brief Checks that the contents of each field are well-formed UTF-8.
+     *  \param err_msg  If not NULL, the tag, the subfield code, if any, and the offset w/in the field of the first
+     *                  ill-formed sequence are reported here.
+     *  \note  Leader/09 is not checked, i.e. this is only meaningful for records that claim to be UTF-8 encoded.
+     */
+    bool validateUtf8(std::string * const err_msg = NULL) const;
+
+    /** \return The index of the first field at or after "start_index" w/ tag "tag" or getNumberOfFields() if
+     *          no such field exists.
+     */
+    size_t findTag(const MarcTag &tag, const size_t start_index = 0) const;
+private:
+    /** Converts digits that have already been checked by ParseRecord(). */
+    static unsigned DecodeValidatedDigits(const char *s, const size_t length) {
+	unsigned value(0);
+	for (const char * const end(s + length); s != end; ++s)
+	    value = value * 10 + (*s - '0');
+	return value;
+    }
+
+    const char *getRawDirectoryEntry(const size_t field_index) const
+	{ return record_ + Leader::LEADER_LENGTH + field_index * DirectoryEntry::DIRECTORY_ENTRY_LENGTH; }
+};
+
+
+#endif // ifndef RECORD_VIEW_H
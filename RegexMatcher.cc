@@ -0,0 +1,322 @@
+/** \file   RegexMatcher.cc
+ *  \brief  Implementation of the RegexMatcher class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RegexMatcher.h"
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include "util.h"
+
+
+bool RegexMatcher::utf8_configured_;
+
+
+namespace {
+
+
+// The JIT stack grows on demand from the start size up to the maximum size.
+const int JIT_STACK_START_SIZE(32 * 1024);
+const int JIT_STACK_MAX_SIZE(1024 * 1024);
+
+
+/** Owns the JIT stack of the current thread.  JIT-compiled patterns may be shared between threads but a JIT stack
+ *  must never be used by more than one thread at a time.
+ */
+class JitStack {
+    pcre_jit_stack *stack_;
+public:
+    JitStack(): stack_(NULL) {}
+    ~JitStack() { if (stack_ != NULL) ::pcre_jit_stack_free(stack_); }
+    pcre_jit_stack *get() {
+	if (stack_ == NULL)
+	    stack_ = ::pcre_jit_stack_alloc(JIT_STACK_START_SIZE, JIT_STACK_MAX_SIZE);
+	return stack_;
+    }
+};
+
+
+thread_local JitStack thread_jit_stack;
+
+
+// pcre_exec() needs 3 ints per captured substring plus 3 for the entire match.
+const int OVECTOR_SIZE(3 * 43);
+
+
+thread_local int thread_ovector[OVECTOR_SIZE];
+
+
+} // unnamed namespace
+
+
+// Called by pcre_exec() for JIT-compiled patterns.  Returning NULL makes PCRE fall back to its small internal stack.
+static pcre_jit_stack *GetThreadJitStack(void * /* data */) {
+    return thread_jit_stack.get();
+}
+
+
+static bool CompileAndStudy(const std::string &pattern, const bool utf8, pcre ** const pcre_ptr,
+			    pcre_extra ** const extra_ptr, std::string * const err_msg)
+{
+    const char *errptr;
+    int erroffset;
+    *pcre_ptr = ::pcre_compile(pattern.c_str(), utf8 ? PCRE_UTF8 : 0, &errptr, &erroffset, NULL);
+    if (*pcre_ptr == NULL) {
+	*err_msg = "failed to compile invalid regular expression: \"" + pattern + "\"! (" + std::string(errptr)
+		   + " at offset " + std::to_string(erroffset) + ")";
+	return false;
+    }
+
+    // Without JIT support pcre_study() silently falls back to the interpreter.
+    *extra_ptr = ::pcre_study(*pcre_ptr, PCRE_STUDY_JIT_COMPILE, &errptr);
+    if (*extra_ptr == NULL and errptr != NULL) {
+	::pcre_free(*pcre_ptr);
+	*pcre_ptr = NULL;
+	*err_msg = "failed to \"study\" the compiled pattern \"" + pattern + "\"! (" + std::string(errptr) + ")";
+	return false;
+    }
+    if (*extra_ptr != NULL)
+	::pcre_assign_jit_stack(*extra_ptr, GetThreadJitStack, NULL);
+
+    return true;
+}
+
+
+RegexMatcher::RegexMatcher(const RegexMatcher &that)
+    : pattern_(that.pattern_), utf8_(that.utf8_), pcre_(NULL), pcre_extra_(NULL)
+{
+    std::string err_msg;
+    if (not CompileAndStudy(pattern_, utf8_, &pcre_, &pcre_extra_, &err_msg))
+	Error("in RegexMatcher copy constructor: " + err_msg);
+}
+
+
+RegexMatcher::RegexMatcher(RegexMatcher &&that)
+    : pattern_(std::move(that.pattern_)), utf8_(that.utf8_), pcre_(that.pcre_), pcre_extra_(that.pcre_extra_)
+{
+    that.pcre_       = NULL;
+    that.pcre_extra_ = NULL;
+}
+
+
+RegexMatcher *RegexMatcher::RegexMatcherFactory(const std::string &pattern, std::string * const err_msg,
+						 const bool utf8)
+{
+    // Make sure the PCRE library supports UTF8:
+    if (utf8 and not RegexMatcher::utf8_configured_) {
+	int utf8_available;
+	if (::pcre_config(PCRE_CONFIG_UTF8, reinterpret_cast<void *>(&utf8_available)) == PCRE_ERROR_BADOPTION) {
+	    *err_msg = "PCRE library does not know PCRE_CONFIG_UTF8!";
+	    return NULL;
+	}
+
+	if (utf8_available != 1) {
+	    *err_msg = "This version of the PCRE library does not support UTF8!";
+	    return NULL;
+	}
+
+	RegexMatcher::utf8_configured_ = true;
+    }
+
+    pcre *pcre_ptr;
+    pcre_extra *extra_ptr;
+    if (not CompileAndStudy(pattern, utf8, &pcre_ptr, &extra_ptr, err_msg))
+	return NULL;
+
+    return new RegexMatcher(pattern, utf8, pcre_ptr, extra_ptr);
+}
+
+
+namespace {
+
+
+/** Collects runs of consecutive literal characters of a regex and remembers the longest one. */
+class LiteralRun {
+    std::string current_, longest_;
+public:
+    void append(const char ch) { current_ += ch; }
+
+    /** Removes the last, possibly multi-byte UTF-8, character because it turned out to be quantified. */
+    void dropLastCharacter() {
+	while (not current_.empty() and (current_[current_.length() - 1] & 0xC0) == 0x80)
+	    current_.resize(current_.length() - 1);
+	if (not current_.empty())
+	    current_.resize(current_.length() - 1);
+    }
+
+    void end() {
+	if (current_.length() > longest_.length())
+	    longest_ = current_;
+	current_.clear();
+    }
+
+    const std::string &getLongest() { end(); return longest_; }
+};
+
+
+} // unnamed namespace
+
+
+// Escapes that consist of a backslash and a single letter and that do not match a literal character.
+static const char ARGUMENTLESS_ESCAPES[] = "dDwWsShHvVbBAzZGRXCK";
+
+
+/** \return The position after the character class that starts at "class_start" or std::string::npos. */
+static std::string::size_type SkipCharacterClass(const std::string &pattern, std::string::size_type class_start) {
+    std::string::size_type pos(class_start + 1);
+    if (pos < pattern.length() and pattern[pos] == '^')
+	++pos;
+    if (pos < pattern.length() and pattern[pos] == ']') // A leading ']' is a literal.
+	++pos;
+    for (/* Intentionally empty! */; pos < pattern.length(); ++pos) {
+	if (pattern[pos] == '\\')
+	    ++pos;
+	else if (pattern[pos] == ']')
+	    return pos + 1;
+    }
+
+    return std::string::npos;
+}
+
+
+/** \return The position after the group that starts at "group_start" or std::string::npos. */
+static std::string::size_type SkipGroup(const std::string &pattern, const std::string::size_type group_start) {
+    unsigned nesting_level(0);
+    std::string::size_type pos(group_start);
+    while (pos < pattern.length()) {
+	if (pattern[pos] == '\\')
+	    pos += 2;
+	else if (pattern[pos] == '[')
+	    pos = SkipCharacterClass(pattern, pos);
+	else {
+	    if (pattern[pos] == '(')
+		++nesting_level;
+	    else if (pattern[pos] == ')' and --nesting_level == 0)
+		return pos + 1;
+	    ++pos;
+	}
+    }
+
+    return std::string::npos;
+}
+
+
+std::string RegexMatcher::ExtractRequiredLiteral(const std::string &pattern) {
+    if (pattern.find('|') != std::string::npos or pattern.find("(?") != std::string::npos
+	or pattern.find("\\Q") != std::string::npos)
+	return "";
+
+    LiteralRun literal_run;
+    std::string::size_type pos(0);
+    while (pos < pattern.length()) {
+	const char ch(pattern[pos]);
+
+	char literal;
+	if (ch == '\\') {
+	    if (pos + 1 == pattern.length())
+		return "";
+	    const char escaped_char(pattern[pos + 1]);
+	    if (std::isalnum(static_cast<unsigned char>(escaped_char))) {
+		// Escapes w/ arguments like \x41 or \p{L} would require real parsing.
+		if (std::strchr(ARGUMENTLESS_ESCAPES, escaped_char) == NULL)
+		    return literal_run.getLongest();
+		literal_run.end();
+		pos += 2;
+		continue;
+	    }
+	    literal = escaped_char;
+	    pos += 2;
+	} else if (ch == '[') {
+	    literal_run.end();
+	    pos = SkipCharacterClass(pattern, pos);
+	    if (pos == std::string::npos)
+		return literal_run.getLongest();
+	    continue;
+	} else if (ch == '(') {
+	    literal_run.end();
+	    pos = SkipGroup(pattern, pos);
+	    if (pos == std::string::npos)
+		return literal_run.getLongest();
+	    continue;
+	} else if (ch == '?' or ch == '*' or ch == '+' or ch == '.' or ch == '^' or ch == '$' or ch == ')') {
+	    literal_run.end();
+	    ++pos;
+	    continue;
+	} else if (ch == '{') {
+	    literal_run.end();
+	    pos = pattern.find('}', pos);
+	    if (pos == std::string::npos)
+		return literal_run.getLongest();
+	    ++pos;
+	    continue;
+	} else {
+	    literal = ch;
+	    ++pos;
+	}
+
+	// A quantifier makes the preceding character optional, except for "+".
+	literal_run.append(literal);
+	if (pos < pattern.length()) {
+	    const char next_char(pattern[pos]);
+	    if (next_char == '?' or next_char == '*' or next_char == '{') {
+		literal_run.dropLastCharacter();
+		literal_run.end();
+	    } else if (next_char == '+')
+		literal_run.end();
+	}
+    }
+
+    return literal_run.getLongest();
+}
+
+
+bool RegexMatcher::matched(const std::string &s, std::string * const err_msg,
+			   std::string::size_type * const start_pos) const
+{
+    return matched(s.data(), s.length(), err_msg, start_pos);
+}
+
+
+bool RegexMatcher::matched(const char * const s, const size_t length, std::string * const err_msg,
+			   std::string::size_type * const start_pos) const
+{
+    err_msg->clear();
+
+    if (length > static_cast<size_t>(INT_MAX)) {
+	*err_msg = "subject passed into RegexMatcher::matched() is too long!";
+	return false;
+    }
+
+    const int retcode(::pcre_exec(pcre_, pcre_extra_, s, static_cast<int>(length), 0, 0, thread_ovector,
+				  OVECTOR_SIZE));
+
+    // A return code of 0 means that the ovector was too small to hold all captured substrings.  The start of the
+    // match will nevertheless have been stored.
+    if (retcode >= 0) {
+	if (start_pos != NULL)
+	    *start_pos = thread_ovector[0];
+	return true;
+    }
+
+    if (retcode == PCRE_ERROR_BADUTF8)
+	*err_msg = "A \"subject\" with invalid UTF-8 was passed into RegexMatcher::matched()!";
+    else if (retcode != PCRE_ERROR_NOMATCH)
+	*err_msg = "pcre_exec() failed with error code " + std::to_string(retcode) + "!";
+
+    return false;
+}
@@ -27,11 +27,14 @@
 
 /** \class RegexMatcher
  *  \brief Wrapper class for simple use cases of the PCRE library and UTF-8 strings.
+ *  \note  Patterns are JIT-compiled if the PCRE library supports it.  A const RegexMatcher may be used by several
+ *         threads at the same time as each thread gets its own JIT stack and match buffer.
  */
 class RegexMatcher {
 public:
     static bool utf8_configured_;
     std::string pattern_;
+    bool utf8_;
     pcre* pcre_;
     pcre_extra* pcre_extra_;
 public:
@@ -48,18 +51,32 @@ public:
     }
 
     /** \brief Creates a RegexMatcher.
+     *  \param utf8  If false, "pattern" and the subjects are treated as bytes, e.g. for MARC-8 encoded values, which
+     *               would otherwise be rejected as invalid UTF-8.
      *  \return NULL if "pattern" failed to compile and then also sets "err_msg".
      */
-    static RegexMatcher *RegexMatcherFactory(const std::string &pattern, std::string * const err_msg);
+    static RegexMatcher *RegexMatcherFactory(const std::string &pattern, std::string * const err_msg,
+					     const bool utf8 = true);
+
+    /** \brief Determines a literal that occurs in every string that "pattern" matches.
+     *  \return The longest such literal that could be found or the empty string if none could be found.  The
+     *          analysis is conservative and gives up on alternations, option settings and \Q...\E quoting.
+     *  \note   Useful as a cheap prefilter, e.g. w/ memmem(3), before running the actual regex.
+     */
+    static std::string ExtractRequiredLiteral(const std::string &pattern);
 
     /** Returns true if "s" was matched, false, if an error occurred or no match was found. In the case of an
      *  error "err_msg" will be set to a non-empty string, otherwise "err_msg" will be cleared.
      */
     bool matched(const std::string &s, std::string * const err_msg,
 		 std::string::size_type * const start_pos = NULL) const;
+
+    /** Like the above but matches the "length" bytes starting at "s" which need not be NUL-terminated. */
+    bool matched(const char * const s, const size_t length, std::string * const err_msg,
+		 std::string::size_type * const start_pos = NULL) const;
 private:
-    RegexMatcher(const std::string &pattern, pcre * const pcre, pcre_extra * const pcre_extra)
-	: pattern_(pattern), pcre_(pcre), pcre_extra_(pcre_extra) {}
+    RegexMatcher(const std::string &pattern, const bool utf8, pcre * const pcre, pcre_extra * const pcre_extra)
+	: pattern_(pattern), utf8_(utf8), pcre_(pcre), pcre_extra_(pcre_extra) {}
 };
 
 
@@ -0,0 +1,49 @@
+/** \file   RejectLog.cc
+ *  \brief  Implementation of the RejectLog class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "RejectLog.h"
+#include <cerrno>
+#include <cstring>
+#include "util.h"
+
+
+RejectLog *RejectLog::RejectLogFactory(const std::string &filename, std::string * const err_msg) {
+    FILE * const output(std::fopen(filename.c_str(), "w"));
+    if (output == NULL) {
+	*err_msg = "can't open \"" + filename + "\" for writing! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    return new RejectLog(filename, output);
+}
+
+
+RejectLog::~RejectLog() {
+    const bool write_failed(std::ferror(output_) != 0);
+    if (std::fclose(output_) != 0 or write_failed)
+	Warning("write to the reject log \"" + filename_ + "\" failed!");
+}
+
+
+void RejectLog::log(const size_t offset, const size_t length, const std::string &reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::fprintf(output_, "%zu\t%zu\t%s\n", offset, length, reason.c_str());
+    ++reject_count_;
+    rejected_byte_count_ += length;
+}
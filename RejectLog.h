@@ -0,0 +1,68 @@
+/** \file   RejectLog.h
+ *  \brief  Interface for the RejectLog class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REJECT_LOG_H
+#define REJECT_LOG_H
+
+
+#include <mutex>
+#include <string>
+#include <cstdio>
+
+
+/** \class RejectLog
+ *  \brief Records the byte ranges of an input file that had to be skipped because they did not contain valid records.
+ *
+ *  Each rejected range is written as a line of three tab-separated columns: the file offset and the length of the
+ *  range in bytes, both in decimal, followed by the reason.  The bytes themselves can then be extracted w/ e.g.
+ *  "dd bs=1 skip=offset count=length".
+ *
+ *  \note  log() may be called concurrently, e.g. by the reader and the writer of a RecordPipeline.
+ */
+class RejectLog {
+    const std::string filename_;
+    FILE *output_;
+    std::mutex mutex_;
+    size_t reject_count_;
+    size_t rejected_byte_count_;
+public:
+    /** \brief Creates or truncates "filename".
+     *  \return NULL if "filename" could not be opened and then also sets "err_msg".
+     */
+    static RejectLog *RejectLogFactory(const std::string &filename, std::string * const err_msg);
+
+    /** Closes the log.  Write errors are reported as warnings. */
+    ~RejectLog();
+
+    const std::string &getFilename() const { return filename_; }
+
+    /** \param reason  Must not contain any newlines. */
+    void log(const size_t offset, const size_t length, const std::string &reason);
+
+    size_t getRejectCount() const { return reject_count_; }
+    size_t getRejectedByteCount() const { return rejected_byte_count_; }
+private:
+    RejectLog(const std::string &filename, FILE * const output)
+	: filename_(filename), output_(output), reject_count_(0), rejected_byte_count_(0) {}
+    RejectLog(const RejectLog &rhs) = delete;
+    const RejectLog &operator=(const RejectLog &rhs) = delete;
+};
+
+
+#endif // ifndef REJECT_LOG_H
@@ -0,0 +1,82 @@
+/** \file   Slice.h
+ *  \brief  Interface for the Slice class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLICE_H
+#define SLICE_H
+
+
+#include <ostream>
+#include <string>
+#include <cstring>
+
+
+/** \class Slice
+ *  \brief A non-owning (pointer, length) reference to a range of bytes, e.g. a field inside of a mapped MARC file.
+ *  \note  A Slice is only valid for as long as the memory that it refers to is valid.
+ */
+class Slice {
+    const char *data_;
+    size_t size_;
+public:
+    Slice(): data_(NULL), size_(0) {}
+    Slice(const char * const data, const size_t size): data_(data), size_(size) {}
+    explicit Slice(const std::string &s): data_(s.data()), size_(s.size()) {}
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    char operator[](const size_t pos) const { return data_[pos]; }
+
+    /** \return The slice starting at "pos" w/ at most "n" bytes.  "pos" must not exceed size(). */
+    Slice substr(const size_t pos, const size_t n = std::string::npos) const
+	{ return Slice(data_ + pos, (n > size_ - pos) ? size_ - pos : n); }
+
+    /** \return A copy of the referenced bytes. */
+    std::string toString() const { return std::string(data_, size_); }
+
+    /** \return A negative number, zero or a positive number if this slice sorts before, equal to or after "rhs". */
+    int compare(const Slice &rhs) const {
+	const int result(std::memcmp(data_, rhs.data_, size_ < rhs.size_ ? size_ : rhs.size_));
+	if (result != 0)
+	    return result;
+	return (size_ < rhs.size_) ? -1 : (size_ > rhs.size_ ? 1 : 0);
+    }
+
+    bool startsWith(const Slice &prefix) const
+	{ return prefix.size_ <= size_ and std::memcmp(data_, prefix.data_, prefix.size_) == 0; }
+
+    bool operator<(const Slice &rhs) const { return compare(rhs) < 0; }
+    bool operator==(const Slice &rhs) const
+	{ return size_ == rhs.size_ and (size_ == 0 or std::memcmp(data_, rhs.data_, size_) == 0); }
+    bool operator!=(const Slice &rhs) const { return not operator==(rhs); }
+    bool operator==(const std::string &rhs) const { return operator==(Slice(rhs)); }
+    bool operator!=(const std::string &rhs) const { return not operator==(Slice(rhs)); }
+    bool operator==(const char * const rhs) const { return operator==(Slice(rhs, std::strlen(rhs))); }
+    bool operator!=(const char * const rhs) const { return not operator==(rhs); }
+};
+
+
+inline std::ostream &operator<<(std::ostream &output, const Slice &slice) {
+    return output.write(slice.data(), slice.size());
+}
+
+
+#endif // ifndef SLICE_H
@@ -0,0 +1,84 @@
+/** \file   SmallVector.h
+ *  \brief  Interface for the SmallVector class template.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+
+#include <algorithm>
+#include <vector>
+
+
+/** \class SmallVector
+ *  \brief A vector that keeps up to "INLINE_CAPACITY" elements in place and only spills to the heap beyond that.
+ *  \note  "ElementType" should be a cheap-to-copy, default-constructible type.
+ */
+template<typename ElementType, size_t INLINE_CAPACITY> class SmallVector {
+    size_t size_;
+    ElementType inline_storage_[INLINE_CAPACITY];
+    std::vector<ElementType> heap_storage_; // Once non-empty it holds all of the elements.
+public:
+    typedef ElementType *iterator;
+    typedef const ElementType *const_iterator;
+public:
+    SmallVector(): size_(0) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    ElementType *data() { return onHeap() ? heap_storage_.data() : inline_storage_; }
+    const ElementType *data() const { return onHeap() ? heap_storage_.data() : inline_storage_; }
+
+    iterator begin() { return data(); }
+    iterator end() { return data() + size_; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + size_; }
+
+    ElementType &operator[](const size_t index) { return data()[index]; }
+    const ElementType &operator[](const size_t index) const { return data()[index]; }
+
+    void push_back(const ElementType &element) {
+	if (onHeap())
+	    heap_storage_.push_back(element);
+	else if (size_ < INLINE_CAPACITY)
+	    inline_storage_[size_] = element;
+	else {
+	    heap_storage_.reserve(2 * INLINE_CAPACITY);
+	    heap_storage_.assign(inline_storage_, inline_storage_ + size_);
+	    heap_storage_.push_back(element);
+	}
+	++size_;
+    }
+
+    /** Removes the element at "index" while preserving the order of the remaining elements. */
+    void erase(const size_t index) {
+	if (onHeap())
+	    heap_storage_.erase(heap_storage_.begin() + index);
+	else
+	    std::copy(inline_storage_ + index + 1, inline_storage_ + size_, inline_storage_ + index);
+	--size_;
+    }
+
+    void clear() { heap_storage_.clear(); size_ = 0; }
+private:
+    bool onHeap() const { return not heap_storage_.empty(); }
+};
+
+
+#endif // ifndef SMALL_VECTOR_H
@@ -0,0 +1,154 @@
+/** \file   Stats.cc
+ *  \brief  Implementation of the instrumentation declared in Stats.h.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Stats.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdio>
+
+
+namespace Stats {
+
+
+void Histogram::merge(const Histogram &other) {
+    for (unsigned bucket_no(0); bucket_no < BUCKET_COUNT; ++bucket_no)
+	buckets_[bucket_no] += other.buckets_[bucket_no];
+    count_ += other.count_;
+    sum_   += other.sum_;
+    if (other.max_ > max_)
+	max_ = other.max_;
+}
+
+
+void Histogram::print(const std::string &title, std::ostream &output) const {
+    char line[128];
+    std::snprintf(line, sizeof line, "%s (mean %.1f, max %llu):\n", title.c_str(),
+		  count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_, static_cast<unsigned long long>(max_));
+    output << line;
+
+    for (unsigned bucket_no(0); bucket_no < BUCKET_COUNT; ++bucket_no) {
+	if (buckets_[bucket_no] == 0)
+	    continue;
+	const unsigned long long low(bucket_no == 0 ? 0 : 1ull << (bucket_no - 1));
+	const unsigned long long high(bucket_no == 0 ? 0 : (1ull << bucket_no) - 1);
+	std::snprintf(line, sizeof line, "    %10llu - %-10llu %12llu %6.2f%%\n", low, high,
+		      static_cast<unsigned long long>(buckets_[bucket_no]), 100.0 * buckets_[bucket_no] / count_);
+	output << line;
+    }
+}
+
+
+#ifndef MARC_NO_STATS
+
+
+bool enabled(false);
+
+
+namespace {
+
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Counters>> registry; // The counters of all threads, including terminated ones.
+uint64_t start_cycles;
+std::chrono::steady_clock::time_point start_time;
+
+
+const char * const STAGE_NAMES[STAGE_COUNT] = {
+    "other", "reading", "leader and directory parsing", "field and subfield extraction", "value matching", "output"
+};
+
+
+} // unnamed namespace
+
+
+bool Enable() {
+    start_time   = std::chrono::steady_clock::now();
+    start_cycles = ReadCycleCounter();
+    enabled      = true;
+    return true;
+}
+
+
+Counters *AllocateThreadCounters() {
+    // Value-initialisation zeroes all counters and makes OTHER the current stage.
+    Counters * const counters(new Counters());
+    counters->last_switch_ = ReadCycleCounter();
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.emplace_back(counters);
+    return counters;
+}
+
+
+void PrintSummary(std::ostream &output) {
+    const double elapsed_seconds(
+	std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+    const double cycles_per_second((ReadCycleCounter() - start_cycles) / elapsed_seconds);
+
+    Counters totals = Counters();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto &counters : registry) {
+	for (unsigned stage(0); stage < STAGE_COUNT; ++stage)
+	    totals.stage_cycles_[stage] += counters->stage_cycles_[stage];
+	totals.records_read_   += counters->records_read_;
+	totals.bytes_read_     += counters->bytes_read_;
+	totals.records_parsed_ += counters->records_parsed_;
+	totals.record_lengths_.merge(counters->record_lengths_);
+	totals.field_counts_.merge(counters->field_counts_);
+    }
+
+    char line[128];
+    output << "Statistics (" << registry.size() << " thread(s)):\n";
+    std::snprintf(line, sizeof line, "  %llu records (%.2f MB) read, %llu records parsed in %.3f s\n",
+		  static_cast<unsigned long long>(totals.records_read_), totals.bytes_read_ / (1024.0 * 1024.0),
+		  static_cast<unsigned long long>(totals.records_parsed_), elapsed_seconds);
+    output << line;
+    std::snprintf(line, sizeof line, "  Throughput: %.0f records/s, %.2f MB/s\n",
+		  totals.records_read_ / elapsed_seconds, totals.bytes_read_ / (1024.0 * 1024.0) / elapsed_seconds);
+    output << line;
+
+    // Shares are relative to the instrumented stages, i.e. w/o OTHER, and summed over all threads.
+    uint64_t instrumented_cycles(0);
+    for (unsigned stage(OTHER + 1); stage < STAGE_COUNT; ++stage)
+	instrumented_cycles += totals.stage_cycles_[stage];
+    std::snprintf(line, sizeof line, "  %-32s %16s %8s %10s\n", "Stage", "Cycles", "Share", "Seconds");
+    output << line;
+    for (unsigned stage(OTHER + 1); stage < STAGE_COUNT; ++stage) {
+	std::snprintf(line, sizeof line, "  %-32s %16llu %7.2f%% %10.3f\n", STAGE_NAMES[stage],
+		      static_cast<unsigned long long>(totals.stage_cycles_[stage]),
+		      instrumented_cycles == 0 ? 0.0 : 100.0 * totals.stage_cycles_[stage] / instrumented_cycles,
+		      totals.stage_cycles_[stage] / cycles_per_second);
+	output << line;
+    }
+    std::snprintf(line, sizeof line, "  %-32s %16llu %8s %10.3f\n", "other (incl. waiting)",
+		  static_cast<unsigned long long>(totals.stage_cycles_[OTHER]), "",
+		  totals.stage_cycles_[OTHER] / cycles_per_second);
+    output << line;
+
+    totals.record_lengths_.print("  Record lengths of parsed records", output);
+    totals.field_counts_.print("  Field counts of parsed records", output);
+}
+
+
+#endif // ifndef MARC_NO_STATS
+
+
+} // namespace Stats
@@ -0,0 +1,217 @@
+/** \file   Stats.h
+ *  \brief  Low-overhead instrumentation: per-stage cycle counters, record counts and histograms.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <ostream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#ifndef MARC_NO_STATS
+#   if defined(__x86_64__) || defined(__i386__)
+#       include <x86intrin.h>
+#   else
+#       include <chrono>
+#   endif
+#endif
+
+
+/** \namespace Stats
+ *  \brief Collects statistics about where the time goes when processing MARC-21 records.
+ *
+ *  Nothing is collected until Enable() has been called and then each thread updates its own counters, so that
+ *  there is no contention between threads.  PrintSummary() aggregates the counters of all threads.  If
+ *  MARC_NO_STATS is defined, e.g. w/ "make NO_STATS=1", all instrumentation compiles to nothing.
+ */
+namespace Stats {
+
+
+/** The processing stages that cycles are attributed to.  OTHER is everything that is not inside of a StageTimer. */
+enum Stage { OTHER, READING, PARSING, EXTRACTION, MATCHING, OUTPUT };
+const unsigned STAGE_COUNT(OUTPUT + 1);
+
+
+/** \class Histogram
+ *  \brief Counts values in power-of-two buckets, i.e. bucket n > 0 holds the values in [2^(n-1), 2^n - 1].
+ */
+class Histogram {
+    static const unsigned BUCKET_COUNT = 33;
+    uint64_t buckets_[BUCKET_COUNT];
+    uint64_t count_, sum_, max_;
+public:
+    Histogram(): buckets_(), count_(0), sum_(0), max_(0) {}
+
+    void add(const uint32_t value) {
+	++buckets_[value == 0 ? 0 : 32 - __builtin_clz(value)];
+	++count_;
+	sum_ += value;
+	if (value > max_)
+	    max_ = value;
+    }
+
+    void merge(const Histogram &other);
+
+    /** Writes the non-empty buckets and the mean and maximum value to "output". */
+    void print(const std::string &title, std::ostream &output) const;
+};
+
+
+/** The counters of a single thread. */
+struct Counters {
+    uint64_t stage_cycles_[STAGE_COUNT];
+    Stage current_stage_;
+    uint64_t last_switch_;
+    uint64_t records_read_, bytes_read_, records_parsed_;
+    Histogram record_lengths_, field_counts_;
+
+    /** Attributes the cycles since the last switch to the current stage and then makes "new_stage" current.
+     *  \return The previously current stage.
+     */
+    inline Stage switchStage(const Stage new_stage);
+};
+
+
+#ifndef MARC_NO_STATS
+
+
+extern bool enabled;
+
+
+inline uint64_t ReadCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+Stage Counters::switchStage(const Stage new_stage) {
+    const uint64_t now(ReadCycleCounter());
+    stage_cycles_[current_stage_] += now - last_switch_;
+    last_switch_ = now;
+
+    const Stage old_stage(current_stage_);
+    current_stage_ = new_stage;
+    return old_stage;
+}
+
+
+/** \brief Starts the collection of statistics.
+ *  \note  Must be called before any threads that process records are started.
+ *  \return False if statistics support has been compiled out, else true.
+ */
+bool Enable();
+
+
+inline bool IsEnabled() { return enabled; }
+
+
+/** Allocates the counters of the calling thread on first use.  Only call this if IsEnabled() returns true. */
+Counters *AllocateThreadCounters();
+
+
+inline Counters *GetThreadCounters() {
+    static thread_local Counters *thread_counters(NULL);
+    if (thread_counters == NULL)
+	thread_counters = AllocateThreadCounters();
+    return thread_counters;
+}
+
+
+/** \class StageTimer
+ *  \brief Attributes the cycles spent during its lifetime to "stage".
+ *
+ *  StageTimer's nest, i.e. the time spent in an inner StageTimer is only attributed to the inner stage and the outer
+ *  stage resumes when the inner StageTimer is destroyed.  Each transition costs a single read of the cycle counter.
+ */
+class StageTimer {
+    Counters *counters_; // NULL if statistics are disabled.
+    Stage outer_stage_;
+public:
+    explicit StageTimer(const Stage stage): counters_(enabled ? GetThreadCounters() : NULL), outer_stage_(OTHER) {
+	if (counters_ != NULL)
+	    outer_stage_ = counters_->switchStage(stage);
+    }
+
+    ~StageTimer() {
+	if (counters_ != NULL)
+	    counters_->switchStage(outer_stage_);
+    }
+private:
+    StageTimer(const StageTimer &rhs) = delete;
+    const StageTimer &operator=(const StageTimer &rhs) = delete;
+};
+
+
+/** Counts a record that has been located in the input, whether it will be parsed or not. */
+inline void CountRawRecord(const size_t record_length) {
+    if (enabled) {
+	Counters * const counters(GetThreadCounters());
+	++counters->records_read_;
+	counters->bytes_read_ += record_length;
+    }
+}
+
+
+/** Counts a record whose leader and directory have been parsed. */
+inline void CountParsedRecord(const unsigned record_length, const size_t field_count) {
+    if (enabled) {
+	Counters * const counters(GetThreadCounters());
+	++counters->records_parsed_;
+	counters->record_lengths_.add(record_length);
+	counters->field_counts_.add(field_count);
+    }
+}
+
+
+/** \brief Writes the aggregated counters of all threads to "output".
+ *  \note  Threads must not update their counters while this function is running, e.g. call it after joining them.
+ */
+void PrintSummary(std::ostream &output);
+
+
+#else // MARC_NO_STATS
+
+
+inline bool Enable() { return false; }
+inline bool IsEnabled() { return false; }
+
+
+class StageTimer {
+public:
+    explicit StageTimer(const Stage /* stage */) {}
+};
+
+
+inline void CountRawRecord(const size_t /* record_length */) { }
+inline void CountParsedRecord(const unsigned /* record_length */, const size_t /* field_count */) { }
+inline void PrintSummary(std::ostream &/* output */) { }
+
+
+#endif // ifndef MARC_NO_STATS
+
+
+} // namespace Stats
+
+
+#endif // ifndef STATS_H
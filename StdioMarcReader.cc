@@ -0,0 +1,85 @@
+/** \file   StdioMarcReader.cc
+ *  \brief  Implementation of the StdioMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "StdioMarcReader.h"
+#include <cerrno>
+#include <cstring>
+#include "Stats.h"
+
+
+// The leader has 5 digits for the record length.  This is also large enough for the peeks during resynchronisation.
+static const size_t MAX_RECORD_LENGTH(99999);
+
+
+StdioMarcReader *StdioMarcReader::StdioMarcReaderFactory(const std::string &input_filename,
+							 std::string * const err_msg)
+{
+    FILE * const input(std::fopen(input_filename.c_str(), "rb"));
+    if (input == NULL) {
+	*err_msg = "can't open \"" + input_filename + "\" for reading! (" + std::strerror(errno) + ")";
+	return NULL;
+    }
+
+    return new StdioMarcReader(input_filename, input);
+}
+
+
+StdioMarcReader::StdioMarcReader(const std::string &input_filename, FILE * const input)
+    : input_filename_(input_filename), input_(input), offset_(0), buffer_(new char[MAX_RECORD_LENGTH]),
+      buffer_size_(MAX_RECORD_LENGTH), pending_start_(0), pending_end_(0)
+{
+}
+
+
+const char *StdioMarcReader::peek(const size_t min_size, size_t * const available, std::string * const err_msg) {
+    if (pending_end_ - pending_start_ < min_size) {
+	const Stats::StageTimer timer(Stats::READING);
+	if (min_size > buffer_size_) {
+	    std::unique_ptr<char[]> new_buffer(new char[min_size]);
+	    std::memcpy(new_buffer.get(), buffer_.get() + pending_start_, pending_end_ - pending_start_);
+	    buffer_.swap(new_buffer);
+	    buffer_size_ = min_size;
+	    pending_end_  -= pending_start_;
+	    pending_start_ = 0;
+	} else if (pending_start_ + min_size > buffer_size_) {
+	    std::memmove(buffer_.get(), buffer_.get() + pending_start_, pending_end_ - pending_start_);
+	    pending_end_  -= pending_start_;
+	    pending_start_ = 0;
+	}
+
+	pending_end_ += std::fread(buffer_.get() + pending_end_, 1, min_size - (pending_end_ - pending_start_),
+				   input_);
+	if (std::ferror(input_)) {
+	    *err_msg = "read from \"" + input_filename_ + "\" failed!";
+	    *available = 0;
+	    return NULL;
+	}
+    }
+
+    *available = pending_end_ - pending_start_;
+    return buffer_.get() + pending_start_;
+}
+
+
+void StdioMarcReader::skip(const size_t count) {
+    pending_start_ += count;
+    if (pending_start_ == pending_end_)
+	pending_start_ = pending_end_ = 0;
+    offset_ += count;
+}
@@ -0,0 +1,67 @@
+/** \file   StdioMarcReader.h
+ *  \brief  Interface for the StdioMarcReader class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STDIO_MARC_READER_H
+#define STDIO_MARC_READER_H
+
+
+#include <memory>
+#include <string>
+#include <cstdio>
+#include "MarcReader.h"
+
+
+/** \class StdioMarcReader
+ *  \brief Reads binary MARC-21 records w/ two fread(3) calls per record, one for the leader and one for the rest.
+ *
+ *  This is the I/O pattern of MarcUtil::ReadNextRecord().  Unlike the other readers it works on pipes and other
+ *  non-seekable files.  The returned records are only valid until the next call.
+ */
+class StdioMarcReader: public MarcReader {
+    const std::string input_filename_;
+    FILE *input_;
+    size_t offset_;
+    std::unique_ptr<char[]> buffer_;
+    size_t buffer_size_;
+    size_t pending_start_, pending_end_; // The bytes in "buffer_" that have been read but not skipped yet.
+public:
+    /** \brief Opens "input_filename" for reading.
+     *  \return NULL if "input_filename" could not be opened and then also sets "err_msg".
+     */
+    static StdioMarcReader *StdioMarcReaderFactory(const std::string &input_filename, std::string * const err_msg);
+
+    ~StdioMarcReader() { std::fclose(input_); }
+
+    const std::string &getFilename() const override { return input_filename_; }
+    size_t tell() const override { return offset_; }
+protected:
+    /** \brief Reads exactly the missing bytes, i.e. for a record first its leader and then the rest.
+     *  \note  The buffer grows if more than the maximum record length is requested, e.g. by a MarcXmlReader.
+     */
+    const char *peek(const size_t min_size, size_t * const available, std::string * const err_msg) override;
+
+    void skip(const size_t count) override;
+private:
+    StdioMarcReader(const std::string &input_filename, FILE * const input);
+    StdioMarcReader(const StdioMarcReader &rhs) = delete;
+    const StdioMarcReader &operator=(const StdioMarcReader &rhs) = delete;
+};
+
+
+#endif // ifndef STDIO_MARC_READER_H
@@ -47,6 +47,32 @@ inline bool EndsWith(const std::string &s, const std::string &suffix) {
 }
 
 
+/** \brief Converts the "length" ASCII decimal digits starting at "s" to an unsigned number.
+ *  \return False if any of the "length" characters was not a decimal digit, else true.
+ */
+inline bool DecimalDigitsToUnsigned(const char *s, const size_t length, unsigned * const n) {
+    unsigned value(0);
+    for (const char * const end(s + length); s != end; ++s) {
+	const unsigned digit(static_cast<unsigned char>(*s) - '0');
+	if (digit > 9)
+	    return false;
+	value = value * 10 + digit;
+    }
+
+    *n = value;
+    return true;
+}
+
+
+/** \brief Writes "n" as exactly "length" ASCII decimal digits, padded w/ leading zeros, to "s".
+ *  \note  No terminating NUL will be written.  "n" must be less than 10^length.
+ */
+inline void UnsignedToDecimalDigits(unsigned n, const size_t length, char * const s) {
+    for (char *cp(s + length); cp != s; n /= 10)
+	*--cp = static_cast<char>('0' + n % 10);
+}
+
+
 /** Pads "s" with leading "pad_char"'s if s.length() < min_length. */
 std::string PadLeading(const std::string &s, const std::string::size_type min_length, const char pad_char = ' ');
 
@@ -0,0 +1,57 @@
+/** \file   SubfieldCodeSet.h
+ *  \brief  Interface for the SubfieldCodeSet class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SUBFIELD_CODE_SET_H
+#define SUBFIELD_CODE_SET_H
+
+
+#include <string>
+#include <cstdint>
+
+
+/** \class SubfieldCodeSet
+ *  \brief A 128-bit presence mask for subfield codes.
+ *  \note  Subfield codes are ASCII characters.  Should a non-ASCII code show up it shares its bit with the ASCII
+ *         code that has the same low 7 bits, IOW, contains() may report false positives for such codes.
+ */
+class SubfieldCodeSet {
+    uint64_t bits_[2];
+public:
+    SubfieldCodeSet() { bits_[0] = bits_[1] = 0; }
+
+    /** Constructs a set containing all of the characters in "subfield_codes". */
+    explicit SubfieldCodeSet(const std::string &subfield_codes) {
+	bits_[0] = bits_[1] = 0;
+	for (const char subfield_code : subfield_codes)
+	    insert(subfield_code);
+    }
+
+    bool empty() const { return (bits_[0] | bits_[1]) == 0; }
+    void clear() { bits_[0] = bits_[1] = 0; }
+    void insert(const char subfield_code) { bits_[Word(subfield_code)] |= Bit(subfield_code); }
+    void erase(const char subfield_code) { bits_[Word(subfield_code)] &= ~Bit(subfield_code); }
+    bool contains(const char subfield_code) const { return (bits_[Word(subfield_code)] & Bit(subfield_code)) != 0; }
+private:
+    static unsigned Word(const char subfield_code) { return (static_cast<unsigned char>(subfield_code) >> 6) & 1u; }
+    static uint64_t Bit(const char subfield_code)
+	{ return uint64_t(1) << (static_cast<unsigned char>(subfield_code) & 63u); }
+};
+
+
+#endif // ifndef SUBFIELD_CODE_SET_H
@@ -0,0 +1,120 @@
+/** \file   SubfieldView.h
+ *  \brief  Interface for the SubfieldView class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SUBFIELD_VIEW_H
+#define SUBFIELD_VIEW_H
+
+
+#include <iterator>
+#include <utility>
+#include <cstring>
+#include "Slice.h"
+
+
+/** \class SubfieldView
+ *  \brief A read-only, non-materialising view of the subfields of a MARC-21 data field.
+ *
+ *  Unlike Subfields, nothing gets parsed up front.  The iterators walk the field data in place, one subfield
+ *  delimiter at a time, and yield (subfield code, Slice) pairs.  Malformed data before the first subfield delimiter
+ *  is skipped.
+ */
+class SubfieldView {
+    Slice field_data_;
+public:
+    /** \class ConstIterator
+     *  \brief Iterates over (subfield code, subfield data) pairs in field order.
+     */
+    class ConstIterator: public std::iterator<std::forward_iterator_tag, std::pair<char, Slice>> {
+	friend class SubfieldView;
+	const char *delimiter_; // Points at the subfield delimiter of the current subfield or at end_.
+	const char *end_;
+	bool filtered_;
+	char subfield_code_;
+	std::pair<char, Slice> code_and_value_;
+    public:
+	const std::pair<char, Slice> &operator*() const { return code_and_value_; }
+	const std::pair<char, Slice> *operator->() const { return &code_and_value_; }
+	ConstIterator &operator++() { advance(code_and_value_.second.end()); return *this; }
+	ConstIterator operator++(int) { ConstIterator old(*this); operator++(); return old; }
+	bool operator==(const ConstIterator &rhs) const { return delimiter_ == rhs.delimiter_; }
+	bool operator!=(const ConstIterator &rhs) const { return delimiter_ != rhs.delimiter_; }
+    private:
+	ConstIterator(const char * const start, const char * const end, const bool filtered, const char subfield_code)
+	    : delimiter_(end), end_(end), filtered_(filtered), subfield_code_(subfield_code) { advance(start); }
+
+	/** Positions the iterator on the first (matching) subfield at or after "start". */
+	void advance(const char *start) {
+	    for (;;) {
+		delimiter_ = FindDelimiter(start, end_);
+		if (end_ - delimiter_ < 2) { // No subfield or a delimiter w/o a subfield code.
+		    delimiter_ = end_;
+		    return;
+		}
+
+		const char * const value_start(delimiter_ + 2);
+		const char * const value_end(FindDelimiter(value_start, end_));
+		if (not filtered_ or delimiter_[1] == subfield_code_) {
+		    code_and_value_ = std::make_pair(delimiter_[1], Slice(value_start, value_end - value_start));
+		    return;
+		}
+		start = value_end;
+	    }
+	}
+
+	static const char *FindDelimiter(const char * const start, const char * const end) {
+	    if (start == end)
+		return end;
+	    const void * const delimiter(std::memchr(start, '\x1F', end - start));
+	    return (delimiter == NULL) ? end : reinterpret_cast<const char *>(delimiter);
+	}
+    };
+public:
+    /** \param field_data  The contents of a data field, starting w/ the two indicators, w/o a field terminator. */
+    explicit SubfieldView(const Slice &field_data): field_data_(field_data) {}
+
+    char getIndicator1() const { return field_data_.size() < 3 ? '\0' : field_data_[0]; }
+    char getIndicator2() const { return field_data_.size() < 3 ? '\0' : field_data_[1]; }
+
+    /** \return An iterator over all subfields in field order. */
+    ConstIterator begin() const { return ConstIterator(getFirstSubfieldStart(), field_data_.end(), false, '\0'); }
+    ConstIterator end() const { return ConstIterator(field_data_.end(), field_data_.end(), false, '\0'); }
+
+    /** \return The bounds of the range of subfields that have a subfield code of "subfield_code". */
+    std::pair<ConstIterator, ConstIterator> getIterators(const char subfield_code) const {
+	return std::make_pair(ConstIterator(getFirstSubfieldStart(), field_data_.end(), true, subfield_code), end());
+    }
+
+    /** \brief Locates the first subfield w/ code "subfield_code".  The scan stops as soon as it has been found.
+     *  \return True if a subfield w/ code "subfield_code" exists, else false.
+     */
+    bool getFirstSubfieldValue(const char subfield_code, Slice * const value) const {
+	const ConstIterator subfield(getIterators(subfield_code).first);
+	if (subfield == end())
+	    return false;
+
+	*value = subfield->second;
+	return true;
+    }
+private:
+    const char *getFirstSubfieldStart() const
+	{ return field_data_.size() < 3 ? field_data_.end() : field_data_.begin() + 2; }
+};
+
+
+#endif // ifndef SUBFIELD_VIEW_H
@@ -18,44 +18,63 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "Subfields.h"
+#include <cstring>
 #include "util.h"
 
 
-Subfields::Subfields(const std::string &field_data) {
+void Subfields::ConstIterator::skipToMatch() {
+    const size_t entry_count(subfields_->entries_.size());
+    if (filtered_) {
+	while (index_ < entry_count and subfields_->entries_[index_].code_ != subfield_code_)
+	    ++index_;
+    }
+
+    if (index_ < entry_count) {
+	const Entry &entry(subfields_->entries_[index_]);
+	code_and_value_ = std::make_pair(entry.code_, subfields_->getValue(entry));
+    }
+}
+
+
+Subfields::Subfields(const std::string &field_data): buffer_(field_data) {
     if (field_data.size() < 3) {
 	indicator1_ = indicator2_ = '\0';
 	return;
     }
 
-    std::string::const_iterator ch(field_data.begin());
-    indicator1_ = *ch++;
-    indicator2_ = *ch++;
-    
-    while (ch != field_data.end()) {
+    indicator1_ = buffer_[0];
+    indicator2_ = buffer_[1];
+
+    const char * const start(buffer_.data());
+    const char * const end(start + buffer_.size());
+    const char *ch(start + 2);
+    while (ch != end) {
 	if (*ch != '\x1F')
 	    Error("Expected subfield code delimiter not found!");
 
 	++ch;
-	if (ch == field_data.end())
+	if (ch == end)
 	    Error("Unexpected subfield data end while expecting a subfield code!");
 	const char subfield_code = *ch++;
 
-	std::string subfield_data;
-	while (ch != field_data.end() and *ch != '\x1F')
-	    subfield_data += *ch++;
-	if (subfield_data.empty())
+	const char *next_delimiter(reinterpret_cast<const char *>(std::memchr(ch, '\x1F', end - ch)));
+	if (next_delimiter == NULL)
+	    next_delimiter = end;
+	if (next_delimiter == ch)
 	    Error("Empty subfield for code '" + std::to_string(subfield_code) + "'!");
 
-	subfield_code_to_data_map_.insert(std::make_pair(subfield_code, subfield_data));
+	const Entry entry = { subfield_code, static_cast<unsigned>(ch - start),
+			      static_cast<unsigned>(next_delimiter - ch) };
+	entries_.push_back(entry);
+	subfield_codes_.insert(subfield_code);
+	ch = next_delimiter;
     }
 }
 
 
 bool Subfields::hasSubfieldWithValue(const char subfield_code, const std::string &value) const {
-    for (auto code_and_value(subfield_code_to_data_map_.find(subfield_code));
-	 code_and_value != subfield_code_to_data_map_.end() and code_and_value->first == subfield_code;
-	 ++code_and_value)
-    {
+    const std::pair<ConstIterator, ConstIterator> begin_end(getIterators(subfield_code));
+    for (ConstIterator code_and_value(begin_end.first); code_and_value != begin_end.second; ++code_and_value) {
 	if (code_and_value->second == value)
 	    return true;
     }
@@ -67,12 +86,17 @@ bool Subfields::hasSubfieldWithValue(const char subfield_code, const std::string
 void Subfields::replace(const char subfield_code, const std::string &old_value, const std::string &new_value) {
     bool found(false);
 
-    const std::pair<Iterator, Iterator> begin_end(getIterators(subfield_code));
-    for (Iterator code_and_value(begin_end.first); code_and_value != begin_end.second; ++code_and_value) {
-	if (code_and_value->second == old_value) {
-	    found = true;
-	    code_and_value->second = new_value;
-	}
+    for (auto &entry : entries_) {
+	if (entry.code_ != subfield_code or getValue(entry) != old_value)
+	    continue;
+
+	found = true;
+	if (new_value.size() > entry.length_) { // Doesn't fit => move the data to the end of the buffer.
+	    entry.offset_ = buffer_.size();
+	    buffer_ += new_value;
+	} else
+	    buffer_.replace(entry.offset_, new_value.size(), new_value);
+	entry.length_ = new_value.size();
     }
 
     if (not found)
@@ -81,30 +105,53 @@ void Subfields::replace(const char subfield_code, const std::string &old_value,
 }
 
 
+template<typename Predicate> void Subfields::eraseIf(const Predicate &predicate) {
+    subfield_codes_.clear();
+    for (size_t index(0); index < entries_.size(); /* Intentionally empty! */) {
+	if (predicate(entries_[index]))
+	    entries_.erase(index);
+	else {
+	    subfield_codes_.insert(entries_[index].code_);
+	    ++index;
+	}
+    }
+}
+
+
+void Subfields::erase(const char subfield_code) {
+    if (subfield_codes_.contains(subfield_code))
+	eraseIf([subfield_code](const Entry &entry) { return entry.code_ == subfield_code; });
+}
+
+
 void Subfields::erase(const char subfield_code, const std::string &value) {
-    Iterator code_and_value(subfield_code_to_data_map_.find(subfield_code));
+    if (subfield_codes_.contains(subfield_code))
+	eraseIf([this, subfield_code, &value](const Entry &entry) {
+		    return entry.code_ == subfield_code and getValue(entry) == value;
+		});
+}
 
-    while (code_and_value != subfield_code_to_data_map_.end() and code_and_value->first == subfield_code) {
-	if (code_and_value->second == value)
-	    code_and_value = subfield_code_to_data_map_.erase(code_and_value);
-	else
-	    ++code_and_value;
-    }
+
+void Subfields::addSubfield(const char subfield_code, const std::string &subfield_data) {
+    const Entry entry = { subfield_code, static_cast<unsigned>(buffer_.size()),
+			  static_cast<unsigned>(subfield_data.size()) };
+    entries_.push_back(entry);
+    subfield_codes_.insert(subfield_code);
+    buffer_ += subfield_data;
 }
 
 
 std::string Subfields::toString() const {
     std::string as_string;
+    as_string.reserve(2 + buffer_.size() + 2 * entries_.size());
 
     as_string += indicator1_;
     as_string += indicator2_;
 
-    for (ConstIterator code_and_value(subfield_code_to_data_map_.begin());
-	 code_and_value != subfield_code_to_data_map_.end(); ++code_and_value)
-    {
+    for (const auto &entry : entries_) {
 	as_string += '\x1F';
-	as_string += code_and_value->first;
-	as_string += code_and_value->second;
+	as_string += entry.code_;
+	as_string.append(buffer_, entry.offset_, entry.length_);
     }
 
     return as_string;
@@ -21,59 +21,109 @@
 #define SUBFIELDS_H
 
 
-#include <unordered_map>
+#include <iterator>
 #include <string>
+#include <utility>
+#include "Slice.h"
+#include "SmallVector.h"
+#include "SubfieldCodeSet.h"
 
 
 /** \class Subfields
  *  \brief Encapsulates the subfields of a MARC-21 data field.
+ *
+ *  The subfields are kept in their original order as (code, offset, length) entries that refer to a single,
+ *  contiguous buffer.  The entries for up to INLINE_SUBFIELD_COUNT subfields are stored in place and a presence mask
+ *  allows for cheap rejection of lookups for subfield codes that do not occur at all.
  */
 class Subfields {
+    static const size_t INLINE_SUBFIELD_COUNT = 16;
+
+    struct Entry {
+	char code_;
+	unsigned offset_; // Relative to the start of buffer_.
+	unsigned length_;
+    };
+
     char indicator1_, indicator2_;
-    std::unordered_multimap<char, std::string> subfield_code_to_data_map_;
+    std::string buffer_;
+    SmallVector<Entry, INLINE_SUBFIELD_COUNT> entries_;
+    SubfieldCodeSet subfield_codes_;
 public:
-    typedef std::unordered_multimap<char, std::string>::const_iterator ConstIterator;
-    typedef std::unordered_multimap<char, std::string>::iterator Iterator;
+    /** \class ConstIterator
+     *  \brief Iterates over (subfield code, subfield data) pairs in the original subfield order.
+     */
+    class ConstIterator: public std::iterator<std::forward_iterator_tag, std::pair<char, Slice>> {
+	friend class Subfields;
+	const Subfields *subfields_;
+	size_t index_;
+	bool filtered_;
+	char subfield_code_;
+	std::pair<char, Slice> code_and_value_;
+    public:
+	const std::pair<char, Slice> &operator*() const { return code_and_value_; }
+	const std::pair<char, Slice> *operator->() const { return &code_and_value_; }
+	ConstIterator &operator++() { ++index_; skipToMatch(); return *this; }
+	ConstIterator operator++(int) { ConstIterator old(*this); operator++(); return old; }
+	bool operator==(const ConstIterator &rhs) const { return index_ == rhs.index_; }
+	bool operator!=(const ConstIterator &rhs) const { return index_ != rhs.index_; }
+    private:
+	ConstIterator(const Subfields * const subfields, const size_t index, const bool filtered,
+		      const char subfield_code)
+	    : subfields_(subfields), index_(index), filtered_(filtered), subfield_code_(subfield_code)
+	    { skipToMatch(); }
+	void skipToMatch();
+    };
+
+    /** Subfield data can only be modified via replace(), therefore both iterator types are read-only. */
+    typedef ConstIterator Iterator;
 public:
-    Subfields() {}
+    Subfields(): indicator1_('\0'), indicator2_('\0') {}
     Subfields(const char indicator1, const char indicator2): indicator1_(indicator1), indicator2_(indicator2) {}
 
     /** \brief Parses a binary MARC-21 field. */
     explicit Subfields(const std::string &field_data);
 
-    bool empty() const { return subfield_code_to_data_map_.empty(); }
+    bool empty() const { return entries_.empty(); }
     char getIndicator1() const { return indicator1_; }
     void setIndicator1(const char indicator1) { indicator1_ = indicator1; }
     char getIndicator2() const { return indicator2_; }
     void setIndicator2(const char indicator2) { indicator2_ = indicator2; }
     bool hasSubfield(const char subfield_code) const
-        { return subfield_code_to_data_map_.find(subfield_code) != subfield_code_to_data_map_.end(); }
+	{ return getIterators(subfield_code).first != end(); }
 
     /** \return True, if a subfield with subfield code "subfield_code" and contents "value" exists, else false. */
     bool hasSubfieldWithValue(const char subfield_code, const std::string &value) const;
 
-    /** \return The bounds of the range of entries that have a subfield code of "subfield_code". */
-    std::pair<ConstIterator, ConstIterator> getIterators(const char subfield_code) const
-        { return subfield_code_to_data_map_.equal_range(subfield_code); }
+    /** \return An iterator over all subfields in their original order. */
+    ConstIterator begin() const { return ConstIterator(this, 0, /* filtered = */false, '\0'); }
+    ConstIterator end() const { return ConstIterator(this, entries_.size(), /* filtered = */false, '\0'); }
 
     /** \return The bounds of the range of entries that have a subfield code of "subfield_code". */
-    std::pair<Iterator, Iterator> getIterators(const char subfield_code)
-        { return subfield_code_to_data_map_.equal_range(subfield_code); }
+    std::pair<ConstIterator, ConstIterator> getIterators(const char subfield_code) const {
+	if (not subfield_codes_.contains(subfield_code))
+	    return std::make_pair(end(), end());
+	return std::make_pair(ConstIterator(this, 0, /* filtered = */true, subfield_code), end());
+    }
 
     /** Swaps out all subfields' data whose subfield code is "subfield_code" and whose data value is "old_value". */
     void replace(const char subfield_code, const std::string &old_value, const std::string &new_value);
 
-    void erase(const char subfield_code) { subfield_code_to_data_map_.erase(subfield_code); }
+    void erase(const char subfield_code);
     void erase(const char subfield_code, const std::string &value);
-    void addSubfield(const char subfield_code, const std::string &subfield_data)
-        { subfield_code_to_data_map_.insert(std::make_pair(subfield_code, subfield_data)); }
+    void addSubfield(const char subfield_code, const std::string &subfield_data);
 
     /** Returns true if the two indicators have valid, i.e. non-NUL, data and at least one subfield exists. */
     bool isValid() const
-        { return indicator1_ != '\0' and indicator2_ != '\0' and not subfield_code_to_data_map_.empty(); }
+	{ return indicator1_ != '\0' and indicator2_ != '\0' and not entries_.empty(); }
 
     /** Returns a MARC-21 binary blob for all subfields. (No field terminator will be appended!) */
     std::string toString() const;
+private:
+    Slice getValue(const Entry &entry) const { return Slice(buffer_.data() + entry.offset_, entry.length_); }
+
+    /** Removes all entries for which "predicate" returns true and updates the subfield code presence mask. */
+    template<typename Predicate> void eraseIf(const Predicate &predicate);
 };
 
 
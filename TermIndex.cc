@@ -0,0 +1,409 @@
+/** \file   TermIndex.cc
+ *  \brief  Implementation of the TermIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "TermIndex.h"
+#include <algorithm>
+#include <unordered_map>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include "DirectoryEntry.h"
+#include "MarcFileReader.h"
+#include "MarcTag.h"
+#include "StringUtil.h"
+#include "SubfieldCodeSet.h"
+#include "SubfieldView.h"
+#include "util.h"
+
+
+static const char INDEX_MAGIC[8] = { 'M', 'A', 'R', 'C', 'T', 'R', 'M', '1' };
+
+
+// Separates the field reference from the value in a term.  Subfield delimiters never occur in values.
+static const char TERM_SEPARATOR('\x1F');
+
+
+TermIndex::TermIndex(MemoryMappedFile * const index_file)
+    : index_file_(index_file), header_(reinterpret_cast<const Header *>(index_file->getData())),
+      record_locations_(reinterpret_cast<const RecordLocation *>(index_file->getData() + sizeof(Header))),
+      terms_(reinterpret_cast<const Term *>(record_locations_ + header_->record_count_)),
+      term_pool_(index_file->getData() + header_->term_pool_offset_),
+      postings_(reinterpret_cast<const unsigned char *>(index_file->getData() + header_->postings_offset_))
+{
+}
+
+
+/** \return True if all records lie within the MARC file and the strings and postings lists of all terms within the
+ *          term pool and the postings, else false.
+ *  \note   "header" must be followed by the rest of the index, which must end at "index_size".
+ */
+static bool EntriesAreInBounds(const TermIndex::Header &header, const uint64_t index_size) {
+    const TermIndex::RecordLocation * const record_locations(
+	reinterpret_cast<const TermIndex::RecordLocation *>(&header + 1));
+    for (const TermIndex::RecordLocation *location(record_locations);
+	 location != record_locations + header.record_count_; ++location)
+    {
+	if (location->record_offset_ > header.source_size_
+	    or location->record_length_ > header.source_size_ - location->record_offset_)
+	    return false;
+    }
+
+    const uint64_t term_pool_size(header.postings_offset_ - header.term_pool_offset_),
+	postings_size(index_size - header.postings_offset_);
+    const TermIndex::Term * const terms(
+	reinterpret_cast<const TermIndex::Term *>(record_locations + header.record_count_));
+    for (const TermIndex::Term *term(terms); term != terms + header.term_count_; ++term) {
+	if (static_cast<uint64_t>(term->term_offset_) + term->term_length_ > term_pool_size
+	    or term->postings_offset_ > postings_size or term->postings_size_ > postings_size - term->postings_offset_)
+	    return false;
+    }
+
+    return true;
+}
+
+
+TermIndex *TermIndex::TermIndexFactory(const std::string &index_filename, const std::string &marc_filename,
+				       std::string * const err_msg)
+{
+    MemoryMappedFile * const raw_index_file(
+	MemoryMappedFile::MemoryMappedFileFactory(index_filename, err_msg, MemoryMappedFile::RANDOM));
+    if (raw_index_file == NULL)
+	return NULL;
+    std::unique_ptr<MemoryMappedFile> index_file(raw_index_file);
+
+    const Header * const header(reinterpret_cast<const Header *>(index_file->getData()));
+    if (index_file->getSize() < sizeof(Header)
+	or std::memcmp(header->magic_, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0)
+    {
+	*err_msg = "\"" + index_filename + "\" is not a term index!";
+	return NULL;
+    }
+
+    // N.B. Checking the counts first keeps the multiplications from overflowing.
+    const uint64_t max_record_count((index_file->getSize() - sizeof(Header)) / sizeof(RecordLocation));
+    if (header->record_count_ > max_record_count
+	or header->term_count_ > (index_file->getSize() - sizeof(Header)
+				  - header->record_count_ * sizeof(RecordLocation)) / sizeof(Term)
+	or header->term_pool_offset_
+	   != sizeof(Header) + header->record_count_ * sizeof(RecordLocation) + header->term_count_ * sizeof(Term)
+	or header->postings_offset_ < header->term_pool_offset_ or header->postings_offset_ > index_file->getSize()
+	or not EntriesAreInBounds(*header, index_file->getSize()))
+    {
+	*err_msg = "term index \"" + index_filename + "\" is corrupt!";
+	return NULL;
+    }
+
+    struct stat stat_buf;
+    if (not GetFileStatus(marc_filename, &stat_buf, err_msg))
+	return NULL;
+    if (header->source_size_ != static_cast<uint64_t>(stat_buf.st_size)
+	or header->source_mtime_seconds_ != stat_buf.st_mtim.tv_sec
+	or header->source_mtime_nanoseconds_ != stat_buf.st_mtim.tv_nsec)
+    {
+	*err_msg = "term index \"" + index_filename + "\" is stale w.r.t. \"" + marc_filename + "\"!";
+	return NULL;
+    }
+
+    return new TermIndex(index_file.release());
+}
+
+
+static void AppendVarInt(uint32_t value, std::string * const buffer) {
+    while (value >= 0x80) {
+	*buffer += static_cast<char>((value & 0x7Fu) | 0x80u);
+	value >>= 7;
+    }
+    *buffer += static_cast<char>(value);
+}
+
+
+/** \brief Decodes the variable-length integer at "*cp", which must end before "end", and advances "*cp" past it.
+ *  \return False if the integer is truncated or too long for 32 bits, i.e. the index is corrupt, else true.
+ */
+static bool DecodeVarInt(const unsigned char **cp, const unsigned char * const end, uint32_t * const value) {
+    *value = 0;
+    for (unsigned shift(0); *cp != end and shift < 32; shift += 7) {
+	const unsigned char byte(*(*cp)++);
+	*value |= static_cast<uint32_t>(byte & 0x7Fu) << shift;
+	if ((byte & 0x80u) == 0)
+	    return true;
+    }
+
+    return false;
+}
+
+
+namespace {
+
+
+/** A field reference w/ zero or more subfield codes, e.g. "650a" or "001". */
+struct FieldReference {
+    MarcTag marc_tag_;
+    std::string tag_; // The same tag as text, used to compose the terms.
+    std::string subfield_codes_;
+    SubfieldCodeSet subfield_code_set_;
+};
+
+
+} // unnamed namespace
+
+
+static bool ParseFieldReferences(const std::string &field_references, std::vector<FieldReference> * const refs,
+				 std::string * const err_msg)
+{
+    std::vector<std::string> pieces;
+    StringUtil::Split(field_references, ':', &pieces);
+    for (const auto &piece : pieces) {
+	if (piece.length() < DirectoryEntry::TAG_LENGTH) {
+	    *err_msg = "bad field reference \"" + piece + "\"!";
+	    return false;
+	}
+
+	FieldReference ref;
+	ref.marc_tag_          = MarcTag(piece.data());
+	ref.tag_               = piece.substr(0, DirectoryEntry::TAG_LENGTH);
+	ref.subfield_codes_    = piece.substr(DirectoryEntry::TAG_LENGTH);
+	ref.subfield_code_set_ = SubfieldCodeSet(ref.subfield_codes_);
+	refs->push_back(ref);
+    }
+
+    return true;
+}
+
+
+namespace {
+
+
+/** The postings list of a single term during index construction. */
+struct Postings {
+    uint32_t record_count_;
+    uint32_t last_record_ordinal_;
+    std::string encoded_ordinals_;
+};
+
+
+} // unnamed namespace
+
+
+static void AddPosting(const std::string &term, const uint32_t record_ordinal,
+		       std::unordered_map<std::string, Postings> * const term_to_postings_map)
+{
+    const auto term_and_postings(term_to_postings_map->find(term));
+    if (term_and_postings == term_to_postings_map->end()) {
+	Postings postings;
+	postings.record_count_ = 1;
+	postings.last_record_ordinal_ = record_ordinal;
+	AppendVarInt(record_ordinal, &postings.encoded_ordinals_);
+	term_to_postings_map->insert(std::make_pair(term, postings));
+    } else {
+	Postings &postings(term_and_postings->second);
+	if (postings.last_record_ordinal_ == record_ordinal) // Repeated value in the same record.
+	    return;
+	++postings.record_count_;
+	AppendVarInt(record_ordinal - postings.last_record_ordinal_, &postings.encoded_ordinals_);
+	postings.last_record_ordinal_ = record_ordinal;
+    }
+}
+
+
+bool TermIndex::Build(const std::string &marc_filename, const std::string &field_references,
+		      const std::string &index_filename, std::string * const err_msg)
+{
+    std::vector<FieldReference> refs;
+    if (not ParseFieldReferences(field_references, &refs, err_msg))
+	return false;
+
+    struct stat stat_buf;
+    if (not GetFileStatus(marc_filename, &stat_buf, err_msg))
+	return false;
+
+    MarcFileReader * const raw_reader(MarcFileReader::MarcFileReaderFactory(marc_filename, err_msg));
+    if (raw_reader == NULL)
+	return false;
+    const std::unique_ptr<MarcFileReader> reader(raw_reader);
+
+    std::vector<RecordLocation> record_locations;
+    std::unordered_map<std::string, Postings> term_to_postings_map;
+    std::string term;
+    RecordView record;
+    uint64_t record_offset(reader->tell());
+    while (reader->getNextRecord(&record, err_msg)) {
+	const uint32_t record_ordinal(record_locations.size());
+	const RecordLocation location = { record_offset, record.getRecordLength(), 0 };
+	record_locations.push_back(location);
+	record_offset = reader->tell();
+
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    const MarcTag tag(record.getTag(field_index));
+	    for (const auto &ref : refs) {
+		if (tag != ref.marc_tag_)
+		    continue;
+
+		if (ref.subfield_codes_.empty()) {
+		    term = ref.tag_ + TERM_SEPARATOR;
+		    term.append(record.getField(field_index).data(), record.getField(field_index).size());
+		    AddPosting(term, record_ordinal, &term_to_postings_map);
+		    continue;
+		}
+
+		const SubfieldView subfields(record.getField(field_index));
+		for (const auto &code_and_value : subfields) {
+		    if (not ref.subfield_code_set_.contains(code_and_value.first))
+			continue;
+		    term = ref.tag_ + code_and_value.first + TERM_SEPARATOR;
+		    term.append(code_and_value.second.data(), code_and_value.second.size());
+		    AddPosting(term, record_ordinal, &term_to_postings_map);
+		}
+	    }
+	}
+    }
+    if (not err_msg->empty())
+	return false;
+
+    //
+    // Lay out the sorted term dictionary, the term pool and the postings:
+    //
+
+    std::vector<std::unordered_map<std::string, Postings>::const_iterator> sorted_terms;
+    sorted_terms.reserve(term_to_postings_map.size());
+    for (auto term_and_postings(term_to_postings_map.cbegin()); term_and_postings != term_to_postings_map.cend();
+	 ++term_and_postings)
+	sorted_terms.push_back(term_and_postings);
+    std::sort(sorted_terms.begin(), sorted_terms.end(),
+	      [](const std::unordered_map<std::string, Postings>::const_iterator &lhs,
+		 const std::unordered_map<std::string, Postings>::const_iterator &rhs)
+	      { return lhs->first < rhs->first; });
+
+    std::vector<Term> terms;
+    terms.reserve(sorted_terms.size());
+    uint64_t term_pool_size(0), postings_size(0);
+    for (const auto &term_and_postings : sorted_terms) {
+	const Term term_entry = { postings_size,
+				  static_cast<uint32_t>(term_and_postings->second.encoded_ordinals_.size()),
+				  term_and_postings->second.record_count_, static_cast<uint32_t>(term_pool_size),
+				  static_cast<uint32_t>(term_and_postings->first.size()) };
+	terms.push_back(term_entry);
+	term_pool_size += term_and_postings->first.size();
+	postings_size  += term_and_postings->second.encoded_ordinals_.size();
+    }
+
+    if (term_pool_size > UINT32_MAX) {
+	*err_msg = "too many distinct terms for a term index!";
+	return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic_, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    header.source_size_              = stat_buf.st_size;
+    header.source_mtime_seconds_     = stat_buf.st_mtim.tv_sec;
+    header.source_mtime_nanoseconds_ = stat_buf.st_mtim.tv_nsec;
+    header.record_count_             = record_locations.size();
+    header.term_count_               = terms.size();
+    header.term_pool_offset_         = sizeof(Header) + record_locations.size() * sizeof(RecordLocation)
+				       + terms.size() * sizeof(Term);
+    header.postings_offset_          = header.term_pool_offset_ + term_pool_size;
+
+    // Write to a temporary file first so that readers never see a partially written index.
+    const std::string temp_filename(index_filename + ".tmp");
+    FILE * const output(std::fopen(temp_filename.c_str(), "wb"));
+    if (output == NULL) {
+	*err_msg = "can't open \"" + temp_filename + "\" for writing! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    bool write_ok(std::fwrite(&header, sizeof header, 1, output) == 1);
+    if (write_ok and not record_locations.empty())
+	write_ok = std::fwrite(record_locations.data(), sizeof(RecordLocation), record_locations.size(), output)
+		   == record_locations.size();
+    if (write_ok and not terms.empty())
+	write_ok = std::fwrite(terms.data(), sizeof(Term), terms.size(), output) == terms.size();
+    for (auto term_and_postings(sorted_terms.cbegin()); write_ok and term_and_postings != sorted_terms.cend();
+	 ++term_and_postings)
+    {
+	// N.B. Values may contain NUL bytes, so the terms must not be written as C strings.
+	const std::string &term_text((*term_and_postings)->first);
+	write_ok = std::fwrite(term_text.data(), 1, term_text.size(), output) == term_text.size();
+    }
+    for (auto term_and_postings(sorted_terms.cbegin()); write_ok and term_and_postings != sorted_terms.cend();
+	 ++term_and_postings)
+    {
+	const std::string &encoded_ordinals((*term_and_postings)->second.encoded_ordinals_);
+	write_ok = std::fwrite(encoded_ordinals.data(), 1, encoded_ordinals.size(), output)
+		   == encoded_ordinals.size();
+    }
+    if (std::fclose(output) != 0)
+	write_ok = false;
+
+    if (not write_ok or std::rename(temp_filename.c_str(), index_filename.c_str()) != 0) {
+	*err_msg = "failed to write \"" + index_filename + "\"! (" + std::strerror(errno) + ")";
+	std::remove(temp_filename.c_str());
+	return false;
+    }
+
+    return true;
+}
+
+
+void TermIndex::appendPostings(const Term &term, std::vector<uint32_t> * const record_ordinals) const {
+    // The postings lists have not been checked when the index was opened, so a corrupt one ends the list early.
+    const unsigned char *cp(postings_ + term.postings_offset_);
+    const unsigned char * const end(cp + term.postings_size_);
+    uint32_t record_ordinal(0), delta;
+    for (uint32_t posting_no(0); posting_no < term.record_count_ and DecodeVarInt(&cp, end, &delta); ++posting_no) {
+	record_ordinal += delta;
+	if (record_ordinal >= header_->record_count_)
+	    return;
+	record_ordinals->push_back(record_ordinal);
+    }
+}
+
+
+void TermIndex::lookup(const std::string &field_reference, const std::string &value, const bool prefix_match,
+		       std::vector<uint32_t> * const record_ordinals) const
+{
+    record_ordinals->clear();
+
+    // A reference w/ several subfield codes is the union of the single-code references.
+    std::vector<std::string> term_prefixes;
+    if (field_reference.length() <= DirectoryEntry::TAG_LENGTH + 1)
+	term_prefixes.push_back(field_reference + TERM_SEPARATOR);
+    else {
+	for (const char subfield_code : field_reference.substr(DirectoryEntry::TAG_LENGTH))
+	    term_prefixes.push_back(field_reference.substr(0, DirectoryEntry::TAG_LENGTH) + subfield_code
+				    + TERM_SEPARATOR);
+    }
+
+    const Term * const terms_end(terms_ + header_->term_count_);
+    for (const auto &term_prefix : term_prefixes) {
+	const std::string wanted_term(term_prefix + value);
+	const Slice wanted(wanted_term);
+	const Term *term(std::lower_bound(terms_, terms_end, wanted,
+					  [this](const Term &lhs, const Slice &rhs) { return getTerm(lhs) < rhs; }));
+	if (not prefix_match) {
+	    if (term != terms_end and getTerm(*term) == wanted)
+		appendPostings(*term, record_ordinals);
+	} else {
+	    for (/* Intentionally empty! */; term != terms_end and getTerm(*term).startsWith(wanted); ++term)
+		appendPostings(*term, record_ordinals);
+	}
+    }
+
+    std::sort(record_ordinals->begin(), record_ordinals->end());
+    record_ordinals->erase(std::unique(record_ordinals->begin(), record_ordinals->end()), record_ordinals->end());
+}
@@ -0,0 +1,116 @@
+/** \file   TermIndex.h
+ *  \brief  Interface for the TermIndex class.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TERM_INDEX_H
+#define TERM_INDEX_H
+
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MemoryMappedFile.h"
+#include "Slice.h"
+
+
+/** \class TermIndex
+ *  \brief An on-disk inverted index over the values of selected fields and subfields of a MARC-21 file.
+ *
+ *  Field references have the same form as in marc_grep, e.g. "650a" for subfield a of field 650 or "001" for the
+ *  entire contents of field 001.  A term is a field reference combined w/ a field or subfield value.  For each term
+ *  the index stores a postings list of the ordinals of the records that contain the term.  The postings lists are
+ *  delta encoded and compressed w/ variable-length integers.  An offset table maps record ordinals to the
+ *  locations of the records in the MARC file.
+ *
+ *  The index file consists of a header, the offset table, the term dictionary sorted by term, the pool of the term
+ *  strings and the postings lists.  All integers are stored in host byte order.
+ */
+class TermIndex {
+public:
+    struct Header {
+	char magic_[8];
+	uint64_t source_size_;
+	int64_t source_mtime_seconds_;
+	int64_t source_mtime_nanoseconds_;
+	uint64_t record_count_;
+	uint64_t term_count_;
+	uint64_t term_pool_offset_;     // Relative to the start of the index file.
+	uint64_t postings_offset_;      // Relative to the start of the index file.
+    };
+
+    struct RecordLocation {
+	uint64_t record_offset_;
+	uint32_t record_length_;
+	uint32_t reserved_;
+    };
+
+    struct Term {
+	uint64_t postings_offset_;      // Relative to the start of the postings.
+	uint32_t postings_size_;        // In bytes.
+	uint32_t record_count_;
+	uint32_t term_offset_;          // Relative to the start of the term pool.
+	uint32_t term_length_;
+    };
+private:
+    std::unique_ptr<MemoryMappedFile> index_file_;
+    const Header *header_;
+    const RecordLocation *record_locations_;
+    const Term *terms_;
+    const char *term_pool_;
+    const unsigned char *postings_;
+public:
+    /** \brief Opens the index "index_filename" for the MARC file "marc_filename".
+     *  \return NULL if the index could not be opened, is corrupt or is stale w.r.t. "marc_filename".  In that case
+     *          "err_msg" will be set.
+     */
+    static TermIndex *TermIndexFactory(const std::string &index_filename, const std::string &marc_filename,
+				       std::string * const err_msg);
+
+    /** \brief Scans "marc_filename" once and writes an index of the values referenced by "field_references" to
+     *         "index_filename".
+     *  \param field_references  A colon-separated list of field references like "650a:100a:020a".
+     *  \return True on success, else false and then "err_msg" will be set.
+     */
+    static bool Build(const std::string &marc_filename, const std::string &field_references,
+		      const std::string &index_filename, std::string * const err_msg);
+
+    /** \return The name that tools use for the term index of "marc_filename" unless told otherwise. */
+    static std::string DefaultIndexFilename(const std::string &marc_filename) { return marc_filename + ".terms"; }
+
+    size_t getRecordCount() const { return header_->record_count_; }
+    size_t getTermCount() const { return header_->term_count_; }
+
+    /** \brief Finds the records that contain "value", or a value starting w/ "value" if "prefix_match" is true, in
+     *         a field or subfield referenced by "field_reference".
+     *  \param field_reference  E.g. "650a".  Several subfield codes, e.g. "650ax", select the union of the matches.
+     *  \param record_ordinals  The sorted and unique ordinals of the matching records.
+     */
+    void lookup(const std::string &field_reference, const std::string &value, const bool prefix_match,
+		std::vector<uint32_t> * const record_ordinals) const;
+
+    const RecordLocation &getRecordLocation(const uint32_t record_ordinal) const
+	{ return record_locations_[record_ordinal]; }
+private:
+    explicit TermIndex(MemoryMappedFile * const index_file);
+    Slice getTerm(const Term &term) const { return Slice(term_pool_ + term.term_offset_, term.term_length_); }
+    void appendPostings(const Term &term, std::vector<uint32_t> * const record_ordinals) const;
+};
+
+
+#endif // ifndef TERM_INDEX_H
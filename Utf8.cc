@@ -0,0 +1,134 @@
+/** \file   Utf8.cc
+ *  \brief  Implementation of the UTF-8 validation.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Utf8.h"
+#include <cstdint>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+
+namespace Utf8 {
+
+
+namespace {
+
+
+// The byte classes:
+//  0: 00-7F ASCII                      6: E0 3-byte lead, 2nd byte A0-BF
+//  1: 80-8F continuation               7: E1-EC and EE-EF 3-byte lead
+//  2: 90-9F continuation               8: ED 3-byte lead, 2nd byte 80-9F (no surrogates)
+//  3: A0-BF continuation               9: F0 4-byte lead, 2nd byte 90-BF
+//  4: C0-C1 and F5-FF never valid     10: F1-F3 4-byte lead
+//  5: C2-DF 2-byte lead               11: F4 4-byte lead, 2nd byte 80-8F (nothing beyond U+10FFFF)
+const uint8_t BYTE_CLASSES[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // 0x90
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, // 0xA0
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, // 0xB0
+    4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, // 0xC0
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, // 0xD0
+    6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 7, // 0xE0
+    9, 10, 10, 10, 11, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, // 0xF0
+};
+const unsigned CLASS_COUNT(12);
+
+
+// The DFA states are premultiplied by CLASS_COUNT so that they can be used as row offsets into TRANSITIONS.
+enum State {
+    ACCEPT      = 0 * CLASS_COUNT, // At a character boundary.
+    REJECT      = 1 * CLASS_COUNT,
+    NEED_1      = 2 * CLASS_COUNT, // 1 more continuation byte.
+    NEED_2      = 3 * CLASS_COUNT, // 2 more continuation bytes.
+    AFTER_E0    = 4 * CLASS_COUNT,
+    AFTER_ED    = 5 * CLASS_COUNT,
+    AFTER_F0    = 6 * CLASS_COUNT,
+    NEED_3      = 7 * CLASS_COUNT, // 3 more continuation bytes.
+    AFTER_F4    = 8 * CLASS_COUNT,
+};
+
+
+const uint8_t TRANSITIONS[9 * CLASS_COUNT] = {
+    // 0       1       2       3       4       5       6         7       8         9         10      11
+    ACCEPT, REJECT, REJECT, REJECT, REJECT, NEED_1, AFTER_E0, NEED_2, AFTER_ED, AFTER_F0, NEED_3, AFTER_F4, // ACCEPT
+    REJECT, REJECT, REJECT, REJECT, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // REJECT
+    REJECT, ACCEPT, ACCEPT, ACCEPT, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // NEED_1
+    REJECT, NEED_1, NEED_1, NEED_1, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // NEED_2
+    REJECT, REJECT, REJECT, NEED_1, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // AFTER_E0
+    REJECT, NEED_1, NEED_1, REJECT, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // AFTER_ED
+    REJECT, REJECT, NEED_2, NEED_2, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // AFTER_F0
+    REJECT, NEED_2, NEED_2, NEED_2, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // NEED_3
+    REJECT, NEED_2, REJECT, REJECT, REJECT, REJECT, REJECT,   REJECT, REJECT,   REJECT,   REJECT, REJECT,   // AFTER_F4
+};
+
+
+} // unnamed namespace
+
+
+size_t FindInvalidSequence(const char * const data, const size_t size) {
+    const unsigned char * const bytes(reinterpret_cast<const unsigned char *>(data));
+    size_t offset(0);
+    while (offset < size) {
+#ifdef __SSE2__
+	while (offset + sizeof(__m128i) <= size) {
+	    const unsigned non_ascii_mask(
+		_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + offset))));
+	    if (non_ascii_mask != 0) {
+		offset += __builtin_ctz(non_ascii_mask);
+		break;
+	    }
+	    offset += sizeof(__m128i);
+	}
+	if (offset == size)
+	    break;
+#endif
+	if (bytes[offset] < 0x80) {
+	    ++offset;
+	    continue;
+	}
+
+	// Run the DFA until we are at a character boundary that is followed by ASCII again.
+	unsigned state(ACCEPT);
+	size_t sequence_start(offset);
+	do {
+	    if (state == ACCEPT)
+		sequence_start = offset;
+	    state = TRANSITIONS[state + BYTE_CLASSES[bytes[offset]]];
+	    if (state == REJECT)
+		return sequence_start;
+	    ++offset;
+	} while (offset < size and (state != ACCEPT or bytes[offset] >= 0x80));
+
+	if (state != ACCEPT) // Truncated at the end of the data.
+	    return sequence_start;
+    }
+
+    return size;
+}
+
+
+} // namespace Utf8
@@ -0,0 +1,47 @@
+/** \file   Utf8.h
+ *  \brief  Validation of UTF-8 encoded data.
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UTF8_H
+#define UTF8_H
+
+
+#include <cstddef>
+
+
+/** \namespace Utf8
+ *  \brief Checks data for well-formed UTF-8 according to RFC 3629.
+ *
+ *  Overlong encodings, surrogates, code points beyond U+10FFFF and truncated sequences are all rejected.  ASCII,
+ *  which makes up most of the bytes of typical MARC-21 records, is skipped 16 bytes at a time w/ SSE2 and only the
+ *  multibyte sequences are run through a table-driven DFA.
+ */
+namespace Utf8 {
+
+
+/** \return The offset of the first byte of the first ill-formed sequence in "data" or "size" if there is none. */
+size_t FindInvalidSequence(const char * const data, const size_t size);
+
+
+inline bool IsValid(const char * const data, const size_t size) { return FindInvalidSequence(data, size) == size; }
+
+
+} // namespace Utf8
+
+
+#endif // ifndef UTF8_H
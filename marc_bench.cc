@@ -0,0 +1,634 @@
+/** \file marc_bench.cc
+ *  \brief marc_bench runs microbenchmarks of the MARC-21 parsing and composition code and reports them as JSON.
+ *
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Arena.h"
+#include "DirectoryEntry.h"
+#include "Extractor.h"
+#include "Leader.h"
+#include "Marc8.h"
+#include "MarcFileReader.h"
+#include "MarcJson.h"
+#include "MarcReader.h"
+#include "MarcRecord.h"
+#include "MarcTag.h"
+#include "MarcUtil.h"
+#include "MarcXmlWriter.h"
+#include "RecordPipeline.h"
+#include "RecordView.h"
+#include "Slice.h"
+#include "SubfieldView.h"
+#include "Subfields.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << progname << " [-t min_seconds] [-g marc_grep_path] [-c label] marc_filename\n";
+    std::cerr << "\tRuns each benchmark on all records of \"marc_filename\" repeatedly for at least \"min_seconds\"\n";
+    std::cerr << "\t(default 1) and writes the fastest run of each as JSON to stdout.  If \"marc_grep_path\" is\n";
+    std::cerr << "\tgiven, the end-to-end throughput of a few marc_grep queries is measured too.  \"label\", e.g. a\n";
+    std::cerr << "\tcommit hash, is copied to the output to make it easier to compare results.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+// Benchmarks add their results here so that the compiler can't optimise the benchmarked code away.
+volatile size_t sink;
+
+
+struct BenchmarkResult {
+    std::string name_;
+    unsigned iterations_;
+    double best_seconds_;
+    size_t records_;
+    size_t bytes_;
+};
+
+
+/** Calls "benchmark" at least 3 times and until "min_seconds" have elapsed and records the fastest call.
+ *  \param records  How many records are processed per call.
+ *  \param bytes    How many bytes are processed per call.
+ */
+template<typename Benchmark> BenchmarkResult RunBenchmark(const std::string &name, const size_t records,
+							  const size_t bytes, const double min_seconds,
+							  Benchmark benchmark)
+{
+    BenchmarkResult result = { name, 0, 0.0, records, bytes };
+    double total_seconds(0.0);
+    while (result.iterations_ < 3 or total_seconds < min_seconds) {
+	const auto start(std::chrono::steady_clock::now());
+	sink += benchmark();
+	const double seconds(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+	if (result.iterations_ == 0 or seconds < result.best_seconds_)
+	    result.best_seconds_ = seconds;
+	total_seconds += seconds;
+	++result.iterations_;
+    }
+    std::cerr << name << ": " << result.iterations_ << " iterations\n";
+
+    return result;
+}
+
+
+struct Corpus {
+    std::string filename_;
+    size_t size_;
+    std::vector<RecordView> records_;
+    size_t leader_bytes_, directory_bytes_, data_field_bytes_;
+};
+
+
+void LoadCorpus(const MarcFileReader &reader, Corpus * const corpus) {
+    corpus->filename_ = reader.getFilename();
+    corpus->size_ = reader.getSize();
+    corpus->leader_bytes_ = corpus->directory_bytes_ = corpus->data_field_bytes_ = 0;
+
+    std::string err_msg;
+    RecordView record;
+    size_t offset(0);
+    while (offset < reader.getSize()) {
+	if (not RecordView::ParseRecord(reader.getData() + offset, reader.getSize() - offset, &record, &err_msg))
+	    Error(err_msg + " (Record starting at file offset " + std::to_string(offset) + ".)");
+	corpus->records_.push_back(record);
+	offset += record.getRecordLength();
+
+	corpus->leader_bytes_ += Leader::LEADER_LENGTH;
+	corpus->directory_bytes_ += record.getDirectory().size() + 1;
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    if (not record.getTag(field_index).isControlFieldTag())
+		corpus->data_field_bytes_ += record.getField(field_index).size();
+	}
+    }
+
+    if (corpus->records_.empty())
+	Error("\"" + corpus->filename_ + "\" contains no records!");
+}
+
+
+size_t BenchmarkReadNextRecord(const std::string &filename) {
+    FILE * const input(std::fopen(filename.c_str(), "rb"));
+    if (input == NULL)
+	Error("can't open \"" + filename + "\" for reading!");
+
+    Leader leader;
+    std::vector<DirectoryEntry> dir_entries;
+    std::vector<std::string> fields;
+    std::string err_msg;
+    size_t field_count(0);
+    while (MarcUtil::ReadNextRecord(input, &leader, &dir_entries, &fields, &err_msg))
+	field_count += fields.size();
+    if (not err_msg.empty())
+	Error(err_msg);
+
+    std::fclose(input);
+    return field_count;
+}
+
+
+/** Reads only the leaders and directories and then only the 856 fields, skipping the bodies of all other records. */
+size_t BenchmarkDirectoryFirstReading(const std::string &filename) {
+    FILE * const input(std::fopen(filename.c_str(), "rb"));
+    if (input == NULL)
+	Error("can't open \"" + filename + "\" for reading!");
+
+    const MarcTag SELECTED_TAG("856");
+    Leader leader;
+    std::vector<DirectoryEntry> dir_entries;
+    std::vector<size_t> field_indices;
+    std::vector<std::string> fields;
+    std::string err_msg;
+    size_t field_count(0);
+    while (MarcUtil::ReadRecordHeader(input, &leader, &dir_entries, &err_msg)) {
+	field_indices.clear();
+	for (size_t field_index(0); field_index < dir_entries.size(); ++field_index) {
+	    if (dir_entries[field_index].getTag() == SELECTED_TAG)
+		field_indices.push_back(field_index);
+	}
+
+	if (field_indices.empty()) {
+	    if (not MarcUtil::SkipRecordBody(input, leader, &err_msg))
+		break;
+	} else {
+	    if (not MarcUtil::ReadSelectedFields(input, leader, dir_entries, field_indices, &fields, &err_msg))
+		break;
+	    field_count += fields.size();
+	}
+    }
+    if (not err_msg.empty())
+	Error(err_msg);
+
+    std::fclose(input);
+    return field_count;
+}
+
+
+size_t BenchmarkRawRecordReading(const std::string &filename, const MarcReader::Backend backend) {
+    std::string err_msg;
+    MarcReader * const raw_reader(MarcReader::MarcReaderFactory(filename, &err_msg, backend));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcReader> reader(raw_reader);
+
+    Slice raw_record;
+    size_t record_count(0);
+    while (reader->getNextRawRecord(&raw_record, &err_msg))
+	++record_count;
+    if (not err_msg.empty())
+	Error(err_msg);
+
+    return record_count;
+}
+
+
+/** Scans the subfields of all records on PIPELINE_WORKER_COUNT worker threads of a RecordPipeline. */
+size_t BenchmarkRecordPipeline(const std::string &filename, const MarcReader::Backend backend) {
+    static const unsigned PIPELINE_WORKER_COUNT(4);
+
+    std::string err_msg;
+    MarcReader * const raw_reader(MarcReader::MarcReaderFactory(filename, &err_msg, backend));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcReader> reader(raw_reader);
+
+    RecordPipeline pipeline(reader.get(), PIPELINE_WORKER_COUNT);
+    pipeline.setTransform([](const RecordView &record, std::string * const /* outputs */,
+			     std::string * const /* err_msg */)
+    {
+	size_t subfield_count(0);
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    if (record.getTag(field_index).isControlFieldTag())
+		continue;
+	    const SubfieldView subfields(record.getField(field_index));
+	    for (auto code_and_value(subfields.begin()); code_and_value != subfields.end(); ++code_and_value)
+		++subfield_count;
+	}
+	return subfield_count > 0;
+    });
+    if (not pipeline.run(&err_msg))
+	Error(err_msg);
+
+    return pipeline.getMatchedCount();
+}
+
+
+size_t BenchmarkLeaderParsing(const Corpus &corpus) {
+    size_t record_length_sum(0);
+    Leader leader;
+    std::string err_msg;
+    for (const auto &record : corpus.records_) {
+	if (not Leader::ParseLeader(record.getLeader().data(), &leader, &err_msg))
+	    Error(err_msg);
+	record_length_sum += leader.getRecordLength();
+    }
+
+    return record_length_sum;
+}
+
+
+size_t BenchmarkDirectoryParsing(const Corpus &corpus) {
+    size_t field_count(0);
+    std::vector<DirectoryEntry> dir_entries;
+    std::string err_msg;
+    for (const auto &record : corpus.records_) {
+	const Slice directory(record.getDirectory());
+	if (not DirectoryEntry::ParseDirEntries(directory.data(), directory.size() + 1, &dir_entries, &err_msg))
+	    Error(err_msg);
+	field_count += dir_entries.size();
+    }
+
+    return field_count;
+}
+
+
+size_t BenchmarkSubfieldsParsing(const Corpus &corpus) {
+    size_t subfield_count(0);
+    std::string field_contents;
+    for (const auto &record : corpus.records_) {
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    if (record.getTag(field_index).isControlFieldTag())
+		continue;
+	    const Slice field(record.getField(field_index));
+	    field_contents.assign(field.data(), field.size());
+	    const Subfields subfields(field_contents);
+	    for (auto code_and_value(subfields.begin()); code_and_value != subfields.end(); ++code_and_value)
+		++subfield_count;
+	}
+    }
+
+    return subfield_count;
+}
+
+
+size_t BenchmarkSubfieldViewScanning(const Corpus &corpus) {
+    size_t subfield_count(0);
+    for (const auto &record : corpus.records_) {
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    if (record.getTag(field_index).isControlFieldTag())
+		continue;
+	    const SubfieldView subfields(record.getField(field_index));
+	    for (auto code_and_value(subfields.begin()); code_and_value != subfields.end(); ++code_and_value)
+		++subfield_count;
+	}
+    }
+
+    return subfield_count;
+}
+
+
+/** A field reference like "245ab" that gets interpreted at runtime. */
+struct FieldReference {
+    MarcTag tag_;
+    std::string subfield_codes_; // Empty for the entire field.
+};
+
+
+// The same extractions as in BenchmarkCompiledFieldExtraction().
+const std::vector<FieldReference> FIELD_REFERENCES = {
+    { "001"_tag, "" }, { "100"_tag, "a" }, { "245"_tag, "ab" }, { "650"_tag, "axz" }, { "700"_tag, "a4" },
+};
+
+
+/** Extracts FIELD_REFERENCES like marc_grep does, i.e. one subfield code after the other. */
+size_t BenchmarkRuntimeFieldExtraction(const Corpus &corpus) {
+    size_t value_bytes(0);
+    for (const auto &record : corpus.records_) {
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index) {
+	    const MarcTag tag(record.getTag(field_index));
+	    for (const auto &field_reference : FIELD_REFERENCES) {
+		if (tag != field_reference.tag_)
+		    continue;
+		if (field_reference.subfield_codes_.empty()) {
+		    value_bytes += record.getField(field_index).size();
+		    continue;
+		}
+		const SubfieldView subfields(record.getField(field_index));
+		for (const char subfield_code : field_reference.subfield_codes_) {
+		    const auto begin_end(subfields.getIterators(subfield_code));
+		    for (auto code_and_value(begin_end.first); code_and_value != begin_end.second; ++code_and_value)
+			value_bytes += code_and_value->second.size();
+		}
+	    }
+	}
+    }
+
+    return value_bytes;
+}
+
+
+size_t BenchmarkCompiledFieldExtraction(const Corpus &corpus) {
+    typedef ExtractorSet<Extractor<Tag<'0','0','1'>>, Extractor<Tag<'1','0','0'>, Codes<'a'>>,
+			 Extractor<Tag<'2','4','5'>, Codes<'a','b'>>, Extractor<Tag<'6','5','0'>, Codes<'a','x','z'>>,
+			 Extractor<Tag<'7','0','0'>, Codes<'a','4'>>> Extractors;
+
+    size_t value_bytes(0);
+    for (const auto &record : corpus.records_)
+	Extractors::Extract(record, [&value_bytes](const unsigned /* extractor_no */, const char /* subfield_code */,
+						   const Slice &value) { value_bytes += value.size(); });
+
+    return value_bytes;
+}
+
+
+/** The input of MarcUtil::ComposeRecord(). */
+struct ParsedRecord {
+    Leader leader_;
+    std::vector<DirectoryEntry> dir_entries_;
+    std::vector<std::string> fields_;
+};
+
+
+void ParseCorpus(const Corpus &corpus, std::vector<ParsedRecord> * const parsed_records) {
+    parsed_records->resize(corpus.records_.size());
+    std::string err_msg;
+    for (size_t record_index(0); record_index < corpus.records_.size(); ++record_index) {
+	const RecordView &record(corpus.records_[record_index]);
+	ParsedRecord &parsed_record((*parsed_records)[record_index]);
+	if (not Leader::ParseLeader(record.getLeader().data(), &parsed_record.leader_, &err_msg))
+	    Error(err_msg);
+	const Slice directory(record.getDirectory());
+	if (not DirectoryEntry::ParseDirEntries(directory.data(), directory.size() + 1, &parsed_record.dir_entries_,
+						&err_msg))
+	    Error(err_msg);
+	for (size_t field_index(0); field_index < record.getNumberOfFields(); ++field_index)
+	    parsed_record.fields_.push_back(record.getField(field_index).toString());
+    }
+}
+
+
+size_t BenchmarkRecordComposition(std::vector<ParsedRecord> * const parsed_records) {
+    size_t record_length_sum(0);
+    for (auto &parsed_record : *parsed_records)
+	record_length_sum += MarcUtil::ComposeRecord(parsed_record.dir_entries_, parsed_record.fields_,
+						     &parsed_record.leader_).size();
+
+    return record_length_sum;
+}
+
+
+/** Converts all records to UTF-8 and composes the results.  The corpus does not have to be MARC-8 encoded since
+ *  all non-ASCII bytes take the same path through the converter.
+ */
+size_t BenchmarkMarc8Conversion(const Corpus &corpus) {
+    Arena arena;
+    MarcRecord converted(&arena);
+    std::string converted_record;
+    size_t record_length_sum(0);
+    for (const auto &record : corpus.records_) {
+	Marc8::ConvertRecord(record, &converted);
+	converted_record.resize(converted.getRecordLength());
+	converted.toBuffer(&converted_record[0]);
+	record_length_sum += converted_record.size();
+	arena.reset();
+    }
+
+    return record_length_sum;
+}
+
+
+/** Checks all fields of all records for well-formed UTF-8, regardless of leader/09. */
+size_t BenchmarkUtf8Validation(const Corpus &corpus) {
+    size_t valid_record_count(0);
+    for (const auto &record : corpus.records_) {
+	if (record.validateUtf8())
+	    ++valid_record_count;
+    }
+
+    return valid_record_count;
+}
+
+
+/** Serialises all records as JSON into an output buffer that gets reused once it has grown beyond 1 MiB. */
+size_t BenchmarkJsonSerialization(const Corpus &corpus, const MarcJson::Format format) {
+    std::string json;
+    size_t json_size(0);
+    for (const auto &record : corpus.records_) {
+	MarcJson::AppendRecord(record, format, &json);
+	if (json.size() >= 1024 * 1024) {
+	    json_size += json.size();
+	    json.clear();
+	}
+    }
+
+    return json_size + json.size();
+}
+
+
+/** Writes all records as MARCXML to /dev/null, so that the write(2) calls cost next to nothing. */
+size_t BenchmarkXmlSerialization(const Corpus &corpus) {
+    std::string err_msg;
+    const std::unique_ptr<MarcXmlWriter> writer(MarcXmlWriter::MarcXmlWriterFactory("/dev/null", &err_msg));
+    if (writer.get() == NULL)
+	Error(err_msg);
+    size_t written_count(0);
+    for (const auto &record : corpus.records_) {
+	if (writer->write(record, &err_msg) == MarcXmlWriter::WRITTEN)
+	    ++written_count;
+    }
+    if (not writer->close(&err_msg))
+	Error(err_msg);
+
+    return written_count;
+}
+
+
+/** \brief Runs "marc_grep_path" on the corpus w/ its standard output and error redirected to /dev/null.
+ *  \param arguments  The options, if any, followed by the field reference.
+ */
+size_t RunMarcGrep(const std::string &marc_grep_path, const std::vector<std::string> &arguments,
+		   const std::string &marc_filename)
+{
+    std::vector<char *> argv;
+    argv.push_back(const_cast<char *>(marc_grep_path.c_str()));
+    for (auto argument(arguments.cbegin()); argument != arguments.cend() - 1; ++argument)
+	argv.push_back(const_cast<char *>(argument->c_str()));
+    argv.push_back(const_cast<char *>(marc_filename.c_str()));
+    argv.push_back(const_cast<char *>(arguments.back().c_str()));
+    argv.push_back(NULL);
+
+    const pid_t pid(::fork());
+    if (pid == -1)
+	Error("fork(2) failed! (" + std::string(std::strerror(errno)) + ")");
+    if (pid == 0) {
+	const int dev_null(::open("/dev/null", O_WRONLY));
+	if (dev_null == -1 or ::dup2(dev_null, STDOUT_FILENO) == -1 or ::dup2(dev_null, STDERR_FILENO) == -1)
+	    ::_exit(EXIT_FAILURE);
+	::execv(marc_grep_path.c_str(), argv.data());
+	::_exit(EXIT_FAILURE);
+    }
+
+    int status;
+    while (::waitpid(pid, &status, 0) == -1) {
+	if (errno != EINTR)
+	    Error("waitpid(2) failed! (" + std::string(std::strerror(errno)) + ")");
+    }
+    if (not WIFEXITED(status) or WEXITSTATUS(status) != EXIT_SUCCESS)
+	Error("\"" + marc_grep_path + "\" failed!");
+
+    return 1;
+}
+
+
+std::string JsonString(const std::string &s) {
+    std::string json("\"");
+    for (const char ch : s) {
+	if (ch == '"' or ch == '\\') {
+	    json += '\\';
+	    json += ch;
+	} else if (static_cast<unsigned char>(ch) < 0x20) {
+	    char escape[7];
+	    std::snprintf(escape, sizeof escape, "\\u%04x", static_cast<unsigned>(ch));
+	    json += escape;
+	} else
+	    json += ch;
+    }
+
+    return json + "\"";
+}
+
+
+void WriteResults(const std::string &label, const Corpus &corpus, const std::vector<BenchmarkResult> &results) {
+    std::cout << "{\n";
+    std::cout << "  \"label\": " << JsonString(label) << ",\n";
+    std::cout << "  \"corpus\": { \"filename\": " << JsonString(corpus.filename_) << ", \"records\": "
+	      << corpus.records_.size() << ", \"bytes\": " << corpus.size_ << " },\n";
+    std::cout << "  \"benchmarks\": [\n";
+    for (auto result(results.cbegin()); result != results.cend(); ++result) {
+	char numbers[256];
+	std::snprintf(numbers, sizeof numbers,
+		      "\"iterations\": %u, \"best_seconds\": %.6f, \"records_per_second\": %.1f, \"mb_per_second\": %.2f",
+		      result->iterations_, result->best_seconds_, result->records_ / result->best_seconds_,
+		      result->bytes_ / result->best_seconds_ / (1024.0 * 1024.0));
+	std::cout << "    { \"name\": " << JsonString(result->name_) << ", " << numbers << " }"
+		  << (result + 1 == results.cend() ? "\n" : ",\n");
+    }
+    std::cout << "  ]\n";
+    std::cout << "}\n";
+}
+
+
+int main(int argc, char **argv) {
+    progname = argv[0];
+
+    double min_seconds(1.0);
+    std::string marc_grep_path, label;
+    int option;
+    while ((option = ::getopt(argc, argv, "t:g:c:")) != -1) {
+	if (option == 't') {
+	    char *end;
+	    min_seconds = std::strtod(optarg, &end);
+	    if (*end != '\0' or min_seconds < 0.0)
+		Error("bad minimum time \"" + std::string(optarg) + "\"!");
+	} else if (option == 'g')
+	    marc_grep_path = optarg;
+	else if (option == 'c')
+	    label = optarg;
+	else
+	    Usage();
+    }
+
+    if (argc - optind != 1)
+	Usage();
+
+    std::string err_msg;
+    MarcFileReader * const raw_reader(MarcFileReader::MarcFileReaderFactory(argv[optind], &err_msg));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcFileReader> reader(raw_reader);
+
+    Corpus corpus;
+    LoadCorpus(*reader, &corpus);
+    const size_t record_count(corpus.records_.size());
+
+    std::vector<BenchmarkResult> results;
+    results.push_back(RunBenchmark("read_next_record", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkReadNextRecord(corpus.filename_); }));
+    results.push_back(RunBenchmark("directory_first_reading_856", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkDirectoryFirstReading(corpus.filename_); }));
+    static const std::vector<std::pair<std::string, MarcReader::Backend>> READER_BACKENDS = {
+	{ "mmap", MarcReader::MMAP }, { "stdio", MarcReader::STDIO }, { "async", MarcReader::ASYNC },
+    };
+    for (const auto &name_and_backend : READER_BACKENDS)
+	results.push_back(RunBenchmark("raw_record_reading_" + name_and_backend.first, record_count, corpus.size_,
+				       min_seconds, [&]() {
+					   return BenchmarkRawRecordReading(corpus.filename_, name_and_backend.second);
+				       }));
+    for (const auto &name_and_backend : READER_BACKENDS)
+	results.push_back(RunBenchmark("record_pipeline_" + name_and_backend.first, record_count, corpus.size_,
+				       min_seconds, [&]() {
+					   return BenchmarkRecordPipeline(corpus.filename_, name_and_backend.second);
+				       }));
+    results.push_back(RunBenchmark("leader_parsing", record_count, corpus.leader_bytes_, min_seconds,
+				   [&corpus]() { return BenchmarkLeaderParsing(corpus); }));
+    results.push_back(RunBenchmark("directory_parsing", record_count, corpus.directory_bytes_, min_seconds,
+				   [&corpus]() { return BenchmarkDirectoryParsing(corpus); }));
+    results.push_back(RunBenchmark("subfields_parsing", record_count, corpus.data_field_bytes_, min_seconds,
+				   [&corpus]() { return BenchmarkSubfieldsParsing(corpus); }));
+    results.push_back(RunBenchmark("subfield_view_scanning", record_count, corpus.data_field_bytes_, min_seconds,
+				   [&corpus]() { return BenchmarkSubfieldViewScanning(corpus); }));
+    results.push_back(RunBenchmark("field_extraction_runtime", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkRuntimeFieldExtraction(corpus); }));
+    results.push_back(RunBenchmark("field_extraction_compiled", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkCompiledFieldExtraction(corpus); }));
+
+    std::vector<ParsedRecord> parsed_records;
+    ParseCorpus(corpus, &parsed_records);
+    results.push_back(RunBenchmark("record_composition", record_count, corpus.size_, min_seconds,
+				   [&parsed_records]() { return BenchmarkRecordComposition(&parsed_records); }));
+    parsed_records.clear();
+    results.push_back(RunBenchmark("marc8_conversion", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkMarc8Conversion(corpus); }));
+    results.push_back(RunBenchmark("utf8_validation", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkUtf8Validation(corpus); }));
+    results.push_back(RunBenchmark("json_serialization_marc_in_json", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkJsonSerialization(corpus, MarcJson::MARC_IN_JSON); }));
+    results.push_back(RunBenchmark("json_serialization_flat", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkJsonSerialization(corpus, MarcJson::FLAT); }));
+    results.push_back(RunBenchmark("xml_serialization", record_count, corpus.size_, min_seconds,
+				   [&corpus]() { return BenchmarkXmlSerialization(corpus); }));
+
+    if (not marc_grep_path.empty()) {
+	static const std::vector<std::vector<std::string>> QUERIES = {
+	    { "245a" }, { "L[6]=a;100a" }, { "650a=/schich/" }, { "-j", "4", "700a" },
+	};
+	for (const auto &query : QUERIES) {
+	    std::string name("marc_grep");
+	    for (const auto &argument : query)
+		name += " " + argument;
+	    results.push_back(RunBenchmark(name, record_count, corpus.size_, min_seconds,
+					   [&]() { return RunMarcGrep(marc_grep_path, query, corpus.filename_); }));
+	}
+    }
+
+    WriteResults(label, corpus, results);
+}
@@ -0,0 +1,322 @@
+/** \file marc_generate.cc
+ *  \brief marc_generate is a command-line utility that generates synthetic MARC-21 files, e.g. for benchmarks.
+ *
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "DirectoryEntry.h"
+#include "Leader.h"
+#include "MarcTag.h"
+#include "MarcWriter.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << progname << " [-n record_count] [-s seed] [-f min_fields:max_fields]\n"
+	      << "       [-l min_length:max_length] [-u utf8_percentage] [-8] output_filename\n";
+    std::cerr << "\tGenerates \"record_count\" (default 10000) synthetic bibliographic records w/ the given number\n";
+    std::cerr << "\tof fields per record (default 8:40) and subfield values of the given length in bytes (default\n";
+    std::cerr << "\t3:40).  \"utf8_percentage\" (default 10) is the percentage of words w/ non-ASCII characters.\n";
+    std::cerr << "\t\"-8\" generates MARC-8 instead of UTF-8 encoded records.\n";
+    std::cerr << "\tThe output only depends on the arguments, i.e. the same seed always yields the same file.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+/** \class Random
+ *  \brief A small xorshift64* PRNG.  Unlike the standard distributions its output is the same on all platforms.
+ */
+class Random {
+    uint64_t state_;
+public:
+    explicit Random(const uint64_t seed): state_((seed + 1) * 0x9E3779B97F4A7C15ull) {}
+
+    uint64_t next() {
+	state_ ^= state_ >> 12u;
+	state_ ^= state_ << 25u;
+	state_ ^= state_ >> 27u;
+	return state_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    /** \return A number in [low, high]. */
+    unsigned uniform(const unsigned low, const unsigned high) { return low + next() % (high - low + 1); }
+
+    bool percentage(const unsigned percent) { return uniform(0, 99) < percent; }
+};
+
+
+struct GeneratorOptions {
+    unsigned record_count_;
+    unsigned min_fields_, max_fields_;
+    unsigned min_value_length_, max_value_length_;
+    unsigned utf8_percentage_;
+    bool marc8_;
+};
+
+
+/** The variable fields that get added to each record in addition to 245, w/ their relative frequencies. */
+struct DataFieldSpec {
+    MarcTag tag_;
+    char indicator1_, indicator2_;
+    const char *subfield_codes_;
+    unsigned weight_;
+};
+
+
+const DataFieldSpec DATA_FIELD_SPECS[] = {
+    { "020"_tag, ' ', ' ', "a",     4 },
+    { "035"_tag, ' ', ' ', "a",     6 },
+    { "040"_tag, ' ', ' ', "abc",   3 },
+    { "041"_tag, '0', ' ', "a",     2 },
+    { "100"_tag, '1', ' ', "ad",    4 },
+    { "250"_tag, ' ', ' ', "a",     2 },
+    { "264"_tag, ' ', '1', "abc",   4 },
+    { "300"_tag, ' ', ' ', "ac",    4 },
+    { "490"_tag, '1', ' ', "av",    3 },
+    { "500"_tag, ' ', ' ', "a",     8 },
+    { "650"_tag, ' ', '0', "axz2", 20 },
+    { "689"_tag, '0', '0', "Da",   10 },
+    { "700"_tag, '1', ' ', "ae4",  12 },
+    { "856"_tag, '4', '1', "uz",    6 },
+    { "935"_tag, ' ', ' ', "ac",    4 },
+};
+
+
+const char * const SYLLABLES[] = {
+    "ge", "schich", "te", "der", "kir", "che", "his", "to", "ry", "phi", "lo", "so", "phie", "the", "o", "gie",
+    "re", "for", "ma", "tion", "mit", "tel", "al", "ter", "bib", "li", "ca", "na", "tur", "ver", "lag", "stu",
+    "di", "en", "an", "thro", "po", "mo", "der", "ne", "kul", "stadt", "land", "zeit", "schrift", "band",
+};
+const unsigned SYLLABLE_COUNT(sizeof(SYLLABLES) / sizeof(SYLLABLES[0]));
+
+
+// Each of these contains multibyte UTF-8 sequences of various lengths.
+const char * const UTF8_WORDS[] = {
+    "Müller", "Straße", "Tübingen", "Łódź", "Ærø", "café", "Ελληνικά", "Россия", "日本語", "中文", "한국어",
+    "Señor", "Œuvres", "Dvořák", "İstanbul", "עברית", "العربية", "naïve", "Å", "ﬁn",
+};
+const unsigned UTF8_WORD_COUNT(sizeof(UTF8_WORDS) / sizeof(UTF8_WORDS[0]));
+
+
+// MARC-8 encoded words w/ ANSEL characters, combining diacritics, which precede their base characters, and escapes to
+// the Greek symbol, subscript and superscript sets.
+const char * const MARC8_WORDS[] = {
+    "M\xE8uller", "Stra\xC7" "e", "T\xE8ubingen", "\xA1\xE2od\xE2z", "\xA5r\xB2", "caf\xE2" "e", "Se\xE4nor",
+    "\xA6uvres", "Dvo\xE9r\xE2" "ak", "\xE7Istanbul", "na\xE8ive", "\xEA" "A", "Vi\xF2\xE3" "et",
+    "\x1Bga\x1Bs-Strahlung", "H\x1B" "b2\x1BsO", "m\x1Bp2\x1Bs", "\xA9-Dur", "\xC3 1984", "\xC0" "C",
+    "\xB1\xE2od\xE2z",
+};
+const unsigned MARC8_WORD_COUNT(sizeof(MARC8_WORDS) / sizeof(MARC8_WORDS[0]));
+
+
+/** Appends words to "value" until it has (roughly) "target_length" bytes.  Multibyte characters are never split. */
+void AppendText(const unsigned target_length, const GeneratorOptions &options, Random * const random,
+		std::string * const value)
+{
+    const size_t start_size(value->size());
+    std::string word;
+    do {
+	if (random->percentage(options.utf8_percentage_))
+	    word = options.marc8_ ? MARC8_WORDS[random->uniform(0, MARC8_WORD_COUNT - 1)]
+				  : UTF8_WORDS[random->uniform(0, UTF8_WORD_COUNT - 1)];
+	else {
+	    word.clear();
+	    for (unsigned syllable_count(random->uniform(1, 4)); syllable_count > 0; --syllable_count)
+		word += SYLLABLES[random->uniform(0, SYLLABLE_COUNT - 1)];
+	    if (value->size() == start_size)
+		word[0] = std::toupper(word[0]);
+	}
+
+	if (value->size() > start_size) {
+	    if (value->size() - start_size + 1 + word.size() > target_length)
+		return;
+	    *value += ' ';
+	}
+	*value += word;
+    } while (value->size() - start_size < target_length);
+}
+
+
+void AppendDigits(const unsigned count, Random * const random, std::string * const value) {
+    for (unsigned i(0); i < count; ++i)
+	*value += static_cast<char>('0' + random->uniform(0, 9));
+}
+
+
+std::string GenerateDataField(const DataFieldSpec &spec, const GeneratorOptions &options, Random * const random) {
+    std::string field;
+    field += spec.indicator1_;
+    field += spec.indicator2_;
+    for (const char *subfield_code(spec.subfield_codes_); *subfield_code != '\0'; ++subfield_code) {
+	field += '\x1F';
+	field += *subfield_code;
+	if (spec.tag_ == "020"_tag)
+	    AppendDigits(13, random, &field);
+	else if (spec.tag_ == "856"_tag and *subfield_code == 'u') {
+	    field += "http://example.org/";
+	    AppendDigits(random->uniform(4, 12), random, &field);
+	} else
+	    AppendText(random->uniform(options.min_value_length_, options.max_value_length_), options, random,
+		       &field);
+    }
+
+    return field;
+}
+
+
+void GenerateRecord(const unsigned record_number, const GeneratorOptions &options, Random * const random,
+		    MarcWriter * const writer)
+{
+    static const unsigned WEIGHT_SUM([]() {
+	unsigned sum(0);
+	for (const auto &spec : DATA_FIELD_SPECS)
+	    sum += spec.weight_;
+	return sum;
+    }());
+
+    std::vector<std::pair<MarcTag, std::string>> tags_and_fields;
+    char control_number[16];
+    std::snprintf(control_number, sizeof control_number, "BENCH%09u", record_number);
+    tags_and_fields.push_back(std::make_pair("001"_tag, std::string(control_number)));
+    tags_and_fields.push_back(std::make_pair("005"_tag, std::string("20140101120000.0")));
+    std::string fixed_length_data("140101s");
+    AppendDigits(4, random, &fixed_length_data);
+    fixed_length_data += "    gw            000 0 ger d";
+    tags_and_fields.push_back(std::make_pair("008"_tag, fixed_length_data));
+
+    const DataFieldSpec title_spec = { "245"_tag, '1', '0', "ab", 0 };
+    tags_and_fields.push_back(std::make_pair(title_spec.tag_, GenerateDataField(title_spec, options, random)));
+
+    // A triangular distribution, i.e. field counts near the middle of the range are the most likely ones.
+    const unsigned span(options.max_fields_ - options.min_fields_);
+    const unsigned field_count(options.min_fields_ + (random->uniform(0, span) + random->uniform(0, span)) / 2);
+
+    size_t record_length(Leader::LEADER_LENGTH + 2);
+    for (const auto &tag_and_field : tags_and_fields)
+	record_length += DirectoryEntry::DIRECTORY_ENTRY_LENGTH + tag_and_field.second.size() + 1;
+    while (tags_and_fields.size() < field_count) {
+	unsigned selector(random->uniform(0, WEIGHT_SUM - 1));
+	const DataFieldSpec *spec(DATA_FIELD_SPECS);
+	while (selector >= spec->weight_)
+	    selector -= spec++->weight_;
+
+	std::string field(GenerateDataField(*spec, options, random));
+	record_length += DirectoryEntry::DIRECTORY_ENTRY_LENGTH + field.size() + 1;
+	if (record_length > MarcWriter::MAX_RECORD_LENGTH)
+	    break;
+	tags_and_fields.push_back(std::make_pair(spec->tag_, std::move(field)));
+    }
+
+    std::stable_sort(tags_and_fields.begin(), tags_and_fields.end(),
+		     [](const std::pair<MarcTag, std::string> &lhs, const std::pair<MarcTag, std::string> &rhs)
+		     { return lhs.first < rhs.first; });
+
+    std::vector<DirectoryEntry> dir_entries;
+    std::vector<std::string> fields;
+    for (auto &tag_and_field : tags_and_fields) {
+	dir_entries.push_back(DirectoryEntry(tag_and_field.first, 0, 0));
+	fields.push_back(std::move(tag_and_field.second));
+    }
+
+    Leader leader;
+    if (options.marc8_)
+	leader.setCharacterCodingScheme(' ');
+    std::string err_msg;
+    if (not writer->write(leader, dir_entries, fields, &err_msg))
+	Error(err_msg);
+}
+
+
+void ParseRange(const char * const arg, unsigned * const min, unsigned * const max) {
+    char *end;
+    *min = std::strtoul(arg, &end, 10);
+    if (end == arg or *end != ':')
+	Error("bad range \"" + std::string(arg) + "\"! (Expected min:max)");
+    const char * const max_start(end + 1);
+    *max = std::strtoul(max_start, &end, 10);
+    if (end == max_start or *end != '\0' or *max < *min)
+	Error("bad range \"" + std::string(arg) + "\"! (Expected min:max)");
+}
+
+
+unsigned ParseUnsigned(const char * const arg) {
+    char *end;
+    const unsigned long value(std::strtoul(arg, &end, 10));
+    if (end == arg or *end != '\0')
+	Error("bad number \"" + std::string(arg) + "\"!");
+    return value;
+}
+
+
+int main(int argc, char **argv) {
+    progname = argv[0];
+
+    GeneratorOptions options = { 10000, 8, 40, 3, 40, 10, false };
+    unsigned seed(1);
+    int option;
+    while ((option = ::getopt(argc, argv, "n:s:f:l:u:8")) != -1) {
+	if (option == 'n')
+	    options.record_count_ = ParseUnsigned(optarg);
+	else if (option == 's')
+	    seed = ParseUnsigned(optarg);
+	else if (option == 'f')
+	    ParseRange(optarg, &options.min_fields_, &options.max_fields_);
+	else if (option == 'l')
+	    ParseRange(optarg, &options.min_value_length_, &options.max_value_length_);
+	else if (option == 'u')
+	    options.utf8_percentage_ = ParseUnsigned(optarg);
+	else if (option == '8')
+	    options.marc8_ = true;
+	else
+	    Usage();
+    }
+
+    if (argc - optind != 1)
+	Usage();
+
+    // 4 subfields of this length still fit into the maximum field length.
+    if (options.min_value_length_ == 0 or options.max_value_length_ > 2000)
+	Error("subfield value lengths must be between 1 and 2000!");
+    if (options.min_fields_ < 4)
+	Error("records have at least 4 fields (001, 005, 008 and 245)!");
+    if (options.utf8_percentage_ > 100)
+	Error("the UTF-8 percentage must not exceed 100!");
+
+    std::string err_msg;
+    MarcWriter * const raw_writer(MarcWriter::MarcWriterFactory(argv[optind], &err_msg));
+    if (raw_writer == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcWriter> writer(raw_writer);
+
+    Random random(seed);
+    for (unsigned record_number(1); record_number <= options.record_count_; ++record_number)
+	GenerateRecord(record_number, options, &random, writer.get());
+
+    if (not writer->close(&err_msg))
+	Error(err_msg);
+    std::cerr << "Generated " << options.record_count_ << " records.\n";
+}
@@ -18,9 +18,15 @@
  *  You should have received a copy of the GNU Affero General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <cstdio>
 #include <cstdlib>
@@ -28,33 +34,86 @@
 #include <getopt.h>
 #include "DirectoryEntry.h"
 #include "Leader.h"
+#include "MarcFileReader.h"
+#include "MarcReader.h"
+#include "MarcTag.h"
 #include "MarcUtil.h"
+#include "MultiPatternMatcher.h"
+#include "RecordPipeline.h"
+#include "RecordView.h"
 #include "RegexMatcher.h"
+#include "RejectLog.h"
+#include "SmallVector.h"
+#include "Stats.h"
 #include "StringUtil.h"
-#include "Subfields.h"
+#include "SubfieldCodeSet.h"
+#include "SubfieldView.h"
+#include "TermIndex.h"
 #include "util.h"
 
 
 void Usage() {
-    std::cerr << "Usage: " << progname << " input_filename field_reference\n";
+    std::cerr << "Usage: " << progname
+	      << " [--stats] [--reader=mmap|stdio|async] [--reject-file=reject_filename] [--validate-utf8]\n"
+	      << "\t[-j thread_count | -l field_reference=value] [--queries=queries_filename] [-o output_filename]...\n"
+	      << "\tinput_filename [field_reference...]\n";
     std::cerr << "\tField references are a mixed colon-separated list of either field codes like \"712\" or\n";
     std::cerr << "\tfield codes followed by one or more subfield codes like \"859aw\".\n";
+    std::cerr << "\tA field reference followed by \"=/regex/\", e.g. \"650a=/^Geschichte/\", only reports the\n";
+    std::cerr << "\tfields or subfields whose values match the PCRE \"regex\".  Likewise \"=@patterns_file\", e.g.\n";
+    std::cerr << "\t\"020a=@isbns\", only reports values that contain any of the literals listed, one per line, in\n";
+    std::cerr << "\t\"patterns_file\".\n";
+    std::cerr << "\tAll field references are answered w/ a single pass over the input.  The \"-o\" options assign\n";
+    std::cerr << "\toutput files to the field references on the command line in order, the results of field\n";
+    std::cerr << "\treferences w/o an output file go to stdout.  \"--queries\" reads more field references from\n";
+    std::cerr << "\t\"queries_filename\", one \"output_filename field_reference\" pair per line.  Empty lines and\n";
+    std::cerr << "\tlines starting w/ '#' are ignored.  An output filename of \"-\" stands for stdout.\n";
+    std::cerr << "\t\"-j\" searches the input w/ \"thread_count\" threads.  The output is identical to that of a\n";
+    std::cerr << "\tsequential search.  Memory mapped input files are split into chunks, other input gets read on a\n";
+    std::cerr << "\tseparate thread and handed to the searching threads in batches.\n";
+    std::cerr << "\t\"-l\" only processes the records that contain \"value\" in a field or subfield referenced by\n";
+    std::cerr << "\t\"field_reference\".  The records are located via the term index \"input_filename.terms\" that\n";
+    std::cerr << "\thas to be built with \"marc_index --terms\" first.  A trailing asterisk in \"value\" requests a\n";
+    std::cerr << "\tprefix match.\n";
+    std::cerr << "\tGzip and, if support has been compiled in, zstd compressed input files are decompressed on the\n";
+    std::cerr << "\tfly.  MARCXML input files are recognised by their contents and converted on the fly.  \"-l\"\n";
+    std::cerr << "\trequires a regular, uncompressed input file w/ binary records.\n";
+    std::cerr << "\t\"--reader\" selects how uncompressed input files are read: memory mapped (the default), with\n";
+    std::cerr << "\tstdio, or with several large asynchronous reads in flight.  Pipes are always read with stdio.\n";
+    std::cerr << "\t\"--reject-file\" skips corrupt records instead of aborting and lists the file offset,\n";
+    std::cerr << "\tlength and reason of each skipped byte range in \"reject_filename\".  After a damaged leader the\n";
+    std::cerr << "\tinput is scanned for the next record terminator that is followed by a plausible leader.\n";
+    std::cerr << "\t\"--validate-utf8\" treats records w/ an 'a' in leader/09 whose fields are not well-formed UTF-8\n";
+    std::cerr << "\tas corrupt and reports the tag, subfield and offset of the first ill-formed byte sequence.\n";
+    std::cerr << "\t\"--stats\" reports the time spent in each processing stage, the throughput and histograms of\n";
+    std::cerr << "\tthe record lengths and field counts on stderr.\n";
     std::exit(EXIT_FAILURE);
 }
 
 
-void FieldGrep(const std::string &input_filename, std::string pattern) {
-    FILE *input = std::fopen(input_filename.c_str(), "rb");
-    if (input == NULL)
-	Error("can't open \"" + input_filename + "\" for reading!");
+/** A parsed field reference, optionally preceded by a leader filter and followed by a value filter. */
+struct Query {
+    std::string field_reference; // As given by the user.
+    unsigned output_no;          // Where the extracted values go, see QueryPlan::getOutput().
+    unsigned leader_offset;
+    char leader_match;
+    MarcTag field_tag; // Empty if there is only a leader filter.
+    std::string subfield_codes;
+    std::unique_ptr<RegexMatcher> value_matcher;          // NULL if there is no regex value filter.
+    std::unique_ptr<RegexMatcher> marc8_value_matcher;    // The same regex in byte mode for MARC-8 records.
+    std::unique_ptr<MultiPatternMatcher> value_patterns; // NULL if there is no literal value filter.
+    std::string required_literal; // Occurs in all values accepted by "value_matcher".  May be empty.
+};
+
 
+void ParseQuery(std::string pattern, Query * const query) {
     // Do we have a leader filter?
-    unsigned offset;
-    char leader_match('\0');
+    query->leader_match = '\0';
     if (pattern[0] == 'L') {
-	if (std::sscanf(pattern.c_str(), "L[%u]=%c;", &offset, &leader_match) != 2 or leader_match == ';')
+	if (std::sscanf(pattern.c_str(), "L[%u]=%c;", &query->leader_offset, &query->leader_match) != 2
+	    or query->leader_match == ';')
 	    Error("Bad leader match specification!");
-	if (offset >= Leader::LEADER_LENGTH)
+	if (query->leader_offset >= Leader::LEADER_LENGTH)
 	    Error("Leader match offset exceeds leader length (" + std::to_string(Leader::LEADER_LENGTH) + ")!");
 	const std::string::size_type closing_brace_pos = pattern.find(']');
 	if (closing_brace_pos + 4 > pattern.length() or pattern[closing_brace_pos + 3] != ';')
@@ -62,71 +121,714 @@ void FieldGrep(const std::string &input_filename, std::string pattern) {
 	pattern = pattern.substr(closing_brace_pos + 4);
     }
 
-    std::string field_tag;
-    std::string subfield_codes;
+    // Do we have a value filter?  The first of the two delimiters wins as the other one may occur in the value.
+    const std::string::size_type patterns_filename_start_pos(pattern.find("=@"));
+    const std::string::size_type regex_start_pos(pattern.find("=/"));
+    if (patterns_filename_start_pos < regex_start_pos) {
+	std::string err_msg;
+	query->value_patterns.reset(MultiPatternMatcher::MultiPatternMatcherFactory(
+	    pattern.substr(patterns_filename_start_pos + 2), &err_msg));
+	if (query->value_patterns == NULL)
+	    Error(err_msg);
+	if (query->value_patterns->size() == 0)
+	    Warning("no patterns found in \"" + pattern.substr(patterns_filename_start_pos + 2) + "\"!");
+	pattern.resize(patterns_filename_start_pos);
+	if (pattern.empty())
+	    Error("Missing field reference before patterns file!");
+    } else if (regex_start_pos != std::string::npos) {
+	if (pattern.length() < regex_start_pos + 3 or pattern[pattern.length() - 1] != '/')
+	    Error("Missing closing '/' after value regex!");
+	const std::string regex(pattern.substr(regex_start_pos + 2, pattern.length() - regex_start_pos - 3));
+	std::string err_msg;
+	query->value_matcher.reset(RegexMatcher::RegexMatcherFactory(regex, &err_msg));
+	if (query->value_matcher == NULL)
+	    Error(err_msg);
+	query->marc8_value_matcher.reset(RegexMatcher::RegexMatcherFactory(regex, &err_msg, /* utf8 = */ false));
+	if (query->marc8_value_matcher == NULL)
+	    Error(err_msg);
+	query->required_literal = RegexMatcher::ExtractRequiredLiteral(regex);
+	pattern.resize(regex_start_pos);
+	if (pattern.empty())
+	    Error("Missing field reference before value regex!");
+    }
+
     if (not pattern.empty()) {
 	if (pattern.length() < 3)
 	    Error("Bad field pattern \"" + pattern + "\", must be at least 3 characters in length!");
-	field_tag = pattern.substr(0, 3);
-	subfield_codes = pattern.substr(3);
+	query->field_tag = MarcTag(pattern.data());
+	query->subfield_codes = pattern.substr(3);
     }
+}
 
-    Leader *raw_leader;
-    std::vector<DirectoryEntry> dir_entries;
-    std::vector<std::string> field_data;
-    std::string err_msg;
-    unsigned count(0), matched_count(0);
 
-    while (MarcUtil::ReadNextRecord(input, &raw_leader, &dir_entries, &field_data, &err_msg)) {
-	++count;
-	std::unique_ptr<Leader> leader(raw_leader);
-	if (leader_match != '\0') {
-	    if ((*leader)[offset] != leader_match)
-		continue;
-	    else if (field_tag.empty()) {
-		++matched_count;
-		continue;
-	    }
+/** A destination for the results of one or more queries. */
+struct Output {
+    std::string filename; // "-" for stdout.
+    std::ostream *stream;
+    std::unique_ptr<std::ofstream> file; // NULL for stdout.
+};
+
+
+/** \class QueryPlan
+ *  \brief All queries of a run compiled so that a single scan of each record answers all of them.
+ *
+ *  Each field tag that is of interest maps to the queries that reference it and to the union of their subfield
+ *  codes.  The slots of the tags 000 through 999 are looked up by indexing, other tags via a hash map.
+ */
+class QueryPlan {
+public:
+    /** The queries that reference a given tag. */
+    struct TagQueries {
+	SubfieldCodeSet subfield_codes; // The union of the subfield codes of the queries.
+	std::vector<unsigned> query_nos;
+    };
+private:
+    static const unsigned NUMERIC_TAG_COUNT = 1000;
+
+    std::vector<Query> queries_;
+    std::vector<Output> outputs_;
+    std::vector<TagQueries> tag_queries_;
+    unsigned numeric_tag_slots_[NUMERIC_TAG_COUNT];          // 1 + index into "tag_queries_", or 0 if unused.
+    std::unordered_map<uint32_t, unsigned> other_tag_slots_; // The same for tags that are not all digits.
+public:
+    QueryPlan() { std::fill(numeric_tag_slots_, numeric_tag_slots_ + NUMERIC_TAG_COUNT, 0); }
+
+    /** \brief Parses "field_reference" and adds it to the plan.
+     *  \param output_filename  Where the results go, "-" for stdout.  Queries w/ the same filename share an output.
+     */
+    void addQuery(const std::string &field_reference, const std::string &output_filename);
+
+    /** Reads "output_filename field_reference" lines from "queries_filename" and adds the queries. */
+    void addQueries(const std::string &queries_filename);
+
+    size_t size() const { return queries_.size(); }
+    const Query &getQuery(const unsigned query_no) const { return queries_[query_no]; }
+    size_t getOutputCount() const { return outputs_.size(); }
+    const Output &getOutput(const unsigned output_no) const { return outputs_[output_no]; }
+
+    /** Flushes and closes the output files. */
+    void closeOutputs();
+
+    /** \return The queries that reference "tag" or NULL if there are none. */
+    const TagQueries *findTagQueries(const MarcTag &tag) const {
+	unsigned slot, numeric_tag;
+	if (GetNumericTag(tag, &numeric_tag))
+	    slot = numeric_tag_slots_[numeric_tag];
+	else {
+	    const auto tag_and_slot(other_tag_slots_.find(tag.toInt()));
+	    slot = (tag_and_slot == other_tag_slots_.end()) ? 0 : tag_and_slot->second;
 	}
+	return (slot == 0) ? NULL : &tag_queries_[slot - 1];
+    }
+private:
+    /** \return True if "tag" consists of 3 digits, in which case "numeric_tag" will be set to its value. */
+    static bool GetNumericTag(const MarcTag &tag, unsigned * const numeric_tag) {
+	// Non-digits wrap around to large values.
+	const unsigned digit1(((tag.toInt() >> 16u) & 0xFFu) - '0'), digit2(((tag.toInt() >> 8u) & 0xFFu) - '0'),
+		       digit3((tag.toInt() & 0xFFu) - '0');
+	if (digit1 > 9 or digit2 > 9 or digit3 > 9)
+	    return false;
+	*numeric_tag = digit1 * 100 + digit2 * 10 + digit3;
+	return true;
+    }
+};
+
+
+void QueryPlan::addQuery(const std::string &field_reference, const std::string &output_filename) {
+    queries_.emplace_back();
+    Query &query(queries_.back());
+    query.field_reference = field_reference;
+    ParseQuery(field_reference, &query);
+
+    for (query.output_no = 0; query.output_no < outputs_.size(); ++query.output_no) {
+	if (outputs_[query.output_no].filename == output_filename)
+	    break;
+    }
+    if (query.output_no == outputs_.size()) {
+	Output output;
+	output.filename = output_filename;
+	if (output_filename == "-")
+	    output.stream = &std::cout;
+	else {
+	    output.file.reset(new std::ofstream(output_filename));
+	    if (not *output.file)
+		Error("can't open \"" + output_filename + "\" for writing!");
+	    output.stream = output.file.get();
+	}
+	outputs_.push_back(std::move(output));
+    }
+
+    if (query.field_tag.empty()) // Only a leader filter.
+	return;
+
+    unsigned numeric_tag;
+    unsigned &slot(GetNumericTag(query.field_tag, &numeric_tag) ? numeric_tag_slots_[numeric_tag]
+							       : other_tag_slots_[query.field_tag.toInt()]);
+    if (slot == 0) {
+	tag_queries_.emplace_back();
+	slot = tag_queries_.size();
+    }
+    TagQueries &tag_queries(tag_queries_[slot - 1]);
+    for (const char subfield_code : query.subfield_codes)
+	tag_queries.subfield_codes.insert(subfield_code);
+    tag_queries.query_nos.push_back(queries_.size() - 1);
+}
+
+
+void QueryPlan::addQueries(const std::string &queries_filename) {
+    std::ifstream input(queries_filename);
+    if (not input)
+	Error("can't open \"" + queries_filename + "\" for reading!");
+
+    std::string line;
+    unsigned line_no(0);
+    while (std::getline(input, line)) {
+	++line_no;
+	StringUtil::RightTrim(&line, " \t\r");
+	if (line.empty() or line[0] == '#')
+	    continue;
+
+	const std::string::size_type filename_end(line.find_first_of(" \t"));
+	const std::string::size_type field_reference_start(filename_end == std::string::npos
+							   ? std::string::npos
+							   : line.find_first_not_of(" \t", filename_end));
+	if (field_reference_start == std::string::npos)
+	    Error("missing field reference in line " + std::to_string(line_no) + " of \"" + queries_filename + "\"!");
+	addQuery(line.substr(field_reference_start), line.substr(0, filename_end));
+    }
+    if (input.bad())
+	Error("failed to read \"" + queries_filename + "\"!");
+}
+
+
+void QueryPlan::closeOutputs() {
+    for (auto &output : outputs_) {
+	output.stream->flush();
+	if (output.file != NULL)
+	    output.file->close();
+	if (output.stream->fail())
+	    Error("failed to write to \"" + output.filename + "\"!");
+    }
+}
+
+
+/** The per-record state of the queries and their match counts for one thread. */
+struct MatchState {
+    struct QueryState {
+	bool active;  // The record passed the raw filter of the query.
+	bool done;    // No further fields need to be looked at.
+	bool matched;
+    };
+
+    std::vector<QueryState> query_states;
+    std::vector<unsigned> matched_counts;
+    SmallVector<std::pair<char, Slice>, 32> subfields; // The subfields of the current field that are of interest.
+
+    explicit MatchState(const QueryPlan &plan): query_states(plan.size()), matched_counts(plan.size(), 0) {}
+};
+
+
+/** \return True if there is no value filter or if "value" matches it.  If the match fails w/ an error, "err_msg"
+ *          will be set.
+ *  \param is_utf8  Whether "value" comes from a UTF-8 record, as opposed to a MARC-8 one, see leader/09.
+ */
+inline bool ValueMatched(const Query &query, const Slice &value, const bool is_utf8, std::string * const err_msg) {
+    if (query.value_patterns == NULL and query.value_matcher == NULL)
+	return true;
+
+    const Stats::StageTimer timer(Stats::MATCHING);
+    if (query.value_patterns != NULL)
+	return query.value_patterns->matched(value.data(), value.size());
+    return (is_utf8 ? query.value_matcher : query.marc8_value_matcher)->matched(value.data(), value.size(), err_msg);
+}
+
 
-	std::string control_number;
-	for (unsigned i(0); i < dir_entries.size(); ++i) {
-	    if (dir_entries[i].getTag() == "001")
-		control_number = field_data[i];
+/** \brief A cheap test on the raw bytes of a record, i.e. before its directory gets parsed.
+ *  \return False if "raw_record" cannot match "query", true if it might.
+ */
+inline bool RawRecordMayMatch(const Query &query, const Slice &raw_record) {
+    const Stats::StageTimer timer(Stats::MATCHING);
+    if (query.leader_match != '\0' and raw_record[query.leader_offset] != query.leader_match)
+	return false;
+
+    // Any matching value is a substring of the raw record.
+    if (not query.required_literal.empty()
+	and ::memmem(raw_record.data(), raw_record.size(), query.required_literal.data(),
+		     query.required_literal.size()) == NULL)
+	return false;
+    return query.value_patterns == NULL or query.value_patterns->matched(raw_record.data(), raw_record.size());
+}
+
+
+/** \brief Applies the raw filters of all queries to "raw_record" and marks the queries that it may match as active in
+ *         "state".
+ *  \return False if "raw_record" cannot match any of the queries, true if it might match at least one.
+ */
+bool RawRecordMayMatch(const QueryPlan &plan, const Slice &raw_record, MatchState * const state) {
+    bool may_match(false);
+    for (unsigned query_no(0); query_no < plan.size(); ++query_no) {
+	MatchState::QueryState &query_state(state->query_states[query_no]);
+	query_state.active = RawRecordMayMatch(plan.getQuery(query_no), raw_record);
+	query_state.done = query_state.matched = false;
+	may_match = may_match or query_state.active;
+    }
+
+    return may_match;
+}
 
-	    if (dir_entries[i].getTag() == field_tag) {
-		bool matched(false);
-		if (subfield_codes.empty()) {
-		    std::cout << field_data[i] << "\n";
+
+/** \brief Applies the active queries in "state" to "record" and appends the extracted values to "outputs", which
+ *         has one entry per output of "plan".  The match counts in "state" are updated.
+ *
+ *  Each field is only looked at once.  Fields whose tag is referenced by several queries have their subfields w/
+ *  the union of the codes of these queries collected in a single scan, and the queries pick their values from those.
+ *
+ *  \return True if "record" matched any of the queries, else false.  If an error occurred "err_msg" will be set.
+ */
+bool ProcessRecord(const QueryPlan &plan, const RecordView &record, MatchState * const state,
+		   std::string * const outputs, std::string * const err_msg)
+{
+    const Stats::StageTimer timer(Stats::EXTRACTION);
+    unsigned pending_count(0); // The number of active queries that still need to look at fields.
+    for (unsigned query_no(0); query_no < plan.size(); ++query_no) {
+	MatchState::QueryState &query_state(state->query_states[query_no]);
+	if (not query_state.active)
+	    continue;
+
+	// The raw filter has already checked the leader filter.
+	if (plan.getQuery(query_no).field_tag.empty())
+	    query_state.matched = query_state.done = true;
+	else
+	    ++pending_count;
+    }
+
+    const bool is_utf8(record.getLeader()[9] == 'a');
+    Slice control_number;
+    for (unsigned i(0); i < record.getNumberOfFields() and pending_count > 0; ++i) {
+	const MarcTag tag(record.getTag(i));
+	if (tag == "001"_tag)
+	    control_number = record.getField(i);
+
+	const QueryPlan::TagQueries * const tag_queries(plan.findTagQueries(tag));
+	if (tag_queries == NULL)
+	    continue;
+
+	const Slice field(record.getField(i));
+	bool subfields_collected(false);
+	for (const unsigned query_no : tag_queries->query_nos) {
+	    MatchState::QueryState &query_state(state->query_states[query_no]);
+	    if (not query_state.active or query_state.done)
+		continue;
+
+	    const Query &query(plan.getQuery(query_no));
+	    std::string * const output(&outputs[query.output_no]);
+	    bool matched(false);
+	    if (query.subfield_codes.empty()) {
+		if (ValueMatched(query, field, is_utf8, err_msg)) {
+		    const Stats::StageTimer output_timer(Stats::OUTPUT);
+		    output->append(field.data(), field.size()) += '\n';
 		    matched = true;
-		} else {
-		    const Subfields subfields(field_data[i]);
-		    for (const char subfield_code : subfield_codes) {
-			auto begin_end = subfields.getIterators(subfield_code);
-			for (auto code_and_value(begin_end.first); code_and_value != begin_end.second;
-			     ++code_and_value)
-			{
-			    matched = true;
-			    std::cout << control_number << ':' << subfield_code << ':'
-				      << code_and_value->second << '\n';
+		} else if (not err_msg->empty())
+		    return false;
+	    } else {
+		if (not subfields_collected) {
+		    state->subfields.clear();
+		    const SubfieldView subfields(field);
+		    for (const auto &code_and_value : subfields) {
+			if (tag_queries->subfield_codes.contains(code_and_value.first))
+			    state->subfields.push_back(code_and_value);
+		    }
+		    subfields_collected = true;
+		}
+
+		for (const char subfield_code : query.subfield_codes) {
+		    for (const auto &code_and_value : state->subfields) {
+			if (code_and_value.first != subfield_code)
+			    continue;
+			if (not ValueMatched(query, code_and_value.second, is_utf8, err_msg)) {
+			    if (not err_msg->empty())
+				return false;
+			    continue;
 			}
+			matched = true;
+			const Stats::StageTimer output_timer(Stats::OUTPUT);
+			output->append(control_number.data(), control_number.size()) += ':';
+			(*output += subfield_code) += ':';
+			output->append(code_and_value.second.data(), code_and_value.second.size()) += '\n';
 		    }
 		}
+	    }
+
+	    query_state.matched = query_state.matched or matched;
+
+	    // Without a value filter only the first occurrence of a repeatable field is searched.
+	    if (query.value_matcher == NULL and query.value_patterns == NULL) {
+		query_state.done = true;
+		--pending_count;
+	    }
+	}
+    }
+
+    bool record_matched(false);
+    for (unsigned query_no(0); query_no < plan.size(); ++query_no) {
+	if (state->query_states[query_no].matched) {
+	    ++state->matched_counts[query_no];
+	    record_matched = true;
+	}
+    }
+
+    return record_matched;
+}
+
+
+/** Reports the match counts on stderr, one line per query if there are several. */
+void ReportMatchCounts(const QueryPlan &plan, const std::vector<unsigned> &matched_counts, const size_t count,
+		       const std::string &records_description = "overall records")
+{
+    if (plan.size() == 1) {
+	std::cerr << "Matched " << matched_counts[0] << " records of " << count << ' ' << records_description << ".\n";
+	return;
+    }
+
+    for (unsigned query_no(0); query_no < plan.size(); ++query_no)
+	std::cerr << "Matched " << matched_counts[query_no] << " records of " << count << ' ' << records_description
+		  << " for \"" << plan.getQuery(query_no).field_reference << "\".\n";
+}
+
+
+/** \brief Handles the failure to parse or process a record whose extent is known.
+ *  \param reject_log  If not NULL, the record gets logged and we continue, else we abort.
+ */
+void RejectRecord(RejectLog * const reject_log, const size_t record_offset, const size_t record_length,
+		  const std::string &err_msg)
+{
+    if (reject_log == NULL)
+	Error(err_msg + " (Record starting at file offset " + std::to_string(record_offset) + ".)");
+    reject_log->log(record_offset, record_length, err_msg);
+}
+
+
+// The sequential searches collect their output and write it in blocks of about this size.
+const size_t OUTPUT_BUFFER_SIZE(64 * 1024);
+
+
+/** Writes "output" to "destination" and clears it. */
+void FlushOutput(const Output &destination, std::string * const output) {
+    const Stats::StageTimer output_timer(Stats::OUTPUT);
+    destination.stream->write(output->data(), output->size());
+    output->clear();
+}
 
-		if (matched)
-		    ++matched_count;
-		break;
+
+/** Writes each of "outputs" to the corresponding output of "plan" and clears it.
+ *  \param only_full  If true, only outputs that have reached OUTPUT_BUFFER_SIZE are written.
+ */
+void FlushOutputs(const QueryPlan &plan, std::vector<std::string> * const outputs, const bool only_full = false) {
+    for (unsigned output_no(0); output_no < plan.getOutputCount(); ++output_no) {
+	std::string &output((*outputs)[output_no]);
+	if (not output.empty() and (not only_full or output.size() >= OUTPUT_BUFFER_SIZE))
+	    FlushOutput(plan.getOutput(output_no), &output);
+    }
+}
+
+
+/** Drops the partial output of a failed record, i.e. anything beyond "output_sizes". */
+void TruncateOutputs(const std::vector<size_t> &output_sizes, std::vector<std::string> * const outputs) {
+    for (unsigned output_no(0); output_no < output_sizes.size(); ++output_no)
+	(*outputs)[output_no].resize(output_sizes[output_no]);
+}
+
+
+/** Records the current sizes of "outputs" in "output_sizes". */
+void GetOutputSizes(const std::vector<std::string> &outputs, std::vector<size_t> * const output_sizes) {
+    output_sizes->resize(outputs.size());
+    for (unsigned output_no(0); output_no < outputs.size(); ++output_no)
+	(*output_sizes)[output_no] = outputs[output_no].size();
+}
+
+
+void FieldGrep(MarcReader * const reader, const QueryPlan &plan) {
+    Slice raw_record;
+    RecordView record;
+    MatchState state(plan);
+    std::vector<std::string> outputs(plan.getOutputCount());
+    std::vector<size_t> output_sizes;
+    std::string err_msg;
+    unsigned count(0);
+
+    while (reader->getNextRawRecord(&raw_record, &err_msg)) {
+	++count;
+	if (not RawRecordMayMatch(plan, raw_record, &state))
+	    continue;
+
+	GetOutputSizes(outputs, &output_sizes);
+	if (RecordView::ParseRecord(raw_record.data(), raw_record.size(), &record, &err_msg)
+	    and ProcessRecord(plan, record, &state, &outputs[0], &err_msg))
+	    FlushOutputs(plan, &outputs, /* only_full = */ true);
+	else if (not err_msg.empty()) {
+	    TruncateOutputs(output_sizes, &outputs);
+	    FlushOutputs(plan, &outputs);
+	    size_t input_size;
+	    const size_t record_offset(reader->locateRecord(raw_record, &input_size));
+	    RejectRecord(reader->getRejectLog(), record_offset, input_size, err_msg);
+	}
+    }
+
+    FlushOutputs(plan, &outputs);
+    if (not err_msg.empty())
+	Error(err_msg);
+    ReportMatchCounts(plan, state.matched_counts, count);
+}
+
+
+/** A byte range of the input that has been skipped in the tolerant mode. */
+struct Reject {
+    size_t offset, length;
+    std::string reason;
+};
+
+
+/** The results of searching one chunk of the input file. */
+struct ChunkResult {
+    std::vector<std::string> outputs;
+    MatchState state;
+    unsigned count;
+    std::string err_msg;
+    std::vector<Reject> rejects; // Only used in the tolerant mode.
+    bool done;
+
+    explicit ChunkResult(const QueryPlan &plan)
+	: outputs(plan.getOutputCount()), state(plan), count(0), done(false) {}
+};
+
+
+/** \brief Records the failure in result->err_msg for the record at "record_offset" in the tolerant mode.
+ *  \return False if the search of the chunk has to end because we're not in the tolerant mode, else true.
+ */
+bool RejectChunkRecord(const size_t record_offset, const size_t record_length, const bool tolerant,
+		       ChunkResult * const result)
+{
+    if (not tolerant) {
+	result->err_msg += " (Record starting at file offset " + std::to_string(record_offset) + ".)";
+	return false;
+    }
+
+    result->rejects.push_back(Reject{ record_offset, record_length, result->err_msg });
+    result->err_msg.clear();
+    return true;
+}
+
+
+/** \param tolerant  If true, corrupt records are recorded in result->rejects, else they end the search. */
+void ProcessChunk(const MarcFileReader &reader, const QueryPlan &plan, const Slice &chunk, const bool tolerant,
+		  ChunkResult * const result)
+{
+    Slice raw_record;
+    RecordView record;
+    std::vector<size_t> output_sizes;
+    const char *record_start(chunk.begin());
+    while (record_start != chunk.end()) {
+	const size_t record_offset(record_start - reader.getData());
+	if (not RecordView::GetRawRecord(record_start, chunk.end() - record_start, &raw_record, &result->err_msg)) {
+	    if (not tolerant) {
+		result->err_msg += " (Record starting at file offset " + std::to_string(record_offset) + ".)";
+		return;
+	    }
+
+	    // Chunks start at plausible record starts, so we never need to look beyond the end of our chunk.
+	    const size_t skip_size(1 + RecordView::FindNextRecordStart(record_start + 1,
+								       chunk.end() - record_start - 1));
+	    result->rejects.push_back(Reject{ record_offset, skip_size, result->err_msg });
+	    result->err_msg.clear();
+	    record_start += skip_size;
+	    continue;
+	}
+	record_start += raw_record.size();
+
+	if (reader.getValidateUtf8() and not MarcReader::ValidateUtf8(raw_record, &result->err_msg)) {
+	    if (not RejectChunkRecord(record_offset, raw_record.size(), tolerant, result))
+		return;
+	    continue;
+	}
+
+	++result->count;
+	if (not RawRecordMayMatch(plan, raw_record, &result->state))
+	    continue;
+
+	GetOutputSizes(result->outputs, &output_sizes);
+	if (not RecordView::ParseRecord(raw_record.data(), raw_record.size(), &record, &result->err_msg)
+	    or not ProcessRecord(plan, record, &result->state, &result->outputs[0], &result->err_msg))
+	{
+	    if (not result->err_msg.empty()) {
+		TruncateOutputs(output_sizes, &result->outputs);
+		if (not RejectChunkRecord(record_offset, raw_record.size(), tolerant, result))
+		    return;
+	    }
+	}
+    }
+}
+
+
+// Over-partitioning the input evens out the load if some chunks take longer to process than others.
+const unsigned CHUNKS_PER_THREAD(8);
+
+
+/** Searches chunks of the input on "thread_count" threads and emits the per-chunk results in input order. */
+void ParallelFieldGrep(const MarcFileReader &reader, const QueryPlan &plan, const unsigned thread_count) {
+    RejectLog * const reject_log(reader.getRejectLog());
+    std::vector<Slice> chunks;
+    reader.splitIntoChunks(thread_count * CHUNKS_PER_THREAD, &chunks);
+
+    std::vector<ChunkResult> results(chunks.size(), ChunkResult(plan));
+    std::atomic<size_t> next_chunk_no(0);
+    std::atomic<bool> abort(false);
+    std::mutex results_mutex;
+    std::condition_variable chunk_done;
+
+    std::vector<std::thread> threads;
+    for (unsigned thread_no(0); thread_no < thread_count; ++thread_no) {
+	threads.emplace_back([&]() {
+	    size_t chunk_no;
+	    while (not abort and (chunk_no = next_chunk_no++) < chunks.size()) {
+		ProcessChunk(reader, plan, chunks[chunk_no], reject_log != NULL, &results[chunk_no]);
+
+		std::lock_guard<std::mutex> lock(results_mutex);
+		results[chunk_no].done = true;
+		chunk_done.notify_all();
 	    }
+	});
+    }
+
+    unsigned count(0);
+    std::vector<unsigned> matched_counts(plan.size(), 0);
+    std::string err_msg;
+    for (auto &result : results) {
+	{
+	    std::unique_lock<std::mutex> lock(results_mutex);
+	    chunk_done.wait(lock, [&result]() { return result.done; });
+	}
+
+	FlushOutputs(plan, &result.outputs);
+	for (auto &output : result.outputs)
+	    output.shrink_to_fit();
+	for (const auto &reject : result.rejects)
+	    reject_log->log(reject.offset, reject.length, reject.reason);
+	count += result.count;
+	for (unsigned query_no(0); query_no < plan.size(); ++query_no)
+	    matched_counts[query_no] += result.state.matched_counts[query_no];
+
+	if (not result.err_msg.empty()) {
+	    err_msg = result.err_msg;
+	    abort = true;
+	    break;
 	}
     }
 
+    for (auto &thread : threads)
+	thread.join();
+
     if (not err_msg.empty())
 	Error(err_msg);
-    std::cerr << "Matched " << matched_count << " records of " << count << " overall records.\n";
+    ReportMatchCounts(plan, matched_counts, count);
+}
+
 
-    std::fclose(input);
+/** \brief Searches the records of "reader" w/ "thread_count" worker threads and emits the results in input order.
+ *  \note   Unlike ParallelFieldGrep() this works w/ all readers, i.e. also for compressed input files and pipes.
+ */
+void PipelinedFieldGrep(MarcReader * const reader, const QueryPlan &plan, const unsigned thread_count) {
+    RecordPipeline pipeline(reader, thread_count);
+
+    // The raw filter hands the active queries of a record on to the transform in the state of its worker.  The states
+    // are allocated separately so that the workers don't share cache lines.
+    std::vector<std::unique_ptr<MatchState>> worker_states;
+    for (unsigned worker_no(0); worker_no < thread_count; ++worker_no)
+	worker_states.emplace_back(new MatchState(plan));
+
+    pipeline.setOutputCount(plan.getOutputCount());
+    pipeline.setRawFilter([&plan, &worker_states](const Slice &raw_record) {
+	return RawRecordMayMatch(plan, raw_record, worker_states[RecordPipeline::GetWorkerNo()].get());
+    });
+    pipeline.setTransform([&plan, &worker_states](const RecordView &record, std::string * const outputs,
+						  std::string * const err_msg) {
+	return ProcessRecord(plan, record, worker_states[RecordPipeline::GetWorkerNo()].get(), outputs, err_msg);
+    });
+    pipeline.setWriter([&plan](const unsigned output_no, const std::string &output,
+			       std::string * const /* err_msg */) {
+	const Stats::StageTimer output_timer(Stats::OUTPUT);
+	plan.getOutput(output_no).stream->write(output.data(), output.size());
+	return true;
+    });
+
+    std::string err_msg;
+    if (not pipeline.run(&err_msg))
+	Error(err_msg);
+
+    std::vector<unsigned> matched_counts(plan.size(), 0);
+    for (const auto &worker_state : worker_states) {
+	for (unsigned query_no(0); query_no < plan.size(); ++query_no)
+	    matched_counts[query_no] += worker_state->matched_counts[query_no];
+    }
+    ReportMatchCounts(plan, matched_counts, pipeline.getRecordCount());
 }
 
+
+/** Applies the queries of "plan" only to the records that "lookup", e.g. "650a=Geschichte" or "650a=Gesch*", finds
+    in the term index. */
+void IndexedFieldGrep(const MarcFileReader &reader, const QueryPlan &plan, const std::string &lookup) {
+    const std::string::size_type equal_pos(lookup.find('='));
+    if (equal_pos == std::string::npos or equal_pos < DirectoryEntry::TAG_LENGTH)
+	Error("bad lookup specification \"" + lookup + "\"!");
+    const std::string field_reference(lookup.substr(0, equal_pos));
+    std::string value(lookup.substr(equal_pos + 1));
+    const bool prefix_match(not value.empty() and value[value.length() - 1] == '*');
+    if (prefix_match)
+	value.resize(value.length() - 1);
+
+    std::string err_msg;
+    TermIndex * const raw_index(
+	TermIndex::TermIndexFactory(TermIndex::DefaultIndexFilename(reader.getFilename()), reader.getFilename(),
+				    &err_msg));
+    if (raw_index == NULL)
+	Error(err_msg);
+    const std::unique_ptr<TermIndex> index(raw_index);
+
+    std::vector<uint32_t> record_ordinals;
+    index->lookup(field_reference, value, prefix_match, &record_ordinals);
+
+    RecordView record;
+    MatchState state(plan);
+    std::vector<std::string> outputs(plan.getOutputCount());
+    std::vector<size_t> output_sizes;
+    for (const auto record_ordinal : record_ordinals) {
+	const TermIndex::RecordLocation &location(index->getRecordLocation(record_ordinal));
+	if (not reader.getRecordAt(location.record_offset_, &record, &err_msg)
+	    or (reader.getValidateUtf8() and not MarcReader::ValidateUtf8(record.getRawRecord(), &err_msg)))
+	{
+	    // The term index tells us where the next record starts, so there is no need to resynchronise.
+	    FlushOutputs(plan, &outputs);
+	    RejectRecord(reader.getRejectLog(), location.record_offset_, location.record_length_, err_msg);
+	    continue;
+	}
+
+	if (not RawRecordMayMatch(plan, record.getRawRecord(), &state))
+	    continue;
+
+	GetOutputSizes(outputs, &output_sizes);
+	if (ProcessRecord(plan, record, &state, &outputs[0], &err_msg))
+	    FlushOutputs(plan, &outputs, /* only_full = */ true);
+	else if (not err_msg.empty()) {
+	    TruncateOutputs(output_sizes, &outputs);
+	    FlushOutputs(plan, &outputs);
+	    RejectRecord(reader.getRejectLog(), location.record_offset_, location.record_length_, err_msg);
+	}
+    }
+    FlushOutputs(plan, &outputs);
+
+    ReportMatchCounts(plan, state.matched_counts, record_ordinals.size(), "looked up records");
+}
+
+
 // Creates a binary, a.k.a. "raw" representation of a MARC21 record.
 std::string ComposeRecord(const std::vector<DirectoryEntry> &dir_entries, const std::vector<std::string> &fields,
 			  Leader * const leader)
@@ -146,7 +848,7 @@ std::string ComposeRecord(const std::vector<DirectoryEntry> &dir_entries, const
     record.reserve(record_size);
     record += leader->toString();
     for (const auto &dir_entry : dir_entries)
-        record +=  dir_entry.toString();
+	record +=  dir_entry.toString();
     record += '\x1E';
     for (const auto &field : fields) {
 	record += field;
@@ -165,37 +867,36 @@ bool RecordSeemsCorrect(const std::string &record, std::string * const err_msg)
 	return false;
     }
 
-    Leader *raw_leader;
-    if (not Leader::ParseLeader(record.substr(0, Leader::LEADER_LENGTH), &raw_leader, err_msg))
+    Leader leader;
+    if (not Leader::ParseLeader(record.data(), &leader, err_msg))
 	return false;
-    const std::unique_ptr<Leader> leader(raw_leader);
 
-    if (leader->getRecordLength() != record.length()) {
-	*err_msg = "leader's record length (" + std::to_string(leader->getRecordLength())
-	           + ") does not equal actual record length (" + std::to_string(record.length()) + ")!";
+    if (leader.getRecordLength() != record.length()) {
+	*err_msg = "leader's record length (" + std::to_string(leader.getRecordLength())
+		   + ") does not equal actual record length (" + std::to_string(record.length()) + ")!";
 	return false;
     }
 
-    if (leader->getBaseAddressOfData() <= Leader::LEADER_LENGTH) {
+    if (leader.getBaseAddressOfData() <= Leader::LEADER_LENGTH) {
 	*err_msg = "impossible base address of data!";
 	return false;
     }
 
-    const size_t directory_length(leader->getBaseAddressOfData() - Leader::LEADER_LENGTH - 1);
+    const size_t directory_length(leader.getBaseAddressOfData() - Leader::LEADER_LENGTH - 1);
     if ((directory_length % DirectoryEntry::DIRECTORY_ENTRY_LENGTH) != 0) {
 	*err_msg = "directory length is not a multiple of "
-	           + std::to_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH) + "!";
+		   + std::to_string(DirectoryEntry::DIRECTORY_ENTRY_LENGTH) + "!";
 	return false;
     }
 
-    if (record[leader->getBaseAddressOfData() - 1] != '\x1E') {
+    if (record[leader.getBaseAddressOfData() - 1] != '\x1E') {
 	*err_msg = "directory is not terminated with a field terminator!";
 	return false;
     }
 
     if (record[record.size() - 1] != '\x1D') {
 	*err_msg = "record is not terminated with a record terminator!";
-        return false;
+	return false;
     }
     
     return true;
@@ -205,8 +906,118 @@ bool RecordSeemsCorrect(const std::string &record, std::string * const err_msg)
 int main(int argc, char **argv) {
     progname = argv[0];
 
-    if (argc != 3)
+    static const struct option LONG_OPTIONS[] = {
+	{ "stats",         no_argument,       NULL, 's' },
+	{ "reader",        required_argument, NULL, 'r' },
+	{ "reject-file",   required_argument, NULL, 'R' },
+	{ "validate-utf8", no_argument,       NULL, 'u' },
+	{ "queries",       required_argument, NULL, 'q' },
+	{ NULL,            0,                 NULL, 0   }
+    };
+
+    unsigned thread_count(1);
+    std::string lookup, reject_filename, queries_filename;
+    std::vector<std::string> output_filenames;
+    bool print_stats(false), validate_utf8(false);
+    MarcReader::Backend reader_backend(MarcReader::MMAP);
+    int option;
+    while ((option = ::getopt_long(argc, argv, "j:l:o:", LONG_OPTIONS, NULL)) != -1) {
+	if (option == 'j') {
+	    char *end;
+	    thread_count = std::strtoul(optarg, &end, 10);
+	    if (*end != '\0' or thread_count == 0)
+		Error("bad thread count \"" + std::string(optarg) + "\"!");
+	} else if (option == 'l')
+	    lookup = optarg;
+	else if (option == 'o')
+	    output_filenames.emplace_back(optarg);
+	else if (option == 'q')
+	    queries_filename = optarg;
+	else if (option == 's')
+	    print_stats = true;
+	else if (option == 'r') {
+	    if (not MarcReader::ParseBackend(optarg, &reader_backend))
+		Error("unknown reader \"" + std::string(optarg) + "\"!");
+	} else if (option == 'R')
+	    reject_filename = optarg;
+	else if (option == 'u')
+	    validate_utf8 = true;
+	else
+	    Usage();
+    }
+
+    const int field_reference_count(argc - optind - 1);
+    if (field_reference_count < 0 or (field_reference_count == 0 and queries_filename.empty())
+	or output_filenames.size() > static_cast<size_t>(field_reference_count)
+	or (thread_count != 1 and not lookup.empty()))
 	Usage();
 
-    FieldGrep(argv[1], argv[2]);
+    if (print_stats and not Stats::Enable())
+	Warning("\"--stats\" is not available because statistics support has been compiled out!");
+
+    const std::string input_filename(argv[optind]);
+    std::string err_msg;
+    MarcReader::Compression compression;
+    if (not MarcReader::DetectCompression(input_filename, &compression, &err_msg))
+	Error(err_msg);
+    bool is_marc_xml(false);
+    if (compression == MarcReader::NO_COMPRESSION
+	and not MarcReader::DetectMarcXml(input_filename, &is_marc_xml, &err_msg))
+	Error(err_msg);
+    bool is_regular_file;
+    if (not MarcReader::IsRegularFile(input_filename, &is_regular_file, &err_msg))
+	Error(err_msg);
+    const bool random_access(is_regular_file and compression == MarcReader::NO_COMPRESSION and not is_marc_xml
+			     and reader_backend == MarcReader::MMAP);
+    if (not random_access and not lookup.empty())
+	Error("\"-l\" requires a regular, uncompressed input file w/ binary records and the mmap reader!");
+
+    QueryPlan plan;
+    for (int field_reference_no(0); field_reference_no < field_reference_count; ++field_reference_no)
+	plan.addQuery(argv[optind + 1 + field_reference_no],
+		      static_cast<size_t>(field_reference_no) < output_filenames.size()
+		      ? output_filenames[field_reference_no] : "-");
+    if (not queries_filename.empty())
+	plan.addQueries(queries_filename);
+
+    std::unique_ptr<RejectLog> reject_log;
+    if (not reject_filename.empty()) {
+	reject_log.reset(RejectLog::RejectLogFactory(reject_filename, &err_msg));
+	if (reject_log.get() == NULL)
+	    Error(err_msg);
+    }
+
+    if ((thread_count == 1 or not random_access) and lookup.empty()) {
+	MarcReader * const raw_reader(MarcReader::MarcReaderFactory(input_filename, &err_msg, reader_backend));
+	if (raw_reader == NULL)
+	    Error(err_msg);
+	const std::unique_ptr<MarcReader> reader(raw_reader);
+	reader->setRejectLog(reject_log.get());
+	reader->setValidateUtf8(validate_utf8);
+	if (thread_count == 1)
+	    FieldGrep(reader.get(), plan);
+	else
+	    PipelinedFieldGrep(reader.get(), plan, thread_count);
+    } else {
+	// Both the term index and the partitioning of the input require random access to a memory mapped file of
+	// binary records.
+	MarcFileReader * const raw_reader(MarcFileReader::MarcFileReaderFactory(input_filename, &err_msg));
+	if (raw_reader == NULL)
+	    Error(err_msg);
+	const std::unique_ptr<MarcFileReader> reader(raw_reader);
+	reader->setRejectLog(reject_log.get());
+	reader->setValidateUtf8(validate_utf8);
+	if (not lookup.empty())
+	    IndexedFieldGrep(*reader, plan, lookup);
+	else
+	    ParallelFieldGrep(*reader, plan, thread_count);
+    }
+    plan.closeOutputs();
+
+    if (reject_log.get() != NULL and reject_log->getRejectCount() > 0)
+	std::cerr << "Skipped " << reject_log->getRejectCount() << " corrupt byte range(s) ("
+		  << reject_log->getRejectedByteCount() << " bytes), see \"" << reject_log->getFilename() << "\".\n";
+
+    if (Stats::IsEnabled())
+	Stats::PrintSummary(std::cerr);
 }
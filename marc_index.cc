@@ -0,0 +1,112 @@
+/** \file marc_index.cc
+ *  \brief marc_index is a command-line utility for building and using indices of MARC-21 files.
+ *
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include "ControlNumberIndex.h"
+#include "MarcFileReader.h"
+#include "MarcWriter.h"
+#include "RecordView.h"
+#include "StringUtil.h"
+#include "TermIndex.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << progname << " marc_filename\n";
+    std::cerr << "       " << progname << " --fetch marc_filename control_numbers_filename output_filename\n";
+    std::cerr << "       " << progname << " --terms field_references marc_filename\n";
+    std::cerr << "\tThe first form builds an index of the control numbers (field 001) of all records in\n";
+    std::cerr << "\t\"marc_filename\" and stores it in \"marc_filename.idx\".\n";
+    std::cerr << "\tThe second form uses that index to copy the records whose control numbers are listed, one per\n";
+    std::cerr << "\tline, in \"control_numbers_filename\" to \"output_filename\".\n";
+    std::cerr << "\tThe third form builds an inverted index of the values of the fields and subfields referenced by\n";
+    std::cerr << "\t\"field_references\", e.g. \"650a:100a:020a\", and stores it in \"marc_filename.terms\".  It is\n";
+    std::cerr << "\tused by \"marc_grep -l\".\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+void FetchRecords(const std::string &marc_filename, const std::string &control_numbers_filename,
+		  const std::string &output_filename)
+{
+    std::string err_msg;
+    MarcFileReader * const raw_reader(MarcFileReader::MarcFileReaderFactory(marc_filename, &err_msg));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcFileReader> reader(raw_reader);
+    if (not reader->openControlNumberIndex(ControlNumberIndex::DefaultIndexFilename(marc_filename), &err_msg))
+	Error(err_msg);
+
+    std::ifstream control_numbers(control_numbers_filename);
+    if (not control_numbers)
+	Error("can't open \"" + control_numbers_filename + "\" for reading!");
+
+    MarcWriter * const raw_writer(MarcWriter::MarcWriterFactory(output_filename, &err_msg));
+    if (raw_writer == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcWriter> writer(raw_writer);
+
+    unsigned requested_count(0), found_count(0);
+    std::string control_number;
+    RecordView record;
+    while (std::getline(control_numbers, control_number)) {
+	StringUtil::RightTrim(&control_number, " \t\r");
+	if (control_number.empty())
+	    continue;
+
+	++requested_count;
+	if (not reader->getRecordByControlNumber(control_number, &record, &err_msg)) {
+	    if (not err_msg.empty())
+		Error(err_msg);
+	    Warning("control number \"" + control_number + "\" not found!");
+	    continue;
+	}
+
+	if (not writer->writeRaw(record.getRawRecord(), &err_msg))
+	    Error(err_msg);
+	++found_count;
+    }
+
+    if (not writer->close(&err_msg))
+	Error(err_msg);
+    std::cerr << "Found " << found_count << " of " << requested_count << " requested records.\n";
+}
+
+
+int main(int argc, char **argv) {
+    progname = argv[0];
+
+    if (argc == 2) {
+	std::string err_msg;
+	if (not ControlNumberIndex::Build(argv[1], ControlNumberIndex::DefaultIndexFilename(argv[1]), &err_msg))
+	    Error(err_msg);
+    } else if (argc == 5 and std::strcmp(argv[1], "--fetch") == 0)
+	FetchRecords(argv[2], argv[3], argv[4]);
+    else if (argc == 4 and std::strcmp(argv[1], "--terms") == 0) {
+	std::string err_msg;
+	if (not TermIndex::Build(argv[3], argv[2], TermIndex::DefaultIndexFilename(argv[3]), &err_msg))
+	    Error(err_msg);
+    } else
+	Usage();
+}
@@ -0,0 +1,202 @@
+/** \file marc_to_json.cc
+ *  \brief marc_to_json converts MARC-21 records to JSON lines, e.g. in order to feed them to a search engine.
+ *
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include "MarcJson.h"
+#include "MarcReader.h"
+#include "RecordPipeline.h"
+#include "RecordView.h"
+#include "RejectLog.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << progname
+	      << " [--format=marc-in-json|flat] [--reader=mmap|stdio|async] [--reject-file=reject_filename]\n"
+	      << "\t[--validate-utf8] [-j thread_count] input_filename [output_filename]\n";
+    std::cerr << "\tWrites one JSON object per record and line to \"output_filename\" or to stdout.\n";
+    std::cerr << "\t\"--format\" selects either the complete MARC-in-JSON representation (the default) or a flat\n";
+    std::cerr << "\tprojection that maps the tags of control fields and the tags of data fields followed by a\n";
+    std::cerr << "\tsubfield code, e.g. \"245a\", to arrays of their values.  MARC-8 records are converted to UTF-8.\n";
+    std::cerr << "\t\"-j\" converts w/ \"thread_count\" threads.  The output order is the input order.\n";
+    std::cerr << "\t\"--reader\", \"--reject-file\" and \"--validate-utf8\" work like they do for marc_grep.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+// The JSON gets collected and written in blocks of about this size.
+const size_t OUTPUT_BUFFER_SIZE(1024 * 1024);
+
+
+bool WriteJson(FILE * const output, const std::string &output_filename, const std::string &json,
+	       std::string * const err_msg)
+{
+    if (std::fwrite(json.data(), 1, json.size(), output) != json.size()) {
+	*err_msg = "write to \"" + output_filename + "\" failed! (" + std::strerror(errno) + ")";
+	return false;
+    }
+
+    return true;
+}
+
+
+/** \return The number of converted records. */
+size_t ConvertToJson(MarcReader * const reader, const MarcJson::Format format, FILE * const output,
+		     const std::string &output_filename, size_t * const replacement_count)
+{
+    RecordView record;
+    std::string json, err_msg;
+    json.reserve(OUTPUT_BUFFER_SIZE + OUTPUT_BUFFER_SIZE / 4);
+    size_t count(0);
+    while (reader->getNextRecord(&record, &err_msg)) {
+	++count;
+	MarcJson::AppendRecord(record, format, &json, replacement_count);
+	if (json.size() >= OUTPUT_BUFFER_SIZE) {
+	    if (not WriteJson(output, output_filename, json, &err_msg))
+		Error(err_msg);
+	    json.clear();
+	}
+    }
+    if (not err_msg.empty())
+	Error(err_msg);
+
+    if (not WriteJson(output, output_filename, json, &err_msg))
+	Error(err_msg);
+    return count;
+}
+
+
+/** \brief Converts the records of "reader" w/ "thread_count" worker threads and writes the JSON in input order.
+ *  \return The number of converted records.
+ */
+size_t PipelinedConvertToJson(MarcReader * const reader, const MarcJson::Format format, const unsigned thread_count,
+			      FILE * const output, const std::string &output_filename, size_t * const replacement_count)
+{
+    std::atomic<size_t> total_replacement_count(0);
+    RecordPipeline pipeline(reader, thread_count);
+    pipeline.setTransform([format, &total_replacement_count](const RecordView &record, std::string * const json,
+							     std::string * const /* err_msg */)
+    {
+	size_t record_replacement_count(0);
+	MarcJson::AppendRecord(record, format, json, &record_replacement_count);
+	if (record_replacement_count > 0)
+	    total_replacement_count += record_replacement_count;
+	return true;
+    });
+    pipeline.setWriter([output, &output_filename](const unsigned /* output_no */, const std::string &json,
+						  std::string * const err_msg)
+		       { return WriteJson(output, output_filename, json, err_msg); });
+
+    std::string err_msg;
+    if (not pipeline.run(&err_msg))
+	Error(err_msg);
+    *replacement_count += total_replacement_count;
+    return pipeline.getMatchedCount();
+}
+
+
+int main(int argc, char **argv) {
+    progname = argv[0];
+
+    static const struct option LONG_OPTIONS[] = {
+	{ "format",        required_argument, NULL, 'f' },
+	{ "reader",        required_argument, NULL, 'r' },
+	{ "reject-file",   required_argument, NULL, 'R' },
+	{ "validate-utf8", no_argument,       NULL, 'u' },
+	{ NULL,            0,                 NULL, 0   }
+    };
+
+    unsigned thread_count(1);
+    std::string reject_filename;
+    bool validate_utf8(false);
+    MarcJson::Format format(MarcJson::MARC_IN_JSON);
+    MarcReader::Backend reader_backend(MarcReader::MMAP);
+    int option;
+    while ((option = ::getopt_long(argc, argv, "j:", LONG_OPTIONS, NULL)) != -1) {
+	if (option == 'j') {
+	    char *end;
+	    thread_count = std::strtoul(optarg, &end, 10);
+	    if (*end != '\0' or thread_count == 0)
+		Error("bad thread count \"" + std::string(optarg) + "\"!");
+	} else if (option == 'f') {
+	    if (not MarcJson::ParseFormat(optarg, &format))
+		Error("unknown format \"" + std::string(optarg) + "\"!");
+	} else if (option == 'r') {
+	    if (not MarcReader::ParseBackend(optarg, &reader_backend))
+		Error("unknown reader \"" + std::string(optarg) + "\"!");
+	} else if (option == 'R')
+	    reject_filename = optarg;
+	else if (option == 'u')
+	    validate_utf8 = true;
+	else
+	    Usage();
+    }
+
+    if (argc - optind != 1 and argc - optind != 2)
+	Usage();
+
+    const std::string input_filename(argv[optind]);
+    const std::string output_filename(argc - optind == 2 ? argv[optind + 1] : "-");
+
+    std::string err_msg;
+    std::unique_ptr<RejectLog> reject_log;
+    if (not reject_filename.empty()) {
+	reject_log.reset(RejectLog::RejectLogFactory(reject_filename, &err_msg));
+	if (reject_log.get() == NULL)
+	    Error(err_msg);
+    }
+
+    MarcReader * const raw_reader(MarcReader::MarcReaderFactory(input_filename, &err_msg, reader_backend));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcReader> reader(raw_reader);
+    reader->setRejectLog(reject_log.get());
+    reader->setValidateUtf8(validate_utf8);
+
+    FILE * const output(output_filename == "-" ? stdout : std::fopen(output_filename.c_str(), "w"));
+    if (output == NULL)
+	Error("can't open \"" + output_filename + "\" for writing! (" + std::strerror(errno) + ")");
+    // We only ever hand over large blocks, so stdio's own buffering would merely add a copy.
+    std::setvbuf(output, NULL, _IONBF, 0);
+
+    size_t count, replacement_count(0);
+    if (thread_count == 1)
+	count = ConvertToJson(reader.get(), format, output, output_filename, &replacement_count);
+    else
+	count = PipelinedConvertToJson(reader.get(), format, thread_count, output, output_filename,
+				       &replacement_count);
+    if (std::fclose(output) != 0)
+	Error("failed to close \"" + output_filename + "\"! (" + std::strerror(errno) + ")");
+
+    std::cerr << "Converted " << count << " records.\n";
+    if (reject_log.get() != NULL and reject_log->getRejectCount() > 0)
+	std::cerr << "Skipped " << reject_log->getRejectCount() << " corrupt byte range(s) ("
+		  << reject_log->getRejectedByteCount() << " bytes), see \"" << reject_log->getFilename() << "\".\n";
+    if (replacement_count > 0)
+	Warning(std::to_string(replacement_count) + " MARC-8 character(s) could not be converted and were replaced "
+		"w/ U+FFFD!");
+}
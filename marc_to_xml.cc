@@ -0,0 +1,120 @@
+/** \file marc_to_xml.cc
+ *  \brief marc_to_xml converts MARC-21 records to MARCXML, e.g. for partners that can't process binary records.
+ *
+ *  \author Dr. Johannes Ruscheinski (johannes.ruscheinski@uni-tuebingen.de)
+ *
+ *  \copyright 2014 Universitätsbiblothek Tübingen.  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <getopt.h>
+#include "MarcReader.h"
+#include "MarcXmlWriter.h"
+#include "RecordView.h"
+#include "RejectLog.h"
+#include "util.h"
+
+
+void Usage() {
+    std::cerr << "Usage: " << progname << " [--reader=mmap|stdio|async] [--reject-file=reject_filename]\n"
+	      << "\t[--validate-utf8] input_filename output_filename\n";
+    std::cerr << "\tWrites the records of \"input_filename\" as a MARCXML collection to \"output_filename\".\n";
+    std::cerr << "\tMARC-8 records are converted to UTF-8.  The input may be MARCXML itself.\n";
+    std::cerr << "\t\"--reader\", \"--reject-file\" and \"--validate-utf8\" work like they do for marc_grep.\n";
+    std::exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char **argv) {
+    progname = argv[0];
+
+    static const struct option LONG_OPTIONS[] = {
+	{ "reader",        required_argument, NULL, 'r' },
+	{ "reject-file",   required_argument, NULL, 'R' },
+	{ "validate-utf8", no_argument,       NULL, 'u' },
+	{ NULL,            0,                 NULL, 0   }
+    };
+
+    std::string reject_filename;
+    bool validate_utf8(false);
+    MarcReader::Backend reader_backend(MarcReader::MMAP);
+    int option;
+    while ((option = ::getopt_long(argc, argv, "", LONG_OPTIONS, NULL)) != -1) {
+	if (option == 'r') {
+	    if (not MarcReader::ParseBackend(optarg, &reader_backend))
+		Error("unknown reader \"" + std::string(optarg) + "\"!");
+	} else if (option == 'R')
+	    reject_filename = optarg;
+	else if (option == 'u')
+	    validate_utf8 = true;
+	else
+	    Usage();
+    }
+
+    if (argc - optind != 2)
+	Usage();
+
+    std::string err_msg;
+    std::unique_ptr<RejectLog> reject_log;
+    if (not reject_filename.empty()) {
+	reject_log.reset(RejectLog::RejectLogFactory(reject_filename, &err_msg));
+	if (reject_log.get() == NULL)
+	    Error(err_msg);
+    }
+
+    MarcReader * const raw_reader(MarcReader::MarcReaderFactory(argv[optind], &err_msg, reader_backend));
+    if (raw_reader == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcReader> reader(raw_reader);
+    reader->setRejectLog(reject_log.get());
+    reader->setValidateUtf8(validate_utf8);
+
+    MarcXmlWriter * const raw_writer(MarcXmlWriter::MarcXmlWriterFactory(argv[optind + 1], &err_msg));
+    if (raw_writer == NULL)
+	Error(err_msg);
+    const std::unique_ptr<MarcXmlWriter> writer(raw_writer);
+
+    RecordView record;
+    size_t count(0), replacement_count(0);
+    while (reader->getNextRecord(&record, &err_msg)) {
+	const MarcXmlWriter::WriteStatus status(writer->write(record, &err_msg, &replacement_count));
+	if (status == MarcXmlWriter::FAILED)
+	    Error(err_msg);
+	if (status == MarcXmlWriter::REJECTED) {
+	    size_t input_size;
+	    const size_t record_offset(reader->locateRecord(record.getRawRecord(), &input_size));
+	    if (reject_log.get() == NULL)
+		Error(err_msg + " (Record starting at file offset " + std::to_string(record_offset) + ".)");
+	    reject_log->log(record_offset, input_size, err_msg);
+	    continue;
+	}
+	++count;
+    }
+    if (not err_msg.empty())
+	Error(err_msg);
+
+    if (not writer->close(&err_msg))
+	Error(err_msg);
+
+    std::cerr << "Converted " << count << " records.\n";
+    if (reject_log.get() != NULL and reject_log->getRejectCount() > 0)
+	std::cerr << "Skipped " << reject_log->getRejectCount() << " corrupt byte range(s) ("
+		  << reject_log->getRejectedByteCount() << " bytes), see \"" << reject_log->getFilename() << "\".\n";
+    if (replacement_count > 0)
+	Warning(std::to_string(replacement_count) + " MARC-8 character(s) could not be converted and were replaced "
+		"w/ U+FFFD!");
+}
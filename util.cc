@@ -1,5 +1,7 @@
 #include "util.h"
 #include <iostream>
+#include <cerrno>
+#include <cstring>
 
 
 char *progname; // Must be set in main() with "progname = argv[0];";
@@ -14,3 +16,13 @@ void Error(const std::string &msg) {
 void Warning(const std::string &msg) {
   std::cerr << progname << ": " << msg << '\n';
 }
+
+
+bool GetFileStatus(const std::string &path, struct stat * const stat_buf, std::string * const err_msg) {
+  if (::stat(path.c_str(), stat_buf) == -1) {
+    *err_msg = "can't stat \"" + path + "\"! (" + std::strerror(errno) + ")";
+    return false;
+  }
+
+  return true;
+}
@@ -22,6 +22,7 @@
 
 
 #include <string>
+#include <sys/stat.h>
 
 
 /** Must be set to point to argv[0] in main(). */
@@ -36,4 +37,10 @@ void Error(const std::string &msg) __attribute__((noreturn));
 void Warning(const std::string &msg);
 
 
+/** \brief Wrapper around stat(2).
+ *  \return True on success, else false and then "err_msg" will be set.
+ */
+bool GetFileStatus(const std::string &path, struct stat * const stat_buf, std::string * const err_msg);
+
+
 #endif // ifndef UTIL_H